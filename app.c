@@ -193,7 +193,7 @@ void display(const char* volumename, WINDOW* dirView, WINDOW* volView)
 	}
 	wrefresh(volView);
 
-	mvwprintw(dirView, 1, 1, "Working Directory: %s | blocksize: %i | nblocks: %i",
+	mvwprintw(dirView, 1, 1, "Working Directory: %s | blocksize: %zu | nblocks: %i",
 		*working_directory == '\0' ? "root" : working_directory, header.blocksize, header.nblocks);
 
 	char** entrynames = NULL;
@@ -354,7 +354,7 @@ bool input(const char* volumename, WINDOW* inputWin)
 		{
 			char* time = ctime(&modtime);
 			deleteln();
-			mvprintw(0, 0, "%s | %i bytes | %s", head, length, time);
+			mvprintw(0, 0, "%s | %zu bytes | %s", head, length, time);
 		}
 	}
 	else if (strcmp(head, "vol") == 0)
@@ -459,7 +459,7 @@ void mdisplay(const char* volumename, WINDOW* dirView, WINDOW* volView)
 		char* pnewline = strchr(time, '\n'); // Remove newline
 		*pnewline = '\0';
 		mvwprintw(dirView, 2, 3, "    Modified = %li (%s)", fblock.modtime, time);
-		mvwprintw(dirView, 3, 3, "      length = %i", fblock.length);
+		mvwprintw(dirView, 3, 3, "      length = %zu", fblock.length);
 		mvwprintw(dirView, 4, 3, "         md5 = \"%s\"", MD5_str((char*)fblock.md5));
 		mvwprintw(dirView, 5, 3, "firstblockID = %i", fblock.firstblockID);
 		mvwprintw(dirView, 6, 3, "      nfiles = %i", fblock.nfiles);
@@ -0,0 +1,270 @@
+#define _POSIX_C_SOURCE 199309L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <time.h>
+
+#include "sifs.h"
+
+//  TIMES EACH SIFS OPERATION ON VOLUMES OF INCREASING SIZE, AT VARYING DIRECTORY DEPTH,
+//  FAN-OUT AND FILE SIZE. RESULTS ARE WRITTEN TO STANDARD OUTPUT AS JSON
+
+#define BENCH_VOLUME	"benchvol"
+#define BENCH_BLOCKSIZE	1024
+
+static const uint32_t volume_sizes[]	= { 1000, 10000, 100000, 1000000, 10000000 };
+static const int depths[]		= { 1, 8 };
+static const int fanouts[]		= { 4, 24 };
+static const size_t filesizes[]		= { 256, 16384 };
+
+#define NELEMS(a)	(sizeof(a) / sizeof(a[0]))
+
+// Accumulated timings of one operation within one configuration
+typedef struct {
+	const char*	op;
+	uint32_t	count;
+	uint32_t	failures;
+	double		total_us;
+	double		min_us;
+	double		max_us;
+} TIMING;
+
+typedef struct {
+	uint32_t	nblocks;
+	int		depth;
+	int		fanout;
+	size_t		filesize;
+} CONFIG;
+
+static bool first_result = true;
+
+static double now_us(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static void timing_init(TIMING* t, const char* op)
+{
+	memset(t, 0, sizeof(TIMING));
+	t->op = op;
+}
+
+static void timing_add(TIMING* t, double start, int result)
+{
+	double elapsed = now_us() - start;
+	if (result != 0)
+	{
+		t->failures++;
+		return;
+	}
+	if (t->count == 0 || elapsed < t->min_us)
+		t->min_us = elapsed;
+	if (elapsed > t->max_us)
+		t->max_us = elapsed;
+	t->total_us += elapsed;
+	t->count++;
+}
+
+static void print_result(const CONFIG* c, const TIMING* t)
+{
+	printf("%s\n    {\"op\": \"%s\", \"nblocks\": %u, \"blocksize\": %i, \"depth\": %i, \"fanout\": %i, "
+		"\"filesize\": %zu, \"count\": %u, \"failures\": %u, \"mean_us\": %.3f, \"min_us\": %.3f, \"max_us\": %.3f}",
+		first_result ? "" : ",", t->op, c->nblocks, BENCH_BLOCKSIZE, c->depth, c->fanout, c->filesize,
+		t->count, t->failures, t->count ? t->total_us / t->count : 0.0, t->min_us, t->max_us);
+	first_result = false;
+}
+
+// Fills data with contents that are unique to seed
+static void fill_data(char* data, size_t nbytes, int seed)
+{
+	srand(seed);
+	for (size_t i = 0; i < nbytes; i++)
+	{
+		data[i] = rand() % 256;
+	}
+}
+
+static void bench_config(const CONFIG* c)
+{
+	enum { MKDIR, WRITE_UNIQUE, WRITE_DUPLICATE, READFILE, DIRINFO, FILEINFO, RMFILE, RMDIR, DEFRAG, NOPS };
+	TIMING t[NOPS];
+	timing_init(&t[MKDIR], "mkdir");
+	timing_init(&t[WRITE_UNIQUE], "writefile_unique");
+	timing_init(&t[WRITE_DUPLICATE], "writefile_duplicate");
+	timing_init(&t[READFILE], "readfile");
+	timing_init(&t[DIRINFO], "dirinfo");
+	timing_init(&t[FILEINFO], "fileinfo");
+	timing_init(&t[RMFILE], "rmfile");
+	timing_init(&t[RMDIR], "rmdir");
+	timing_init(&t[DEFRAG], "defrag");
+
+	// Build the chain of directories that every operation runs beneath
+	char target[256] = "";
+	for (int d = 0; d < c->depth; d++)
+	{
+		sprintf(target + strlen(target), "%sL%i", d == 0 ? "" : "/", d);
+		SIFS_mkdir(BENCH_VOLUME, target);
+	}
+
+	char path[BUFSIZ];
+	const char* subdirs[] = { "D", "U", "C" };
+	for (int i = 0; i < 3; i++)
+	{
+		sprintf(path, "%s/%s", target, subdirs[i]);
+		SIFS_mkdir(BENCH_VOLUME, path);
+	}
+
+	char* data = malloc(c->filesize);
+	int nduplicates = c->fanout < 23 ? c->fanout : 23; // The original takes one of 24 file names
+	double start;
+
+	for (int i = 0; i < c->fanout; i++)
+	{
+		sprintf(path, "%s/D/d%02i", target, i);
+		start = now_us();
+		timing_add(&t[MKDIR], start, SIFS_mkdir(BENCH_VOLUME, path));
+	}
+	for (int i = 0; i < c->fanout; i++)
+	{
+		fill_data(data, c->filesize, i + 1);
+		sprintf(path, "%s/U/u%02i", target, i);
+		start = now_us();
+		timing_add(&t[WRITE_UNIQUE], start, SIFS_writefile(BENCH_VOLUME, path, data, c->filesize));
+	}
+	fill_data(data, c->filesize, 1);
+	for (int i = 0; i < nduplicates; i++)
+	{
+		sprintf(path, "%s/C/c%02i", target, i);
+		start = now_us();
+		timing_add(&t[WRITE_DUPLICATE], start, SIFS_writefile(BENCH_VOLUME, path, data, c->filesize));
+	}
+	for (int i = 0; i < c->fanout; i++)
+	{
+		void* contents;
+		size_t nbytes;
+		sprintf(path, "%s/U/u%02i", target, i);
+		start = now_us();
+		int result = SIFS_readfile(BENCH_VOLUME, path, &contents, &nbytes);
+		timing_add(&t[READFILE], start, result);
+		if (result == 0)
+			free(contents);
+	}
+	for (int i = 0; i < c->fanout; i++)
+	{
+		char** entrynames;
+		uint32_t nentries;
+		time_t modtime;
+		sprintf(path, "%s/U", target);
+		start = now_us();
+		int result = SIFS_dirinfo(BENCH_VOLUME, path, &entrynames, &nentries, &modtime);
+		timing_add(&t[DIRINFO], start, result);
+		if (result == 0)
+		{
+			for (uint32_t e = 0; e < nentries; e++)
+			{
+				free(entrynames[e]);
+			}
+			free(entrynames);
+		}
+	}
+	for (int i = 0; i < c->fanout; i++)
+	{
+		size_t length;
+		time_t modtime;
+		sprintf(path, "%s/U/u%02i", target, i);
+		start = now_us();
+		timing_add(&t[FILEINFO], start, SIFS_fileinfo(BENCH_VOLUME, path, &length, &modtime));
+	}
+	for (int i = 0; i < nduplicates; i++)
+	{
+		sprintf(path, "%s/C/c%02i", target, i);
+		start = now_us();
+		timing_add(&t[RMFILE], start, SIFS_rmfile(BENCH_VOLUME, path));
+	}
+	for (int i = 0; i < c->fanout; i++)
+	{
+		sprintf(path, "%s/U/u%02i", target, i);
+		start = now_us();
+		timing_add(&t[RMFILE], start, SIFS_rmfile(BENCH_VOLUME, path));
+	}
+	for (int i = 0; i < c->fanout; i++)
+	{
+		sprintf(path, "%s/D/d%02i", target, i);
+		start = now_us();
+		timing_add(&t[RMDIR], start, SIFS_rmdir(BENCH_VOLUME, path));
+	}
+
+	// Return the volume to its empty state, leaving holes for defrag to close
+	for (int i = 0; i < 3; i++)
+	{
+		sprintf(path, "%s/%s", target, subdirs[i]);
+		SIFS_rmdir(BENCH_VOLUME, path);
+	}
+	for (int d = c->depth - 1; d >= 0; d--)
+	{
+		SIFS_rmdir(BENCH_VOLUME, target);
+		char* pLastSlash = strrchr(target, '/');
+		if (pLastSlash)
+			*pLastSlash = '\0';
+	}
+	start = now_us();
+	timing_add(&t[DEFRAG], start, SIFS_defrag(BENCH_VOLUME));
+
+	for (int op = 0; op < NOPS; op++)
+	{
+		print_result(c, &t[op]);
+	}
+	free(data);
+}
+
+int main(int argc, char* argv[])
+{
+	uint32_t maxnblocks = volume_sizes[NELEMS(volume_sizes) - 1];
+	if (argc == 2)
+	{
+		maxnblocks = strtoul(argv[1], NULL, 10);
+	}
+	else if (argc > 2)
+	{
+		fprintf(stderr, "USAGE: %s [max nblocks]\n", argv[0]);
+		exit(EXIT_FAILURE);
+	}
+
+	printf("{\"benchmark\": \"sifs\", \"results\": [");
+	for (int v = 0; v < NELEMS(volume_sizes) && volume_sizes[v] <= maxnblocks; v++)
+	{
+		uint32_t nblocks = volume_sizes[v];
+		fprintf(stderr, "Benchmarking %u blocks\n", nblocks);
+
+		remove(BENCH_VOLUME);
+		TIMING mkvolume;
+		timing_init(&mkvolume, "mkvolume");
+		double start = now_us();
+		timing_add(&mkvolume, start, SIFS_mkvolume(BENCH_VOLUME, BENCH_BLOCKSIZE, nblocks));
+
+		CONFIG config = { .nblocks = nblocks };
+		print_result(&config, &mkvolume);
+
+		for (int d = 0; d < NELEMS(depths); d++)
+		{
+			for (int f = 0; f < NELEMS(fanouts); f++)
+			{
+				for (int s = 0; s < NELEMS(filesizes); s++)
+				{
+					config.depth = depths[d];
+					config.fanout = fanouts[f];
+					config.filesize = filesizes[s];
+					bench_config(&config);
+				}
+			}
+		}
+	}
+	printf("\n]}\n");
+
+	remove(BENCH_VOLUME);
+	return 0;
+}
@@ -0,0 +1,145 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+#include "sifs.h"
+
+//  MEASURES HOW EACH ALLOCATION STRATEGY FRAGMENTS A VOLUME AS IT AGES. EACH ROUND REMOVES A
+//  QUARTER OF THE FILES AT RANDOM AND WRITES NEW ONES, MOSTLY SMALL WITH SOME LARGE, THEN RECORDS
+//  THE LONGEST RUN OF UNUSED BLOCKS AND HOW MANY WRITES SUCCEEDED. A WRITE THAT FAILS WHILE THE
+//  VOLUME HAS ENOUGH UNUSED BLOCKS FOR IT FAILED BECAUSE OF FRAGMENTATION.
+//  RESULTS ARE WRITTEN TO STANDARD OUTPUT AS JSON
+
+#define BENCH_VOLUME	"benchvol"
+#define BENCH_BLOCKSIZE	1024
+#define BENCH_NBLOCKS	4096
+#define BENCH_NDIRS	48
+#define BENCH_NENTRIES	24	// most entries a directory can hold
+#define BENCH_NROUNDS	40
+#define BENCH_NWRITES	80	// attempted each round
+
+static const int allocators[]		= { SIFS_ALLOC_FIRST_FIT, SIFS_ALLOC_BEST_FIT, SIFS_ALLOC_NEXT_FIT,
+					    SIFS_ALLOC_SIZE_CLASS };
+static const char* allocatornames[]	= { "first_fit", "best_fit", "next_fit", "size_class" };
+
+#define NELEMS(a)	(sizeof(a) / sizeof(a[0]))
+#define NSLOTS		(BENCH_NDIRS * BENCH_NENTRIES)
+
+static bool first_result = true;
+
+// The data blocks of each file slot, 0 if the slot is empty
+static int slots[NSLOTS];
+
+// Data blocks of the next file: one in five is large
+static int random_size(void)
+{
+	return rand() % 5 == 0 ? 16 + rand() % 49 : 1 + rand() % 4;
+}
+
+static void slot_path(int slot, char* path)
+{
+	sprintf(path, "d%02i/f%02i", slot / BENCH_NENTRIES, slot % BENCH_NENTRIES);
+}
+
+// Returns the longest run of unused blocks
+static uint64_t largest_free(void)
+{
+	SIFS_FSCK_REPORT report;
+	return SIFS_fsck(BENCH_VOLUME, 1, 0, &report) == 0 ? report.largestfree : 0;
+}
+
+static void bench_allocator(int a)
+{
+	char path[64];
+	char* data = malloc(64 * BENCH_BLOCKSIZE);
+
+	remove(BENCH_VOLUME);
+	SIFS_set_allocator(allocators[a]);
+	SIFS_mkvolume(BENCH_VOLUME, BENCH_BLOCKSIZE, BENCH_NBLOCKS);
+	for (int d = 0; d < BENCH_NDIRS; d++)
+	{
+		sprintf(path, "d%02i", d);
+		SIFS_mkdir(BENCH_VOLUME, path);
+	}
+	memset(slots, 0, sizeof(slots));
+
+	// Every strategy sees the same sizes and removals. The root directory and every other directory take a block
+	srand(1);
+	uint32_t unused = BENCH_NBLOCKS - 1 - BENCH_NDIRS;
+	uint32_t serial = 0, attempts = 0, successes = 0, largeattempts = 0, largesuccesses = 0;
+	for (int round = 0; round < BENCH_NROUNDS; round++)
+	{
+		for (int s = 0; s < NSLOTS; s++)
+		{
+			if (slots[s] > 0 && rand() % 4 == 0)
+			{
+				slot_path(s, path);
+				SIFS_rmfile(BENCH_VOLUME, path);
+				unused += slots[s] + 1;
+				slots[s] = 0;
+			}
+		}
+
+		uint32_t roundsuccesses = 0, fragfailures = 0;
+		for (int w = 0, s = 0; w < BENCH_NWRITES; w++)
+		{
+			int nblocks = random_size();
+			while (s < NSLOTS && slots[s] > 0)
+				s++;
+			if (s == NSLOTS)
+				break;
+
+			// Contents are unique so that no write is deduplicated
+			memset(data, serial % 256, nblocks * BENCH_BLOCKSIZE);
+			memcpy(data, &serial, sizeof(serial));
+			serial++;
+
+			slot_path(s, path);
+			bool success = SIFS_writefile(BENCH_VOLUME, path, data, nblocks * BENCH_BLOCKSIZE) == 0;
+			if (success)
+			{
+				slots[s] = nblocks;
+				unused -= nblocks + 1;
+				roundsuccesses++;
+			}
+			else if (SIFS_errno == SIFS_ENOSPC && unused >= nblocks + 1)
+				fragfailures++;
+
+			attempts++;
+			successes += success;
+			largeattempts += nblocks >= 16;
+			largesuccesses += success && nblocks >= 16;
+		}
+
+		printf("%s\n    {\"allocator\": \"%s\", \"round\": %i, \"used_pct\": %.1f, \"largest_free\": %llu, "
+			"\"writes\": %i, \"succeeded\": %u, \"fragmentation_failures\": %u, \"success_rate\": %.3f, "
+			"\"large_success_rate\": %.3f}",
+			first_result ? "" : ",", allocatornames[a], round, 100.0 * (BENCH_NBLOCKS - unused) / BENCH_NBLOCKS,
+			(unsigned long long)largest_free(), BENCH_NWRITES, roundsuccesses, fragfailures,
+			(double)successes / attempts, largeattempts ? (double)largesuccesses / largeattempts : 1.0);
+		first_result = false;
+	}
+	free(data);
+}
+
+int main(int argc, char* argv[])
+{
+	if (argc != 1)
+	{
+		fprintf(stderr, "USAGE: %s\n", argv[0]);
+		exit(EXIT_FAILURE);
+	}
+
+	printf("{\"benchmark\": \"allocation\", \"blocksize\": %i, \"nblocks\": %i, \"results\": [",
+		BENCH_BLOCKSIZE, BENCH_NBLOCKS);
+	for (int a = 0; a < NELEMS(allocators); a++)
+	{
+		fprintf(stderr, "Benchmarking %s allocation\n", allocatornames[a]);
+		bench_allocator(a);
+	}
+	printf("\n]}\n");
+
+	remove(BENCH_VOLUME);
+	return 0;
+}
@@ -0,0 +1,226 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+#include "sifs.h"
+
+//  MEASURES HOW FAR THE VOLUME IS SEEKED ACROSS PER TREE WALK UNDER EACH BLOCK PLACEMENT POLICY.
+//  A TREE OF DIRECTORIES IS FILLED A FILE AT A TIME IN TURN, AGED BY REMOVING AND WRITING FILES,
+//  THEN WALKED BY LISTING EACH DIRECTORY AND READING ITS FILES, AND BY SIFS_walk().
+//  RESULTS ARE WRITTEN TO STANDARD OUTPUT AS JSON
+
+#define BENCH_VOLUME	"benchvol"
+#define BENCH_BLOCKSIZE	1024
+#define BENCH_NBLOCKS	16384
+#define BENCH_MAXENTRIES	24	// most entries a directory can hold
+
+static const int policies[]		= { SIFS_PLACE_FIRST, SIFS_PLACE_NEAR };
+static const char* policynames[]	= { "first", "near" };
+static const int ndirs[]		= { 4, 16 };
+static const int nfiles[]		= { 8, 23 };
+
+#define NELEMS(a)	(sizeof(a) / sizeof(a[0]))
+
+static bool first_result = true;
+
+// Fills data with contents that are unique to seed
+static void fill_data(char* data, size_t nbytes, int seed)
+{
+	srand(seed);
+	for (size_t i = 0; i < nbytes; i++)
+	{
+		data[i] = rand() % 256;
+	}
+}
+
+// Size of the nth file written, from a few hundred bytes to several blocks
+static size_t file_size(int n)
+{
+	return 200 + (n * 2749) % (6 * BENCH_BLOCKSIZE);
+}
+
+// Writes file f of every directory in turn, so that no directory is written on its own
+static void write_round(int ndir, int f, char* data)
+{
+	char path[64];
+	for (int d = 0; d < ndir; d++)
+	{
+		int n = f * ndir + d;
+		fill_data(data, file_size(n), n + 1);
+		sprintf(path, "d%02i/f%02i", d, f);
+		SIFS_writefile(BENCH_VOLUME, path, data, file_size(n));
+	}
+}
+
+// Builds the tree, then ages it by removing every third file and writing new ones in their place
+static void build_tree(int ndir, int nfile)
+{
+	char path[64];
+	char* data = malloc(6 * BENCH_BLOCKSIZE + 200);
+
+	remove(BENCH_VOLUME);
+	SIFS_mkvolume(BENCH_VOLUME, BENCH_BLOCKSIZE, BENCH_NBLOCKS);
+	for (int d = 0; d < ndir; d++)
+	{
+		sprintf(path, "d%02i", d);
+		SIFS_mkdir(BENCH_VOLUME, path);
+	}
+	for (int f = 0; f < nfile; f++)
+	{
+		write_round(ndir, f, data);
+	}
+	for (int f = 0; f < nfile; f += 3)
+	{
+		for (int d = 0; d < ndir; d++)
+		{
+			sprintf(path, "d%02i/f%02i", d, f);
+			SIFS_rmfile(BENCH_VOLUME, path);
+		}
+	}
+	for (int f = 0; f < nfile; f += 3)
+	{
+		write_round(ndir, f, data);
+	}
+	free(data);
+}
+
+// Lists every directory and reads each of its files
+static void list_and_read(int ndir)
+{
+	char path[64];
+	for (int d = 0; d < ndir; d++)
+	{
+		char** entrynames;
+		uint32_t nentries;
+		time_t modtime;
+		sprintf(path, "d%02i", d);
+		if (SIFS_dirinfo(BENCH_VOLUME, path, &entrynames, &nentries, &modtime) != 0)
+			continue;
+
+		for (uint32_t e = 0; e < nentries; e++)
+		{
+			void* contents;
+			size_t nbytes;
+			sprintf(path, "d%02i/%s", d, entrynames[e]);
+			if (SIFS_readfile(BENCH_VOLUME, path, &contents, &nbytes) == 0)
+				free(contents);
+			free(entrynames[e]);
+		}
+		free(entrynames);
+	}
+}
+
+// Lists every directory and reads all of its files in one call
+static void list_and_readfiles(int ndir)
+{
+	char path[64];
+	for (int d = 0; d < ndir; d++)
+	{
+		char** entrynames;
+		uint32_t nentries;
+		time_t modtime;
+		sprintf(path, "d%02i", d);
+		if (SIFS_dirinfo(BENCH_VOLUME, path, &entrynames, &nentries, &modtime) != 0)
+			continue;
+
+		const char* paths[BENCH_MAXENTRIES];
+		SIFS_READRESULT results[BENCH_MAXENTRIES];
+		for (uint32_t e = 0; e < nentries; e++)
+		{
+			char* entrypath = malloc(strlen(path) + strlen(entrynames[e]) + 2);
+			sprintf(entrypath, "%s/%s", path, entrynames[e]);
+			paths[e] = entrypath;
+			free(entrynames[e]);
+		}
+		free(entrynames);
+
+		if (SIFS_readfiles(BENCH_VOLUME, paths, nentries, results) == 0)
+		{
+			for (uint32_t e = 0; e < nentries; e++)
+			{
+				free(results[e].data);
+			}
+		}
+		for (uint32_t e = 0; e < nentries; e++)
+		{
+			free((char*)paths[e]);
+		}
+	}
+}
+
+static int visit(const char* path, const SIFS_DIRENTRY* entry, int when, void* arg)
+{
+	return SIFS_WALK_CONTINUE;
+}
+
+static void print_result(const char* policy, const char* walk, int ndir, int nfile, const SIFS_STATS* s)
+{
+	printf("%s\n    {\"policy\": \"%s\", \"walk\": \"%s\", \"ndirs\": %i, \"nfiles\": %i, \"seeks\": %llu, "
+		"\"seekbytes\": %llu, \"mean_seekbytes\": %.1f}",
+		first_result ? "" : ",", policy, walk, ndir, nfile, (unsigned long long)s->nseeks,
+		(unsigned long long)s->seekbytes, s->nseeks ? (double)s->seekbytes / s->nseeks : 0.0);
+	first_result = false;
+}
+
+// Adds the seek counters of operation op to total
+static void add_seeks(SIFS_STATS* total, int op)
+{
+	SIFS_STATS stats;
+	SIFS_get_stats(op, &stats);
+	total->nseeks += stats.nseeks;
+	total->seekbytes += stats.seekbytes;
+}
+
+int main(int argc, char* argv[])
+{
+	if (argc != 1)
+	{
+		fprintf(stderr, "USAGE: %s\n", argv[0]);
+		exit(EXIT_FAILURE);
+	}
+
+	// Every access must reach the volume for its seeks to be counted
+	SIFS_set_cache_size(0);
+
+	printf("{\"benchmark\": \"placement\", \"blocksize\": %i, \"nblocks\": %i, \"results\": [",
+		BENCH_BLOCKSIZE, BENCH_NBLOCKS);
+	for (int p = 0; p < NELEMS(policies); p++)
+	{
+		SIFS_set_placement(policies[p]);
+		for (int d = 0; d < NELEMS(ndirs); d++)
+		{
+			for (int f = 0; f < NELEMS(nfiles); f++)
+			{
+				fprintf(stderr, "Benchmarking %s placement, %i directories of %i files\n", policynames[p],
+					ndirs[d], nfiles[f]);
+				build_tree(ndirs[d], nfiles[f]);
+
+				SIFS_STATS total;
+				memset(&total, 0, sizeof(SIFS_STATS));
+				SIFS_reset_stats();
+				list_and_read(ndirs[d]);
+				add_seeks(&total, SIFS_OP_DIRINFO);
+				add_seeks(&total, SIFS_OP_READFILE);
+				print_result(policynames[p], "dirinfo_readfile", ndirs[d], nfiles[f], &total);
+
+				memset(&total, 0, sizeof(SIFS_STATS));
+				SIFS_reset_stats();
+				list_and_readfiles(ndirs[d]);
+				add_seeks(&total, SIFS_OP_DIRINFO);
+				add_seeks(&total, SIFS_OP_READFILES);
+				print_result(policynames[p], "dirinfo_readfiles", ndirs[d], nfiles[f], &total);
+
+				memset(&total, 0, sizeof(SIFS_STATS));
+				SIFS_reset_stats();
+				SIFS_walk(BENCH_VOLUME, "", visit, NULL, SIFS_WALK_PRE);
+				add_seeks(&total, SIFS_OP_WALK);
+				print_result(policynames[p], "walk", ndirs[d], nfiles[f], &total);
+			}
+		}
+	}
+	printf("\n]}\n");
+
+	remove(BENCH_VOLUME);
+	return 0;
+}
@@ -0,0 +1,187 @@
+#include "sifsutils.h"
+
+// Blocks that SIFS_PLACE_NEAR keeps after a new directory for its entries
+#define PLACE_CLUSTER	64
+
+// Policy used until SIFS_set_placement() is called
+static int placement = SIFS_PLACE_FIRST;
+
+// Strategy used until SIFS_set_allocator() is called
+static int strategy = SIFS_ALLOC_FIRST_FIT;
+
+// Where SIFS_ALLOC_NEXT_FIT carries on searching from, just after the last run it chose
+static SIFS_BLOCKID rover = 0;
+
+// Returns the first of n unused blocks in a row at or after from, or header.nblocks if there are none
+static SIFS_BLOCKID find_run(SIFS_VOLUME_HEADER header, const SIFS_BIT* bitmap, SIFS_BLOCKID from, uint32_t n)
+{
+	uint32_t currentlength = 0;
+	for (SIFS_BLOCKID id = find_unused(header, bitmap, from); id < header.nblocks; id++)
+	{
+		if (bitmap[id] == SIFS_UNUSED)
+			currentlength++;
+		else
+			currentlength = 0;
+
+		if (currentlength == n)
+			return id - n + 1;
+	}
+	return header.nblocks;
+}
+
+// Returns the size class of a run of n blocks. Runs of 1, 2-3, 4-7, 8-15 blocks and so on share a class
+static uint32_t size_class(uint32_t n)
+{
+	uint32_t c = 0;
+	while (n >>= 1)
+		c++;
+	return c;
+}
+
+// Returns the first of n unused blocks in a row from the smallest run that holds them, or from the first run of
+// the smallest size class that does when byclass is set. Returns header.nblocks if there are none
+static SIFS_BLOCKID find_run_fitted(SIFS_VOLUME_HEADER header, const SIFS_BIT* bitmap, uint32_t n, bool byclass)
+{
+	uint32_t want = byclass ? size_class(n) : n;
+	SIFS_BLOCKID best = header.nblocks;
+	uint32_t bestfit = 0;
+	for (SIFS_BLOCKID id = find_unused(header, bitmap, 0); id < header.nblocks; id = find_unused(header, bitmap, id))
+	{
+		SIFS_BLOCKID start = id;
+		while (id < header.nblocks && bitmap[id] == SIFS_UNUSED)
+			id++;
+		if (id - start < n)
+			continue;
+
+		uint32_t fit = byclass ? size_class(id - start) : id - start;
+		if (best == header.nblocks || fit < bestfit)
+		{
+			best = start;
+			bestfit = fit;
+		}
+		// Nothing later can fit better
+		if (fit == want)
+			break;
+	}
+	return best;
+}
+
+// Returns the first of n unused blocks in a row chosen by the allocation strategy, or header.nblocks if there are none
+SIFS_BLOCKID allocate_run(SIFS_VOLUME_HEADER header, const SIFS_BIT* bitmap, uint32_t n)
+{
+	if (strategy == SIFS_ALLOC_BEST_FIT || strategy == SIFS_ALLOC_SIZE_CLASS)
+		return find_run_fitted(header, bitmap, n, strategy == SIFS_ALLOC_SIZE_CLASS);
+	if (strategy == SIFS_ALLOC_FIRST_FIT)
+		return find_run(header, bitmap, 0, n);
+
+	// Next fit wraps around to the start of the volume once the rest of it has no room
+	SIFS_BLOCKID id = find_run(header, bitmap, rover < header.nblocks ? rover : 0, n);
+	if (id == header.nblocks)
+		id = find_run(header, bitmap, 0, n);
+	if (id < header.nblocks)
+		rover = id + n;
+	return id;
+}
+
+// Returns the first of the n unused blocks in a row that end closest before to, or header.nblocks if there are none
+static SIFS_BLOCKID find_run_before(SIFS_VOLUME_HEADER header, const SIFS_BIT* bitmap, SIFS_BLOCKID to, uint32_t n)
+{
+	uint32_t currentlength = 0;
+	for (SIFS_BLOCKID id = to; id-- > 0; /*blank*/)
+	{
+		if (bitmap[id] == SIFS_UNUSED)
+			currentlength++;
+		else
+			currentlength = 0;
+
+		if (currentlength == n)
+			return id;
+	}
+	return header.nblocks;
+}
+
+// Returns the first of n unused blocks in a row closest to near, looking after it first
+static SIFS_BLOCKID find_run_near(SIFS_VOLUME_HEADER header, const SIFS_BIT* bitmap, SIFS_BLOCKID near, uint32_t n)
+{
+	SIFS_BLOCKID id = find_run(header, bitmap, near, n);
+	return id < header.nblocks ? id : find_run_before(header, bitmap, near, n);
+}
+
+// Returns the block for a new directory added to directory parent, or header.nblocks if the volume is full
+SIFS_BLOCKID place_dirblock(SIFS_VOLUME_HEADER header, const SIFS_BIT* bitmap, SIFS_BLOCKID parent)
+{
+	if (placement == SIFS_PLACE_FIRST)
+		return allocate_run(header, bitmap, 1);
+
+	// A directory starts the first run of PLACE_CLUSTER unused blocks that keeps clear of the PLACE_CLUSTER blocks
+	// after every other directory, which its own entries gather in
+	SIFS_BLOCKID lastdir = SIFS_ROOTDIR_BLOCKID;
+	for (SIFS_BLOCKID id = 0; id < header.nblocks; /*blank*/)
+	{
+		if (bitmap[id] != SIFS_UNUSED)
+		{
+			if (bitmap[id] == SIFS_DIR)
+				lastdir = id;
+			id++;
+			continue;
+		}
+
+		SIFS_BLOCKID start = id;
+		while (id < header.nblocks && bitmap[id] == SIFS_UNUSED)
+			id++;
+		SIFS_BLOCKID candidate = start > lastdir + PLACE_CLUSTER ? start : lastdir + PLACE_CLUSTER + 1;
+		if ((uint64_t)candidate + PLACE_CLUSTER <= id)
+			return candidate;
+	}
+
+	// Volumes too small or too full for that keep the directory close to its parent
+	return find_run_near(header, bitmap, parent, 1);
+}
+
+// Returns the block for a new file block added to directory parent, followed where possible by ndata unused
+// blocks for its data. Returns header.nblocks if the volume is full
+SIFS_BLOCKID place_fileblock(SIFS_VOLUME_HEADER header, const SIFS_BIT* bitmap, SIFS_BLOCKID parent, uint32_t ndata)
+{
+	if (placement == SIFS_PLACE_FIRST)
+		return allocate_run(header, bitmap, 1);
+
+	// The files of a directory gather just after it, each with its data behind it. Where there is no room
+	// for the data as well, the block still stays close to its directory
+	SIFS_BLOCKID id = find_run_near(header, bitmap, parent, 1 + ndata);
+	return id < header.nblocks || ndata == 0 ? id : find_run_near(header, bitmap, parent, 1);
+}
+
+// Returns the first of nblocks unused blocks in a row for the data of file block fileID,
+// or header.nblocks if there are none
+SIFS_BLOCKID place_data(SIFS_VOLUME_HEADER header, const SIFS_BIT* bitmap, SIFS_BLOCKID fileID, uint32_t nblocks)
+{
+	if (placement == SIFS_PLACE_FIRST)
+		return allocate_run(header, bitmap, nblocks);
+	return find_run_near(header, bitmap, fileID + 1, nblocks);
+}
+
+// choose where new directory, file and data blocks are placed
+int SIFS_set_placement(int policy)
+{
+	if (policy != SIFS_PLACE_FIRST && policy != SIFS_PLACE_NEAR)
+	{
+		SIFS_errno = SIFS_EINVAL;
+		return 1;
+	}
+	placement = policy;
+	return 0;
+}
+
+// choose how free runs of blocks are chosen for new blocks
+int SIFS_set_allocator(int allocator)
+{
+	if (allocator != SIFS_ALLOC_FIRST_FIT && allocator != SIFS_ALLOC_BEST_FIT &&
+		allocator != SIFS_ALLOC_NEXT_FIT && allocator != SIFS_ALLOC_SIZE_CLASS)
+	{
+		SIFS_errno = SIFS_EINVAL;
+		return 1;
+	}
+	strategy = allocator;
+	rover = 0;
+	return 0;
+}
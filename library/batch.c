@@ -0,0 +1,334 @@
+#define _DEFAULT_SOURCE
+
+#include <stdlib.h>
+#include <errno.h>
+#include <unistd.h>
+#include "sifsutils.h"
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define HAVE_URING
+#endif
+#endif
+
+#ifdef HAVE_URING
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#endif
+
+// Size of each request a run is split into
+#define BATCH_SEGMENT	(64 * 1024)
+
+// Most requests in flight at once
+#define URING_ENTRIES	64
+
+// Backend used until SIFS_set_io_backend() is called, chosen on first use
+static int backend = -1;
+
+#ifdef HAVE_URING
+// The submission and completion rings shared with the kernel
+static struct {
+	int			fd;
+	unsigned		entries;
+	unsigned*		sqtail;
+	unsigned*		sqmask;
+	unsigned*		sqarray;
+	unsigned*		cqhead;
+	unsigned*		cqtail;
+	unsigned*		cqmask;
+	struct io_uring_sqe*	sqes;
+	struct io_uring_cqe*	cqes;
+} ring = { .fd = -1 };
+
+// Sets up the ring. Returns false if the kernel does not support io_uring
+static bool uring_setup(void)
+{
+	if (ring.fd >= 0)
+		return true;
+
+	struct io_uring_params p;
+	memset(&p, 0, sizeof(p));
+	int fd = syscall(__NR_io_uring_setup, URING_ENTRIES, &p);
+	if (fd < 0)
+		return false;
+
+	size_t sqsize = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+	size_t cqsize = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+	bool single = p.features & IORING_FEAT_SINGLE_MMAP;
+	if (single)
+		sqsize = cqsize = sqsize > cqsize ? sqsize : cqsize;
+
+	char* sq = mmap(NULL, sqsize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, IORING_OFF_SQ_RING);
+	char* cq = single || sq == MAP_FAILED ? sq :
+		mmap(NULL, cqsize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, IORING_OFF_CQ_RING);
+	void* sqes = sq == MAP_FAILED || cq == MAP_FAILED ? MAP_FAILED :
+		mmap(NULL, p.sq_entries * sizeof(struct io_uring_sqe), PROT_READ | PROT_WRITE, MAP_SHARED, fd,
+			IORING_OFF_SQES);
+	if (sqes == MAP_FAILED)
+	{
+		// Closing the ring leaves its mappings in place, so those that succeeded are undone first
+		if (cq != MAP_FAILED && cq != sq)
+			munmap(cq, cqsize);
+		if (sq != MAP_FAILED)
+			munmap(sq, sqsize);
+		close(fd);
+		return false;
+	}
+
+	ring.fd = fd;
+	ring.entries = p.sq_entries;
+	ring.sqtail = (unsigned*)(sq + p.sq_off.tail);
+	ring.sqmask = (unsigned*)(sq + p.sq_off.ring_mask);
+	ring.sqarray = (unsigned*)(sq + p.sq_off.array);
+	ring.cqhead = (unsigned*)(cq + p.cq_off.head);
+	ring.cqtail = (unsigned*)(cq + p.cq_off.tail);
+	ring.cqmask = (unsigned*)(cq + p.cq_off.ring_mask);
+	ring.sqes = sqes;
+	ring.cqes = (struct io_uring_cqe*)(cq + p.cq_off.cqes);
+	return true;
+}
+
+// Submits up to ring.entries requests on fd and waits for them all. Requests that fail or come up short are
+// left for the caller to finish. Returns false if nothing could be submitted
+static bool uring_run(int fd, IO_REQUEST* reqs, size_t nreqs, bool write)
+{
+	unsigned tail = *ring.sqtail;
+	for (size_t i = 0; i < nreqs; i++)
+	{
+		unsigned index = tail & *ring.sqmask;
+		struct io_uring_sqe* sqe = &ring.sqes[index];
+		memset(sqe, 0, sizeof(struct io_uring_sqe));
+		sqe->opcode = write ? IORING_OP_WRITE : IORING_OP_READ;
+		sqe->fd = fd;
+		sqe->off = reqs[i].offset;
+		sqe->addr = (uintptr_t)reqs[i].buf;
+		sqe->len = reqs[i].nbytes;
+		sqe->user_data = i;
+		ring.sqarray[index] = index;
+		tail++;
+	}
+	__atomic_store_n(ring.sqtail, tail, __ATOMIC_RELEASE);
+
+	size_t nsubmitted = 0, ncompleted = 0;
+	while (ncompleted < nreqs)
+	{
+		// The kernel only waits when everything asked for was submitted
+		int r = syscall(__NR_io_uring_enter, ring.fd, (unsigned)(nreqs - nsubmitted), (unsigned)(nreqs - ncompleted),
+			IORING_ENTER_GETEVENTS, NULL, 0);
+		if (r < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY)
+		{
+			// Nothing in flight can be left behind, but unsubmitted requests can still be taken back
+			if (nsubmitted == ncompleted)
+			{
+				*ring.sqtail -= nreqs - nsubmitted;
+				return nsubmitted > 0;
+			}
+		}
+		else if (r > 0)
+			nsubmitted += r;
+
+		unsigned head = *ring.cqhead;
+		unsigned cqtail = __atomic_load_n(ring.cqtail, __ATOMIC_ACQUIRE);
+		for (/*blank*/; head != cqtail; head++)
+		{
+			struct io_uring_cqe* cqe = &ring.cqes[head & *ring.cqmask];
+			reqs[cqe->user_data].ndone = cqe->res > 0 ? cqe->res : 0;
+			ncompleted++;
+		}
+		__atomic_store_n(ring.cqhead, head, __ATOMIC_RELEASE);
+	}
+	return true;
+}
+#endif
+
+// Finishes req with pread() or pwrite(), from where it got to
+static void sync_run(int fd, IO_REQUEST* req, bool write)
+{
+	while (req->ndone < req->nbytes)
+	{
+		char* buf = (char*)req->buf + req->ndone;
+		ssize_t n = write ? pwrite(fd, buf, req->nbytes - req->ndone, req->offset + req->ndone) :
+			pread(fd, buf, req->nbytes - req->ndone, req->offset + req->ndone);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			break;
+		req->ndone += n;
+	}
+}
+
+// Issues every request on fd with the current backend. Returns the number of bytes transferred
+static size_t run(int fd, IO_REQUEST* reqs, size_t nreqs, bool write)
+{
+	if (backend < 0)
+	{
+#ifdef HAVE_URING
+		backend = uring_setup() ? SIFS_IO_URING : SIFS_IO_SYNC;
+#else
+		backend = SIFS_IO_SYNC;
+#endif
+	}
+
+	for (size_t i = 0; i < nreqs; i++)
+	{
+		reqs[i].ndone = 0;
+	}
+
+#ifdef HAVE_URING
+	if (backend == SIFS_IO_URING)
+	{
+		for (size_t i = 0; i < nreqs; i += ring.entries)
+		{
+			size_t n = nreqs - i < ring.entries ? nreqs - i : ring.entries;
+			if (!uring_run(fd, reqs + i, n, write))
+				break;
+		}
+	}
+#endif
+
+	// Whatever the ring did not finish is done here, one request at a time
+	size_t total = 0;
+	for (size_t i = 0; i < nreqs; i++)
+	{
+		sync_run(fd, &reqs[i], write);
+		total += reqs[i].ndone;
+	}
+	return total;
+}
+
+static bool all_done(const IO_REQUEST* reqs, size_t nreqs)
+{
+	for (size_t i = 0; i < nreqs; i++)
+	{
+		if (reqs[i].ndone != reqs[i].nbytes)
+			return false;
+	}
+	return true;
+}
+
+// Reads every one of the nreqs requests of reqs from vol as one batch. Returns true if each was read in full
+bool read_batch(FILE* vol, IO_REQUEST* reqs, size_t nreqs)
+{
+	// Blocks waiting in the cache or in the stdio buffer must reach the volume first
+	cache_flush();
+	fflush(vol);
+
+	size_t nread = run(fileno(vol), reqs, nreqs, false);
+
+	for (size_t i = 0; i < nreqs; i++)
+	{
+		stat_seek(reqs[i].offset, reqs[i].ndone);
+	}
+	STAT_ADD(nreads, nreqs);
+	STAT_ADD(bytesread, nread);
+	return all_done(reqs, nreqs);
+}
+
+// Writes every one of the nreqs requests of reqs to vol as one batch. Returns true if each was written in full
+bool write_batch(FILE* vol, IO_REQUEST* reqs, size_t nreqs)
+{
+	for (size_t i = 0; i < nreqs; i++)
+	{
+		cache_forget(vol, reqs[i].offset, reqs[i].nbytes);
+	}
+	fflush(vol);
+
+	phase_begin(SIFS_PHASE_FLUSH);
+	size_t nwritten = run(fileno(vol), reqs, nreqs, true);
+	phase_end(SIFS_PHASE_FLUSH);
+
+	// Flushing again drops anything stdio had read ahead of the new contents
+	fflush(vol);
+
+	for (size_t i = 0; i < nreqs; i++)
+	{
+		stat_seek(reqs[i].offset, reqs[i].ndone);
+	}
+	STAT_ADD(nwrites, nreqs);
+	STAT_ADD(byteswritten, nwritten);
+	return all_done(reqs, nreqs);
+}
+
+// Splits nbytes at offset into requests of BATCH_SEGMENT bytes. Returns NULL if there is no memory for them
+static IO_REQUEST* split_run(long offset, const void* buf, size_t nbytes, size_t* nreqs)
+{
+	*nreqs = (nbytes + BATCH_SEGMENT - 1) / BATCH_SEGMENT;
+	IO_REQUEST* reqs = malloc(sizeof(IO_REQUEST) * (*nreqs > 0 ? *nreqs : 1));
+	if (!reqs)
+		return NULL;
+
+	for (size_t i = 0; i < *nreqs; i++)
+	{
+		size_t start = i * BATCH_SEGMENT;
+		reqs[i].offset = offset + start;
+		reqs[i].buf = (char*)buf + start;
+		reqs[i].nbytes = nbytes - start < BATCH_SEGMENT ? nbytes - start : BATCH_SEGMENT;
+	}
+	return reqs;
+}
+
+// Reads nbytes at offset of vol into buf, split into a batch of reads. Returns the number of bytes read
+size_t read_run(FILE* vol, long offset, void* buf, size_t nbytes)
+{
+	size_t nreqs;
+	IO_REQUEST* reqs = split_run(offset, buf, nbytes, &nreqs);
+	if (!reqs)
+		return read_at(vol, offset, buf, nbytes);
+
+	read_batch(vol, reqs, nreqs);
+
+	// A short read stops the run where the volume ended
+	size_t nread = 0;
+	for (size_t i = 0; i < nreqs && (i == 0 || reqs[i - 1].ndone == reqs[i - 1].nbytes); i++)
+	{
+		nread += reqs[i].ndone;
+	}
+	free(reqs);
+	return nread;
+}
+
+// Writes nbytes of buf at offset of vol, split into a batch of writes. Returns the number of bytes written
+size_t write_run(FILE* vol, long offset, const void* buf, size_t nbytes)
+{
+	size_t nreqs;
+	IO_REQUEST* reqs = split_run(offset, buf, nbytes, &nreqs);
+	if (!reqs)
+		return write_at(vol, offset, buf, nbytes);
+
+	write_batch(vol, reqs, nreqs);
+
+	size_t nwritten = 0;
+	for (size_t i = 0; i < nreqs && (i == 0 || reqs[i - 1].ndone == reqs[i - 1].nbytes); i++)
+	{
+		nwritten += reqs[i].ndone;
+	}
+	free(reqs);
+	return nwritten;
+}
+
+// choose how batches of block reads and writes are issued
+int SIFS_set_io_backend(int iobackend)
+{
+	if (iobackend == SIFS_IO_SYNC)
+	{
+		backend = SIFS_IO_SYNC;
+		return 0;
+	}
+	if (iobackend != SIFS_IO_URING)
+	{
+		SIFS_errno = SIFS_EINVAL;
+		return 1;
+	}
+
+#ifdef HAVE_URING
+	if (uring_setup())
+	{
+		backend = SIFS_IO_URING;
+		return 0;
+	}
+#endif
+	SIFS_errno = SIFS_EIO;
+	return 1;
+}
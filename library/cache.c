@@ -0,0 +1,476 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <sys/stat.h>
+#include "sifsutils.h"
+
+// Size of the cache in megabytes when the environment variable SIFS_CACHE_MB is not set
+#define CACHE_DEFAULT_MB	0
+
+// A cached directory or file block
+typedef struct CACHE_ENTRY {
+	dev_t			dev;		// device and inode of the volume the block belongs to
+	ino_t			ino;
+	SIFS_BLOCKID		id;
+	size_t			nvalid;		// leading bytes of block that are valid
+	FILE*			dirty;		// handle to write the block back through, NULL if clean
+	size_t			ndirty;		// leading bytes of block to write back
+	long			offset;		// where the block is written back to
+	struct CACHE_ENTRY*	newer;		// least recently used list
+	struct CACHE_ENTRY*	older;
+	struct CACHE_ENTRY*	next;		// hash chain
+	union {
+		SIFS_DIRBLOCK	dir;
+		SIFS_FILEBLOCK	file;
+	} block;
+} CACHE_ENTRY;
+
+// An open handle whose blocks are being cached
+typedef struct {
+	FILE*		vol;
+	dev_t		dev;
+	ino_t		ino;
+	long		base;		// offset of block 0
+	size_t		blocksize;
+	bool		failed;		// a dirty block of vol could not be written back
+} CACHE_HANDLE;
+
+// What a volume looked like when this process last closed it
+typedef struct {
+	dev_t		dev;
+	ino_t		ino;
+	off_t		size;
+	struct timespec	mtime;
+	struct timespec	ctime;
+} CACHE_VOLUME;
+
+static bool		configured = false;
+static size_t		capacity = 0;		// most blocks cached at once, 0 when the cache is off
+static size_t		nentries = 0;
+static size_t		ndirty = 0;
+static CACHE_ENTRY**	buckets = NULL;
+static size_t		nbuckets = 0;
+static CACHE_ENTRY*	newest = NULL;
+static CACHE_ENTRY*	oldest = NULL;
+static CACHE_HANDLE*	handles = NULL;
+static size_t		nhandles = 0;
+static CACHE_VOLUME*	volumes = NULL;
+static size_t		nvolumes = 0;
+
+static size_t bucket_of(dev_t dev, ino_t ino, SIFS_BLOCKID id)
+{
+	uint64_t h = ((uint64_t)dev * 31 + (uint64_t)ino) * 0x9E3779B97F4A7C15ULL ^ id;
+	h *= 0xBF58476D1CE4E5B9ULL;
+	return (h >> 32) & (nbuckets - 1);
+}
+
+static CACHE_HANDLE* find_handle(FILE* vol)
+{
+	for (size_t i = 0; i < nhandles; i++)
+	{
+		if (handles[i].vol == vol)
+			return &handles[i];
+	}
+	return NULL;
+}
+
+static CACHE_ENTRY* lookup(dev_t dev, ino_t ino, SIFS_BLOCKID id)
+{
+	for (CACHE_ENTRY* e = buckets[bucket_of(dev, ino, id)]; e; e = e->next)
+	{
+		if (e->id == id && e->ino == ino && e->dev == dev)
+			return e;
+	}
+	return NULL;
+}
+
+// Removes e from the least recently used list
+static void unlist(CACHE_ENTRY* e)
+{
+	if (e->newer)
+		e->newer->older = e->older;
+	else
+		newest = e->older;
+	if (e->older)
+		e->older->newer = e->newer;
+	else
+		oldest = e->newer;
+}
+
+// Makes e the most recently used block
+static void touch(CACHE_ENTRY* e)
+{
+	if (newest == e)
+		return;
+	unlist(e);
+	e->newer = NULL;
+	e->older = newest;
+	if (newest)
+		newest->newer = e;
+	newest = e;
+	if (!oldest)
+		oldest = e;
+}
+
+// Writes e back through the handle it was changed through. Returns false, and marks the handle so that
+// close_volume() fails, if the block could not be written
+static bool write_back(CACHE_ENTRY* e)
+{
+	bool written = write_uncached(e->dirty, e->offset, &e->block, e->ndirty) == e->ndirty;
+	CACHE_HANDLE* h = find_handle(e->dirty);
+	if (!written && h)
+		h->failed = true;
+
+	e->dirty = NULL;
+	e->ndirty = 0;
+	ndirty--;
+	return written;
+}
+
+// Drops e from the cache, writing it back first if it is dirty
+static void drop(CACHE_ENTRY* e)
+{
+	if (e->dirty)
+		write_back(e);
+
+	CACHE_ENTRY** link = &buckets[bucket_of(e->dev, e->ino, e->id)];
+	while (*link != e)
+	{
+		link = &(*link)->next;
+	}
+	*link = e->next;
+
+	unlist(e);
+	nentries--;
+	free(e);
+}
+
+static void drop_volume(dev_t dev, ino_t ino)
+{
+	for (CACHE_ENTRY* e = newest; e; /*blank*/)
+	{
+		CACHE_ENTRY* older = e->older;
+		if (e->dev == dev && e->ino == ino)
+			drop(e);
+		e = older;
+	}
+}
+
+// Adds an empty entry for block id of the volume h refers to, evicting the least recently used blocks to make room.
+// Returns NULL if there is no memory for it
+static CACHE_ENTRY* insert(const CACHE_HANDLE* h, SIFS_BLOCKID id)
+{
+	while (nentries >= capacity && oldest)
+	{
+		drop(oldest);
+	}
+
+	CACHE_ENTRY* e = malloc(sizeof(CACHE_ENTRY));
+	if (!e)
+		return NULL;
+
+	e->dev = h->dev;
+	e->ino = h->ino;
+	e->id = id;
+	e->nvalid = 0;
+	e->dirty = NULL;
+	e->ndirty = 0;
+	e->offset = 0;
+
+	size_t b = bucket_of(e->dev, e->ino, id);
+	e->next = buckets[b];
+	buckets[b] = e;
+
+	e->newer = NULL;
+	e->older = newest;
+	if (newest)
+		newest->newer = e;
+	newest = e;
+	if (!oldest)
+		oldest = e;
+
+	nentries++;
+	return e;
+}
+
+// Empties the cache and makes room for megabytes of blocks. Returns false if there is no memory for it
+static bool resize(size_t megabytes)
+{
+	while (oldest)
+	{
+		drop(oldest);
+	}
+	free(buckets);
+	buckets = NULL;
+	nbuckets = 0;
+
+	capacity = megabytes * 1024 * 1024 / sizeof(CACHE_ENTRY);
+	if (capacity == 0)
+		return true;
+
+	nbuckets = 1;
+	while (nbuckets < capacity)
+	{
+		nbuckets *= 2;
+	}
+	buckets = calloc(nbuckets, sizeof(CACHE_ENTRY*));
+	if (!buckets)
+	{
+		capacity = 0;
+		nbuckets = 0;
+		return false;
+	}
+	return true;
+}
+
+// The cache is sized from SIFS_CACHE_MB the first time a volume is opened, unless it has been sized already
+static void configure(void)
+{
+	if (configured)
+		return;
+	configured = true;
+
+	const char* megabytes = getenv("SIFS_CACHE_MB");
+	resize(megabytes ? strtoul(megabytes, NULL, 10) : CACHE_DEFAULT_MB);
+}
+
+static bool unchanged(const CACHE_VOLUME* v, const struct stat* st)
+{
+	return v->size == st->st_size && v->mtime.tv_sec == st->st_mtim.tv_sec &&
+		v->mtime.tv_nsec == st->st_mtim.tv_nsec && v->ctime.tv_sec == st->st_ctim.tv_sec &&
+		v->ctime.tv_nsec == st->st_ctim.tv_nsec;
+}
+
+static CACHE_VOLUME* find_volume(dev_t dev, ino_t ino)
+{
+	for (size_t i = 0; i < nvolumes; i++)
+	{
+		if (volumes[i].dev == dev && volumes[i].ino == ino)
+			return &volumes[i];
+	}
+	return NULL;
+}
+
+// Records what a volume looks like as it is closed. A volume that cannot be recorded has its blocks dropped
+static void remember(const struct stat* st)
+{
+	CACHE_VOLUME* v = find_volume(st->st_dev, st->st_ino);
+	if (!v)
+	{
+		CACHE_VOLUME* grown = realloc(volumes, sizeof(CACHE_VOLUME) * (nvolumes + 1));
+		if (!grown)
+		{
+			drop_volume(st->st_dev, st->st_ino);
+			return;
+		}
+		volumes = grown;
+		v = &volumes[nvolumes++];
+		v->dev = st->st_dev;
+		v->ino = st->st_ino;
+	}
+
+	v->size = st->st_size;
+	v->mtime = st->st_mtim;
+	v->ctime = st->st_ctim;
+}
+
+// Starts caching the blocks of vol, which has just been opened and locked. Blocks cached by earlier calls are
+// dropped if the volume has changed since this process last closed it
+void cache_attach(FILE* vol, SIFS_VOLUME_HEADER header)
+{
+	configure();
+	if (capacity == 0)
+		return;
+
+	struct stat st;
+	if (fstat(fileno(vol), &st) != 0)
+		return;
+
+	// Another process, or the same file made again, leaves a different size or change time behind
+	CACHE_VOLUME* v = find_volume(st.st_dev, st.st_ino);
+	if (!v || !unchanged(v, &st))
+		drop_volume(st.st_dev, st.st_ino);
+
+	CACHE_HANDLE* grown = realloc(handles, sizeof(CACHE_HANDLE) * (nhandles + 1));
+	if (!grown)
+		return;
+	handles = grown;
+	handles[nhandles++] = (CACHE_HANDLE){ .vol = vol, .dev = st.st_dev, .ino = st.st_ino,
+		.base = block_offset(header, 0), .blocksize = header.blocksize, .failed = false };
+}
+
+// Writes back the dirty blocks of vol, remembers what the volume looks like and closes it.
+// Returns the result of fclose(), or EOF if a dirty block could not be written back
+int close_volume(FILE* vol)
+{
+	bool failed = false;
+	CACHE_HANDLE* h = find_handle(vol);
+	if (h)
+	{
+		for (CACHE_ENTRY* e = newest; e && ndirty > 0; e = e->older)
+		{
+			if (e->dirty == vol && !write_back(e))
+				failed = true;
+		}
+
+		// The volume is still locked, so nobody else can have changed it since these blocks were read.
+		// Blocks that did not all reach it are not trusted next time
+		struct stat st;
+		failed = fflush(vol) != 0 || h->failed || failed;
+		if (!failed && fstat(fileno(vol), &st) == 0)
+			remember(&st);
+		else
+			drop_volume(h->dev, h->ino);
+
+		*h = handles[--nhandles];
+	}
+
+	int closed = fclose(vol);
+	return failed ? EOF : closed;
+}
+
+// Returns true if the blocks of vol are being cached
+bool cache_active(FILE* vol)
+{
+	return capacity > 0 && find_handle(vol) != NULL;
+}
+
+// Copies nbytes of block id of vol into block. Returns false if the block is not cached
+bool cache_get(FILE* vol, SIFS_BLOCKID id, void* block, size_t nbytes)
+{
+	CACHE_HANDLE* h = capacity > 0 ? find_handle(vol) : NULL;
+	if (!h)
+		return false;
+
+	CACHE_ENTRY* e = lookup(h->dev, h->ino, id);
+	if (!e)
+		return false;
+
+	// A directory block cached where a file block is now wanted is read again
+	if (e->nvalid < nbytes)
+	{
+		drop(e);
+		return false;
+	}
+
+	memcpy(block, &e->block, nbytes);
+	touch(e);
+	STAT_ADD(cachehits, 1);
+	return true;
+}
+
+// Caches nbytes of block id of vol, just read from the volume
+void cache_fill(FILE* vol, SIFS_BLOCKID id, const void* block, size_t nbytes)
+{
+	CACHE_HANDLE* h = capacity > 0 ? find_handle(vol) : NULL;
+	if (!h || lookup(h->dev, h->ino, id))
+		return;
+
+	CACHE_ENTRY* e = insert(h, id);
+	if (e)
+	{
+		memcpy(&e->block, block, nbytes);
+		e->nvalid = nbytes;
+	}
+}
+
+// Caches nbytes of block id of vol, to be written at offset later. Returns false if the block must be written now
+bool cache_put(FILE* vol, SIFS_BLOCKID id, const void* block, size_t nbytes, long offset)
+{
+	CACHE_HANDLE* h = capacity > 0 ? find_handle(vol) : NULL;
+	if (!h)
+		return false;
+
+	CACHE_ENTRY* e = lookup(h->dev, h->ino, id);
+	if (!e)
+		e = insert(h, id);
+	if (!e)
+		return false;
+
+	memcpy(&e->block, block, nbytes);
+	if (nbytes > e->nvalid)
+		e->nvalid = nbytes;
+	if (!e->dirty)
+		ndirty++;
+	e->dirty = vol;
+	if (nbytes > e->ndirty)
+		e->ndirty = nbytes;
+	e->offset = offset;
+
+	touch(e);
+	return true;
+}
+
+// Writes back every dirty block, before the volume is read without the cache
+void cache_flush(void)
+{
+	for (CACHE_ENTRY* e = newest; e && ndirty > 0; e = e->older)
+	{
+		if (e->dirty)
+			write_back(e);
+	}
+}
+
+// Drops the cached blocks of vol that overlap nbytes at offset, before they are written without the cache
+void cache_forget(FILE* vol, long offset, size_t nbytes)
+{
+	CACHE_HANDLE* h = nentries > 0 ? find_handle(vol) : NULL;
+	if (!h || nbytes == 0 || offset + (long)nbytes <= h->base)
+		return;
+
+	long end = offset + (long)nbytes;
+	SIFS_BLOCKID first = offset < h->base ? 0 : (offset - h->base) / h->blocksize;
+	SIFS_BLOCKID last = (end - 1 - h->base) / h->blocksize;
+
+	// Large writes look through the cache instead of looking up every block they cover
+	if ((size_t)(last - first) < nentries)
+	{
+		for (SIFS_BLOCKID id = first; id <= last; id++)
+		{
+			CACHE_ENTRY* e = lookup(h->dev, h->ino, id);
+			long start = h->base + (long)id * h->blocksize;
+			if (e && start < end && offset < start + (long)e->nvalid)
+				drop(e);
+		}
+		return;
+	}
+
+	for (CACHE_ENTRY* e = newest; e; /*blank*/)
+	{
+		CACHE_ENTRY* older = e->older;
+		long start = h->base + (long)e->id * h->blocksize;
+		if (e->dev == h->dev && e->ino == h->ino && start < end && offset < start + (long)e->nvalid)
+			drop(e);
+		e = older;
+	}
+}
+
+// Drops every cached block of the volume vol refers to, after its header has been rewritten
+void cache_reset(FILE* vol, SIFS_VOLUME_HEADER header)
+{
+	struct stat st;
+	if (nentries == 0 && nhandles == 0)
+		return;
+	if (fstat(fileno(vol), &st) != 0)
+		return;
+
+	drop_volume(st.st_dev, st.st_ino);
+	CACHE_HANDLE* h = find_handle(vol);
+	if (h)
+	{
+		h->base = block_offset(header, 0);
+		h->blocksize = header.blocksize;
+	}
+}
+
+// set the size of the block cache shared by every operation, in megabytes
+int SIFS_set_cache_size(size_t megabytes)
+{
+	configured = true;
+	if (!resize(megabytes))
+	{
+		SIFS_errno = SIFS_ENOMEM;
+		return 1;
+	}
+	return 0;
+}
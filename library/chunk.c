@@ -0,0 +1,372 @@
+#include <stdlib.h>
+#include "sifsutils.h"
+
+//  CONTENT-DEFINED CHUNKING. ON VOLUMES MADE WITH SIFS_FORMAT_CHUNKED A FILE'S DATA BLOCKS HOLD A LIST OF
+//  CHUNK BLOCKS. A CHUNK BLOCK IS A FILE BLOCK THAT NO DIRECTORY POINTS AT: ITS nfiles COUNTS THE CHUNK LISTS
+//  REFERRING TO IT, AND ITS CONTENTS ARE STORED LIKE THOSE OF ANY OTHER FILE
+
+// Chunk boundaries are placed where the rolling hash has its top bits clear, so the average chunk is 16KB
+#define CHUNK_MIN	4096
+#define CHUNK_MAX	SIFS_CHUNK_MAX
+#define CHUNK_MASK	0xFFFC000000000000ULL
+
+// One chunk of the index. Empty slots have id SIFS_ROOTDIR_BLOCKID, which is never a chunk
+typedef struct {
+	unsigned char	md5[MD5_BYTELEN];
+	SIFS_BLOCKID	id;
+} CHUNK_ENTRY;
+
+// Every chunk on the volume, keyed by the MD5 of its contents
+typedef struct {
+	CHUNK_ENTRY*	entries;
+	uint32_t	capacity;	// always a power of two
+	uint32_t	count;
+} CHUNK_INDEX;
+
+// Fills gear with the pseudo-random values the rolling hash adds for each byte. They must never change,
+// or new files would no longer find the chunks of older ones
+static void fill_gear(uint64_t gear[256])
+{
+	uint64_t x = 0x5349465343484B53ULL;
+	for (int i = 0; i < 256; i++)
+	{
+		// splitmix64
+		uint64_t z = (x += 0x9E3779B97F4A7C15ULL);
+		z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+		z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+		gear[i] = z ^ (z >> 31);
+	}
+}
+
+// Returns the length of the chunk at the front of nbytes of data
+static size_t next_chunk(const uint64_t gear[256], const unsigned char* data, size_t nbytes)
+{
+	if (nbytes <= CHUNK_MIN)
+		return nbytes;
+	size_t end = nbytes < CHUNK_MAX ? nbytes : CHUNK_MAX;
+
+	// Each byte shifts out of the hash after 64 more, so only the last 64 bytes place a boundary
+	uint64_t hash = 0;
+	for (size_t i = CHUNK_MIN; i < end; i++)
+	{
+		hash = (hash << 1) + gear[data[i]];
+		if ((hash & CHUNK_MASK) == 0)
+			return i + 1;
+	}
+	return end;
+}
+
+static uint32_t chunk_slot(const CHUNK_INDEX* index, const unsigned char* md5)
+{
+	uint32_t h;
+	memcpy(&h, md5, sizeof(uint32_t));
+	return h & (index->capacity - 1);
+}
+
+// Returns the chunk block with contents md5, or SIFS_ROOTDIR_BLOCKID if there is none
+static SIFS_BLOCKID find_chunk(const CHUNK_INDEX* index, const unsigned char* md5)
+{
+	for (uint32_t i = chunk_slot(index, md5); index->entries[i].id != SIFS_ROOTDIR_BLOCKID;
+		i = (i + 1) & (index->capacity - 1))
+	{
+		if (memcmp(index->entries[i].md5, md5, MD5_BYTELEN) == 0)
+			return index->entries[i].id;
+	}
+	return SIFS_ROOTDIR_BLOCKID;
+}
+
+// Adds chunk block id to the index. Returns true if action was successful
+static bool add_chunk(CHUNK_INDEX* index, const unsigned char* md5, SIFS_BLOCKID id)
+{
+	// Keep the index at most half full
+	if ((index->count + 1) * 2 > index->capacity)
+	{
+		CHUNK_INDEX grown = { .capacity = index->capacity * 2 };
+		grown.entries = calloc(grown.capacity, sizeof(CHUNK_ENTRY));
+		if (!grown.entries)
+			return false;
+		for (uint32_t i = 0; i < index->capacity; i++)
+		{
+			if (index->entries[i].id != SIFS_ROOTDIR_BLOCKID)
+				add_chunk(&grown, index->entries[i].md5, index->entries[i].id);
+		}
+		free(index->entries);
+		*index = grown;
+	}
+
+	uint32_t i = chunk_slot(index, md5);
+	while (index->entries[i].id != SIFS_ROOTDIR_BLOCKID)
+	{
+		i = (i + 1) & (index->capacity - 1);
+	}
+	memcpy(index->entries[i].md5, md5, MD5_BYTELEN);
+	index->entries[i].id = id;
+	index->count++;
+	return true;
+}
+
+// Reads every chunk block of the volume into index, skipping fileID, which is not written yet.
+// Returns true if action was successful
+static bool build_index(SIFS_VOLUME_HEADER header, const SIFS_BIT* bitmap, FILE* vol, SIFS_BLOCKID fileID,
+	CHUNK_INDEX* index)
+{
+	index->count = 0;
+	index->capacity = 256;
+	index->entries = calloc(index->capacity, sizeof(CHUNK_ENTRY));
+	if (!index->entries)
+		return false;
+
+	STAT_ADD(bitmapscans, 1);
+	for (SIFS_BLOCKID id = 0; id < header.nblocks; id++)
+	{
+		if (bitmap[id] != SIFS_FILE || id == fileID)
+			continue;
+
+		SIFS_FILEBLOCK fblock = get_fileblock(header, vol, id);
+		if (is_chunk(header, &fblock) && !add_chunk(index, fblock.md5, id))
+			return false;
+	}
+	return true;
+}
+
+// Stores nbytes of data as a new chunk block holding no references, followed by its data blocks.
+// Returns the chunk block, or SIFS_ROOTDIR_BLOCKID if the volume is full
+static SIFS_BLOCKID store_chunk(SIFS_VOLUME_HEADER header, SIFS_BIT* bitmap, FILE* vol, const void* data,
+	size_t nbytes, const unsigned char* md5)
+{
+	SIFS_FILEBLOCK chunk;
+	memset(&chunk, 0, sizeof(SIFS_FILEBLOCK));
+	chunk.modtime = time(NULL);
+	chunk.length = nbytes;
+	memcpy(chunk.md5, md5, MD5_BYTELEN);
+	chunk.fileflags = SIFS_FILE_CHUNK;
+	if ((header.flags & SIFS_FORMAT_INLINE) && nbytes <= inline_capacity(header))
+		chunk.fileflags |= SIFS_FILE_INLINE;
+
+	const void* stored = pack_filedata(header, data, &chunk);
+	uint32_t nblocks = data_blocks(header, &chunk);
+	SIFS_BLOCKID id = allocate_run(header, bitmap, 1 + nblocks);
+	if (id < header.nblocks)
+	{
+		chunk.firstblockID = nblocks == 0 ? id : id + 1;
+		bitmap[id] = SIFS_FILE;
+		for (SIFS_BLOCKID b = id + 1; b <= id + nblocks; b++)
+		{
+			bitmap[b] = SIFS_DATABLOCK;
+		}
+
+		put_fileblock(header, vol, id, &chunk);
+		write_at(vol, data_offset(header, &chunk), stored, stored_length(header, &chunk));
+	}
+	else
+		id = SIFS_ROOTDIR_BLOCKID;
+
+	if (stored != data)
+		free((void*)stored);
+	return id;
+}
+
+// Splits nbytes of data into content-defined chunks, storing those the volume does not hold yet and marking
+// their blocks in bitmap. Sets file's chunk list and returns it for the caller to write and free. Chunks hold
+// no new references until add_chunkrefs() is called. Returns NULL and sets err on failure
+const void* chunk_filedata(SIFS_VOLUME_HEADER header, SIFS_BIT* bitmap, FILE* vol, const void* data, size_t nbytes,
+	SIFS_BLOCKID fileID, SIFS_FILEBLOCK* file, int* err)
+{
+	uint64_t gear[256];
+	fill_gear(gear);
+
+	// Nothing is stored if a block read for the index, or before it, failed its checksum
+	CHUNK_INDEX index = { 0 };
+	uint32_t capacity = 64;
+	SIFS_BLOCKID* list = malloc(sizeof(SIFS_BLOCKID) * capacity);
+	bool built = list && build_index(header, bitmap, vol, fileID, &index);
+	if (!built || !metadata_intact())
+	{
+		*err = built ? SIFS_EBADCRC : SIFS_ENOMEM;
+		free(list);
+		free(index.entries);
+		return NULL;
+	}
+
+	file->nchunks = 0;
+	*err = SIFS_EOK;
+	const unsigned char* p = data;
+	for (size_t offset = 0; offset < nbytes && *err == SIFS_EOK; /*blank*/)
+	{
+		size_t length = next_chunk(gear, p + offset, nbytes - offset);
+		unsigned char md5_digest[MD5_BYTELEN];
+		phase_begin(SIFS_PHASE_HASH);
+		MD5_buffer((const char*)p + offset, length, md5_digest);
+		STAT_ADD(md5bytes, length);
+		phase_end(SIFS_PHASE_HASH);
+
+		// Repeats within this file are found too, as new chunks join the index
+		SIFS_BLOCKID id = find_chunk(&index, md5_digest);
+		if (id == SIFS_ROOTDIR_BLOCKID)
+		{
+			id = store_chunk(header, bitmap, vol, p + offset, length, md5_digest);
+			if (id == SIFS_ROOTDIR_BLOCKID)
+				*err = SIFS_ENOSPC;
+			else if (!add_chunk(&index, md5_digest, id))
+				*err = SIFS_ENOMEM;
+		}
+
+		if (*err == SIFS_EOK && file->nchunks == capacity)
+		{
+			SIFS_BLOCKID* grown = realloc(list, sizeof(SIFS_BLOCKID) * capacity * 2);
+			if (grown)
+			{
+				list = grown;
+				capacity *= 2;
+			}
+			else
+				*err = SIFS_ENOMEM;
+		}
+		if (*err == SIFS_EOK)
+			list[file->nchunks++] = id;
+		offset += length;
+	}
+
+	free(index.entries);
+	if (*err != SIFS_EOK)
+	{
+		free(list);
+		return NULL;
+	}
+	file->fileflags |= SIFS_FILE_CHUNKED;
+	file->compression = SIFS_COMPRESS_NONE;
+	file->storedlength = file->length;
+	return list;
+}
+
+// Reads the chunk list of file. Returns NULL on failure; the caller frees the result
+SIFS_BLOCKID* get_chunklist(SIFS_VOLUME_HEADER header, FILE* vol, const SIFS_FILEBLOCK* file)
+{
+	size_t nbytes = stored_length(header, file);
+	SIFS_BLOCKID* list = malloc(nbytes ? nbytes : 1);
+	if (list && read_at(vol, data_offset(header, file), list, nbytes) != nbytes)
+	{
+		free(list);
+		return NULL;
+	}
+	return list;
+}
+
+static int compare_blockids(const void* a, const void* b)
+{
+	SIFS_BLOCKID ia = *(const SIFS_BLOCKID*)a;
+	SIFS_BLOCKID ib = *(const SIFS_BLOCKID*)b;
+	return ia < ib ? -1 : ia > ib;
+}
+
+// Returns true if every chunk block in list passes its checksum
+bool chunks_intact(SIFS_VOLUME_HEADER header, const SIFS_BIT* bitmap, FILE* vol, const SIFS_BLOCKID* list,
+	uint32_t nchunks)
+{
+	for (uint32_t c = 0; c < nchunks; c++)
+	{
+		if (list[c] >= header.nblocks || bitmap[list[c]] != SIFS_FILE)
+			continue;
+		SIFS_FILEBLOCK chunk = get_fileblock(header, vol, list[c]);
+		if (!fileblock_intact(header, &chunk))
+			return false;
+	}
+	return true;
+}
+
+// Adds delta to the reference count of each chunk in list, once for every time it appears.
+// Chunks left with no references are freed in bitmap, along with their data blocks.
+// Returns false and sets err, changing nothing, if a chunk fails its checksum or memory runs out
+static bool count_chunkrefs(SIFS_VOLUME_HEADER header, SIFS_BIT* bitmap, FILE* vol, const SIFS_BLOCKID* list,
+	uint32_t nchunks, int delta, int* err)
+{
+	if (!chunks_intact(header, bitmap, vol, list, nchunks))
+	{
+		*err = SIFS_EBADCRC;
+		return false;
+	}
+
+	// Sorting the list visits each chunk block once, in the order they are stored
+	SIFS_BLOCKID* sorted = malloc(sizeof(SIFS_BLOCKID) * (nchunks ? nchunks : 1));
+	if (!sorted)
+	{
+		*err = SIFS_ENOMEM;
+		return false;
+	}
+	memcpy(sorted, list, sizeof(SIFS_BLOCKID) * nchunks);
+	qsort(sorted, nchunks, sizeof(SIFS_BLOCKID), compare_blockids);
+
+	for (uint32_t first = 0, last; first < nchunks; first = last)
+	{
+		for (last = first + 1; last < nchunks && sorted[last] == sorted[first]; last++)
+			;
+
+		SIFS_BLOCKID id = sorted[first];
+		if (id >= header.nblocks || bitmap[id] != SIFS_FILE)
+			continue;
+		SIFS_FILEBLOCK chunk = get_fileblock(header, vol, id);
+		if (!is_chunk(header, &chunk))
+			continue;
+
+		chunk.nfiles += delta * (int)(last - first);
+		if (chunk.nfiles == 0)
+		{
+			bitmap[id] = SIFS_UNUSED;
+			uint32_t nblocks = data_blocks(header, &chunk);
+			for (SIFS_BLOCKID b = chunk.firstblockID; b < chunk.firstblockID + nblocks; b++)
+			{
+				bitmap[b] = SIFS_UNUSED;
+			}
+		}
+		else
+			put_fileblock(header, vol, id, &chunk);
+	}
+	free(sorted);
+	return true;
+}
+
+// Adds a reference to each chunk in list, once for every time it appears.
+// Returns false and sets err, changing nothing, if a chunk fails its checksum or memory runs out
+bool add_chunkrefs(SIFS_VOLUME_HEADER header, SIFS_BIT* bitmap, FILE* vol, const SIFS_BLOCKID* list, uint32_t nchunks,
+	int* err)
+{
+	return count_chunkrefs(header, bitmap, vol, list, nchunks, 1, err);
+}
+
+// Drops a reference to each chunk in list. Chunks left with none are freed in bitmap, which the caller writes.
+// Returns false and sets err, changing nothing, if a chunk fails its checksum or memory runs out
+bool release_chunks(SIFS_VOLUME_HEADER header, SIFS_BIT* bitmap, FILE* vol, const SIFS_BLOCKID* list, uint32_t nchunks,
+	int* err)
+{
+	return count_chunkrefs(header, bitmap, vol, list, nchunks, -1, err);
+}
+
+// Points every chunk list that refers to chunk block from at chunk block to instead
+void relink_chunk(SIFS_VOLUME_HEADER header, const SIFS_BIT* bitmap, FILE* vol, SIFS_BLOCKID from, SIFS_BLOCKID to)
+{
+	STAT_ADD(bitmapscans, 1);
+	for (SIFS_BLOCKID id = 0; id < header.nblocks; id++)
+	{
+		if (bitmap[id] != SIFS_FILE)
+			continue;
+		SIFS_FILEBLOCK fblock = get_fileblock(header, vol, id);
+		if (!is_chunked(header, &fblock))
+			continue;
+
+		SIFS_BLOCKID* list = get_chunklist(header, vol, &fblock);
+		if (!list)
+			continue;
+		bool changed = false;
+		for (uint32_t i = 0; i < fblock.nchunks; i++)
+		{
+			if (list[i] == from)
+			{
+				list[i] = to;
+				changed = true;
+			}
+		}
+		if (changed)
+			write_at(vol, data_offset(header, &fblock), list, stored_length(header, &fblock));
+		free(list);
+	}
+}
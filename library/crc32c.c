@@ -0,0 +1,79 @@
+#include "crc32c.h"
+
+#include <string.h>
+#include <stdbool.h>
+
+#define	CRC32C_POLY	0x82F63B78U	// the Castagnoli polynomial, reflected
+
+#if	defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define	HAVE_SSE42
+#endif
+
+static uint32_t	table[256];
+static bool	tablemade	= false;
+
+static void make_table(void)
+{
+    for(uint32_t i = 0 ; i < 256 ; i++) {
+	uint32_t	crc	= i;
+
+	for(int bit = 0 ; bit < 8 ; bit++)
+	    crc	= (crc >> 1) ^ (CRC32C_POLY & (0U - (crc & 1)));
+	table[i]	= crc;
+    }
+    tablemade	= true;
+}
+
+static uint32_t crc_table(uint32_t crc, const unsigned char *p, size_t nbytes)
+{
+    if(!tablemade)
+	make_table();
+    while(nbytes-- > 0)
+	crc	= table[(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+    return crc;
+}
+
+#ifdef	HAVE_SSE42
+//  EIGHT BYTES AT A TIME WHERE THE CPU CAN, THEN ONE AT A TIME FOR THE REST
+__attribute__((target("sse4.2")))
+static uint32_t crc_sse42(uint32_t crc, const unsigned char *p, size_t nbytes)
+{
+#ifdef	__x86_64__
+    uint64_t	crc64	= crc;
+
+    for( ; nbytes >= 8 ; p += 8, nbytes -= 8) {
+	uint64_t	v;
+
+	memcpy(&v, p, sizeof v);
+	crc64	= __builtin_ia32_crc32di(crc64, v);
+    }
+    crc	= (uint32_t)crc64;
+#endif
+    for( ; nbytes >= 4 ; p += 4, nbytes -= 4) {
+	uint32_t	v;
+
+	memcpy(&v, p, sizeof v);
+	crc	= __builtin_ia32_crc32si(crc, v);
+    }
+    while(nbytes-- > 0)
+	crc	= __builtin_ia32_crc32qi(crc, *p++);
+    return crc;
+}
+#endif
+
+uint32_t CRC32C_buffer(const void *data, size_t nbytes)
+{
+    uint32_t	crc	= 0xFFFFFFFFU;
+
+#ifdef	HAVE_SSE42
+    static int	sse42	= -1;
+
+    if(sse42 < 0) {
+	__builtin_cpu_init();
+	sse42	= __builtin_cpu_supports("sse4.2") ? 1 : 0;
+    }
+    if(sse42)
+	return ~crc_sse42(crc, data, nbytes);
+#endif
+    return ~crc_table(crc, data, nbytes);
+}
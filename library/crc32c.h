@@ -0,0 +1,8 @@
+//  CRC32C (CASTAGNOLI) CHECKSUMS OF VOLUME METADATA. THE SSE4.2 crc32 INSTRUCTION IS
+//  USED WHERE THE CPU HAS IT, AND A TABLE OTHERWISE; BOTH GIVE THE SAME RESULT
+
+#include <stdlib.h>		// defines  size_t
+#include <stdint.h>
+
+//  RETURNS THE CRC32C OF nbytes OF data
+extern	uint32_t	CRC32C_buffer(const void *data, size_t nbytes);
@@ -1,12 +1,17 @@
 #include "sifsutils.h"
 #include <assert.h>
 
+// Most bytes of data blocks moved in one run
+#define DEFRAG_RUNBYTES	(1024 * 1024)
+
 void shift_dir(SIFS_VOLUME_HEADER header, SIFS_BIT* bitmap, FILE* vol, SIFS_BLOCKID dir, uint32_t npos)
 {
 	assert(bitmap[dir] == SIFS_DIR);
 	assert(dir > npos);
 
-	// Find parent directory
+	// Find parent directory. Snapshots may share the directory, giving it a parent in each of them
+	bool shared = header.flags & SIFS_FORMAT_SNAPSHOT;
+	STAT_ADD(bitmapscans, 1);
 	for (SIFS_BLOCKID id = 0; id < header.nblocks; id++)
 	{
 		if (bitmap[id] == SIFS_DIR)
@@ -19,9 +24,10 @@ void shift_dir(SIFS_VOLUME_HEADER header, SIFS_BIT* bitmap, FILE* vol, SIFS_BLOC
 					// Update child entry
 					block.entries[entry].blockID -= npos;
 					// Write to volume
-					fseek(vol, sizeof(SIFS_VOLUME_HEADER) + header.nblocks + id * header.blocksize, SEEK_SET);
-					fwrite(&block, sizeof(SIFS_DIRBLOCK), 1, vol);
-					goto BREAK_LOOP;
+					put_dirblock(header, vol, id, &block);
+					if (!shared)
+						goto BREAK_LOOP;
+					break;
 				}
 			}
 		}
@@ -31,13 +37,11 @@ BREAK_LOOP:
 	bitmap[dir] = SIFS_UNUSED;
 	bitmap[dir - npos] = SIFS_DIR;
 
-	fseek(vol, sizeof(SIFS_VOLUME_HEADER), SEEK_SET);
-	fwrite(bitmap, sizeof(SIFS_BIT), header.nblocks, vol);
+	put_volumebitmap(header, vol, bitmap);
 
 	// Move directory block
 	SIFS_DIRBLOCK child = get_dirblock(header, vol, dir);
-	fseek(vol, sizeof(SIFS_VOLUME_HEADER) + header.nblocks + (dir - npos) * header.blocksize, SEEK_SET);
-	fwrite(&child, sizeof(SIFS_DIRBLOCK), 1, vol);
+	put_dirblock(header, vol, dir - npos, &child);
 }
 
 void shift_file(SIFS_VOLUME_HEADER header, SIFS_BIT* bitmap, FILE* vol, SIFS_BLOCKID file, uint32_t npos)
@@ -47,9 +51,11 @@ void shift_file(SIFS_VOLUME_HEADER header, SIFS_BIT* bitmap, FILE* vol, SIFS_BLO
 
 	SIFS_FILEBLOCK fblock = get_fileblock(header, vol, file);
 
-	// Update all directory entries that point to this file
+	// Update all directory entries that point to this file. Those of snapshots are not counted by nfiles
 	uint32_t ndirs_processed = 0;
-	for (SIFS_BLOCKID id = 0; id < header.nblocks && ndirs_processed < fblock.nfiles; id++)
+	bool shared = header.flags & SIFS_FORMAT_SNAPSHOT;
+	STAT_ADD(bitmapscans, 1);
+	for (SIFS_BLOCKID id = 0; id < header.nblocks && (shared || ndirs_processed < fblock.nfiles); id++)
 	{
 		if (bitmap[id] == SIFS_DIR)
 		{
@@ -63,8 +69,7 @@ void shift_file(SIFS_VOLUME_HEADER header, SIFS_BIT* bitmap, FILE* vol, SIFS_BLO
 				}
 			}
 			// Write to volume
-			fseek(vol, sizeof(SIFS_VOLUME_HEADER) + header.nblocks + id * header.blocksize, SEEK_SET);
-			fwrite(&dblock, sizeof(SIFS_DIRBLOCK), 1, vol);
+			put_dirblock(header, vol, id, &dblock);
 		}
 	}
 
@@ -72,39 +77,57 @@ void shift_file(SIFS_VOLUME_HEADER header, SIFS_BIT* bitmap, FILE* vol, SIFS_BLO
 	bitmap[file] = SIFS_UNUSED;
 	bitmap[file - npos] = SIFS_FILE;
 
-	fseek(vol, sizeof(SIFS_VOLUME_HEADER), SEEK_SET);
-	fwrite(bitmap, sizeof(SIFS_BIT), header.nblocks, vol);
+	put_volumebitmap(header, vol, bitmap);
+
+	// Move file block. Contents that need no data blocks live in, and point at, the file block
+	if (fblock.firstblockID == file)
+	{
+		fblock.firstblockID = file - npos;
+		if (is_inline(header, &fblock))
+		{
+			char* block = malloc(header.blocksize);
+			read_at(vol, block_offset(header, file), block, header.blocksize);
+			write_at(vol, block_offset(header, file - npos), block, header.blocksize);
+			free(block);
+		}
+	}
+	put_fileblock(header, vol, file - npos, &fblock);
 
-	// Move file block
-	fseek(vol, sizeof(SIFS_VOLUME_HEADER) + header.nblocks + (file - npos) * header.blocksize, SEEK_SET);
-	fwrite(&fblock, sizeof(SIFS_FILEBLOCK), 1, vol);
+	// Chunk blocks are found through the chunk lists of files rather than directories
+	if (is_chunk(header, &fblock))
+		relink_chunk(header, bitmap, vol, file, file - npos);
 }
 
-void shift_data(SIFS_VOLUME_HEADER header, SIFS_BIT* bitmap, FILE* vol, SIFS_BLOCKID data, uint32_t npos)
+// Moves the run of nrun datablocks starting at data, reading the whole run before any of it is written
+void shift_data(SIFS_VOLUME_HEADER header, SIFS_BIT* bitmap, FILE* vol, SIFS_BLOCKID data, uint32_t nrun, uint32_t npos)
 {
 	assert(bitmap[data] == SIFS_DATABLOCK);
 	assert(data > npos);
 
-	// Update and write bitmap
-	bitmap[data] = SIFS_UNUSED;
-	bitmap[data - npos] = SIFS_DATABLOCK;
+	// Update and write bitmap. The old and new runs may overlap
+	for (SIFS_BLOCKID id = data; id < data + nrun; id++)
+	{
+		bitmap[id] = SIFS_UNUSED;
+	}
+	for (SIFS_BLOCKID id = data; id < data + nrun; id++)
+	{
+		bitmap[id - npos] = SIFS_DATABLOCK;
+	}
 
-	fseek(vol, sizeof(SIFS_VOLUME_HEADER), SEEK_SET);
-	fwrite(bitmap, sizeof(SIFS_BIT), header.nblocks, vol);
+	put_volumebitmap(header, vol, bitmap);
 
-	// Move datablock
-	char* block = malloc(header.blocksize);
-	
-	fseek(vol, sizeof(SIFS_VOLUME_HEADER) + header.nblocks + data * header.blocksize, SEEK_SET);
-	fread(block, 1, header.blocksize, vol);
+	// Move datablocks
+	char* blocks = malloc(nrun * header.blocksize);
 	
-	fseek(vol, sizeof(SIFS_VOLUME_HEADER) + header.nblocks + (data - npos) * header.blocksize, SEEK_SET);
-	fwrite(block, 1, header.blocksize, vol);
+	read_run(vol, block_offset(header, data), blocks, nrun * header.blocksize);
+	write_run(vol, block_offset(header, data - npos), blocks, nrun * header.blocksize);
+
+	free(blocks);
 }
 
 
 // Defragments the volume
-int SIFS_defrag(const char* volumename)
+int defragment(const char* volumename)
 {
 	// Check arguments
 	if (volumename == NULL || *volumename == '\0')
@@ -113,35 +136,42 @@ int SIFS_defrag(const char* volumename)
 		return 1;
 	}
 
-	// Try to open volume
-	FILE* vol = fopen(volumename, "r+");
+	// Open volume, reading and validating its header and bitmap
+	SIFS_VOLUME_HEADER header;
+	SIFS_BIT* bitmap;
+	FILE* vol = open_volume(volumename, "r+", &header, &bitmap);
 	if (!vol)
-	{
-		SIFS_errno = SIFS_ENOVOL;
 		return 1;
-	}
 
-	// Read and validate header
-	SIFS_VOLUME_HEADER header = get_volumeheader(vol);
-	if (header.blocksize < SIFS_MIN_BLOCKSIZE || header.nblocks == 0)
+	// Every directory and file block may be written again as blocks move, so each must pass its checksum first
+	bool intact = true;
+	STAT_ADD(bitmapscans, 1);
+	for (SIFS_BLOCKID id = 0; id < header.nblocks && intact; id++)
 	{
-		SIFS_errno = SIFS_ENOTVOL;
-		fclose(vol);
-		return 1;
+		if (bitmap[id] == SIFS_DIR)
+		{
+			SIFS_DIRBLOCK dblock = get_dirblock(header, vol, id);
+			intact = dirblock_intact(header, &dblock);
+		}
+		else if (bitmap[id] == SIFS_FILE)
+		{
+			SIFS_FILEBLOCK fblock = get_fileblock(header, vol, id);
+			intact = fileblock_intact(header, &fblock);
+		}
 	}
-
-	// Read and validate bitmap
-	SIFS_BIT* bitmap;
-	get_volumebitmap(vol, &bitmap);
-	if (!validate_bitmap(bitmap, header.nblocks))
+	if (!intact)
 	{
-		SIFS_errno = SIFS_ENOTVOL;
+		SIFS_errno = SIFS_EBADCRC;
 		free(bitmap);
-		fclose(vol);
+		close_volume(vol);
 		return 1;
 	}
 
+	// Blocks left behind at the end once everything has moved down are punched out together
+	SIFS_BIT* before = punch_begin(header, bitmap);
+
 	SIFS_BLOCKID maxIndex = 0;
+	STAT_ADD(bitmapscans, 1);
 	for (SIFS_BLOCKID i = 1; i < header.nblocks; i++)
 	{
 		if (bitmap[i] != SIFS_UNUSED)
@@ -166,31 +196,59 @@ int SIFS_defrag(const char* volumename)
 			}
 			else if (bitmap[i] == SIFS_DATABLOCK)
 			{
-				// We need to update fileblock if we are shifting the first datablock
-				for (SIFS_BLOCKID id = 0; id < header.nblocks; id++)
+				// Consecutive datablocks are moved together, so that their reads and writes are batched
+				uint32_t nrun = 1;
+				while (i + nrun <= maxIndex && bitmap[i + nrun] == SIFS_DATABLOCK &&
+					(nrun + 1) * header.blocksize <= DEFRAG_RUNBYTES)
 				{
-					if (bitmap[id] == SIFS_FILE)
+					nrun++;
+				}
+
+				for (SIFS_BLOCKID data = i; data < i + nrun; data++)
+				{
+					// We need to update fileblock if we are shifting the first datablock.
+					// File blocks copied for snapshots share the data of the original
+					STAT_ADD(bitmapscans, 1);
+					for (SIFS_BLOCKID id = 0; id < header.nblocks; id++)
 					{
-						SIFS_FILEBLOCK fblock = get_fileblock(header, vol, id);
-						if (fblock.firstblockID == i) // If our datablock is the first block
+						if (bitmap[id] == SIFS_FILE)
 						{
-							fblock.firstblockID -= consecutiveUnsued;
+							SIFS_FILEBLOCK fblock = get_fileblock(header, vol, id);
+							if (fblock.firstblockID == data) // If our datablock is the first block
+							{
+								fblock.firstblockID -= consecutiveUnsued;
 
-							// Write to volume
-							fseek(vol, sizeof(SIFS_VOLUME_HEADER) + header.nblocks + id * header.blocksize, SEEK_SET);
-							fwrite(&fblock, sizeof(SIFS_FILEBLOCK), 1, vol);
+								// Write to volume
+								put_fileblock(header, vol, id, &fblock);
 
-							break;
+								if (!(header.flags & SIFS_FORMAT_SNAPSHOT))
+									break;
+							}
 						}
 					}
 				}
 
-				shift_data(header, bitmap, vol, i, consecutiveUnsued);
+				shift_data(header, bitmap, vol, i, nrun, consecutiveUnsued);
+				i += nrun - 1;
 			}
 		}
 	}
+	punch_end(header, vol, before, bitmap);
 
 	free(bitmap);
-	fclose(vol);
+	if (close_volume(vol) != 0)
+	{
+		SIFS_errno = SIFS_EIO;
+		return 1;
+	}
 	return 0;
 }
+
+// Defragments the volume
+int SIFS_defrag(const char* volumename)
+{
+	stats_begin(SIFS_OP_DEFRAG);
+	int result = defragment(volumename);
+	stats_end();
+	return result;
+}
@@ -1,7 +1,7 @@
 #include "sifsutils.h"
 
 // get information about a requested directory
-int SIFS_dirinfo(const char *volumename, const char *pathname,
+static int directory_info(const char *volumename, const char *pathname,
                  char ***entrynames, uint32_t *nentries, time_t *modtime)
 {
 	// Check arguments
@@ -12,46 +12,42 @@ int SIFS_dirinfo(const char *volumename, const char *pathname,
 		return 1;
 	}
 
-	// Try to open volume
-	FILE* vol = fopen(volumename, "r");
-	if (!vol)
-	{
-		SIFS_errno = SIFS_ENOVOL;
-		return 1;
-	}
-	
-	// Read and validate header
-	SIFS_VOLUME_HEADER header = get_volumeheader(vol);
-	if (header.blocksize < SIFS_MIN_BLOCKSIZE || header.nblocks == 0)
-	{
-		SIFS_errno = SIFS_ENOTVOL;
-		fclose(vol);
-		return 1;
-	}
-
-	// Read and validate bitmap
+	// Open volume, reading and validating its header and bitmap
+	SIFS_VOLUME_HEADER header;
 	SIFS_BIT* bitmap;
-	get_volumebitmap(vol, &bitmap);
-	if (!validate_bitmap(bitmap, header.nblocks))
-	{
-		SIFS_errno = SIFS_ENOTVOL;
-		free(bitmap);
-		fclose(vol);
+	SIFS_BLOCKID rootID;
+	FILE* vol = open_snapshot(volumename, &header, &bitmap, &rootID);
+	if (!vol)
 		return 1;
-	}
 
 	int err = SIFS_EOK;
 	// If filepath is '\0' we are working in the root directory
-	SIFS_BLOCKID dir = (*pathname == '\0') ? SIFS_ROOTDIR_BLOCKID :
-		find_dir(header, bitmap, vol, SIFS_ROOTDIR_BLOCKID, pathname, &err);
+	SIFS_BLOCKID dir = (*pathname == '\0') ? rootID :
+		find_dir(header, bitmap, vol, rootID, pathname, &err);
 	if (err != SIFS_EOK)
 	{
 		SIFS_errno = err;
 		free(bitmap);
-		fclose(vol);
+		close_volume(vol);
 		return 1;
 	}
+	// Read the names of every entry together. The directory and every entry block read must pass their checksums
 	SIFS_DIRBLOCK block = get_dirblock(header, vol, dir);
+	char names[SIFS_MAX_ENTRIES][SIFS_MAX_NAME_LENGTH];
+	bool intact[SIFS_MAX_ENTRIES];
+	get_entrynames(header, bitmap, vol, &block, names, intact);
+	bool allintact = dirblock_intact(header, &block);
+	for (uint32_t i = 0; i < block.nentries && i < SIFS_MAX_ENTRIES; i++)
+	{
+		allintact = allintact && intact[i];
+	}
+	if (!allintact)
+	{
+		SIFS_errno = SIFS_EBADCRC;
+		free(bitmap);
+		close_volume(vol);
+		return 1;
+	}
 
 	// Allocate memory for entrynames
 	*entrynames = malloc(sizeof(char*) * block.nentries);
@@ -59,7 +55,7 @@ int SIFS_dirinfo(const char *volumename, const char *pathname,
 	{
 		SIFS_errno = SIFS_ENOMEM;
 		free(bitmap);
-		fclose(vol);
+		close_volume(vol);
 		return 1;
 	}
 	for (int i = 0; i < block.nentries; i++)
@@ -75,7 +71,7 @@ int SIFS_dirinfo(const char *volumename, const char *pathname,
 			}
 			free(*entrynames);
 			free(bitmap);
-			fclose(vol);
+			close_volume(vol);
 			return 1;
 		}
 	}
@@ -83,17 +79,7 @@ int SIFS_dirinfo(const char *volumename, const char *pathname,
 	// Assign entrynames
 	for (int i = 0; i < block.nentries; i++)
 	{
-		SIFS_BLOCKID id = block.entries[i].blockID;
-		if (bitmap[id] == SIFS_DIR)
-		{
-			SIFS_DIRBLOCK entry = get_dirblock(header, vol, id);
-			strcpy((*entrynames)[i], entry.name);
-		}
-		else if (bitmap[id] == SIFS_FILE)
-		{
-			SIFS_FILEBLOCK entry = get_fileblock(header, vol, id);
-			strcpy((*entrynames)[i], entry.filenames[block.entries[i].fileindex]);
-		}
+		strcpy((*entrynames)[i], names[i]);
 	}
 
 	// Assign other values
@@ -101,7 +87,17 @@ int SIFS_dirinfo(const char *volumename, const char *pathname,
 	*modtime = block.modtime;
 
 	free(bitmap);
-	fclose(vol);
+	close_volume(vol);
 
     return 0;
 }
+
+// get information about a requested directory
+int SIFS_dirinfo(const char *volumename, const char *pathname,
+                 char ***entrynames, uint32_t *nentries, time_t *modtime)
+{
+	stats_begin(SIFS_OP_DIRINFO);
+	int result = directory_info(volumename, pathname, entrynames, nentries, modtime);
+	stats_end();
+	return result;
+}
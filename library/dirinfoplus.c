@@ -0,0 +1,117 @@
+#include "sifsutils.h"
+
+// get the name, type, length, modification time and md5 of every entry of a requested directory
+static int directory_info_plus(const char *volumename, const char *pathname,
+		SIFS_DIRENTRY **entries, uint32_t *nentries, time_t *modtime)
+{
+	// Check arguments
+	if (volumename == NULL || pathname == NULL || *volumename == '\0' ||
+		entries == NULL || nentries == NULL || modtime == NULL)
+	{
+		SIFS_errno = SIFS_EINVAL;
+		return 1;
+	}
+
+	// Open volume, reading and validating its header and bitmap
+	SIFS_VOLUME_HEADER header;
+	SIFS_BIT* bitmap;
+	SIFS_BLOCKID rootID;
+	FILE* vol = open_snapshot(volumename, &header, &bitmap, &rootID);
+	if (!vol)
+		return 1;
+
+	int err = SIFS_EOK;
+	// If filepath is '\0' we are working in the root directory
+	SIFS_BLOCKID dir = (*pathname == '\0') ? rootID :
+		find_dir(header, bitmap, vol, rootID, pathname, &err);
+	if (err != SIFS_EOK)
+	{
+		SIFS_errno = err;
+		free(bitmap);
+		close_volume(vol);
+		return 1;
+	}
+	SIFS_DIRBLOCK block = get_dirblock(header, vol, dir);
+	if (!dirblock_intact(header, &block) || block.nentries > SIFS_MAX_ENTRIES)
+	{
+		SIFS_errno = dirblock_intact(header, &block) ? SIFS_ENOTVOL : SIFS_EBADCRC;
+		free(bitmap);
+		close_volume(vol);
+		return 1;
+	}
+
+	// The entries are followed by their names in the same allocation
+	SIFS_DIRENTRY* result = malloc((sizeof(SIFS_DIRENTRY) + SIFS_MAX_NAME_LENGTH) * (block.nentries ? block.nentries : 1));
+	if (!result)
+	{
+		SIFS_errno = SIFS_ENOMEM;
+		free(bitmap);
+		close_volume(vol);
+		return 1;
+	}
+	char* names = (char*)(result + block.nentries);
+
+	// Each entry costs the one block read that SIFS_dirinfo() already makes for its name.
+	// An entry whose block fails its checksum fails the call
+	uint32_t n = 0;
+	bool intact = true;
+	for (uint32_t i = 0; i < block.nentries && intact; i++)
+	{
+		SIFS_BLOCKID id = block.entries[i].blockID;
+		SIFS_DIRENTRY* entry = &result[n];
+		entry->name = names + n * SIFS_MAX_NAME_LENGTH;
+
+		if (id < header.nblocks && bitmap[id] == SIFS_DIR)
+		{
+			SIFS_DIRBLOCK child = get_dirblock(header, vol, id);
+			intact = dirblock_intact(header, &child);
+			strncpy(entry->name, child.name, SIFS_MAX_NAME_LENGTH);
+			entry->type = SIFS_ENTRY_DIR;
+			entry->length = child.nentries;
+			entry->modtime = child.modtime;
+			memset(entry->md5, 0, sizeof(entry->md5));
+		}
+		else if (id < header.nblocks && bitmap[id] == SIFS_FILE && block.entries[i].fileindex < SIFS_MAX_ENTRIES)
+		{
+			SIFS_FILEBLOCK file = get_fileblock(header, vol, id);
+			intact = fileblock_intact(header, &file);
+			strncpy(entry->name, file.filenames[block.entries[i].fileindex], SIFS_MAX_NAME_LENGTH);
+			entry->type = SIFS_ENTRY_FILE;
+			entry->length = file.length;
+			entry->modtime = file.modtime;
+			memcpy(entry->md5, file.md5, MD5_BYTELEN);
+		}
+		// directory points to an invalid block. Leave the entry out
+		else
+			continue;
+
+		entry->name[SIFS_MAX_NAME_LENGTH - 1] = '\0';
+		n++;
+	}
+	if (!intact)
+	{
+		SIFS_errno = SIFS_EBADCRC;
+		free(result);
+		free(bitmap);
+		close_volume(vol);
+		return 1;
+	}
+
+	*entries = result;
+	*nentries = n;
+	*modtime = block.modtime;
+
+	free(bitmap);
+	close_volume(vol);
+	return 0;
+}
+
+// get the name, type, length, modification time and md5 of every entry of a requested directory
+int SIFS_dirinfo_plus(const char *volumename, const char *pathname,
+		SIFS_DIRENTRY **entries, uint32_t *nentries, time_t *modtime)
+{
+	stats_begin(SIFS_OP_DIRINFO_PLUS);
+	int result = directory_info_plus(volumename, pathname, entries, nentries, modtime);
+	stats_end();
+	return result;
+}
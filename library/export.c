@@ -0,0 +1,313 @@
+#include "sifsutils.h"
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include <errno.h>
+
+// A single path to be exported, and the file block holding its contents
+typedef struct {
+	SIFS_BLOCKID	fileID;
+	SIFS_BLOCKID	firstblockID;
+	size_t		length;
+	char*		path;
+} EXPORT_ENTRY;
+
+// A directory still to be visited, and the host path it is exported to
+typedef struct {
+	SIFS_BLOCKID	dirID;
+	char*		path;
+} EXPORT_DIR;
+
+// Joins a host directory path and an entry name. Returns NULL on failure
+static char* join_path(const char* dir, const char* name)
+{
+	char* path = malloc(strlen(dir) + strlen(name) + 2); // For '/' and null byte
+	if (path)
+		sprintf(path, "%s/%s", dir, name);
+	return path;
+}
+
+// Returns true if name can be joined to a host path without leaving the directory it is joined to
+static bool safe_name(const char* name)
+{
+	if (!memchr(name, '\0', SIFS_MAX_NAME_LENGTH))
+		return false;
+	return *name != '\0' && strcmp(name, ".") != 0 && strcmp(name, "..") != 0 && !strchr(name, '/');
+}
+
+// Orders entries by the physical location of their data, keeping entries of the same file together
+static int compare_entries(const void* a, const void* b)
+{
+	const EXPORT_ENTRY* ea = a;
+	const EXPORT_ENTRY* eb = b;
+
+	if (ea->firstblockID != eb->firstblockID)
+		return ea->firstblockID < eb->firstblockID ? -1 : 1;
+	if (ea->fileID != eb->fileID)
+		return ea->fileID < eb->fileID ? -1 : 1;
+	return 0;
+}
+
+// Writes nbytes of data to a new host file. Returns true if action was successful
+static bool write_hostfile(const char* path, const void* data, size_t nbytes)
+{
+	// Never write through a link left behind by an earlier export
+	remove(path);
+	FILE* f = fopen(path, "w");
+	if (!f)
+		return false;
+
+	bool success = fwrite(data, 1, nbytes, f) == nbytes;
+	if (fclose(f) != 0)
+		success = false;
+	return success;
+}
+
+// Walks the directory tree under root once. Host directories are created as they are found and
+// every file path is appended to entries. Returns SIFS_EOK if action was successful, or SIFS_EBADCRC
+// if a block read fails its checksum
+static int collect_entries(SIFS_VOLUME_HEADER header, SIFS_BIT* bitmap, FILE* vol, SIFS_BLOCKID root,
+	const char* hostdir, EXPORT_ENTRY** entries, uint32_t* nentries)
+{
+	uint32_t capacity = 0, ndirs = 0, dircapacity = 1;
+	EXPORT_DIR* dirs = malloc(sizeof(EXPORT_DIR) * dircapacity);
+	char* rootpath = malloc(strlen(hostdir) + 1);
+	if (!dirs || !rootpath)
+	{
+		free(dirs);
+		free(rootpath);
+		return SIFS_ENOMEM;
+	}
+	strcpy(rootpath, hostdir);
+	dirs[ndirs].dirID = root;
+	dirs[ndirs].path = rootpath;
+	ndirs++;
+
+	*entries = NULL;
+	*nentries = 0;
+
+	int err = SIFS_EOK;
+	while (ndirs > 0)
+	{
+		EXPORT_DIR current = dirs[--ndirs];
+		SIFS_DIRBLOCK dblock = get_dirblock(header, vol, current.dirID);
+		if (!dirblock_intact(header, &dblock))
+			err = SIFS_EBADCRC;
+		else if (dblock.nentries > SIFS_MAX_ENTRIES)
+			err = SIFS_ENOTVOL;
+
+		for (uint32_t i = 0; i < dblock.nentries && err == SIFS_EOK; i++)
+		{
+			// An entry pointing outside the volume means the volume is corrupted
+			SIFS_BLOCKID id = dblock.entries[i].blockID;
+			if (id >= header.nblocks)
+			{
+				err = SIFS_ENOTVOL;
+				break;
+			}
+			if (bitmap[id] == SIFS_DIR)
+			{
+				// A name that would leave the host directory means the volume is corrupted
+				SIFS_DIRBLOCK child = get_dirblock(header, vol, id);
+				if (!dirblock_intact(header, &child))
+				{
+					err = SIFS_EBADCRC;
+					break;
+				}
+				if (!safe_name(child.name))
+				{
+					err = SIFS_ENOTVOL;
+					break;
+				}
+				char* path = join_path(current.path, child.name);
+				if (!path)
+				{
+					err = SIFS_ENOMEM;
+					break;
+				}
+				if (mkdir(path, 0777) != 0 && errno != EEXIST)
+				{
+					free(path);
+					err = SIFS_EIO;
+					break;
+				}
+
+				// Grow the stack of directories to visit
+				if (ndirs == dircapacity)
+				{
+					EXPORT_DIR* grown = realloc(dirs, sizeof(EXPORT_DIR) * dircapacity * 2);
+					if (!grown)
+					{
+						free(path);
+						err = SIFS_ENOMEM;
+						break;
+					}
+					dirs = grown;
+					dircapacity *= 2;
+				}
+				dirs[ndirs].dirID = id;
+				dirs[ndirs].path = path;
+				ndirs++;
+			}
+			else if (bitmap[id] == SIFS_FILE)
+			{
+				SIFS_FILEBLOCK fblock = get_fileblock(header, vol, id);
+				uint32_t fileindex = dblock.entries[i].fileindex;
+				if (!fileblock_intact(header, &fblock))
+				{
+					err = SIFS_EBADCRC;
+					break;
+				}
+				if (fileindex >= SIFS_MAX_ENTRIES || !safe_name(fblock.filenames[fileindex]))
+				{
+					err = SIFS_ENOTVOL;
+					break;
+				}
+				char* path = join_path(current.path, fblock.filenames[fileindex]);
+				if (!path)
+				{
+					err = SIFS_ENOMEM;
+					break;
+				}
+
+				// Grow the list of exported files
+				if (*nentries == capacity)
+				{
+					capacity = capacity ? capacity * 2 : 64;
+					EXPORT_ENTRY* grown = realloc(*entries, sizeof(EXPORT_ENTRY) * capacity);
+					if (!grown)
+					{
+						free(path);
+						err = SIFS_ENOMEM;
+						break;
+					}
+					*entries = grown;
+				}
+				EXPORT_ENTRY* entry = &(*entries)[(*nentries)++];
+				entry->fileID = id;
+				entry->firstblockID = fblock.firstblockID;
+				entry->length = fblock.length;
+				entry->path = path;
+			}
+			// directory points to an invalid block. Volume is corrupted
+			else
+			{
+				err = SIFS_ENOTVOL;
+			}
+		}
+		free(current.path);
+
+		if (err != SIFS_EOK)
+			break;
+	}
+
+	// Deallocate directories that were never visited
+	for (uint32_t i = 0; i < ndirs; i++)
+	{
+		free(dirs[i].path);
+	}
+	free(dirs);
+	return err;
+}
+
+// export every directory and file of an existing volume to a host directory
+static int export_volume(const char* volumename, const char* hostdir)
+{
+	// Check arguments
+	if (volumename == NULL || hostdir == NULL || *volumename == '\0' || *hostdir == '\0')
+	{
+		SIFS_errno = SIFS_EINVAL;
+		return 1;
+	}
+
+	// Open volume, reading and validating its header and bitmap
+	SIFS_VOLUME_HEADER header;
+	SIFS_BIT* bitmap;
+	SIFS_BLOCKID rootID;
+	FILE* vol = open_snapshot(volumename, &header, &bitmap, &rootID);
+	if (!vol)
+		return 1;
+
+	// Create the host directory that the root directory is exported to
+	if (mkdir(hostdir, 0777) != 0 && errno != EEXIST)
+	{
+		SIFS_errno = SIFS_EIO;
+		free(bitmap);
+		close_volume(vol);
+		return 1;
+	}
+
+	EXPORT_ENTRY* entries;
+	uint32_t nentries;
+	int err = collect_entries(header, bitmap, vol, rootID, hostdir, &entries, &nentries);
+
+	// Read each file's contents once, in the order it is stored on the volume
+	if (nentries > 0)
+		qsort(entries, nentries, sizeof(EXPORT_ENTRY), compare_entries);
+
+	void* data = NULL;
+	size_t capacity = 0;
+	for (uint32_t first = 0; first < nentries && err == SIFS_EOK; /*blank*/)
+	{
+		EXPORT_ENTRY* entry = &entries[first];
+		if (entry->length > capacity)
+		{
+			void* grown = realloc(data, entry->length);
+			if (!grown)
+			{
+				err = SIFS_ENOMEM;
+				break;
+			}
+			data = grown;
+			capacity = entry->length;
+		}
+
+		SIFS_FILEBLOCK fblock = get_fileblock(header, vol, entry->fileID);
+		if (!fileblock_intact(header, &fblock))
+		{
+			err = SIFS_EBADCRC;
+			break;
+		}
+		if (!read_filedata(header, vol, &fblock, data) || !write_hostfile(entry->path, data, entry->length))
+		{
+			err = SIFS_EIO;
+			break;
+		}
+
+		// Every other path with the same contents becomes a hard link, or a copy if linking fails
+		uint32_t last = first + 1;
+		for (/*blank*/; last < nentries && entries[last].fileID == entry->fileID; last++)
+		{
+			remove(entries[last].path);
+			if (link(entry->path, entries[last].path) != 0 &&
+				!write_hostfile(entries[last].path, data, entry->length))
+			{
+				err = SIFS_EIO;
+				break;
+			}
+		}
+		first = last;
+	}
+
+	if (err != SIFS_EOK)
+		SIFS_errno = err;
+
+	for (uint32_t i = 0; i < nentries; i++)
+	{
+		free(entries[i].path);
+	}
+	free(entries);
+	free(data);
+	free(bitmap);
+	close_volume(vol);
+	return err == SIFS_EOK ? 0 : 1;
+}
+
+// export every directory and file of an existing volume to a host directory
+int SIFS_export(const char* volumename, const char* hostdir)
+{
+	stats_begin(SIFS_OP_EXPORT);
+	int result = export_volume(volumename, hostdir);
+	stats_end();
+	return result;
+}
@@ -1,7 +1,7 @@
 #include "sifsutils.h"
 
 // get information about a requested file
-int SIFS_fileinfo(const char *volumename, const char *pathname,
+static int file_info(const char *volumename, const char *pathname,
 		  size_t *length, time_t *modtime)
 {
 	// Check arguments
@@ -12,33 +12,13 @@ int SIFS_fileinfo(const char *volumename, const char *pathname,
 		return 1;
 	}
 
-	// Try to open volume
-	FILE* vol = fopen(volumename, "r");
-	if (!vol)
-	{
-		SIFS_errno = SIFS_ENOVOL;
-		return 1;
-	}
-
-	// Read and validate header
-	SIFS_VOLUME_HEADER header = get_volumeheader(vol);
-	if (header.blocksize < SIFS_MIN_BLOCKSIZE || header.nblocks == 0)
-	{
-		SIFS_errno = SIFS_ENOTVOL;
-		fclose(vol);
-		return 1;
-	}
-
-	// Read and validate bitmap
+	// Open volume, reading and validating its header and bitmap
+	SIFS_VOLUME_HEADER header;
 	SIFS_BIT* bitmap;
-	get_volumebitmap(vol, &bitmap);
-	if (!validate_bitmap(bitmap, header.nblocks))
-	{
-		SIFS_errno = SIFS_ENOTVOL;
-		free(bitmap);
-		fclose(vol);
+	SIFS_BLOCKID rootID;
+	FILE* vol = open_snapshot(volumename, &header, &bitmap, &rootID);
+	if (!vol)
 		return 1;
-	}
 
 	// Split pathname
 	char* pdirpath, * name;
@@ -46,14 +26,14 @@ int SIFS_fileinfo(const char *volumename, const char *pathname,
 	{
 		SIFS_errno = SIFS_ENOMEM;
 		free(bitmap);
-		fclose(vol);
+		close_volume(vol);
 		return 1;
 	}
 
 	int err = SIFS_EOK;
 	// If dirpath is NULL we are working in the root directory
-	SIFS_BLOCKID dir = pdirpath == NULL ? SIFS_ROOTDIR_BLOCKID :
-		find_dir(header, bitmap, vol, SIFS_ROOTDIR_BLOCKID, pdirpath, &err);
+	SIFS_BLOCKID dir = pdirpath == NULL ? rootID :
+		find_dir(header, bitmap, vol, rootID, pdirpath, &err);
 	if (err != SIFS_EOK)
 	{
 		SIFS_errno = err;
@@ -61,7 +41,7 @@ int SIFS_fileinfo(const char *volumename, const char *pathname,
 		if (pdirpath)
 			free(pdirpath);
 		free(name);
-		fclose(vol);
+		close_volume(vol);
 		return 1;
 	}
 	
@@ -73,11 +53,21 @@ int SIFS_fileinfo(const char *volumename, const char *pathname,
 		if (pdirpath)
 			free(pdirpath);
 		free(name);
-		fclose(vol);
+		close_volume(vol);
 		return 1;
 	}
 
 	SIFS_FILEBLOCK fblock = get_fileblock(header, vol, fileID);
+	if (!fileblock_intact(header, &fblock))
+	{
+		SIFS_errno = SIFS_EBADCRC;
+		free(bitmap);
+		if (pdirpath)
+			free(pdirpath);
+		free(name);
+		close_volume(vol);
+		return 1;
+	}
 
 	*length = fblock.length;
 	*modtime = fblock.modtime;
@@ -86,6 +76,16 @@ int SIFS_fileinfo(const char *volumename, const char *pathname,
 	if (pdirpath)
 		free(pdirpath);
 	free(name);
-	fclose(vol);
+	close_volume(vol);
 	return 0;
 }
+
+// get information about a requested file
+int SIFS_fileinfo(const char *volumename, const char *pathname,
+		  size_t *length, time_t *modtime)
+{
+	stats_begin(SIFS_OP_FILEINFO);
+	int result = file_info(volumename, pathname, length, modtime);
+	stats_end();
+	return result;
+}
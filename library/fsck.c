@@ -0,0 +1,608 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <pthread.h>
+#include <unistd.h>
+#include "sifsutils.h"
+
+// Number of file blocks a worker takes from the pool at a time
+#define FSCK_BATCH	64
+
+// Largest number of worker threads
+#define FSCK_MAXTHREADS	64
+
+// What the checker knows of one file block
+typedef struct {
+	SIFS_BLOCKID	fileID;
+	SIFS_BLOCKID	firstblockID;
+	uint32_t	nblocks;	// data blocks holding its contents
+	uint32_t	nfiles;
+	bool		extentok;	// data lies inside the volume
+	bool		md5ok;		// data matches the file block's MD5
+	bool		crcok;		// file block matches its checksum
+	bool		chunk;		// a chunk block, reached through chunk lists
+	bool		chunked;	// data blocks hold a chunk list
+} FSCK_FILE;
+
+// Work shared by every worker. Files are handed out in block order so the volume is read front to back
+typedef struct {
+	SIFS_VOLUME_HEADER	header;
+	int			fd;
+	FSCK_FILE*		files;
+	uint32_t		nfiles;
+	uint32_t		next;		// next file to hand out
+	bool			failed;		// a worker could not allocate memory
+	SIFS_STATS		io;		// counters summed over every worker
+	pthread_mutex_t		lock;
+} FSCK_POOL;
+
+// Reads exactly nbytes at offset of fd into buf. Returns true if action was successful
+static bool pread_full(int fd, void* buf, size_t nbytes, long offset)
+{
+	char* p = buf;
+	while (nbytes > 0)
+	{
+		ssize_t n = pread(fd, p, nbytes, offset);
+		if (n <= 0)
+			return false;
+		p += n;
+		offset += n;
+		nbytes -= n;
+	}
+	return true;
+}
+
+// Reads the contents of fblock into data. Sets nomem if memory ran out. Returns true if action was successful
+static bool pread_filedata(FSCK_POOL* pool, const SIFS_FILEBLOCK* fblock, char* data, SIFS_STATS* io, bool* nomem)
+{
+	SIFS_VOLUME_HEADER header = pool->header;
+
+	// Compressed contents are read aside and expanded into data
+	size_t nstored = stored_length(header, fblock);
+	char* stored = is_compressed(header, fblock) ? malloc(nstored) : data;
+	if (!stored)
+	{
+		*nomem = true;
+		return false;
+	}
+
+	bool readok = pread_full(pool->fd, stored, nstored, data_offset(header, fblock)) &&
+		unpack_filedata(header, fblock, stored, data);
+	io->nreads++;
+	io->bytesread += nstored;
+	if (stored != data)
+		free(stored);
+	return readok;
+}
+
+// Reads the contents of the chunked file fblock into data by joining its chunks. Sets nomem if memory ran out.
+// Returns true if action was successful
+static bool pread_chunks(FSCK_POOL* pool, const SIFS_FILEBLOCK* fblock, char* data, SIFS_STATS* io, bool* nomem)
+{
+	SIFS_VOLUME_HEADER header = pool->header;
+	size_t nbytes = stored_length(header, fblock);
+	SIFS_BLOCKID* list = malloc(nbytes ? nbytes : 1);
+	if (!list)
+	{
+		*nomem = true;
+		return false;
+	}
+
+	bool readok = pread_full(pool->fd, list, nbytes, data_offset(header, fblock));
+	io->nreads++;
+	io->bytesread += nbytes;
+
+	size_t offset = 0;
+	for (uint32_t i = 0; i < fblock->nchunks && readok; i++)
+	{
+		SIFS_FILEBLOCK chunk;
+		readok = list[i] < header.nblocks &&
+			pread_full(pool->fd, &chunk, sizeof(SIFS_FILEBLOCK), block_offset(header, list[i]));
+		io->nreads++;
+		io->bytesread += sizeof(SIFS_FILEBLOCK);
+		io->fileblocks++;
+
+		readok = readok && is_chunk(header, &chunk) && chunk.length <= fblock->length - offset &&
+			pread_filedata(pool, &chunk, data + offset, io, nomem);
+		if (readok)
+			offset += chunk.length;
+	}
+	free(list);
+	return readok && offset == fblock->length;
+}
+
+// Reads a file block and hashes its data. Counters are kept in io, which belongs to the calling worker
+static bool check_file(FSCK_POOL* pool, FSCK_FILE* file, char** data, size_t* capacity, SIFS_STATS* io)
+{
+	SIFS_VOLUME_HEADER header = pool->header;
+	SIFS_FILEBLOCK fblock;
+	memset(&fblock, 0, sizeof(SIFS_FILEBLOCK));
+	pread_full(pool->fd, &fblock, sizeof(SIFS_FILEBLOCK), block_offset(header, file->fileID));
+	io->nreads++;
+	io->bytesread += sizeof(SIFS_FILEBLOCK);
+	io->fileblocks++;
+
+	file->firstblockID = fblock.firstblockID;
+	file->nblocks = data_blocks(header, &fblock);
+	file->nfiles = fblock.nfiles;
+	file->chunk = is_chunk(header, &fblock);
+	file->chunked = is_chunked(header, &fblock);
+	file->crcok = fileblock_intact(header, &fblock);
+
+	file->extentok = fblock.firstblockID < header.nblocks && file->nblocks <= header.nblocks - fblock.firstblockID;
+	if (is_inline(header, &fblock))
+		file->extentok = fblock.firstblockID == file->fileID && stored_length(header, &fblock) <= inline_capacity(header);
+	if (!file->extentok)
+		return true;
+
+	if (fblock.length > *capacity)
+	{
+		char* grown = realloc(*data, fblock.length);
+		if (!grown)
+			return false;
+		*data = grown;
+		*capacity = fblock.length;
+	}
+
+	bool nomem = false;
+	unsigned char md5_digest[MD5_BYTELEN];
+	bool readok = file->chunked ? pread_chunks(pool, &fblock, *data, io, &nomem) :
+		pread_filedata(pool, &fblock, *data, io, &nomem);
+	if (nomem)
+		return false;
+	if (readok)
+	{
+		MD5_buffer(*data, fblock.length, md5_digest);
+		io->md5bytes += fblock.length;
+	}
+	file->md5ok = readok && memcmp(md5_digest, fblock.md5, MD5_BYTELEN) == 0;
+	return true;
+}
+
+// Body of each worker thread
+static void* fsck_worker(void* arg)
+{
+	FSCK_POOL* pool = arg;
+	SIFS_STATS io;
+	memset(&io, 0, sizeof(SIFS_STATS));
+	char* data = NULL;
+	size_t capacity = 0;
+	bool failed = false;
+
+	while (!failed)
+	{
+		pthread_mutex_lock(&pool->lock);
+		uint32_t first = pool->next;
+		pool->next = pool->nfiles - first < FSCK_BATCH ? pool->nfiles : first + FSCK_BATCH;
+		uint32_t last = pool->next;
+		pthread_mutex_unlock(&pool->lock);
+
+		if (first == last)
+			break;
+		for (uint32_t i = first; i < last && !failed; i++)
+		{
+			failed = !check_file(pool, &pool->files[i], &data, &capacity, &io);
+		}
+	}
+	free(data);
+
+	pthread_mutex_lock(&pool->lock);
+	pool->failed = pool->failed || failed;
+	pool->io.nreads += io.nreads;
+	pool->io.bytesread += io.bytesread;
+	pool->io.fileblocks += io.fileblocks;
+	pool->io.md5bytes += io.md5bytes;
+	pthread_mutex_unlock(&pool->lock);
+	return NULL;
+}
+
+// Reads and hashes every file with nthreads workers. Returns SIFS_EOK if action was successful
+static int check_files(FSCK_POOL* pool, int nthreads)
+{
+	pthread_t threads[FSCK_MAXTHREADS];
+	int nstarted = 0;
+
+	pthread_mutex_init(&pool->lock, NULL);
+	for (/*blank*/; nstarted < nthreads; nstarted++)
+	{
+		if (pthread_create(&threads[nstarted], NULL, fsck_worker, pool) != 0)
+			break;
+	}
+	// With no threads at all the caller does the work itself
+	if (nstarted == 0)
+		fsck_worker(pool);
+	for (int i = 0; i < nstarted; i++)
+	{
+		pthread_join(threads[i], NULL);
+	}
+	pthread_mutex_destroy(&pool->lock);
+
+	STAT_ADD(nreads, pool->io.nreads);
+	STAT_ADD(bytesread, pool->io.bytesread);
+	STAT_ADD(fileblocks, pool->io.fileblocks);
+	STAT_ADD(md5bytes, pool->io.md5bytes);
+	return pool->failed ? SIFS_ENOMEM : SIFS_EOK;
+}
+
+// A directory entry naming a file name that another entry names too
+typedef struct {
+	SIFS_BLOCKID	dirID;
+	SIFS_BLOCKID	fileID;
+	uint32_t	fileindex;
+} FSCK_STALE;
+
+// Of two directories holding the same file name, returns the one whose entry is stale. SIFS_rename writes the
+// new parent before the old one, so the entry left in the directory changed longer ago goes
+static SIFS_BLOCKID stale_dir(SIFS_VOLUME_HEADER header, FILE* vol, SIFS_BLOCKID earlier, const SIFS_DIRBLOCK* later,
+	SIFS_BLOCKID laterID)
+{
+	SIFS_DIRBLOCK dblock = get_dirblock(header, vol, earlier);
+	return dblock.modtime < later->modtime ? earlier : laterID;
+}
+
+// Removes every stale entry from its directory, unless the directory fails its checksum
+static void drop_stale(SIFS_VOLUME_HEADER header, FILE* vol, const FSCK_STALE* stale, uint32_t nstale,
+	SIFS_FSCK_REPORT* report)
+{
+	for (uint32_t s = 0; s < nstale; s++)
+	{
+		SIFS_DIRBLOCK dblock = get_dirblock(header, vol, stale[s].dirID);
+		if (!dirblock_intact(header, &dblock))
+			continue;
+		for (uint32_t i = 0; i < dblock.nentries && i < SIFS_MAX_ENTRIES; i++)
+		{
+			if (dblock.entries[i].blockID != stale[s].fileID || dblock.entries[i].fileindex != stale[s].fileindex)
+				continue;
+			for (uint32_t j = i; j < dblock.nentries - 1; j++)
+			{
+				dblock.entries[j] = dblock.entries[j + 1];
+			}
+			dblock.nentries--;
+			put_dirblock(header, vol, stale[s].dirID, &dblock);
+			report->dropped++;
+			break;
+		}
+	}
+}
+
+// Walks the directory tree from the root, marking every directory and file it reaches.
+// On volumes with snapshots the tree of every snapshot is walked too, from the snapshot table.
+// Without snapshots each file name has one entry. Of two, the stale one is counted, and dropped if repair is set
+static int walk_tree(SIFS_VOLUME_HEADER header, const SIFS_BIT* bitmap, FILE* vol, const uint32_t* fileindex,
+	const FSCK_FILE* files, uint32_t nfiles, unsigned char* reached, bool repair, SIFS_FSCK_REPORT* report)
+{
+	bool snapshots = header.flags & SIFS_FORMAT_SNAPSHOT;
+	uint32_t ndirs = 0, capacity = 64, nstale = 0, stalecapacity = 0;
+	SIFS_BLOCKID* dirs = malloc(sizeof(SIFS_BLOCKID) * capacity);
+	SIFS_BLOCKID* namedby = snapshots ? NULL : malloc(sizeof(SIFS_BLOCKID) * SIFS_MAX_ENTRIES * (nfiles ? nfiles : 1));
+	FSCK_STALE* stale = NULL;
+	if (!dirs || (!snapshots && !namedby))
+	{
+		free(dirs);
+		free(namedby);
+		return SIFS_ENOMEM;
+	}
+	for (uint32_t i = 0; namedby && i < SIFS_MAX_ENTRIES * nfiles; i++)
+	{
+		namedby[i] = header.nblocks;
+	}
+
+	dirs[ndirs++] = SIFS_ROOTDIR_BLOCKID;
+	reached[SIFS_ROOTDIR_BLOCKID] = true;
+	if (snapshots)
+	{
+		dirs[ndirs++] = SIFS_SNAPSHOT_BLOCKID;
+		reached[SIFS_SNAPSHOT_BLOCKID] = true;
+	}
+	int err = SIFS_EOK;
+	while (ndirs > 0 && err == SIFS_EOK)
+	{
+		SIFS_BLOCKID dirID = dirs[--ndirs];
+		SIFS_DIRBLOCK dblock = get_dirblock(header, vol, dirID);
+		if (!dirblock_intact(header, &dblock))
+			report->badcrc++;
+		if (dblock.nentries > SIFS_MAX_ENTRIES)
+		{
+			report->badentries += dblock.nentries - SIFS_MAX_ENTRIES;
+			dblock.nentries = SIFS_MAX_ENTRIES;
+		}
+
+		for (uint32_t i = 0; i < dblock.nentries; i++)
+		{
+			SIFS_BLOCKID id = dblock.entries[i].blockID;
+			if (id >= header.nblocks)
+			{
+				report->badentries++;
+			}
+			else if (bitmap[id] == SIFS_DIR)
+			{
+				// A directory reached twice has two parents, or is its own ancestor. Snapshots share directories
+				if (reached[id])
+				{
+					if (!snapshots)
+						report->badentries++;
+					continue;
+				}
+				reached[id] = true;
+
+				if (ndirs == capacity)
+				{
+					SIFS_BLOCKID* grown = realloc(dirs, sizeof(SIFS_BLOCKID) * capacity * 2);
+					if (!grown)
+					{
+						err = SIFS_ENOMEM;
+						break;
+					}
+					dirs = grown;
+					capacity *= 2;
+				}
+				dirs[ndirs++] = id;
+			}
+			else if (bitmap[id] == SIFS_FILE && files[fileindex[id]].chunk)
+			{
+				report->badentries++;
+			}
+			else if (bitmap[id] == SIFS_FILE)
+			{
+				reached[id] = true;
+				uint32_t index = dblock.entries[i].fileindex;
+				if (index >= files[fileindex[id]].nfiles || index >= SIFS_MAX_ENTRIES)
+				{
+					report->badindex++;
+					continue;
+				}
+				if (!namedby)
+					continue;
+
+				// A crash while a file moved between directories leaves its entry in both
+				SIFS_BLOCKID* first = &namedby[fileindex[id] * SIFS_MAX_ENTRIES + index];
+				if (*first == header.nblocks)
+				{
+					*first = dirID;
+					continue;
+				}
+				report->duplicates++;
+				if (!repair)
+					continue;
+				if (nstale == stalecapacity)
+				{
+					stalecapacity = stalecapacity ? stalecapacity * 2 : 16;
+					FSCK_STALE* grown = realloc(stale, sizeof(FSCK_STALE) * stalecapacity);
+					if (!grown)
+					{
+						err = SIFS_ENOMEM;
+						break;
+					}
+					stale = grown;
+				}
+				SIFS_BLOCKID staleID = *first == dirID ? dirID : stale_dir(header, vol, *first, &dblock, dirID);
+				stale[nstale++] = (FSCK_STALE){ .dirID = staleID, .fileID = id, .fileindex = index };
+				if (staleID == *first)
+					*first = dirID;
+			}
+			else
+				report->badentries++;
+		}
+	}
+
+	if (err == SIFS_EOK)
+		drop_stale(header, vol, stale, nstale, report);
+	free(dirs);
+	free(namedby);
+	free(stale);
+	return err;
+}
+
+// Reaches every chunk that the chunk list of a reachable file points at, and checks that the reference count
+// of each chunk block matches the number of times it is pointed at. File blocks copied for snapshots share
+// the chunk list of the original, which is counted once
+static int walk_chunks(SIFS_VOLUME_HEADER header, const SIFS_BIT* bitmap, FILE* vol, const uint32_t* fileindex,
+	const FSCK_FILE* files, uint32_t nfiles, unsigned char* reached, SIFS_FSCK_REPORT* report)
+{
+	uint32_t* nrefs = calloc(header.nblocks, sizeof(uint32_t));
+	unsigned char* counted = header.flags & SIFS_FORMAT_SNAPSHOT ? calloc(header.nblocks, 1) : NULL;
+	if (!nrefs || ((header.flags & SIFS_FORMAT_SNAPSHOT) && !counted))
+	{
+		free(nrefs);
+		free(counted);
+		return SIFS_ENOMEM;
+	}
+
+	for (uint32_t i = 0; i < nfiles; i++)
+	{
+		if (!files[i].chunked || !files[i].extentok || !reached[files[i].fileID])
+			continue;
+		if (counted && counted[files[i].firstblockID]++)
+			continue;
+
+		SIFS_FILEBLOCK fblock = get_fileblock(header, vol, files[i].fileID);
+		SIFS_BLOCKID* list = get_chunklist(header, vol, &fblock);
+		if (!list)
+		{
+			free(nrefs);
+			free(counted);
+			return SIFS_ENOMEM;
+		}
+		for (uint32_t c = 0; c < fblock.nchunks; c++)
+		{
+			SIFS_BLOCKID id = list[c];
+			if (id >= header.nblocks || bitmap[id] != SIFS_FILE || !files[fileindex[id]].chunk)
+				report->badrefs++;
+			else
+				nrefs[id]++;
+		}
+		free(list);
+	}
+
+	for (uint32_t i = 0; i < nfiles; i++)
+	{
+		SIFS_BLOCKID id = files[i].fileID;
+		if (!files[i].chunk || nrefs[id] == 0)
+			continue;
+		reached[id] = true;
+		if (nrefs[id] != files[i].nfiles)
+			report->badrefs++;
+	}
+
+	free(nrefs);
+	free(counted);
+	return SIFS_EOK;
+}
+
+// check the consistency of an existing volume, and free orphaned blocks if asked to
+static int check_volume(const char* volumename, int nthreads, int flags, SIFS_FSCK_REPORT* report)
+{
+	// Check arguments
+	if (volumename == NULL || *volumename == '\0' || report == NULL || nthreads < 0 ||
+		(flags & ~SIFS_FSCK_REPAIR) != 0)
+	{
+		SIFS_errno = SIFS_EINVAL;
+		return 1;
+	}
+	if (nthreads == 0)
+		nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+	if (nthreads < 1)
+		nthreads = 1;
+	if (nthreads > FSCK_MAXTHREADS)
+		nthreads = FSCK_MAXTHREADS;
+
+	// Open volume, reading and validating its header and bitmap
+	SIFS_VOLUME_HEADER header;
+	SIFS_BIT* bitmap;
+	FILE* vol = open_volume(volumename, (flags & SIFS_FSCK_REPAIR) ? "r+" : "r", &header, &bitmap);
+	if (!vol)
+		return 1;
+	memset(report, 0, sizeof(SIFS_FSCK_REPORT));
+
+	// Number the file blocks in the order they are stored
+	uint32_t* fileindex = malloc(sizeof(uint32_t) * header.nblocks);
+	unsigned char* reached = calloc(header.nblocks, 1);
+	FSCK_POOL pool = { .header = header, .fd = fileno(vol) };
+	if (fileindex && reached)
+	{
+		STAT_ADD(bitmapscans, 1);
+		for (SIFS_BLOCKID id = 0; id < header.nblocks; id++)
+		{
+			if (bitmap[id] == SIFS_FILE)
+				fileindex[id] = pool.nfiles++;
+			if (bitmap[id] != SIFS_UNUSED)
+				report->used++;
+		}
+		pool.files = calloc(pool.nfiles ? pool.nfiles : 1, sizeof(FSCK_FILE));
+	}
+	if (!fileindex || !reached || !pool.files)
+	{
+		SIFS_errno = SIFS_ENOMEM;
+		free(fileindex);
+		free(reached);
+		free(bitmap);
+		close_volume(vol);
+		return 1;
+	}
+	for (SIFS_BLOCKID id = 0; id < header.nblocks; id++)
+	{
+		if (bitmap[id] == SIFS_FILE)
+			pool.files[fileindex[id]].fileID = id;
+	}
+	report->files = pool.nfiles;
+
+	// Hash every file in parallel, then check the structure of the volume on one thread
+	phase_begin(SIFS_PHASE_HASH);
+	int err = check_files(&pool, nthreads);
+	phase_end(SIFS_PHASE_HASH);
+
+	if (err == SIFS_EOK)
+	{
+		phase_begin(SIFS_PHASE_PATH);
+		err = walk_tree(header, bitmap, vol, fileindex, pool.files, pool.nfiles, reached, flags & SIFS_FSCK_REPAIR,
+			report);
+		if (err == SIFS_EOK)
+			err = walk_chunks(header, bitmap, vol, fileindex, pool.files, pool.nfiles, reached, report);
+		phase_end(SIFS_PHASE_PATH);
+	}
+
+	// On volumes with snapshots, file blocks copied from the same original share its data
+	SIFS_BLOCKID* claimed = NULL;
+	if (err == SIFS_EOK && (header.flags & SIFS_FORMAT_SNAPSHOT))
+	{
+		claimed = malloc(sizeof(SIFS_BLOCKID) * header.nblocks);
+		if (!claimed)
+			err = SIFS_ENOMEM;
+	}
+
+	if (err == SIFS_EOK)
+	{
+		// The data of every reachable file must be data blocks that no other file claims
+		for (uint32_t i = 0; i < pool.nfiles; i++)
+		{
+			FSCK_FILE* file = &pool.files[i];
+			if (!reached[file->fileID])
+				continue;
+			if (!file->crcok)
+				report->badcrc++;
+			if (!file->extentok)
+			{
+				report->overlaps++;
+				continue;
+			}
+			if (!file->md5ok)
+				report->badmd5++;
+
+			SIFS_BLOCKID end = file->firstblockID + file->nblocks;
+			for (SIFS_BLOCKID id = file->firstblockID; id < end; id++)
+			{
+				if (bitmap[id] != SIFS_DATABLOCK || (reached[id] && !(claimed && claimed[id] == file->firstblockID)))
+					report->overlaps++;
+				reached[id] = true;
+				if (claimed)
+					claimed[id] = file->firstblockID;
+			}
+		}
+
+		// Whatever is in use but was never reached is orphaned
+		SIFS_BIT* before = flags & SIFS_FSCK_REPAIR ? punch_begin(header, bitmap) : NULL;
+		STAT_ADD(bitmapscans, 1);
+		uint64_t freerun = 0;
+		for (SIFS_BLOCKID id = 0; id < header.nblocks; id++)
+		{
+			if (bitmap[id] != SIFS_UNUSED && !reached[id])
+			{
+				report->unreachable++;
+				if (flags & SIFS_FSCK_REPAIR)
+				{
+					bitmap[id] = SIFS_UNUSED;
+					report->repaired++;
+				}
+			}
+			freerun = bitmap[id] == SIFS_UNUSED ? freerun + 1 : 0;
+			if (freerun > report->largestfree)
+				report->largestfree = freerun;
+		}
+		if (report->repaired > 0)
+			put_volumebitmap(header, vol, bitmap);
+		punch_end(header, vol, before, bitmap);
+	}
+
+	if (err != SIFS_EOK)
+		SIFS_errno = err;
+
+	free(claimed);
+	free(pool.files);
+	free(fileindex);
+	free(reached);
+	free(bitmap);
+	if (close_volume(vol) != 0 && err == SIFS_EOK)
+	{
+		err = SIFS_EIO;
+		SIFS_errno = err;
+	}
+	return err == SIFS_EOK ? 0 : 1;
+}
+
+// check the consistency of an existing volume, and free orphaned blocks if asked to
+int SIFS_fsck(const char* volumename, int nthreads, int flags, SIFS_FSCK_REPORT* report)
+{
+	stats_begin(SIFS_OP_FSCK);
+	int result = check_volume(volumename, nthreads, flags, report);
+	stats_end();
+	return result;
+}
@@ -0,0 +1,74 @@
+#include "sifsutils.h"
+
+// add blocks to the end of an existing volume
+static int grow_volume(const char *volumename, uint32_t nblocks)
+{
+	// Check arguments
+	if (volumename == NULL || *volumename == '\0' || nblocks == 0)
+	{
+		SIFS_errno = SIFS_EINVAL;
+		return 1;
+	}
+
+	// Open volume, reading and validating its header and bitmap
+	SIFS_VOLUME_HEADER header;
+	SIFS_BIT* bitmap;
+	FILE* vol = open_volume(volumename, "r+", &header, &bitmap);
+	if (!vol)
+		return 1;
+
+	// The volume can only grow
+	if (nblocks < header.nblocks)
+	{
+		SIFS_errno = SIFS_EINVAL;
+		free(bitmap);
+		close_volume(vol);
+		return 1;
+	}
+	if (nblocks == header.nblocks)
+	{
+		free(bitmap);
+		close_volume(vol);
+		return 0;
+	}
+
+	// A version 1 bitmap sits in front of block 0, so every block in use would have to move, and a crash
+	// part way through would corrupt the volume. Such volumes are refused; make them again to resize them
+	if (header.version < 2)
+	{
+		SIFS_errno = SIFS_EINVAL;
+		free(bitmap);
+		close_volume(vol);
+		return 1;
+	}
+
+	SIFS_BIT* grownbitmap = realloc(bitmap, nblocks);
+	if (!grownbitmap)
+	{
+		SIFS_errno = SIFS_ENOMEM;
+		free(bitmap);
+		close_volume(vol);
+		return 1;
+	}
+	bitmap = grownbitmap;
+	memset(bitmap + header.nblocks, SIFS_UNUSED, nblocks - header.nblocks);
+
+	// Only the bitmap moves, so growing takes time in proportion to the bitmap
+	bool success = relocate_bitmap(vol, &header, nblocks, bitmap);
+	free(bitmap);
+	if (close_volume(vol) != 0 || !success)
+	{
+		SIFS_errno = SIFS_EIO;
+		return 1;
+	}
+	return 0;
+}
+
+// add blocks to the end of an existing volume
+int SIFS_growvolume(const char *volumename, uint32_t nblocks)
+{
+	stats_begin(SIFS_OP_GROWVOLUME);
+	int result = grow_volume(volumename, nblocks);
+	stats_end();
+	return result;
+}
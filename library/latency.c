@@ -0,0 +1,226 @@
+#define _POSIX_C_SOURCE 199309L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <time.h>
+
+#include "../sifs.h"
+#include "sifsstats.h"
+
+//  LATENCY HISTOGRAMS FOR EACH OPERATION AND EACH PHASE WITHIN AN OPERATION.
+//  VALUES ARE RECORDED IN NANOSECONDS INTO LOG-LINEAR BUCKETS: EACH POWER OF TWO
+//  IS SPLIT INTO HIST_HALFCOUNT EQUAL SUB-BUCKETS, GIVING ~3% RELATIVE PRECISION.
+
+#define HIST_SUBBITS	5
+#define HIST_SUBCOUNT	(1 << HIST_SUBBITS)
+#define HIST_HALFCOUNT	(HIST_SUBCOUNT / 2)
+#define HIST_MAXBIT	47				// values above ~39 hours are clamped
+#define HIST_NBUCKETS	((HIST_MAXBIT - HIST_SUBBITS + 3) * HIST_HALFCOUNT)
+
+typedef struct {
+	uint64_t	count;
+	uint64_t	max;
+	uint64_t	buckets[HIST_NBUCKETS];
+} HISTOGRAM;
+
+static HISTOGRAM	histograms[SIFS_NOPS][SIFS_NPHASES];
+
+static const char* phasenames[SIFS_NPHASES] = {
+	"total",		// SIFS_PHASE_TOTAL
+	"open",			// SIFS_PHASE_OPEN
+	"path",			// SIFS_PHASE_PATH
+	"hash",			// SIFS_PHASE_HASH
+	"alloc",		// SIFS_PHASE_ALLOC
+	"flush",		// SIFS_PHASE_FLUSH
+};
+
+// State of the call in progress
+static uint64_t		callstart;
+static uint64_t		phasestart[SIFS_NPHASES];
+static uint64_t		phasetotal[SIFS_NPHASES];
+static uint32_t		phasedepth[SIFS_NPHASES];
+static bool		phaseused[SIFS_NPHASES];
+
+static bool		reportregistered = false;
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// Returns the index of the bucket that value is counted in
+static uint32_t bucket_index(uint64_t value)
+{
+	if (value < HIST_SUBCOUNT)
+		return value;
+
+	int msb = 63;
+	while (!(value >> msb))
+		msb--;
+	if (msb > HIST_MAXBIT)
+		return HIST_NBUCKETS - 1;
+
+	int shift = msb - (HIST_SUBBITS - 1);
+	return (shift + 1) * HIST_HALFCOUNT + (uint32_t)((value >> shift) - HIST_HALFCOUNT);
+}
+
+// Returns the largest value counted in bucket index
+static uint64_t bucket_highest(uint32_t index)
+{
+	if (index < HIST_SUBCOUNT)
+		return index;
+
+	int shift = index / HIST_HALFCOUNT - 1;
+	uint64_t sub = index % HIST_HALFCOUNT + HIST_HALFCOUNT;
+	return ((sub + 1) << shift) - 1;
+}
+
+static void histogram_record(HISTOGRAM* h, uint64_t value)
+{
+	h->buckets[bucket_index(value)]++;
+	h->count++;
+	if (value > h->max)
+		h->max = value;
+}
+
+// Returns the value below which fraction q of the recorded values fall
+static uint64_t histogram_percentile(const HISTOGRAM* h, double q)
+{
+	if (h->count == 0)
+		return 0;
+
+	uint64_t rank = (uint64_t)(q * h->count + 0.5);
+	rank = rank < 1 ? 1 : rank;
+	uint64_t seen = 0;
+	for (uint32_t i = 0; i < HIST_NBUCKETS; i++)
+	{
+		seen += h->buckets[i];
+		if (seen >= rank)
+		{
+			uint64_t highest = bucket_highest(i);
+			return highest < h->max ? highest : h->max;
+		}
+	}
+	return h->max;
+}
+
+static void report_at_exit(void)
+{
+	SIFS_report_latency(getenv("SIFS_LATENCY_REPORT"));
+}
+
+// Marks the start of a call to any operation
+void latency_begin(void)
+{
+	// Reports are requested by naming a file (or "-" for stderr) in SIFS_LATENCY_REPORT
+	if (!reportregistered)
+	{
+		reportregistered = true;
+		if (getenv("SIFS_LATENCY_REPORT"))
+			atexit(report_at_exit);
+	}
+
+	memset(phasetotal, 0, sizeof(phasetotal));
+	memset(phasedepth, 0, sizeof(phasedepth));
+	memset(phaseused, 0, sizeof(phaseused));
+	callstart = now_ns();
+}
+
+// Marks the end of a call to operation op, recording its latency and that of each phase it entered
+void latency_end(int op)
+{
+	uint64_t end = now_ns();
+	histogram_record(&histograms[op][SIFS_PHASE_TOTAL], end - callstart);
+
+	for (int phase = 1; phase < SIFS_NPHASES; phase++)
+	{
+		// Phases left open by an early return end with the call
+		if (phasedepth[phase] > 0)
+			phasetotal[phase] += end - phasestart[phase];
+		if (phaseused[phase])
+			histogram_record(&histograms[op][phase], phasetotal[phase]);
+	}
+}
+
+// Marks the start of a phase within the operation in progress
+void phase_begin(int phase)
+{
+	if (phasedepth[phase]++ == 0)
+		phasestart[phase] = now_ns();
+	phaseused[phase] = true;
+}
+
+// Marks the end of a phase within the operation in progress
+void phase_end(int phase)
+{
+	if (phasedepth[phase] > 0 && --phasedepth[phase] == 0)
+		phasetotal[phase] += now_ns() - phasestart[phase];
+}
+
+// Clears every histogram
+void latency_reset(void)
+{
+	memset(histograms, 0, sizeof(histograms));
+}
+
+// get the latency percentiles of a type of operation, or of one phase of it
+int SIFS_get_latency(int op, int phase, SIFS_LATENCY *latency)
+{
+	if (op < 0 || op >= SIFS_NOPS || phase < 0 || phase >= SIFS_NPHASES || latency == NULL)
+	{
+		SIFS_errno = SIFS_EINVAL;
+		return 1;
+	}
+
+	const HISTOGRAM* h = &histograms[op][phase];
+	latency->count = h->count;
+	latency->p50_ns = histogram_percentile(h, 0.50);
+	latency->p99_ns = histogram_percentile(h, 0.99);
+	latency->p999_ns = histogram_percentile(h, 0.999);
+	latency->max_ns = h->max;
+	return 0;
+}
+
+// write the latency percentiles of every operation and phase as JSON to a host file
+int SIFS_report_latency(const char *filename)
+{
+	bool tostderr = filename == NULL || *filename == '\0' || strcmp(filename, "-") == 0;
+	FILE* out = tostderr ? stderr : fopen(filename, "w");
+	if (!out)
+	{
+		SIFS_errno = SIFS_EIO;
+		return 1;
+	}
+
+	fprintf(out, "{\"latency\": [");
+	bool first = true;
+	for (int op = 0; op < SIFS_NOPS; op++)
+	{
+		for (int phase = 0; phase < SIFS_NPHASES; phase++)
+		{
+			SIFS_LATENCY l;
+			SIFS_get_latency(op, phase, &l);
+			if (l.count == 0)
+				continue;
+
+			fprintf(out, "%s\n    {\"op\": \"%s\", \"phase\": \"%s\", \"count\": %llu, \"p50_ns\": %llu, "
+				"\"p99_ns\": %llu, \"p999_ns\": %llu, \"max_ns\": %llu}",
+				first ? "" : ",", SIFS_opnames[op], phasenames[phase], (unsigned long long)l.count,
+				(unsigned long long)l.p50_ns, (unsigned long long)l.p99_ns,
+				(unsigned long long)l.p999_ns, (unsigned long long)l.max_ns);
+			first = false;
+		}
+	}
+	fprintf(out, "\n]}\n");
+
+	if (!tostderr && fclose(out) != 0)
+	{
+		SIFS_errno = SIFS_EIO;
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,121 @@
+#include "sifsutils.h"
+
+// add a new name for the contents of an existing file, without reading or hashing them
+static int link_file(const char *volumename, const char *srcpathname, const char *dstpathname)
+{
+	// Check arguments
+	if (volumename == NULL || srcpathname == NULL || dstpathname == NULL || *volumename == '\0' ||
+		*srcpathname == '\0' || *dstpathname == '\0')
+	{
+		SIFS_errno = SIFS_EINVAL;
+		return 1;
+	}
+
+	// Open volume, reading and validating its header and bitmap
+	SIFS_VOLUME_HEADER header;
+	SIFS_BIT* bitmap;
+	FILE* vol = open_volume(volumename, "r+", &header, &bitmap);
+	if (!vol)
+		return 1;
+
+	// Split both paths into their directory paths and names
+	char* srcdirpath = NULL, * srcname = NULL, * dstdirpath = NULL, * dstname = NULL;
+	int err = SIFS_EOK;
+	if (!split_filepath(srcpathname, &srcdirpath, &srcname) || !split_filepath(dstpathname, &dstdirpath, &dstname))
+		err = SIFS_ENOMEM;
+
+	// Check if the new name is too long
+	if (err == SIFS_EOK && strlen(dstname) + 1 > SIFS_MAX_NAME_LENGTH)
+		err = SIFS_EINVAL;
+
+	// Find the source file. If a directory path is NULL we are working in the root directory
+	SIFS_BLOCKID srcdirID = SIFS_ROOTDIR_BLOCKID, dstdirID = SIFS_ROOTDIR_BLOCKID, fileID = SIFS_ROOTDIR_BLOCKID;
+	if (err == SIFS_EOK && srcdirpath)
+		srcdirID = find_dir(header, bitmap, vol, SIFS_ROOTDIR_BLOCKID, srcdirpath, &err);
+	if (err == SIFS_EOK)
+		fileID = find_file(header, bitmap, vol, srcdirID, srcname, &err);
+	if (err == SIFS_EOK && dstdirpath)
+		dstdirID = find_dir(header, bitmap, vol, SIFS_ROOTDIR_BLOCKID, dstdirpath, &err);
+
+	// The new name must be free, and both blocks must have room for another entry. A copy made for a snapshot
+	// holds no more names than the original, so nothing is copied for a link that cannot be made
+	SIFS_DIRBLOCK dblock;
+	SIFS_FILEBLOCK fblock;
+	if (err == SIFS_EOK)
+	{
+		dblock = get_dirblock(header, vol, dstdirID);
+		if (find_entry(header, bitmap, vol, &dblock, dstname, &err) != dblock.nentries && err == SIFS_EOK)
+			err = SIFS_EEXIST;
+	}
+	if (err == SIFS_EOK)
+	{
+		fblock = get_fileblock(header, vol, fileID);
+		if (dblock.nentries == SIFS_MAX_ENTRIES || fblock.nfiles == SIFS_MAX_ENTRIES)
+			err = SIFS_EMAXENTRY;
+	}
+
+	// Nothing is written if any block read failed its checksum
+	if (err == SIFS_EOK && !metadata_intact())
+		err = SIFS_EBADCRC;
+
+	// Blocks that a snapshot shares must not gain the name, so the live volume gets copies of its own. Copying
+	// the file repoints its entries, which may lie in the destination directory, so both blocks are read again
+	if (err == SIFS_EOK && (header.flags & SIFS_FORMAT_SNAPSHOT))
+	{
+		dstdirID = cow_dir(header, bitmap, vol, dstdirpath, &err);
+		if (err == SIFS_EOK && snapshot_shared(header, vol, fblock.generation))
+			fileID = cow_file(header, bitmap, vol, fileID, &err);
+		if (err == SIFS_EOK)
+		{
+			dblock = get_dirblock(header, vol, dstdirID);
+			fblock = get_fileblock(header, vol, fileID);
+		}
+	}
+
+	if (err != SIFS_EOK)
+	{
+		SIFS_errno = err;
+		free(bitmap);
+		free(srcdirpath);
+		free(srcname);
+		free(dstdirpath);
+		free(dstname);
+		close_volume(vol);
+		return 1;
+	}
+
+	// Add the name to the file block, as SIFS_writefile() does for contents it already holds
+	memset(fblock.filenames[fblock.nfiles], 0, SIFS_MAX_NAME_LENGTH);
+	strcpy(fblock.filenames[fblock.nfiles], dstname);
+	dblock.entries[dblock.nentries].blockID = fileID;
+	dblock.entries[dblock.nentries].fileindex = fblock.nfiles;
+	dblock.modtime = time(NULL);
+
+	dblock.nentries++;
+	fblock.nfiles++;
+
+	// Write fblock and dblock to volume
+	put_fileblock(header, vol, fileID, &fblock);
+	put_dirblock(header, vol, dstdirID, &dblock);
+
+	free(bitmap);
+	free(srcdirpath);
+	free(srcname);
+	free(dstdirpath);
+	free(dstname);
+	if (close_volume(vol) != 0)
+	{
+		SIFS_errno = SIFS_EIO;
+		return 1;
+	}
+	return 0;
+}
+
+// add a new name for the contents of an existing file, without reading or hashing them
+int SIFS_link(const char *volumename, const char *srcpathname, const char *dstpathname)
+{
+	stats_begin(SIFS_OP_LINK);
+	int result = link_file(volumename, srcpathname, dstpathname);
+	stats_end();
+	return result;
+}
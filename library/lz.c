@@ -0,0 +1,181 @@
+#include "lz.h"
+
+#include <string.h>
+#include <stdint.h>
+
+#define	LZ_MINMATCH	4		// shortest match worth encoding
+#define	LZ_LASTLITERALS	5		// the last bytes are always literals
+#define	LZ_MFLIMIT	12		// no match starts this close to the end
+#define	LZ_MAXOFFSET	65535
+#define	LZ_HASHBITS	12
+#define	LZ_RUNMASK	15		// a nibble of 15 is followed by more length bytes
+
+static uint32_t read32(const unsigned char *p)
+{
+    uint32_t	v;
+
+    memcpy(&v, p, sizeof v);
+    return v;
+}
+
+static uint32_t hash32(uint32_t v)
+{
+    return (v * 2654435761U) >> (32 - LZ_HASHBITS);
+}
+
+//  APPENDS THE BYTES THAT EXTEND A LENGTH PAST ITS NIBBLE
+static unsigned char *put_length(unsigned char *op, size_t len)
+{
+    for( ; len >= 255 ; len -= 255)
+	*op++	= 255;
+    *op++	= (unsigned char)len;
+    return op;
+}
+
+//  APPENDS ONE SEQUENCE OF LITERALS FOLLOWED BY A MATCH, OR ONLY LITERALS IF matchlen IS 0.
+//  RETURNS NULL IF IT WOULD NOT FIT BEFORE oend
+static unsigned char *put_sequence(unsigned char *op, unsigned char *oend,
+				   const unsigned char *literals, size_t litlen,
+				   size_t offset, size_t matchlen)
+{
+    size_t	needed	= 1 + litlen/255 + 1 + litlen + 2 + matchlen/255 + 1;
+
+    if((size_t)(oend - op) < needed)
+	return NULL;
+
+    unsigned char	*token	= op++;
+
+    if(litlen >= LZ_RUNMASK) {
+	*token	= LZ_RUNMASK << 4;
+	op	= put_length(op, litlen - LZ_RUNMASK);
+    }
+    else
+	*token	= (unsigned char)(litlen << 4);
+
+    memcpy(op, literals, litlen);
+    op	+= litlen;
+    if(matchlen == 0)
+	return op;
+
+    *op++	= (unsigned char)(offset & 0xff);
+    *op++	= (unsigned char)(offset >> 8);
+
+    size_t	ml	= matchlen - LZ_MINMATCH;
+
+    if(ml >= LZ_RUNMASK) {
+	*token	|= LZ_RUNMASK;
+	op	= put_length(op, ml - LZ_RUNMASK);
+    }
+    else
+	*token	|= (unsigned char)ml;
+    return op;
+}
+
+//  COMPRESS srclen BYTES OF src INTO AT MOST dstcap BYTES OF dst.
+//  RETURNS THE COMPRESSED LENGTH, OR 0 IF IT WOULD NOT FIT
+size_t LZ_compress(const char *src, size_t srclen, char *dst, size_t dstcap)
+{
+    const unsigned char	*base	= (const unsigned char *)src;
+    const unsigned char	*ip	= base;
+    const unsigned char	*anchor	= base;
+    const unsigned char	*iend	= base + srclen;
+    unsigned char	*op	= (unsigned char *)dst;
+    unsigned char	*oend	= op + dstcap;
+    uint32_t		table[1 << LZ_HASHBITS];
+
+    memset(table, 0, sizeof table);
+
+    if(srclen > LZ_MFLIMIT) {
+	const unsigned char	*mflimit	= iend - LZ_MFLIMIT;
+	const unsigned char	*matchlimit	= iend - LZ_LASTLITERALS;
+
+	while(ip < mflimit) {
+	    uint32_t		h	= hash32(read32(ip));
+	    const unsigned char	*match	= base + table[h];
+
+	    table[h]	= (uint32_t)(ip - base);
+	    if(match >= ip || ip - match > LZ_MAXOFFSET || read32(match) != read32(ip)) {
+		ip++;
+		continue;
+	    }
+
+//  EXTEND THE MATCH AS FAR AS IT GOES
+	    const unsigned char	*mp	= ip + LZ_MINMATCH;
+
+	    match	+= LZ_MINMATCH;
+	    while(mp < matchlimit && *mp == *match) {
+		mp++;
+		match++;
+	    }
+
+	    op	= put_sequence(op, oend, anchor, ip - anchor, mp - match, mp - ip);
+	    if(op == NULL)
+		return 0;
+	    ip	= anchor	= mp;
+	}
+    }
+
+    op	= put_sequence(op, oend, anchor, iend - anchor, 0, 0);
+    return op == NULL ? 0 : op - (unsigned char *)dst;
+}
+
+//  READS THE BYTES THAT EXTEND A LENGTH PAST ITS NIBBLE. RETURNS false IF src RUNS OUT
+static bool get_length(const unsigned char **ip, const unsigned char *iend, size_t *len)
+{
+    unsigned char	b;
+
+    do {
+	if(*ip >= iend)
+	    return false;
+	b	= *(*ip)++;
+	*len	+= b;
+    } while(b == 255);
+    return true;
+}
+
+//  DECOMPRESS srclen BYTES OF src INTO dst. RETURNS true ONLY IF EXACTLY dstlen BYTES WERE PRODUCED
+bool LZ_decompress(const char *src, size_t srclen, char *dst, size_t dstlen)
+{
+    const unsigned char	*ip	= (const unsigned char *)src;
+    const unsigned char	*iend	= ip + srclen;
+    unsigned char	*op	= (unsigned char *)dst;
+    unsigned char	*ostart	= op;
+    unsigned char	*oend	= op + dstlen;
+
+    while(ip < iend) {
+	unsigned char	token	= *ip++;
+	size_t		litlen	= token >> 4;
+
+	if(litlen == LZ_RUNMASK && !get_length(&ip, iend, &litlen))
+	    return false;
+	if(litlen > (size_t)(iend - ip) || litlen > (size_t)(oend - op))
+	    return false;
+	memcpy(op, ip, litlen);
+	ip	+= litlen;
+	op	+= litlen;
+
+//  THE LAST SEQUENCE HAS NO MATCH
+	if(ip == iend)
+	    break;
+
+	if(iend - ip < 2)
+	    return false;
+	size_t	offset	= ip[0] | (ip[1] << 8);
+	ip	+= 2;
+
+	size_t	matchlen	= token & LZ_RUNMASK;
+
+	if(matchlen == LZ_RUNMASK && !get_length(&ip, iend, &matchlen))
+	    return false;
+	matchlen	+= LZ_MINMATCH;
+	if(offset == 0 || offset > (size_t)(op - ostart) || matchlen > (size_t)(oend - op))
+	    return false;
+
+//  MATCHES MAY OVERLAP THE BYTES THEY PRODUCE, SO COPY ONE BYTE AT A TIME
+	const unsigned char	*match	= op - offset;
+
+	while(matchlen-- > 0)
+	    *op++	= *match++;
+    }
+    return op == oend;
+}
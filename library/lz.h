@@ -0,0 +1,15 @@
+//  AN LZ4-STYLE BLOCK COMPRESSOR: SEQUENCES OF LITERALS AND 16-BIT OFFSET MATCHES,
+//  FAVOURING SPEED OVER RATIO. NO STATE IS KEPT BETWEEN CALLS
+
+#include <stdlib.h>		// defines  size_t
+#include <stdbool.h>
+
+//  COMPRESS srclen BYTES OF src INTO AT MOST dstcap BYTES OF dst.
+//  RETURNS THE COMPRESSED LENGTH, OR 0 IF IT WOULD NOT FIT
+extern	size_t	LZ_compress(const char *src, size_t srclen, char *dst, size_t dstcap);
+
+//  NO COMPRESSED BYTE DECOMPRESSES TO MORE THAN THIS MANY BYTES
+#define	LZ_MAXRATIO	255
+
+//  DECOMPRESS srclen BYTES OF src INTO dst. RETURNS true ONLY IF EXACTLY dstlen BYTES WERE PRODUCED
+extern	bool	LZ_decompress(const char *src, size_t srclen, char *dst, size_t dstlen);
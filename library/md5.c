@@ -6,7 +6,6 @@
 
 #include <stdio.h>
 #include <string.h>
-#include <math.h>
 
 #include <unistd.h>
 #include <fcntl.h>
@@ -44,63 +43,66 @@ static uint32_t ROL(uint32_t v, int amt)
  
 //  --------------------------------------------------------------------------
 
-static void *MD5(const char *msg, size_t mlen) 
+typedef uint32_t Digest[4];
+
+//  THE SINE-DERIVED CONSTANTS OF RFC1321, k[i] = floor(|sin(i+1)| * 2^32)
+static const uint32_t k[64] = {
+    0xd76aa478, 0xe8c7b756, 0x242070db, 0xc1bdceee, 0xf57c0faf, 0x4787c62a, 0xa8304613, 0xfd469501,
+    0x698098d8, 0x8b44f7af, 0xffff5bb1, 0x895cd7be, 0x6b901122, 0xfd987193, 0xa679438e, 0x49b40821,
+    0xf61e2562, 0xc040b340, 0x265e5a51, 0xe9b6c7aa, 0xd62f105d, 0x02441453, 0xd8a1e681, 0xe7d3fbc8,
+    0x21e1cde6, 0xc33707d6, 0xf4d50d87, 0x455a14ed, 0xa9e3e905, 0xfcefa3f8, 0x676f02d9, 0x8d2a4c8a,
+    0xfffa3942, 0x8771f681, 0x6d9d6122, 0xfde5380c, 0xa4beea44, 0x4bdecfa9, 0xf6bb4b60, 0xbebfbc70,
+    0x289b7ec6, 0xeaa127fa, 0xd4ef3085, 0x04881d05, 0xd9d4d039, 0xe6db99e5, 0x1fa27cf8, 0xc4ac5665,
+    0xf4292244, 0x432aff97, 0xab9423a7, 0xfc93a039, 0x655b59c3, 0x8f0ccc92, 0xffeff47d, 0x85845dd1,
+    0x6fa87e4f, 0xfe2ce6e0, 0xa3014314, 0x4e0811a1, 0xf7537e82, 0xbd3af235, 0x2ad7d2bb, 0xeb86d391,
+};
+
+//  NO STATE IS KEPT BETWEEN CALLS, SO DIGESTS MAY BE CALCULATED BY MANY THREADS AT ONCE
+static void *MD5(const char *msg, size_t mlen, Digest result)
 {
-    typedef uint32_t Digest[4];
- 
-    static Digest result;
-    static Digest init	= { 0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476 };
+    static const Digest init	= { 0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476 };
 
     memcpy(result, init, sizeof(Digest));		// initialise
  
-    static DgstFctn funcs[]	= { &f0, &f1, &f2, &f3 };
-    static int16_t M[]		= { 1, 5, 3, 7 };
-    static int16_t O[]		= { 0, 1, 5, 0 };
-    static int16_t rot0[]	= { 7, 12, 17, 22 };
-    static int16_t rot1[]	= { 5, 9, 14, 20 };
-    static int16_t rot2[]	= { 4, 11, 16, 23 };
-    static int16_t rot3[]	= { 6, 10, 15, 21 };
-    static int16_t *rots[]	= { rot0, rot1, rot2, rot3 };
-    static uint32_t *k		= NULL;
- 
-    if(k == NULL) {
-	static uint32_t kspace[64];
-	k = kspace;
-
-	for(int i=0; i<64; i++) {
-	    double s = fabs(sin((double)(1+i)));
-
-#define	TWO32		4294967296UL
-	    k[i] = (uint32_t)(s * TWO32);
-#undef	TWO32
-	}
-    }
- 
-    int	ngroups	= (mlen+8)/64 + 1;
-    uint8_t msgcopy[64*ngroups];
-
-    memset(msgcopy, 0, sizeof(msgcopy));
-    memcpy(msgcopy, msg, mlen);
-    msgcopy[mlen] = (uint8_t)0x80;  
+    static const DgstFctn funcs[]	= { &f0, &f1, &f2, &f3 };
+    static const int16_t M[]		= { 1, 5, 3, 7 };
+    static const int16_t O[]		= { 0, 1, 5, 0 };
+    static const int16_t rot0[]		= { 7, 12, 17, 22 };
+    static const int16_t rot1[]		= { 5, 9, 14, 20 };
+    static const int16_t rot2[]		= { 4, 11, 16, 23 };
+    static const int16_t rot3[]		= { 6, 10, 15, 21 };
+    static const int16_t *rots[]	= { rot0, rot1, rot2, rot3 };
+
+//  WHOLE GROUPS ARE READ STRAIGHT FROM msg. ONLY THE LAST PARTIAL GROUP,
+//  THE PADDING AND THE LENGTH ARE COPIED, SO LARGE INPUTS NEVER GO ON THE STACK
+    size_t	ngroups	= (mlen+8)/64 + 1;
+    size_t	nwhole	= mlen/64;
+    uint8_t	tail[128];
+
+    memset(tail, 0, sizeof(tail));
+    memcpy(tail, msg + 64*nwhole, mlen - 64*nwhole);
+    tail[mlen - 64*nwhole] = (uint8_t)0x80;  
 
     uint32_t l = 8*mlen;
-    memcpy(msgcopy + (64*ngroups - 8), &l, 4);
+    memcpy(tail + (64*(ngroups - nwhole) - 8), &l, 4);
  
     union {
         uint32_t w[16];
         char     b[64];
     } mm;
  
-    int offset = 0;
-    for(int group=0 ; group<ngroups ; ++group, offset += 64) {
+    for(size_t group=0 ; group<ngroups ; ++group) {
 	Digest abcd;
 	memcpy(abcd, result, sizeof(Digest));
 
-        memcpy(mm.b, msgcopy+offset, 64);
+	if(group < nwhole)
+	    memcpy(mm.b, msg + 64*group, 64);
+	else
+	    memcpy(mm.b, tail + 64*(group - nwhole), 64);
 
         for(int p=0 ; p<4 ; p++) {
 	    DgstFctn fctn	= funcs[p];
-            int16_t *rotn	= rots[p];
+            const int16_t *rotn	= rots[p];
             int m		= M[p];
 	    int o		= O[p];
 
@@ -126,7 +128,9 @@ static void *MD5(const char *msg, size_t mlen)
 //  CALCULATE THE MD5 DIGEST OF input BUFFER, LEAVE RESULT IN md5_result
 void *MD5_buffer(const char *buffer, size_t len, void *md5_result)
 {
-    return memcpy(md5_result, MD5(buffer, len), MD5_BYTELEN);
+    Digest	result;
+
+    return memcpy(md5_result, MD5(buffer, len, result), MD5_BYTELEN);
 }
 
 //  RETURNS A 'HUMAN-READABLE' FORMATTED STRING OF AN MD5 DIGEST
@@ -146,6 +150,7 @@ char *MD5_format(const void *md5_result)
 //  RETURNS A 'HUMAN-READABLE' FORMATTED STRING OF DIGEST OF A FILE'S CONTENTS
 char *MD5_file(const char *filenm)
 {
+    static Digest	result;
     int	fd = open(filenm, O_RDONLY, 0);
 
     if(fd >= 0) {
@@ -156,18 +161,20 @@ char *MD5_file(const char *filenm)
 
 	    if(read(fd, bytes, sbuf.st_size) == sbuf.st_size) {
 		close(fd);
-		return MD5_format(MD5(bytes, sbuf.st_size));
+		return MD5_format(MD5(bytes, sbuf.st_size, result));
 	    }
 	}
 	close(fd);
     }
-    return MD5_format(MD5("", 0));
+    return MD5_format(MD5("", 0, result));
 }
 
 //  RETURNS A 'HUMAN-READABLE' FORMATTED STRING OF DIGEST OF A STRING
 char *MD5_str(const char *str)
 {
-    return MD5_format(MD5(str, strlen(str)));
+    static Digest	result;
+
+    return MD5_format(MD5(str, strlen(str), result));
 }
 
 //  --------------------------------------------------------------------------
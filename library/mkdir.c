@@ -2,7 +2,7 @@
 #include <stdbool.h>
 
 // make a new directory within an existing volume
-int SIFS_mkdir(const char *volumename, const char *dirname)
+static int make_directory(const char *volumename, const char *dirname)
 {
 	// Check arguments
 	if (volumename == NULL || dirname == NULL || *volumename == '\0' || *dirname == '\0')
@@ -11,33 +11,12 @@ int SIFS_mkdir(const char *volumename, const char *dirname)
 		return 1;
 	}
 
-	// Try to open volume
-	FILE* vol = fopen(volumename, "r+");
-	if (!vol)
-	{
-		SIFS_errno = SIFS_ENOVOL;
-		return 1;
-	}
-
-	// Read and validate header
-	SIFS_VOLUME_HEADER header = get_volumeheader(vol);
-	if (header.blocksize < SIFS_MIN_BLOCKSIZE || header.nblocks == 0)
-	{
-		SIFS_errno = SIFS_ENOTVOL;
-		fclose(vol);
-		return 1;
-	}
-
-	// Read and validate bitmap
+	// Open volume, reading and validating its header and bitmap
+	SIFS_VOLUME_HEADER header;
 	SIFS_BIT* bitmap;
-	get_volumebitmap(vol, &bitmap);
-	if (!validate_bitmap(bitmap, header.nblocks))
-	{
-		SIFS_errno = SIFS_ENOTVOL;
-		free(bitmap);
-		fclose(vol);
+	FILE* vol = open_volume(volumename, "r+", &header, &bitmap);
+	if (!vol)
 		return 1;
-	}
 
 	// Split dirname into its path and name
 	char* dirpath, *name;
@@ -45,7 +24,7 @@ int SIFS_mkdir(const char *volumename, const char *dirname)
 	{
 		SIFS_errno = SIFS_ENOMEM;
 		free(bitmap);
-		fclose(vol);
+		close_volume(vol);
 		return 1;
 	}
 
@@ -57,15 +36,14 @@ int SIFS_mkdir(const char *volumename, const char *dirname)
 		if (dirpath)
 			free(dirpath);
 		free(name);
-		fclose(vol);
+		close_volume(vol);
 		return 1;
 	}
 
-	// Find SIFS_BLOCKID of dirpath
+	// Find SIFS_BLOCKID of dirpath, copying any directory on the way that a snapshot shares
 	int err = SIFS_EOK;
 	// If dirpath is NULL we are working in the root directory
-	SIFS_BLOCKID pdirID = (dirpath) ? find_dir(header, bitmap, vol, SIFS_ROOTDIR_BLOCKID, dirpath, &err) : 
-		SIFS_ROOTDIR_BLOCKID;
+	SIFS_BLOCKID pdirID = cow_dir(header, bitmap, vol, dirpath, &err);
 	if (err != SIFS_EOK)
 	{
 		SIFS_errno = err;
@@ -73,7 +51,7 @@ int SIFS_mkdir(const char *volumename, const char *dirname)
 		if (dirpath)
 			free(dirpath);
 		free(name);
-		fclose(vol);
+		close_volume(vol);
 		return 1;
 	}
 
@@ -88,74 +66,39 @@ int SIFS_mkdir(const char *volumename, const char *dirname)
 		if (dirpath)
 			free(dirpath);
 		free(name);
-		fclose(vol);
+		close_volume(vol);
 		return 1;
 	}
 
-	// Check if name already exists
-	for (uint32_t i = 0; i < pdir.nentries; i++)
+	// Check if name already exists. A directory pointing to an invalid block means the volume is corrupted.
+	// Nothing is written if any block read failed its checksum
+	uint32_t entry = find_entry(header, bitmap, vol, &pdir, name, &err);
+	if (err == SIFS_EOK && !metadata_intact())
+		err = SIFS_EBADCRC;
+	if (entry != pdir.nentries || err != SIFS_EOK)
 	{
-		SIFS_BLOCKID entryID = pdir.entries[i].blockID;
-		// If the entry is a directory block
-		if (bitmap[entryID] == SIFS_DIR)
-		{
-			SIFS_DIRBLOCK entrydir = get_dirblock(header, vol, entryID);
-			// If the entry name is the same as our given name
-			if (strcmp(entrydir.name, name) == 0)
-			{
-				SIFS_errno = SIFS_EEXIST;
-				free(bitmap);
-				if (dirpath)
-					free(dirpath);
-				free(name);
-				fclose(vol);
-				return 1;
-			}
-
-		}
-		// If the entry is a file block
-		else if (bitmap[entryID] == SIFS_FILE)
-		{
-			SIFS_FILEBLOCK entryfile = get_fileblock(header, vol, entryID);
-			if (strcmp(entryfile.filenames[pdir.entries[i].fileindex], name) == 0)
-			{
-				SIFS_errno = SIFS_EEXIST;
-				free(bitmap);
-				if (dirpath)
-					free(dirpath);
-				free(name);
-				fclose(vol);
-				return 1;
-			}
-		}
-		// directory points to an invalid block. Volume is corrupted
-		else
-		{
-			SIFS_errno = SIFS_ENOTVOL;
-			free(bitmap);
-			if (dirpath)
-				free(dirpath);
-			free(name);
-			fclose(vol);
-			return 1;
-		}
+		SIFS_errno = err != SIFS_EOK ? err : SIFS_EEXIST;
+		free(bitmap);
+		if (dirpath)
+			free(dirpath);
+		free(name);
+		close_volume(vol);
+		return 1;
 	}
 
 	// Find an available block for child dir
-	SIFS_BLOCKID cdirID = 0;
 	bool success = false;
-	for (/*blank*/; cdirID < header.nblocks; cdirID++)
+	phase_begin(SIFS_PHASE_ALLOC);
+	STAT_ADD(bitmapscans, 1);
+	SIFS_BLOCKID cdirID = place_dirblock(header, bitmap, pdirID);
+	if (cdirID < header.nblocks)
 	{
-		if (bitmap[cdirID] == SIFS_UNUSED)
-		{
-			// Write to bitmap
-			bitmap[cdirID] = SIFS_DIR;
-			fseek(vol, sizeof(SIFS_VOLUME_HEADER), SEEK_SET);
-			fwrite(bitmap, sizeof(SIFS_BIT), header.nblocks, vol);
-			success = true;
-			break;
-		}
+		// Write to bitmap
+		bitmap[cdirID] = SIFS_DIR;
+		put_bitmapentry(header, vol, bitmap, cdirID);
+		success = true;
 	}
+	phase_end(SIFS_PHASE_ALLOC);
 
 	if (success == false)
 	{
@@ -164,7 +107,7 @@ int SIFS_mkdir(const char *volumename, const char *dirname)
 		if (dirpath)
 			free(dirpath);
 		free(name);
-		fclose(vol);
+		close_volume(vol);
 		return 1;
 	}
 
@@ -173,8 +116,7 @@ int SIFS_mkdir(const char *volumename, const char *dirname)
 	pdir.nentries++;
 	pdir.modtime = time(NULL);
 	// Write parent directory to volume
-	fseek(vol, sizeof(SIFS_VOLUME_HEADER) + header.nblocks + header.blocksize * pdirID, SEEK_SET);
-	fwrite(&pdir, sizeof(SIFS_DIRBLOCK), 1, vol);
+	put_dirblock(header, vol, pdirID, &pdir);
 
 	// Allocate block for new directory
 	SIFS_DIRBLOCK cdir;
@@ -182,15 +124,28 @@ int SIFS_mkdir(const char *volumename, const char *dirname)
 	strcpy(cdir.name, name);
 	cdir.modtime = time(NULL);
 	cdir.nentries = 0;
+	cdir.generation = snapshot_generation(header, vol);
 
 	// Write dirblock to volume
-	fseek(vol, sizeof(SIFS_VOLUME_HEADER) + header.nblocks + header.blocksize * cdirID, SEEK_SET);
-	fwrite(&cdir, sizeof(SIFS_DIRBLOCK), 1, vol);
+	put_dirblock(header, vol, cdirID, &cdir);
 
 	free(bitmap);
 	if (dirpath)
 		free(dirpath);
 	free(name);
-	fclose(vol);
+	if (close_volume(vol) != 0)
+	{
+		SIFS_errno = SIFS_EIO;
+		return 1;
+	}
 	return 0;
 }
+
+// make a new directory within an existing volume
+int SIFS_mkdir(const char *volumename, const char *dirname)
+{
+	stats_begin(SIFS_OP_MKDIR);
+	int result = make_directory(volumename, dirname);
+	stats_end();
+	return result;
+}
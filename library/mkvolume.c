@@ -2,13 +2,17 @@
 #include <string.h>
 #include <unistd.h>
 
-#include "sifs-internal.h"
+#include "sifsutils.h"
+
+//  THE BITMAP IS WRITTEN FROM THE HEAP IN CHUNKS OF THIS MANY BLOCKS
+#define	BITMAP_CHUNK	65536
 
 // make a new volume
-int SIFS_mkvolume(const char *volumename, size_t blocksize, uint32_t nblocks)
+static int make_volume(const char *volumename, size_t blocksize, uint32_t nblocks, uint32_t format)
 {
 //  ENSURE THAT RECEIVED PARAMETERS ARE VALID
-    if(volumename == NULL || nblocks == 0 || blocksize < SIFS_MIN_BLOCKSIZE) {
+    if(volumename == NULL || nblocks == 0 || blocksize < SIFS_MIN_BLOCKSIZE ||
+       (format & ~SIFS_FORMAT_ALL) != 0 || ((format & SIFS_FORMAT_SNAPSHOT) && nblocks < 2)) {
 	SIFS_errno	= SIFS_EINVAL;
 	return 1;
     }
@@ -32,39 +36,106 @@ int SIFS_mkvolume(const char *volumename, size_t blocksize, uint32_t nblocks)
     SIFS_VOLUME_HEADER	header = {
         .blocksize	= blocksize,
         .nblocks	= nblocks,
+        .flags		= format,
+        .magic		= SIFS_MAGIC,
+        .version	= SIFS_VERSION,
+        .features	= SIFS_FEATURE_CRC,
     };
 
-    SIFS_BIT	bitmap[nblocks];
+//  THE BITMAP STARTS OUT IN FRONT OF BLOCK 0, WHICH NEVER MOVES WHEN THE VOLUME IS RESIZED
+    header.bitmapoffset	= header_size(header);
+    header.dataoffset	= header.bitmapoffset + bitmap_size(header);
 
-    bitmap[SIFS_ROOTDIR_BLOCKID] = SIFS_DIR;	// the root directory
-    for(int b=1 ; b<nblocks ; ++b) {
-        bitmap[b]	= SIFS_UNUSED;
+    SIFS_BIT	*bitmap	= malloc(nblocks < BITMAP_CHUNK ? nblocks : BITMAP_CHUNK);
+    if(bitmap == NULL) {
+	SIFS_errno	= SIFS_ENOMEM;
+	fclose(vol);
+	remove(volumename);
+	return 1;
     }
 
-    char		oneblock[blocksize];
-
     SIFS_DIRBLOCK	rootdir_block;
     memset(&rootdir_block, 0, sizeof rootdir_block);	// cleared to all zeroes
 
     rootdir_block.name[0]       = '\0';
     rootdir_block.modtime	= time(NULL);
     rootdir_block.nentries	= 0;
-    memset(oneblock, 0, sizeof oneblock);        // cleared to all zeroes
-    memcpy(oneblock, &rootdir_block, sizeof rootdir_block);
+    rootdir_block.crc		= CRC32C_buffer(&rootdir_block, offsetof(SIFS_DIRBLOCK, crc));	// written directly, so checksummed here
+
+//  THE SNAPSHOT TABLE, ON VOLUMES THAT KEEP SNAPSHOTS, IS AN EMPTY DIRECTORY BLOCK THAT FOLLOWS THE ROOT
+    bool	snapshots	= (format & SIFS_FORMAT_SNAPSHOT) != 0;
+
+//  EXTEND THE VOLUME TO ITS FULL SIZE WITHOUT WRITING ANY BLOCKS.
+//  UNWRITTEN BLOCKS REMAIN HOLES THAT READ AS ZEROES
+    long	volumesize	= block_offset(header, nblocks);
+
+    if(volumesize < block_offset(header, 0) || !resize_volume(vol, volumesize)) {
+	SIFS_errno	= SIFS_ECREATE;
+	free(bitmap);
+	fclose(vol);
+	remove(volumename);
+	return 1;
+    }
 
 //  WRITE ALL OF THE INITIALISED SECTIONS TO THE VOLUME
-    fwrite(&header, sizeof header, 1, vol);
-    fwrite(bitmap,  sizeof bitmap, 1, vol);
+    put_volumeheader(vol, &header);
+
+    memset(bitmap, SIFS_UNUSED, nblocks < BITMAP_CHUNK ? nblocks : BITMAP_CHUNK);
+    bitmap[SIFS_ROOTDIR_BLOCKID] = SIFS_DIR;	// the root directory
+    if(snapshots) {
+        bitmap[SIFS_SNAPSHOT_BLOCKID] = SIFS_DIR;	// the snapshot table
+    }
+
+//  A PACKED BITMAP OF UNUSED BLOCKS IS ALL ZEROES, SO ONLY THE BYTE HOLDING THE ROOT IS WRITTEN
+    if(format & SIFS_FORMAT_PACKED) {
+        SIFS_VOLUME_HEADER	first	= header;
 
-    fwrite(oneblock, sizeof oneblock, 1, vol);	// write rootdir
-    memset(oneblock, 0, sizeof oneblock);	// reset to all zeroes
-    for(int b=1 ; b<nblocks ; ++b) {
-        fwrite(oneblock, sizeof oneblock, 1, vol);
+        first.nblocks	= snapshots ? 2 : 1;
+        put_volumebitmap(first, vol, bitmap);
+    }
+    else {
+        for(uint32_t b=0 ; b<nblocks ; b+=BITMAP_CHUNK) {
+            uint32_t	n	= nblocks - b < BITMAP_CHUNK ? nblocks - b : BITMAP_CHUNK;
+
+            write_at(vol, bitmap_offset(header) + b * sizeof(SIFS_BIT), bitmap, n * sizeof(SIFS_BIT));
+            bitmap[SIFS_ROOTDIR_BLOCKID] = SIFS_UNUSED;	// only the first chunk holds the root
+            if(snapshots) {
+                bitmap[SIFS_SNAPSHOT_BLOCKID] = SIFS_UNUSED;	// and the snapshot table
+            }
+        }
+    }
+
+    write_at(vol, block_offset(header, SIFS_ROOTDIR_BLOCKID), &rootdir_block, sizeof rootdir_block);	// write rootdir
+    if(snapshots) {
+        write_at(vol, block_offset(header, SIFS_SNAPSHOT_BLOCKID), &rootdir_block, sizeof rootdir_block);
     }
 
 //  FINISHED, CLOSE THE VOLUME
-    fclose(vol);
+    free(bitmap);
+    if(fclose(vol) != 0) {
+	SIFS_errno	= SIFS_ECREATE;
+	remove(volumename);
+	return 1;
+    }
 
 //  AND RETURN INDICATING SUCCESS
     return 0;
 }
+
+// make a new volume
+int SIFS_mkvolume(const char *volumename, size_t blocksize, uint32_t nblocks)
+{
+    stats_begin(SIFS_OP_MKVOLUME);
+    int result = make_volume(volumename, blocksize, nblocks, SIFS_FORMAT_CHARMAP);
+    stats_end();
+    return result;
+}
+
+// make a new volume with the given format options
+int SIFS_mkvolume_format(const char *volumename, size_t blocksize, uint32_t nblocks, uint32_t format)
+{
+    stats_begin(SIFS_OP_MKVOLUME);
+    int result = make_volume(volumename, blocksize, nblocks, format);
+    stats_end();
+    return result;
+}
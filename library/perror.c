@@ -18,6 +18,8 @@ char* SIFS_errlist[] = {
 	"Memory allocation failed",			// SIFS_ENOMEM
 		"Not yet implemented",                          // SIFS_ENOTYET
 	"Directory is not empty",			// SIFS_ENOTEMPTY
+	"Host file input/output failed",		// SIFS_EIO
+	"Volume metadata fails its checksum",		// SIFS_EBADCRC
 };
 
 #define	SIFS_NERRS	(sizeof(SIFS_errlist) / sizeof(SIFS_errlist[0]))
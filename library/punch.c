@@ -0,0 +1,85 @@
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <fcntl.h>
+#include "sifsutils.h"
+
+#if defined(__linux__) && defined(FALLOC_FL_PUNCH_HOLE)
+#define HAVE_PUNCH
+#endif
+
+// Whether freed blocks are punched out, until SIFS_set_hole_punching() is called
+static bool enabled = false;
+
+// Gives the host back the n blocks from first of vol. Returns false if they were not punched out,
+// because hole punching is off or the host filesystem does not support it
+bool punch_blocks(SIFS_VOLUME_HEADER header, FILE* vol, SIFS_BLOCKID first, uint32_t n)
+{
+#ifdef HAVE_PUNCH
+	if (!enabled || n == 0)
+		return false;
+
+	// Cached copies and writes still in the stdio buffer would fill the hole back in
+	long offset = block_offset(header, first);
+	long nbytes = (long)n * header.blocksize;
+	cache_forget(vol, offset, nbytes);
+	fflush(vol);
+
+	phase_begin(SIFS_PHASE_FLUSH);
+	bool success = fallocate(fileno(vol), FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, offset, nbytes) == 0;
+	phase_end(SIFS_PHASE_FLUSH);
+	return success;
+#else
+	return false;
+#endif
+}
+
+// Returns a copy of bitmap to compare with once blocks have been freed, or NULL if hole punching is off
+SIFS_BIT* punch_begin(SIFS_VOLUME_HEADER header, const SIFS_BIT* bitmap)
+{
+	if (!enabled)
+		return NULL;
+
+	SIFS_BIT* before = malloc(header.nblocks);
+	if (before)
+		memcpy(before, bitmap, header.nblocks);
+	return before;
+}
+
+// Punches out every block in use in before that bitmap now shows unused, then releases before.
+// Does nothing if before is NULL
+void punch_end(SIFS_VOLUME_HEADER header, FILE* vol, SIFS_BIT* before, const SIFS_BIT* bitmap)
+{
+	if (!before)
+		return;
+
+	STAT_ADD(bitmapscans, 1);
+	for (SIFS_BLOCKID id = 0; id < header.nblocks; /*blank*/)
+	{
+		if (before[id] == SIFS_UNUSED || bitmap[id] != SIFS_UNUSED)
+		{
+			id++;
+			continue;
+		}
+
+		SIFS_BLOCKID first = id;
+		while (id < header.nblocks && before[id] != SIFS_UNUSED && bitmap[id] == SIFS_UNUSED)
+			id++;
+		punch_blocks(header, vol, first, id - first);
+	}
+	free(before);
+}
+
+// choose whether blocks freed by an operation are punched out of the host file
+int SIFS_set_hole_punching(int enable)
+{
+#ifdef HAVE_PUNCH
+	enabled = enable != 0;
+	return 0;
+#else
+	if (!enable)
+		return 0;
+	SIFS_errno = SIFS_EIO;
+	return 1;
+#endif
+}
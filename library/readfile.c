@@ -1,7 +1,7 @@
 #include "sifsutils.h"
 
 // read the contents of an existing file from an existing volume
-int SIFS_readfile(const char *volumename, const char *pathname,
+static int read_file(const char *volumename, const char *pathname,
 		  void **data, size_t *nbytes)
 {
 	// Check arguments
@@ -12,33 +12,13 @@ int SIFS_readfile(const char *volumename, const char *pathname,
 		return 1;
 	}
 
-	// Try to open volume
-	FILE* vol = fopen(volumename, "r");
-	if (!vol)
-	{
-		SIFS_errno = SIFS_ENOVOL;
-		return 1;
-	}
-
-	// Read and validate header
-	SIFS_VOLUME_HEADER header = get_volumeheader(vol);
-	if (header.blocksize < SIFS_MIN_BLOCKSIZE || header.nblocks == 0)
-	{
-		SIFS_errno = SIFS_ENOTVOL;
-		fclose(vol);
-		return 1;
-	}
-
-	// Read and validate bitmap
+	// Open volume, reading and validating its header and bitmap
+	SIFS_VOLUME_HEADER header;
 	SIFS_BIT* bitmap;
-	get_volumebitmap(vol, &bitmap);
-	if (!validate_bitmap(bitmap, header.nblocks))
-	{
-		SIFS_errno = SIFS_ENOTVOL;
-		free(bitmap);
-		fclose(vol);
+	SIFS_BLOCKID rootID;
+	FILE* vol = open_snapshot(volumename, &header, &bitmap, &rootID);
+	if (!vol)
 		return 1;
-	}
 
 	// Split pathname
 	char* dirpath, * name;
@@ -46,14 +26,14 @@ int SIFS_readfile(const char *volumename, const char *pathname,
 	{
 		SIFS_errno = SIFS_ENOMEM;
 		free(bitmap);
-		fclose(vol);
+		close_volume(vol);
 		return 1;
 	}
 
 	int err = SIFS_EOK;
 	// If dirpath is NULL we are working in the root directory
-	SIFS_BLOCKID dir = dirpath == NULL ? SIFS_ROOTDIR_BLOCKID :
-		find_dir(header, bitmap, vol, SIFS_ROOTDIR_BLOCKID, dirpath, &err);
+	SIFS_BLOCKID dir = dirpath == NULL ? rootID :
+		find_dir(header, bitmap, vol, rootID, dirpath, &err);
 	if (err != SIFS_EOK)
 	{
 		SIFS_errno = err;
@@ -61,7 +41,7 @@ int SIFS_readfile(const char *volumename, const char *pathname,
 		if (dirpath)
 			free(dirpath);
 		free(name);
-		fclose(vol);
+		close_volume(vol);
 		return 1;
 	}
 	
@@ -73,23 +53,53 @@ int SIFS_readfile(const char *volumename, const char *pathname,
 		if (dirpath)
 			free(dirpath);
 		free(name);
-		fclose(vol);
+		close_volume(vol);
 		return 1;
 	}
 
 	SIFS_FILEBLOCK fblock = get_fileblock(header, vol, fileID);
+	if (!fileblock_intact(header, &fblock))
+	{
+		SIFS_errno = SIFS_EBADCRC;
+		free(bitmap);
+		if (dirpath)
+			free(dirpath);
+		free(name);
+		close_volume(vol);
+		return 1;
+	}
 	*nbytes = fblock.length;
-	*data = malloc(*nbytes);
+	*data = malloc(*nbytes > 0 ? *nbytes : 1);
 
-	// Read file into data
-	long offset = sizeof(SIFS_VOLUME_HEADER) + header.nblocks + fblock.firstblockID * header.blocksize;
-	fseek(vol, offset, SEEK_SET);
-	fread(*data, 1, *nbytes, vol);
+	// Read file into data, expanding it if it was stored compressed. Inline contents are read from
+	// the tail of the file block straight into data
+	err = !*data ? SIFS_ENOMEM : !read_filedata(header, vol, &fblock, *data) ? SIFS_EIO : SIFS_EOK;
+	if (err != SIFS_EOK)
+	{
+		SIFS_errno = err;
+		free(*data);
+		free(bitmap);
+		if (dirpath)
+			free(dirpath);
+		free(name);
+		close_volume(vol);
+		return 1;
+	}
 
 	free(bitmap);
 	if (dirpath)
 		free(dirpath);
 	free(name);
-	fclose(vol);
+	close_volume(vol);
 	return 0;
 }
+
+// read the contents of an existing file from an existing volume
+int SIFS_readfile(const char *volumename, const char *pathname,
+		  void **data, size_t *nbytes)
+{
+	stats_begin(SIFS_OP_READFILE);
+	int result = read_file(volumename, pathname, data, nbytes);
+	stats_end();
+	return result;
+}
@@ -0,0 +1,254 @@
+#include "sifsutils.h"
+
+// One of the paths being read
+typedef struct {
+	size_t		index;		// of the path in pathnames and results
+	char*		dirpath;	// NULL for the root directory
+	char*		name;
+	SIFS_BLOCKID	fileID;
+} READ_PATH;
+
+// One file block that some of the paths resolved to
+typedef struct {
+	SIFS_BLOCKID	fileID;
+	SIFS_FILEBLOCK	fblock;
+} READ_FILE;
+
+static int compare_dirpaths(const void* a, const void* b)
+{
+	const READ_PATH* pa = a;
+	const READ_PATH* pb = b;
+	return strcmp(pa->dirpath ? pa->dirpath : "", pb->dirpath ? pb->dirpath : "");
+}
+
+static int compare_fileIDs(const void* a, const void* b)
+{
+	const READ_PATH* pa = a;
+	const READ_PATH* pb = b;
+	return pa->fileID < pb->fileID ? -1 : pa->fileID > pb->fileID;
+}
+
+static int compare_firstblocks(const void* a, const void* b)
+{
+	const READ_FILE* fa = a;
+	const READ_FILE* fb = b;
+	return fa->fblock.firstblockID < fb->fblock.firstblockID ? -1 : fa->fblock.firstblockID > fb->fblock.firstblockID;
+}
+
+// Looks up the names of paths[0..npaths), which all share the directory dir, reading its entries once.
+// A path fails its checksum only if dir or the entry it names does, so one damaged block spoils no other path
+static void find_files(SIFS_VOLUME_HEADER header, SIFS_BIT* bitmap, FILE* vol, SIFS_BLOCKID dir,
+	READ_PATH* paths, size_t npaths, SIFS_READRESULT* results)
+{
+	SIFS_DIRBLOCK dblock = get_dirblock(header, vol, dir);
+	char names[SIFS_MAX_ENTRIES][SIFS_MAX_NAME_LENGTH];
+	bool intact[SIFS_MAX_ENTRIES];
+	get_entrynames(header, bitmap, vol, &dblock, names, intact);
+	bool dirintact = dirblock_intact(header, &dblock);
+
+	for (size_t p = 0; p < npaths; p++)
+	{
+		results[paths[p].index].error = dirintact ? SIFS_ENOENT : SIFS_EBADCRC;
+		if (!dirintact)
+			continue;
+		for (uint32_t entry = 0; entry < dblock.nentries && entry < SIFS_MAX_ENTRIES; entry++)
+		{
+			if (strcmp(paths[p].name, names[entry]) != 0)
+				continue;
+
+			SIFS_BLOCKID id = dblock.entries[entry].blockID;
+			if (!intact[entry])
+				results[paths[p].index].error = SIFS_EBADCRC;
+			else if (bitmap[id] == SIFS_FILE)
+			{
+				paths[p].fileID = id;
+				results[paths[p].index].error = SIFS_EOK;
+			}
+			else
+				results[paths[p].index].error = SIFS_ENOTFILE;
+			break;
+		}
+	}
+}
+
+// Resolves every path, sharing the lookup of each directory between the paths in it.
+// Paths start from directory root. Those that resolve get their fileID, the others get an error in results
+static void resolve_paths(SIFS_VOLUME_HEADER header, SIFS_BIT* bitmap, FILE* vol, SIFS_BLOCKID root,
+	READ_PATH* paths, size_t npaths, SIFS_READRESULT* results)
+{
+	qsort(paths, npaths, sizeof(READ_PATH), compare_dirpaths);
+
+	phase_begin(SIFS_PHASE_PATH);
+	for (size_t first = 0, last; first < npaths; first = last)
+	{
+		for (last = first + 1; last < npaths && compare_dirpaths(&paths[first], &paths[last]) == 0; last++)
+		{
+			/*blank*/
+		}
+
+		int err = SIFS_EOK;
+		// If dirpath is NULL we are working in the root directory
+		SIFS_BLOCKID dir = paths[first].dirpath == NULL ? root :
+			find_dir(header, bitmap, vol, root, paths[first].dirpath, &err);
+		if (err != SIFS_EOK)
+		{
+			for (size_t p = first; p < last; p++)
+			{
+				results[paths[p].index].error = err;
+			}
+			continue;
+		}
+		find_files(header, bitmap, vol, dir, paths + first, last - first, results);
+	}
+	phase_end(SIFS_PHASE_PATH);
+}
+
+// Reads the contents of every file that paths resolved to, each once and in the order they are stored,
+// then gives a copy to every path that resolved to it
+static void read_contents(SIFS_VOLUME_HEADER header, FILE* vol, READ_PATH* paths, size_t npaths,
+	SIFS_READRESULT* results)
+{
+	// Paths sharing a file block, because they were written with the same contents, are now next to each other
+	qsort(paths, npaths, sizeof(READ_PATH), compare_fileIDs);
+	READ_FILE* files = malloc(sizeof(READ_FILE) * (npaths > 0 ? npaths : 1));
+	if (!files)
+	{
+		for (size_t p = 0; p < npaths; p++)
+		{
+			results[paths[p].index].error = SIFS_ENOMEM;
+		}
+		return;
+	}
+
+	size_t nfiles = 0;
+	for (size_t p = 0; p < npaths; p++)
+	{
+		if (p > 0 && paths[p].fileID == paths[p - 1].fileID)
+			continue;
+		files[nfiles].fileID = paths[p].fileID;
+		files[nfiles].fblock = get_fileblock(header, vol, paths[p].fileID);
+		nfiles++;
+	}
+	qsort(files, nfiles, sizeof(READ_FILE), compare_firstblocks);
+
+	for (size_t f = 0; f < nfiles; f++)
+	{
+		SIFS_FILEBLOCK* fblock = &files[f].fblock;
+		size_t length = fblock->length;
+		void* data = malloc(length > 0 ? length : 1);
+		int err = !data ? SIFS_ENOMEM : !fileblock_intact(header, fblock) ? SIFS_EBADCRC :
+			!read_filedata(header, vol, fblock, data) ? SIFS_EIO : SIFS_EOK;
+
+		// The paths of this file are found again by its fileID, the first of them keeps data itself
+		READ_PATH key = { .fileID = files[f].fileID };
+		READ_PATH* match = bsearch(&key, paths, npaths, sizeof(READ_PATH), compare_fileIDs);
+		size_t p = match - paths;
+		while (p > 0 && paths[p - 1].fileID == key.fileID)
+			p--;
+
+		bool given = false;
+		for (/*blank*/; p < npaths && paths[p].fileID == key.fileID; p++)
+		{
+			SIFS_READRESULT* result = &results[paths[p].index];
+			void* copy = err != SIFS_EOK || !given ? data : malloc(length > 0 ? length : 1);
+			if (err == SIFS_EOK && !copy)
+			{
+				result->error = SIFS_ENOMEM;
+				continue;
+			}
+			if (copy != data)
+				memcpy(copy, data, length);
+
+			result->error = err;
+			result->data = err == SIFS_EOK ? copy : NULL;
+			result->length = err == SIFS_EOK ? length : 0;
+			given = given || err == SIFS_EOK;
+		}
+		if (!given)
+			free(data);
+	}
+
+	free(files);
+}
+
+// read the contents of many files of an existing volume on one open of it
+static int read_files(const char *volumename, const char **pathnames, size_t npaths,
+		      SIFS_READRESULT *results)
+{
+	// Check arguments
+	if (volumename == NULL || *volumename == '\0' ||
+		(npaths > 0 && (pathnames == NULL || results == NULL)))
+	{
+		SIFS_errno = SIFS_EINVAL;
+		return 1;
+	}
+
+	for (size_t i = 0; i < npaths; i++)
+	{
+		results[i].data = NULL;
+		results[i].length = 0;
+		results[i].error = SIFS_EOK;
+	}
+
+	READ_PATH* paths = malloc(sizeof(READ_PATH) * (npaths > 0 ? npaths : 1));
+	if (!paths)
+	{
+		SIFS_errno = SIFS_ENOMEM;
+		return 1;
+	}
+
+	// Open volume, reading and validating its header and bitmap
+	SIFS_VOLUME_HEADER header;
+	SIFS_BIT* bitmap;
+	SIFS_BLOCKID rootID;
+	FILE* vol = open_snapshot(volumename, &header, &bitmap, &rootID);
+	if (!vol)
+	{
+		free(paths);
+		return 1;
+	}
+
+	// Split every pathname. Paths that cannot be read say why in their result and go no further
+	size_t nsplit = 0;
+	for (size_t i = 0; i < npaths; i++)
+	{
+		READ_PATH* path = &paths[nsplit];
+		path->index = i;
+		path->fileID = 0;
+		if (pathnames[i] == NULL || *pathnames[i] == '\0')
+			results[i].error = SIFS_EINVAL;
+		else if (!split_filepath(pathnames[i], &path->dirpath, &path->name))
+			results[i].error = SIFS_ENOMEM;
+		else
+			nsplit++;
+	}
+
+	resolve_paths(header, bitmap, vol, rootID, paths, nsplit, results);
+
+	// Only paths that resolved to a file are read
+	size_t nfound = 0;
+	for (size_t p = 0; p < nsplit; p++)
+	{
+		if (paths[p].dirpath)
+			free(paths[p].dirpath);
+		free(paths[p].name);
+		if (results[paths[p].index].error == SIFS_EOK)
+			paths[nfound++] = paths[p];
+	}
+	read_contents(header, vol, paths, nfound, results);
+
+	free(paths);
+	free(bitmap);
+	close_volume(vol);
+	return 0;
+}
+
+// read the contents of many files of an existing volume on one open of it
+int SIFS_readfiles(const char *volumename, const char **pathnames, size_t npaths,
+		   SIFS_READRESULT *results)
+{
+	stats_begin(SIFS_OP_READFILES);
+	int result = read_files(volumename, pathnames, npaths, results);
+	stats_end();
+	return result;
+}
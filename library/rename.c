@@ -0,0 +1,185 @@
+#include "sifsutils.h"
+
+// Returns true if path names an entry beneath the one named by top. An entry has one parent, so its path says
+// where it is
+static bool beneath(const char* top, const char* path)
+{
+	// Skip leading '/' if it exists
+	if (*top == '/')
+		top++;
+	if (*path == '/')
+		path++;
+
+	size_t length = strlen(top);
+	return strncmp(path, top, length) == 0 && path[length] == '/';
+}
+
+// rename or move an existing file or directory within an existing volume
+static int rename_entry(const char *volumename, const char *oldpathname, const char *newpathname)
+{
+	// Check arguments
+	if (volumename == NULL || oldpathname == NULL || newpathname == NULL || *volumename == '\0' ||
+		*oldpathname == '\0' || *newpathname == '\0')
+	{
+		SIFS_errno = SIFS_EINVAL;
+		return 1;
+	}
+
+	// Open volume, reading and validating its header and bitmap. The exclusive lock makes the rename atomic
+	SIFS_VOLUME_HEADER header;
+	SIFS_BIT* bitmap;
+	FILE* vol = open_volume(volumename, "r+", &header, &bitmap);
+	if (!vol)
+		return 1;
+
+	// Split both paths into their directory paths and names
+	char* olddirpath = NULL, * oldname = NULL, * newdirpath = NULL, * newname = NULL;
+	int err = SIFS_EOK;
+	if (!split_filepath(oldpathname, &olddirpath, &oldname) || !split_filepath(newpathname, &newdirpath, &newname))
+		err = SIFS_ENOMEM;
+
+	// Check if the new name is too long
+	if (err == SIFS_EOK && strlen(newname) + 1 > SIFS_MAX_NAME_LENGTH)
+		err = SIFS_EINVAL;
+
+	// Nothing can be moved beneath itself. Only a directory has entries beneath it, and a file would fail anyway
+	if (err == SIFS_EOK && beneath(oldpathname, newpathname))
+		err = SIFS_EINVAL;
+
+	// If a directory path is NULL we are working in the root directory. Directories a snapshot shares are copied
+	SIFS_BLOCKID oldparentID = SIFS_ROOTDIR_BLOCKID, newparentID = SIFS_ROOTDIR_BLOCKID;
+	if (err == SIFS_EOK)
+		oldparentID = cow_dir(header, bitmap, vol, olddirpath, &err);
+	if (err == SIFS_EOK)
+		newparentID = cow_dir(header, bitmap, vol, newdirpath, &err);
+
+	SIFS_DIRBLOCK oldparent, newparent;
+	uint32_t oldindex = 0;
+	if (err == SIFS_EOK)
+	{
+		oldparent = get_dirblock(header, vol, oldparentID);
+		oldindex = find_entry(header, bitmap, vol, &oldparent, oldname, &err);
+		if (err == SIFS_EOK && oldindex == oldparent.nentries)
+			err = SIFS_ENOENT;
+	}
+	if (err == SIFS_EOK)
+	{
+		newparent = newparentID == oldparentID ? oldparent : get_dirblock(header, vol, newparentID);
+		uint32_t newindex = find_entry(header, bitmap, vol, &newparent, newname, &err);
+
+		// Renaming an entry to itself changes nothing
+		if (err == SIFS_EOK && newparentID == oldparentID && newindex == oldindex)
+		{
+			free(bitmap);
+			free(olddirpath);
+			free(oldname);
+			free(newdirpath);
+			free(newname);
+			close_volume(vol);
+			return 0;
+		}
+		if (err == SIFS_EOK && newindex != newparent.nentries)
+			err = SIFS_EEXIST;
+	}
+
+	SIFS_BLOCKID entryID = err == SIFS_EOK ? oldparent.entries[oldindex].blockID : SIFS_ROOTDIR_BLOCKID;
+	bool isdir = err == SIFS_EOK && bitmap[entryID] == SIFS_DIR;
+
+	if (err == SIFS_EOK && newparentID != oldparentID && newparent.nentries == SIFS_MAX_ENTRIES)
+		err = SIFS_EMAXENTRY;
+
+	// Nothing is written if any block read, the entry's own among them, failed its checksum
+	SIFS_DIRBLOCK entrydir;
+	SIFS_FILEBLOCK entryfile;
+	if (err == SIFS_EOK && isdir)
+		entrydir = get_dirblock(header, vol, entryID);
+	else if (err == SIFS_EOK)
+		entryfile = get_fileblock(header, vol, entryID);
+	if (err == SIFS_EOK && !metadata_intact())
+		err = SIFS_EBADCRC;
+
+	// A block that a snapshot shares keeps its name there, so the live volume gets a copy of its own to rename
+	if (err == SIFS_EOK && isdir && snapshot_shared(header, vol, entrydir.generation))
+	{
+		entryID = copy_dirblock(header, bitmap, vol, &entrydir, newparentID, &err);
+		oldparent.entries[oldindex].blockID = entryID;
+	}
+	else if (err == SIFS_EOK && !isdir && snapshot_shared(header, vol, entryfile.generation))
+	{
+		// Every entry of the live volume moves to the copy, those of both parents among them
+		entryID = cow_file(header, bitmap, vol, entryID, &err);
+		oldparent = get_dirblock(header, vol, oldparentID);
+		newparent = newparentID == oldparentID ? oldparent : get_dirblock(header, vol, newparentID);
+	}
+
+	if (err != SIFS_EOK)
+	{
+		SIFS_errno = err;
+		free(bitmap);
+		free(olddirpath);
+		free(oldname);
+		free(newdirpath);
+		free(newname);
+		close_volume(vol);
+		return 1;
+	}
+
+	// Rename the entry where its name is stored. No data is touched
+	if (isdir)
+	{
+		SIFS_DIRBLOCK dblock = get_dirblock(header, vol, entryID);
+		memset(dblock.name, 0, SIFS_MAX_NAME_LENGTH);
+		strcpy(dblock.name, newname);
+		put_dirblock(header, vol, entryID, &dblock);
+	}
+	else
+	{
+		SIFS_FILEBLOCK fblock = get_fileblock(header, vol, entryID);
+		char* filename = fblock.filenames[oldparent.entries[oldindex].fileindex];
+		memset(filename, 0, SIFS_MAX_NAME_LENGTH);
+		strcpy(filename, newname);
+		put_fileblock(header, vol, entryID, &fblock);
+	}
+
+	// Move the entry between parent directories. The new entry reaches the volume, past the cache, before the
+	// old one is removed, so a crash in between leaves it in both parents rather than in neither. SIFS_fsck
+	// reports either kind of entry left that way, and with SIFS_FSCK_REPAIR drops the stale file entry
+	if (newparentID != oldparentID)
+	{
+		newparent.entries[newparent.nentries] = oldparent.entries[oldindex];
+		newparent.nentries++;
+		newparent.modtime = time(NULL);
+		put_dirblock(header, vol, newparentID, &newparent);
+		cache_flush();
+		fflush(vol);
+
+		for (uint32_t j = oldindex; j < oldparent.nentries - 1; j++)
+		{
+			oldparent.entries[j] = oldparent.entries[j + 1];
+		}
+		oldparent.nentries--;
+	}
+	oldparent.modtime = time(NULL);
+	put_dirblock(header, vol, oldparentID, &oldparent);
+
+	free(bitmap);
+	free(olddirpath);
+	free(oldname);
+	free(newdirpath);
+	free(newname);
+	if (close_volume(vol) != 0)
+	{
+		SIFS_errno = SIFS_EIO;
+		return 1;
+	}
+	return 0;
+}
+
+// rename or move an existing file or directory within an existing volume
+int SIFS_rename(const char *volumename, const char *oldpathname, const char *newpathname)
+{
+	stats_begin(SIFS_OP_RENAME);
+	int result = rename_entry(volumename, oldpathname, newpathname);
+	stats_end();
+	return result;
+}
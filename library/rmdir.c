@@ -1,7 +1,7 @@
 #include "sifsutils.h"
 
 // remove an existing directory from an existing volume
-int SIFS_rmdir(const char* volumename, const char* dirname)
+static int remove_directory(const char* volumename, const char* dirname)
 {
 	// Check arguments
 	if (volumename == NULL || dirname == NULL || *volumename == '\0' || *dirname == '\0')
@@ -10,33 +10,12 @@ int SIFS_rmdir(const char* volumename, const char* dirname)
 		return 1;
 	}
 
-	// Try to open volume
-	FILE* vol = fopen(volumename, "r+");
-	if (!vol)
-	{
-		SIFS_errno = SIFS_ENOVOL;
-		return 1;
-	}
-
-	// Read and validate header
-	SIFS_VOLUME_HEADER header = get_volumeheader(vol);
-	if (header.blocksize < SIFS_MIN_BLOCKSIZE || header.nblocks == 0)
-	{
-		SIFS_errno = SIFS_ENOTVOL;
-		fclose(vol);
-		return 1;
-	}
-
-	// Read and validate bitmap
+	// Open volume, reading and validating its header and bitmap
+	SIFS_VOLUME_HEADER header;
 	SIFS_BIT* bitmap;
-	get_volumebitmap(vol, &bitmap);
-	if (!validate_bitmap(bitmap, header.nblocks))
-	{
-		SIFS_errno = SIFS_ENOTVOL;
-		free(bitmap);
-		fclose(vol);
+	FILE* vol = open_volume(volumename, "r+", &header, &bitmap);
+	if (!vol)
 		return 1;
-	}
 
 	// Find SIFS_BLOCKID of dirpath
 	int err = SIFS_EOK;
@@ -45,18 +24,18 @@ int SIFS_rmdir(const char* volumename, const char* dirname)
 	{
 		SIFS_errno = err;
 		free(bitmap);
-		fclose(vol);
+		close_volume(vol);
 		return 1;
 	}
 
 	SIFS_DIRBLOCK childblock = get_dirblock(header, vol, childID);
 
 	// Check if childblock has any entries
-	if (childblock.nentries != 0)
+	if (!dirblock_intact(header, &childblock) || childblock.nentries != 0)
 	{
-		SIFS_errno = SIFS_ENOTEMPTY;
+		SIFS_errno = dirblock_intact(header, &childblock) ? SIFS_ENOTEMPTY : SIFS_EBADCRC;
 		free(bitmap);
-		fclose(vol);
+		close_volume(vol);
 		return 1;
 	}
 
@@ -66,13 +45,12 @@ int SIFS_rmdir(const char* volumename, const char* dirname)
 	{
 		SIFS_errno = SIFS_ENOMEM;
 		free(bitmap);
-		fclose(vol);
+		close_volume(vol);
 		return 1;
 	}
 
-	// If parentPath is NULL the parent directory is ROOT
-	SIFS_BLOCKID parentID = parentPath ? find_dir(header, bitmap, vol, SIFS_ROOTDIR_BLOCKID, parentPath, &err) :
-		SIFS_ROOTDIR_BLOCKID;
+	// If parentPath is NULL the parent directory is ROOT. Directories a snapshot shares are copied first
+	SIFS_BLOCKID parentID = cow_dir(header, bitmap, vol, parentPath, &err);
 	if (err != SIFS_EOK)
 	{
 		SIFS_errno = err;
@@ -80,11 +58,23 @@ int SIFS_rmdir(const char* volumename, const char* dirname)
 		if (parentPath)
 			free(parentPath);
 		free(name);
-		fclose(vol);
+		close_volume(vol);
 		return 1;
 	}
 	SIFS_DIRBLOCK parentBlock = get_dirblock(header, vol, parentID);
 
+	// Nothing is written if any block read failed its checksum
+	if (!metadata_intact())
+	{
+		SIFS_errno = SIFS_EBADCRC;
+		free(bitmap);
+		if (parentPath)
+			free(parentPath);
+		free(name);
+		close_volume(vol);
+		return 1;
+	}
+
 	// Remove child directory entry
 	for (uint32_t i = 0; i < parentBlock.nentries; i++)
 	{
@@ -104,25 +94,53 @@ int SIFS_rmdir(const char* volumename, const char* dirname)
 	parentBlock.modtime = time(NULL);
 
 	// Write parentBlock to volume
-	fseek(vol, sizeof(SIFS_VOLUME_HEADER) + header.nblocks + parentID * header.blocksize, SEEK_SET);
-	fwrite(&parentBlock, sizeof(SIFS_DIRBLOCK), 1, vol);
+	put_dirblock(header, vol, parentID, &parentBlock);
+
+	// A child directory that a snapshot shares stays where it is
+	if (snapshot_shared(header, vol, childblock.generation))
+	{
+		free(bitmap);
+		if (parentPath)
+			free(parentPath);
+		free(name);
+		if (close_volume(vol) != 0)
+		{
+			SIFS_errno = SIFS_EIO;
+			return 1;
+		}
+		return 0;
+	}
 
 	// Clear bitmap bit
-	fseek(vol, sizeof(SIFS_VOLUME_HEADER) + sizeof(SIFS_BIT) * childID, SEEK_SET);
-	SIFS_BIT unused = SIFS_UNUSED;
-	fwrite(&unused, sizeof(SIFS_BIT), 1, vol);
+	bitmap[childID] = SIFS_UNUSED;
+	put_bitmapentry(header, vol, bitmap, childID);
 
-	// Clear child block
-	char oneblock[header.blocksize];
-	memset(oneblock, 0, header.blocksize);
-	fseek(vol, sizeof(SIFS_VOLUME_HEADER) + header.nblocks + childID * header.blocksize, SEEK_SET);
-	fwrite(oneblock, 1, header.blocksize, vol);
+	// Clear child block, punching it out where possible. Otherwise only the directory block itself
+	// is zeroed, as the blocks of removed files are not cleared either
+	if (!punch_blocks(header, vol, childID, 1))
+	{
+		SIFS_DIRBLOCK cleared;
+		memset(&cleared, 0, sizeof(cleared));
+		write_at(vol, block_offset(header, childID), &cleared, sizeof(cleared));
+	}
 	
 	free(bitmap);
 	if (parentPath)
 		free(parentPath);
 	free(name);
-	fclose(vol);
-
+	if (close_volume(vol) != 0)
+	{
+		SIFS_errno = SIFS_EIO;
+		return 1;
+	}
 	return 0;
 }
+
+// remove an existing directory from an existing volume
+int SIFS_rmdir(const char* volumename, const char* dirname)
+{
+	stats_begin(SIFS_OP_RMDIR);
+	int result = remove_directory(volumename, dirname);
+	stats_end();
+	return result;
+}
@@ -1,7 +1,7 @@
 #include "sifsutils.h"
 
 // remove an existing file from an existing volume
-int SIFS_rmfile(const char *volumename, const char *pathname)
+static int remove_file(const char *volumename, const char *pathname)
 {
 	// Check arguments
 	if (volumename == NULL || pathname == NULL || *volumename == '\0' || *pathname == '\0')
@@ -10,33 +10,12 @@ int SIFS_rmfile(const char *volumename, const char *pathname)
 		return 1;
 	}
 
-	// Try to open volume
-	FILE* vol = fopen(volumename, "r+");
-	if (!vol)
-	{
-		SIFS_errno = SIFS_ENOVOL;
-		return 1;
-	}
-
-	// Read and validate header
-	SIFS_VOLUME_HEADER header = get_volumeheader(vol);
-	if (header.blocksize < SIFS_MIN_BLOCKSIZE || header.nblocks == 0)
-	{
-		SIFS_errno = SIFS_ENOTVOL;
-		fclose(vol);
-		return 1;
-	}
-
-	// Read and validate bitmap
+	// Open volume, reading and validating its header and bitmap
+	SIFS_VOLUME_HEADER header;
 	SIFS_BIT* bitmap;
-	get_volumebitmap(vol, &bitmap);
-	if (!validate_bitmap(bitmap, header.nblocks))
-	{
-		SIFS_errno = SIFS_ENOTVOL;
-		free(bitmap);
-		fclose(vol);
+	FILE* vol = open_volume(volumename, "r+", &header, &bitmap);
+	if (!vol)
 		return 1;
-	}
 
 	// Split pathname into its path and name
 	char* dirpath, * name;
@@ -44,15 +23,14 @@ int SIFS_rmfile(const char *volumename, const char *pathname)
 	{
 		SIFS_errno = SIFS_ENOMEM;
 		free(bitmap);
-		fclose(vol);
+		close_volume(vol);
 		return 1;
 	}
 
-	// Find SIFS_BLOCKID of dirpath
+	// Find SIFS_BLOCKID of dirpath, copying any directory on the way that a snapshot shares
 	int err = SIFS_EOK;
 	// If dirpath is NULL we are working in the root directory
-	SIFS_BLOCKID dblockID = (dirpath) ? find_dir(header, bitmap, vol, SIFS_ROOTDIR_BLOCKID, dirpath, &err) :
-		SIFS_ROOTDIR_BLOCKID;
+	SIFS_BLOCKID dblockID = cow_dir(header, bitmap, vol, dirpath, &err);
 	if (err != SIFS_EOK)
 	{
 		SIFS_errno = err;
@@ -60,7 +38,7 @@ int SIFS_rmfile(const char *volumename, const char *pathname)
 		if (dirpath)
 			free(dirpath);
 		free(name);
-		fclose(vol);
+		close_volume(vol);
 		return 1;
 	}
 
@@ -93,10 +71,6 @@ int SIFS_rmfile(const char *volumename, const char *pathname)
 				dblock.nentries--;
 
 				dblock.modtime = time(NULL);
-
-				// Write dblock to volume
-				fseek(vol, sizeof(SIFS_VOLUME_HEADER) + header.nblocks + dblockID * header.blocksize, SEEK_SET);
-				fwrite(&dblock, sizeof(SIFS_DIRBLOCK), 1, vol);
 				break;
 			}
 		}
@@ -110,7 +84,7 @@ int SIFS_rmfile(const char *volumename, const char *pathname)
 				if (dirpath)
 					free(dirpath);
 				free(name);
-				fclose(vol);
+				close_volume(vol);
 				return 1;
 			}
 		}
@@ -122,7 +96,7 @@ int SIFS_rmfile(const char *volumename, const char *pathname)
 			if (dirpath)
 				free(dirpath);
 			free(name);
-			fclose(vol);
+			close_volume(vol);
 			return 1;
 		}
 	}
@@ -133,32 +107,126 @@ int SIFS_rmfile(const char *volumename, const char *pathname)
 		if (dirpath)
 			free(dirpath);
 		free(name);
-		fclose(vol);
+		close_volume(vol);
 		return 1;
 	}
 
+	// Everything the removal changes is read before anything is written, so that nothing is written
+	// if any block read failed its checksum
 	SIFS_FILEBLOCK fblock = get_fileblock(header, vol, fileID);
-	if (fblock.nfiles == 1)
+	bool shared = snapshot_shared(header, vol, fblock.generation);
+	bool freed = !shared && fblock.nfiles == 1;
+	bool datashared = freed && snapshot_shared(header, vol, fblock.datageneration);
+
+	// Chunks that no other file shares go with it. Without its chunk list they would never be released
+	SIFS_BLOCKID* list = NULL;
+	if (freed && !datashared && is_chunked(header, &fblock))
+	{
+		list = get_chunklist(header, vol, &fblock);
+		if (!list)
+			err = SIFS_ENOMEM;
+		else if (!chunks_intact(header, bitmap, vol, list, fblock.nchunks))
+			err = SIFS_EBADCRC;
+	}
+
+	// More than one directory may point to fblock. Entries after the deleted filename need their fileindex
+	// adjusted, those of dblock itself in place
+	SIFS_BLOCKID fixedIDs[SIFS_MAX_ENTRIES];
+	SIFS_DIRBLOCK fixed[SIFS_MAX_ENTRIES];
+	uint32_t nfixed = 0;
+	if (!shared && fblock.nfiles > 1)
+	{
+		uint32_t dirs_processed = 0;
+		STAT_ADD(bitmapscans, 1);
+		for (uint32_t i = 0; i < header.nblocks && dirs_processed < fblock.nfiles - 1 && nfixed < SIFS_MAX_ENTRIES; i++)
+		{
+			// If the block is a directory
+			if (bitmap[i] != SIFS_DIR)
+				continue;
+
+			SIFS_DIRBLOCK* d = i == dblockID ? &dblock : &fixed[nfixed];
+			if (i != dblockID)
+				*d = get_dirblock(header, vol, i);
+			bool changed = false;
+			for (uint32_t entry = 0; entry < d->nentries && entry < SIFS_MAX_ENTRIES; entry++)
+			{
+				// If d points to fileID
+				if (d->entries[entry].blockID == fileID)
+				{
+					dirs_processed++;
+					// ... and if its fileindex into filenames occured after the deleted filename
+					if (d->entries[entry].fileindex > fileindex)
+					{
+						// .. adjust it accordingly
+						d->entries[entry].fileindex--;
+						changed = true;
+					}
+				}
+			}
+			if (changed && i != dblockID)
+				fixedIDs[nfixed++] = i;
+		}
+	}
+
+	if (err == SIFS_EOK && !metadata_intact())
+		err = SIFS_EBADCRC;
+	if (err != SIFS_EOK)
+	{
+		SIFS_errno = err;
+		free(list);
+		free(bitmap);
+		if (dirpath)
+			free(dirpath);
+		free(name);
+		close_volume(vol);
+		return 1;
+	}
+
+	// Write dblock to volume
+	put_dirblock(header, vol, dblockID, &dblock);
+
+	if (shared)
+	{
+		// A file block that a snapshot shares is left as it is. Names the live volume still uses move to a copy
+		if (fblock.nfiles > 1)
+			fileID = cow_file(header, bitmap, vol, fileID, &err);
+
+		// The names left may all belong to snapshots, leaving the copy with none
+		if (fblock.nfiles > 1 && err == SIFS_EOK && get_fileblock(header, vol, fileID).nfiles == 0)
+		{
+			bitmap[fileID] = SIFS_UNUSED;
+			put_bitmapentry(header, vol, bitmap, fileID);
+		}
+		if (err != SIFS_EOK)
+			SIFS_errno = err;
+	}
+	else if (freed)
 	{
 		// Only this directory references the specifed file. We can safely delete it
 
-		// Update bitmap
+		// Update bitmap, remembering what it was so the blocks freed can be punched out together
+		SIFS_BIT* before = punch_begin(header, bitmap);
 		bitmap[fileID] = SIFS_UNUSED;
-		uint32_t nblocks = (fblock.length + header.blocksize - 1) / header.blocksize; // Round up
-		for (SIFS_BLOCKID id = fblock.firstblockID; id < fblock.firstblockID + nblocks; id++)
+
+		// Data that a snapshot shares stays where it is, as do its chunks
+		if (!datashared)
 		{
-			bitmap[id] = SIFS_UNUSED;
+			uint32_t nblocks = data_blocks(header, &fblock);
+			for (SIFS_BLOCKID id = fblock.firstblockID; id < fblock.firstblockID + nblocks; id++)
+			{
+				bitmap[id] = SIFS_UNUSED;
+			}
+
+			// Chunks whose references cannot be dropped stay in use, which fsck reports, rather than being lost
+			if (list && !release_chunks(header, bitmap, vol, list, fblock.nchunks, &err))
+				SIFS_errno = err;
 		}
 
 		// Write bitmap to volume
-		fseek(vol, sizeof(SIFS_VOLUME_HEADER), SEEK_SET);
-		fwrite(bitmap, sizeof(SIFS_BIT), header.nblocks, vol);
-
-		// Clear fileblock from volume (is this nessesary?)
-		//unsigned char* clearblock = malloc(header.blocksize);
-		//fseek(vol,sizeof(SIFS_VOLUME_HEADER)+
+		put_volumebitmap(header, vol, bitmap);
 
-		//free(clearblock);
+		// Give the file block, its data and its chunks back to the host
+		punch_end(header, vol, before, bitmap);
 	}
 	else
 	{
@@ -169,44 +237,32 @@ int SIFS_rmfile(const char *volumename, const char *pathname)
 		}
 		fblock.nfiles--;
 
-		// Write fblock to volume
-		fseek(vol, sizeof(SIFS_VOLUME_HEADER) + header.nblocks + fileID * header.blocksize, SEEK_SET);
-		fwrite(&fblock, sizeof(SIFS_FILEBLOCK), 1, vol);
-
-		// More than one directory points to fblock. We need to update thier entries accordingly
-		uint32_t dirs_processed = 0;
-		for (uint32_t i = 0; i < header.nblocks && dirs_processed < fblock.nfiles; i++)
+		// Write fblock, then every other directory whose entries changed, to volume
+		put_fileblock(header, vol, fileID, &fblock);
+		for (uint32_t i = 0; i < nfixed; i++)
 		{
-			// If the block is a directory
-			if (bitmap[i] == SIFS_DIR)
-			{
-				SIFS_DIRBLOCK d = get_dirblock(header, vol, i);
-				for (uint32_t entry = 0; entry < d.nentries; entry++)
-				{
-					// If d points to fileID
-					if (d.entries[entry].blockID == fileID)
-					{
-						dirs_processed++;
-						// ... and if its fileindex into filenames occured after the deleted filename
-						if (d.entries[entry].fileindex > fileindex)
-						{
-							// .. adjust it accordingly
-							d.entries[entry].fileindex--;
-
-							// And write d to volume
-							fseek(vol, sizeof(SIFS_VOLUME_HEADER) + header.nblocks + i * header.blocksize, SEEK_SET);
-							fwrite(&d, sizeof(SIFS_DIRBLOCK), 1, vol);
-						}
-					}
-				}
-			}
+			put_dirblock(header, vol, fixedIDs[i], &fixed[i]);
 		}
 	}
+	free(list);
 	
 	free(bitmap);
 	if (dirpath)
 		free(dirpath);
 	free(name);
-	fclose(vol);
-	return 0;
+	if (close_volume(vol) != 0 && err == SIFS_EOK)
+	{
+		err = SIFS_EIO;
+		SIFS_errno = err;
+	}
+	return err == SIFS_EOK ? 0 : 1;
+}
+
+// remove an existing file from an existing volume
+int SIFS_rmfile(const char *volumename, const char *pathname)
+{
+	stats_begin(SIFS_OP_RMFILE);
+	int result = remove_file(volumename, pathname);
+	stats_end();
+	return result;
 }
@@ -0,0 +1,205 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <time.h>
+#include "sifsutils.h"
+
+// The cursor is saved after this many files, and when the scrub stops
+#define SCRUB_SAVE_EVERY	64
+
+// Returns the block saved in cursorfile, or the first block if there is none
+static SIFS_BLOCKID load_cursor(const char* cursorfile)
+{
+	SIFS_BLOCKID cursor = 0;
+	FILE* f = cursorfile ? fopen(cursorfile, "r") : NULL;
+	if (f)
+	{
+		if (fscanf(f, "%u", &cursor) != 1)
+			cursor = 0;
+		fclose(f);
+	}
+	return cursor;
+}
+
+// Saves cursor to cursorfile. A new file is renamed over the old one, so a crash never leaves half a cursor
+static bool save_cursor(const char* cursorfile, SIFS_BLOCKID cursor)
+{
+	if (!cursorfile)
+		return true;
+
+	char* tmpname = malloc(strlen(cursorfile) + 5); // For ".tmp" and null byte
+	if (!tmpname)
+		return false;
+	sprintf(tmpname, "%s.tmp", cursorfile);
+
+	FILE* f = fopen(tmpname, "w");
+	bool success = f && fprintf(f, "%u\n", cursor) > 0;
+	if (f && fclose(f) != 0)
+		success = false;
+	success = success && rename(tmpname, cursorfile) == 0;
+	if (!success)
+		remove(tmpname);
+
+	free(tmpname);
+	return success;
+}
+
+static double now_seconds(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Sleeps until nbytes at mbps megabytes per second would have taken since start
+static void throttle(double start, uint64_t nbytes, double mbps)
+{
+	if (mbps <= 0)
+		return;
+
+	double wait = nbytes / (mbps * 1e6) - (now_seconds() - start);
+	if (wait > 0)
+	{
+		struct timespec ts = { .tv_sec = (time_t)wait, .tv_nsec = (long)((wait - (time_t)wait) * 1e9) };
+		nanosleep(&ts, NULL);
+	}
+}
+
+// Rehashes the data of the file at fileID. Returns false if it does not match the file's MD5.
+// The volume is locked shared for the check only, so writers are held off no longer than one file
+static bool scrub_file(SIFS_VOLUME_HEADER header, FILE* vol, SIFS_BLOCKID fileID, char** data, size_t* capacity,
+	uint64_t* nbytes, int* err)
+{
+	bool match = true;
+	if (!lock_volume(vol, false))
+	{
+		*err = SIFS_EIO;
+		return true;
+	}
+
+	// The file may have been removed since the bitmap was read
+	if (get_bitmapentry(header, vol, fileID) == SIFS_FILE)
+	{
+		SIFS_FILEBLOCK fblock = get_fileblock(header, vol, fileID);
+		uint64_t nblocks = data_blocks(header, &fblock);
+
+		// A damaged file block is a mismatch too; its length must not size the buffer
+		char* grown = NULL;
+		if (!fileblock_intact(header, &fblock) || !length_plausible(header, &fblock) ||
+			fblock.firstblockID >= header.nblocks || nblocks > header.nblocks - fblock.firstblockID)
+		{
+			match = false;
+		}
+		else if (fblock.length > *capacity && !(grown = realloc(*data, fblock.length)))
+		{
+			*err = SIFS_ENOMEM;
+		}
+		else
+		{
+			if (grown)
+			{
+				*data = grown;
+				*capacity = fblock.length;
+			}
+
+			unsigned char md5_digest[MD5_BYTELEN];
+			phase_begin(SIFS_PHASE_HASH);
+			match = read_filedata(header, vol, &fblock, *data);
+			MD5_buffer(*data, fblock.length, md5_digest);
+			STAT_ADD(md5bytes, fblock.length);
+			phase_end(SIFS_PHASE_HASH);
+
+			match = match && memcmp(md5_digest, fblock.md5, MD5_BYTELEN) == 0;
+			*nbytes += stored_length(header, &fblock);
+		}
+	}
+
+	unlock_volume(vol);
+	return match;
+}
+
+// rehash file data in physical order, resuming from and saving to cursorfile
+static int scrub_volume(const char* volumename, double mbps, uint32_t maxfiles, const char* cursorfile,
+	SIFS_SCRUB_CALLBACK onmismatch, void* arg, SIFS_SCRUB_REPORT* report)
+{
+	// Check arguments
+	if (volumename == NULL || *volumename == '\0' || report == NULL || mbps < 0)
+	{
+		SIFS_errno = SIFS_EINVAL;
+		return 1;
+	}
+
+	// Open volume, reading and validating its header and bitmap
+	SIFS_VOLUME_HEADER header;
+	SIFS_BIT* bitmap;
+	FILE* vol = open_volume(volumename, "r", &header, &bitmap);
+	if (!vol)
+		return 1;
+
+	// Reopen the volume unbuffered, so that no stale data is read after each lock is taken.
+	// Closing it also drops the lock taken while opening; files are locked one at a time
+	close_volume(vol);
+	vol = fopen(volumename, "r");
+	if (!vol)
+	{
+		SIFS_errno = SIFS_ENOVOL;
+		free(bitmap);
+		return 1;
+	}
+	setvbuf(vol, NULL, _IONBF, 0);
+	memset(report, 0, sizeof(SIFS_SCRUB_REPORT));
+
+	SIFS_BLOCKID cursor = load_cursor(cursorfile);
+	if (cursor >= header.nblocks)
+		cursor = 0;
+
+	int err = SIFS_EOK;
+	char* data = NULL;
+	size_t capacity = 0;
+	double start = now_seconds();
+	for (/*blank*/; cursor < header.nblocks && err == SIFS_EOK; cursor++)
+	{
+		if (bitmap[cursor] != SIFS_FILE)
+			continue;
+		if (maxfiles != 0 && report->files == maxfiles)
+			break;
+
+		bool match = scrub_file(header, vol, cursor, &data, &capacity, &report->bytes, &err);
+		if (err != SIFS_EOK)
+			break;
+
+		report->files++;
+		if (!match)
+		{
+			report->mismatches++;
+			if (onmismatch)
+				onmismatch(volumename, cursor, arg);
+		}
+
+		if (report->files % SCRUB_SAVE_EVERY == 0)
+			save_cursor(cursorfile, cursor + 1);
+		throttle(start, report->bytes, mbps);
+	}
+
+	// A finished pass starts the next one from the front. A failed one resumes at the file it stopped on
+	report->finished = cursor >= header.nblocks;
+	if (!save_cursor(cursorfile, report->finished ? 0 : cursor) && err == SIFS_EOK)
+		err = SIFS_EIO;
+
+	if (err != SIFS_EOK)
+		SIFS_errno = err;
+
+	free(data);
+	free(bitmap);
+	fclose(vol);
+	return err == SIFS_EOK ? 0 : 1;
+}
+
+// rehash file data in physical order, resuming from and saving to cursorfile
+int SIFS_scrub(const char* volumename, double mbps, uint32_t maxfiles, const char* cursorfile,
+	SIFS_SCRUB_CALLBACK onmismatch, void* arg, SIFS_SCRUB_REPORT* report)
+{
+	stats_begin(SIFS_OP_SCRUB);
+	int result = scrub_volume(volumename, mbps, maxfiles, cursorfile, onmismatch, arg, report);
+	stats_end();
+	return result;
+}
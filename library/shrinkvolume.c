@@ -0,0 +1,102 @@
+#include "sifsutils.h"
+
+// Returns the number of blocks in use, and sets *nused to one past the last block in use
+static uint32_t count_used(SIFS_VOLUME_HEADER header, const SIFS_BIT* bitmap, SIFS_BLOCKID* nused)
+{
+	uint32_t count = 0;
+	*nused = 0;
+	STAT_ADD(bitmapscans, 1);
+	for (SIFS_BLOCKID id = 0; id < header.nblocks; id++)
+	{
+		if (bitmap[id] != SIFS_UNUSED)
+		{
+			count++;
+			*nused = id + 1;
+		}
+	}
+	return count;
+}
+
+// remove blocks from the end of an existing volume and return the space to the host
+static int shrink_volume(const char *volumename, uint32_t nblocks)
+{
+	// Check arguments
+	if (volumename == NULL || *volumename == '\0' || nblocks == 0)
+	{
+		SIFS_errno = SIFS_EINVAL;
+		return 1;
+	}
+
+	// Open volume, reading and validating its header and bitmap
+	SIFS_VOLUME_HEADER header;
+	SIFS_BIT* bitmap;
+	FILE* vol = open_volume(volumename, "r+", &header, &bitmap);
+	if (!vol)
+		return 1;
+
+	// The volume can only shrink
+	if (nblocks > header.nblocks)
+	{
+		SIFS_errno = SIFS_EINVAL;
+		free(bitmap);
+		close_volume(vol);
+		return 1;
+	}
+	if (nblocks == header.nblocks)
+	{
+		free(bitmap);
+		close_volume(vol);
+		return 0;
+	}
+
+	// A version 1 bitmap sits in front of block 0, so every block in use would have to move, and a crash
+	// part way through would corrupt the volume. Such volumes are refused; make them again to resize them
+	if (header.version < 2)
+	{
+		SIFS_errno = SIFS_EINVAL;
+		free(bitmap);
+		close_volume(vol);
+		return 1;
+	}
+
+	SIFS_BLOCKID nused;
+	if (count_used(header, bitmap, &nused) > nblocks)
+	{
+		SIFS_errno = SIFS_ENOSPC;
+		free(bitmap);
+		close_volume(vol);
+		return 1;
+	}
+
+	// Blocks in use past the new end are packed to the front first
+	if (nused > nblocks)
+	{
+		free(bitmap);
+		close_volume(vol);
+		if (defragment(volumename) != 0)
+			return 1;
+
+		vol = open_volume(volumename, "r+", &header, &bitmap);
+		if (!vol)
+			return 1;
+	}
+
+	// Only the bitmap moves, and the tail of the volume is cut off with it
+	bool success = relocate_bitmap(vol, &header, nblocks, bitmap);
+	free(bitmap);
+	if (close_volume(vol) != 0 || !success)
+	{
+		SIFS_errno = SIFS_EIO;
+		return 1;
+	}
+	return 0;
+}
+
+// remove blocks from the end of an existing volume and return the space to the host
+int SIFS_shrinkvolume(const char *volumename, uint32_t nblocks)
+{
+	stats_begin(SIFS_OP_SHRINKVOLUME);
+	int result = shrink_volume(volumename, nblocks);
+	stats_end();
+	return result;
+}
@@ -1,5 +1,8 @@
+#include <stddef.h>
 #include "../sifs.h"
 #include "md5.h"
+#include "lz.h"
+#include "crc32c.h"
 
 //  CONCRETE STRUCTURES AND CONSTANTS USED THROUGHOUT THE SIFS LIBRARY.
 //  DO NOT CHANGE ANYTHING IN THIS FILE.
@@ -15,12 +18,41 @@
 #define SIFS_DATABLOCK		'b'
 
 #define SIFS_ROOTDIR_BLOCKID	0
+#define SIFS_SNAPSHOT_BLOCKID	1	// the snapshot table, on volumes made with SIFS_FORMAT_SNAPSHOT
+
+#define SIFS_FORMAT_ALL		(SIFS_FORMAT_PACKED | SIFS_FORMAT_COMPRESS | SIFS_FORMAT_INLINE | SIFS_FORMAT_CHUNKED | \
+				 SIFS_FORMAT_SNAPSHOT)
+
+#define SIFS_FILE_INLINE	0x1	// contents follow the file block in its own block
+#define SIFS_FILE_CHUNKED	0x2	// data blocks hold a list of chunk blocks
+#define SIFS_FILE_CHUNK		0x4	// a chunk of other files' contents, nfiles counts its references
+#define SIFS_CHUNK_MAX		65536	// no chunk holds more bytes of contents than this
+
+#define SIFS_COMPRESS_NONE	0	// contents are stored as they are
+#define SIFS_COMPRESS_LZ	1	// contents are stored by LZ_compress()
 
 typedef struct {
     size_t		blocksize;
     uint32_t		nblocks;
+    uint32_t		flags;		// SIFS_FORMAT_*, zero for older volumes
+
+    //  ONLY ON DISK FROM VERSION 2. VERSION 1 VOLUMES END THEIR HEADER AT flags
+    uint32_t		magic;		// SIFS_MAGIC
+    uint32_t		version;	// SIFS_VERSION of the format, 1 for volumes without a magic number
+    uint32_t		features;	// SIFS_FEATURE_* of the on-disk structures
+    uint32_t		checksum;	// CRC32C of the header, taken with checksum zeroed
+    uint64_t		bitmapoffset;	// byte offset of the bitmap, which moves as the volume is resized
+    uint64_t		dataoffset;	// byte offset of block 0, which never moves
 } SIFS_VOLUME_HEADER;
 
+#define SIFS_MAGIC		0x53464953	// "SIFS" on disk, on little-endian hosts
+#define SIFS_VERSION		2
+
+#define SIFS_V1_HEADER_SIZE	offsetof(SIFS_VOLUME_HEADER, magic)
+
+#define SIFS_FEATURE_CRC	0x1	// directory and file blocks carry a CRC32C
+#define SIFS_FEATURE_ALL	(SIFS_FEATURE_CRC)
+
 typedef char		SIFS_BIT;	// SIFS_UNUSED, SIFS_DIR, ...
 typedef uint32_t	SIFS_BLOCKID;
 
@@ -34,6 +66,12 @@ typedef struct {
 	SIFS_BLOCKID	blockID;	// of the entry's subdirectory or file
 	uint32_t	fileindex;	// into a SIFS_FILEBLOCK's filenames[]
     } entries[SIFS_MAX_ENTRIES];
+
+    //  ONLY USED ON VOLUMES MADE WITH SIFS_FORMAT_SNAPSHOT
+    uint32_t		generation;	// in which the block was made or copied
+
+    //  ONLY USED ON VOLUMES WITH SIFS_FEATURE_CRC. ALWAYS THE LAST FIELD
+    uint32_t		crc;		// CRC32C of every byte before it
 } SIFS_DIRBLOCK;
 
 //  DEFINITION OF EACH FILE BLOCK - MUST FIT INSIDE A SINGLE BLOCK
@@ -46,5 +84,22 @@ typedef struct {
 
     uint32_t		nfiles;		// n files with identical contents
     char		filenames[SIFS_MAX_ENTRIES][SIFS_MAX_NAME_LENGTH];
+
+    //  ONLY USED ON VOLUMES MADE WITH SIFS_FORMAT_COMPRESS
+    uint32_t		compression;	// SIFS_COMPRESS_* of the stored contents
+    size_t		storedlength;	// length of the stored contents in bytes
+
+    //  ONLY USED ON VOLUMES MADE WITH SIFS_FORMAT_INLINE
+    uint32_t		fileflags;	// SIFS_FILE_*
+
+    //  ONLY USED ON VOLUMES MADE WITH SIFS_FORMAT_CHUNKED
+    uint32_t		nchunks;	// n chunk blocks in the chunk list
+
+    //  ONLY USED ON VOLUMES MADE WITH SIFS_FORMAT_SNAPSHOT
+    uint32_t		generation;	// in which the block was made or copied
+    uint32_t		datageneration;	// in which the contents were written
+
+    //  ONLY USED ON VOLUMES WITH SIFS_FEATURE_CRC. ALWAYS THE LAST FIELD
+    uint32_t		crc;		// CRC32C of every byte before it
 } SIFS_FILEBLOCK;
 
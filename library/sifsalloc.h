@@ -0,0 +1,21 @@
+//  WHERE NEW BLOCKS GO. DIRECTORY, FILE AND DATA BLOCKS ADDED TO A VOLUME ARE PLACED HERE, UNDER THE
+//  POLICY CHOSEN WITH SIFS_set_placement(). SIFS_PLACE_FIRST TAKES THE RUN OF UNUSED BLOCKS CHOSEN BY
+//  THE STRATEGY SET WITH SIFS_set_allocator(). SIFS_PLACE_NEAR GIVES EACH NEW DIRECTORY A CLUSTER OF UNUSED BLOCKS, PUTS A FILE BLOCK AS
+//  CLOSE AFTER ITS DIRECTORY AS IT CAN, AND A FILE'S DATA STRAIGHT AFTER ITS FILE BLOCK.
+//  MUST BE INCLUDED AFTER sifs-internal.h
+
+// Returns the first of n unused blocks in a row chosen by the allocation strategy, or header.nblocks if there are none
+extern SIFS_BLOCKID allocate_run(SIFS_VOLUME_HEADER header, const SIFS_BIT* bitmap, uint32_t n);
+
+// Returns the block for a new directory added to directory parent, or header.nblocks if the volume is full
+extern SIFS_BLOCKID place_dirblock(SIFS_VOLUME_HEADER header, const SIFS_BIT* bitmap, SIFS_BLOCKID parent);
+
+// Returns the block for a new file block added to directory parent, followed where possible by ndata unused
+// blocks for its data. Returns header.nblocks if the volume is full
+extern SIFS_BLOCKID place_fileblock(SIFS_VOLUME_HEADER header, const SIFS_BIT* bitmap, SIFS_BLOCKID parent,
+	uint32_t ndata);
+
+// Returns the first of nblocks unused blocks in a row for the data of file block fileID,
+// or header.nblocks if there are none
+extern SIFS_BLOCKID place_data(SIFS_VOLUME_HEADER header, const SIFS_BIT* bitmap, SIFS_BLOCKID fileID,
+	uint32_t nblocks);
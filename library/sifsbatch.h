@@ -0,0 +1,25 @@
+//  BATCHES OF BLOCK READS AND WRITES, ISSUED TOGETHER SO THAT THE DEVICE SEES THEM ALL AT ONCE.
+//  WITH THE SIFS_IO_URING BACKEND A WHOLE BATCH IS SUBMITTED TO THE KERNEL IN ONE CALL, OTHERWISE
+//  ITS REQUESTS ARE ISSUED ONE AFTER THE OTHER WITH pread() AND pwrite().
+//  BATCHES GO AROUND THE STDIO BUFFERS OF A VOLUME, AND KEEP THE BLOCK CACHE COHERENT WITH THEM.
+//  MUST BE INCLUDED AFTER sifs-internal.h
+
+// One read or write of a batch
+typedef struct {
+	long		offset;
+	void*		buf;
+	size_t		nbytes;
+	size_t		ndone;		// bytes transferred, set by read_batch() and write_batch()
+} IO_REQUEST;
+
+// Reads every one of the nreqs requests of reqs from vol as one batch. Returns true if each was read in full
+extern bool read_batch(FILE* vol, IO_REQUEST* reqs, size_t nreqs);
+
+// Writes every one of the nreqs requests of reqs to vol as one batch. Returns true if each was written in full
+extern bool write_batch(FILE* vol, IO_REQUEST* reqs, size_t nreqs);
+
+// Reads nbytes at offset of vol into buf, split into a batch of reads. Returns the number of bytes read
+extern size_t read_run(FILE* vol, long offset, void* buf, size_t nbytes);
+
+// Writes nbytes of buf at offset of vol, split into a batch of writes. Returns the number of bytes written
+extern size_t write_run(FILE* vol, long offset, const void* buf, size_t nbytes);
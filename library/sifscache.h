@@ -0,0 +1,35 @@
+//  A BLOCK CACHE OF DIRECTORY AND FILE BLOCKS SHARED BY EVERY OPERATION.
+//  BLOCKS ARE CACHED BY THE VOLUME THEY BELONG TO (ITS DEVICE AND INODE), SO THEY SURVIVE FROM ONE
+//  CALL TO THE NEXT UNTIL THE VOLUME IS CHANGED BY SOMEONE ELSE. BLOCKS WRITTEN WITH put_dirblock()
+//  AND put_fileblock() ARE ONLY WRITTEN TO THE VOLUME WHEN THEY ARE EVICTED, WHEN THE VOLUME IS READ
+//  BEHIND THE CACHE'S BACK, OR WHEN IT IS CLOSED WITH close_volume().
+//  MUST BE INCLUDED AFTER sifs-internal.h
+
+// Starts caching the blocks of vol, which has just been opened and locked. Blocks cached by earlier calls are
+// dropped if the volume has changed since this process last closed it
+extern void cache_attach(FILE* vol, SIFS_VOLUME_HEADER header);
+
+// Writes back the dirty blocks of vol, remembers what the volume looks like and closes it.
+// Returns the result of fclose(), or EOF if a dirty block could not be written back
+extern int close_volume(FILE* vol);
+
+// Returns true if the blocks of vol are being cached
+extern bool cache_active(FILE* vol);
+
+// Copies nbytes of block id of vol into block. Returns false if the block is not cached
+extern bool cache_get(FILE* vol, SIFS_BLOCKID id, void* block, size_t nbytes);
+
+// Caches nbytes of block id of vol, just read from the volume
+extern void cache_fill(FILE* vol, SIFS_BLOCKID id, const void* block, size_t nbytes);
+
+// Caches nbytes of block id of vol, to be written at offset later. Returns false if the block must be written now
+extern bool cache_put(FILE* vol, SIFS_BLOCKID id, const void* block, size_t nbytes, long offset);
+
+// Writes back every dirty block, before the volume is read without the cache
+extern void cache_flush(void);
+
+// Drops the cached blocks of vol that overlap nbytes at offset, before they are written without the cache
+extern void cache_forget(FILE* vol, long offset, size_t nbytes);
+
+// Drops every cached block of the volume vol refers to, after its header has been rewritten
+extern void cache_reset(FILE* vol, SIFS_VOLUME_HEADER header);
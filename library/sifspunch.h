@@ -0,0 +1,16 @@
+//  HOLE PUNCHING. WHEN IT IS TURNED ON WITH SIFS_set_hole_punching(), BLOCKS THAT AN OPERATION FREES
+//  ARE HANDED BACK TO THE HOST FILESYSTEM WITH fallocate(FALLOC_FL_PUNCH_HOLE), EACH RUN OF
+//  NEIGHBOURING BLOCKS IN ONE CALL, SO THAT THE SPACE A VOLUME TAKES ON THE HOST FOLLOWS THE BLOCKS
+//  IN USE. PUNCHED BLOCKS READ AS ZEROES.
+//  MUST BE INCLUDED AFTER sifs-internal.h
+
+// Gives the host back the n blocks from first of vol. Returns false if they were not punched out,
+// because hole punching is off or the host filesystem does not support it
+extern bool punch_blocks(SIFS_VOLUME_HEADER header, FILE* vol, SIFS_BLOCKID first, uint32_t n);
+
+// Returns a copy of bitmap to compare with once blocks have been freed, or NULL if hole punching is off
+extern SIFS_BIT* punch_begin(SIFS_VOLUME_HEADER header, const SIFS_BIT* bitmap);
+
+// Punches out every block in use in before that bitmap now shows unused, then releases before.
+// Does nothing if before is NULL
+extern void punch_end(SIFS_VOLUME_HEADER header, FILE* vol, SIFS_BIT* before, const SIFS_BIT* bitmap);
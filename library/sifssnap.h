@@ -0,0 +1,33 @@
+//  COPY-ON-WRITE SNAPSHOTS. ON VOLUMES MADE WITH SIFS_FORMAT_SNAPSHOT, BLOCK SIFS_SNAPSHOT_BLOCKID IS A
+//  DIRECTORY BLOCK HOLDING THE SNAPSHOT TABLE. EACH OF ITS ENTRIES POINTS AT THE ROOT DIRECTORY OF A SNAPSHOT,
+//  A COPY OF THE ROOT DIRECTORY CARRYING THE SNAPSHOT'S NAME, AND ITS fileindex HOLDS THE GENERATION THE
+//  SNAPSHOT WAS TAKEN IN. THE TABLE'S OWN generation IS STAMPED ON EVERY BLOCK MADE OR COPIED NOW.
+//  A DIRECTORY OR FILE BLOCK STAMPED NO LATER THAN THE NEWEST SNAPSHOT IS SHARED WITH A SNAPSHOT: IT IS
+//  COPIED BEFORE IT CHANGES, AND KEPT WHEN THE VOLUME STOPS USING IT. THE DATA BLOCKS OF A FILE ARE SHARED
+//  THE SAME WAY, BY THEIR datageneration. THE ROOT DIRECTORY ITSELF IS NEVER SHARED.
+//  MUST BE INCLUDED AFTER sifs-internal.h
+
+// Returns the generation to stamp on blocks made or copied now. Always 0 on volumes without snapshots
+extern uint32_t snapshot_generation(SIFS_VOLUME_HEADER header, FILE* vol);
+
+// Returns true if a block stamped with generation is shared with a snapshot, so must be neither changed nor freed
+extern bool snapshot_shared(SIFS_VOLUME_HEADER header, FILE* vol, uint32_t generation);
+
+// Writes dblock, stamped with the current generation, to a new block near parent. The caller points the entry
+// of parent at the copy. Returns header.nblocks and sets err on failure
+extern SIFS_BLOCKID copy_dirblock(SIFS_VOLUME_HEADER header, SIFS_BIT* bitmap, FILE* vol, SIFS_DIRBLOCK* dblock,
+	SIFS_BLOCKID parent, int* err);
+
+// Returns the SIFS_BLOCKID of the directory dirpath of the live volume (the root directory if dirpath is NULL),
+// first copying it and each directory above it that a snapshot shares, so that it may be changed in place
+extern SIFS_BLOCKID cow_dir(SIFS_VOLUME_HEADER header, SIFS_BIT* bitmap, FILE* vol, const char* dirpath, int* err);
+
+// Copies the shared file block file for the live volume, and points every entry of the live volume that
+// refers to it at the copy. The copy holds only the names those entries use. Returns header.nblocks and
+// sets err on failure
+extern SIFS_BLOCKID cow_file(SIFS_VOLUME_HEADER header, SIFS_BIT* bitmap, FILE* vol, SIFS_BLOCKID file, int* err);
+
+// Opens volumename for reading like open_volume(), and sets root to the directory that paths start from.
+// A volumename of the form volume@name, where no such host file exists, opens the snapshot name of volume
+extern FILE* open_snapshot(const char* volumename, SIFS_VOLUME_HEADER* header, SIFS_BIT** bitmap,
+	SIFS_BLOCKID* root);
@@ -0,0 +1,29 @@
+//  I/O AND WORK COUNTERS KEPT FOR EACH TYPE OF OPERATION.
+//  EVERY PUBLIC SIFS_* FUNCTION CALLS stats_begin() BEFORE DOING ANY WORK,
+//  SO THAT THE COUNTERS BELOW ARE ATTRIBUTED TO THE OPERATION IN PROGRESS.
+//  MUST BE INCLUDED AFTER sifs.h
+
+extern SIFS_STATS	SIFS_stats[SIFS_NOPS];
+extern int		SIFS_currentop;
+
+// Adds n to field of the counters of the operation in progress
+#define STAT_ADD(field, n)	(SIFS_stats[SIFS_currentop].field += (n))
+
+// Counts a seek to offset before nbytes are transferred there, and how far it moved from the last transfer
+extern void stat_seek(long offset, size_t nbytes);
+
+// Marks the start of a call to operation op
+extern void stats_begin(int op);
+
+// Marks the end of the call started by stats_begin()
+extern void stats_end(void);
+
+// Marks the start and end of a phase (one of SIFS_PHASE_*) within the operation in progress.
+// Phases may nest and overlap; a phase still open when the call ends is closed with it
+extern void phase_begin(int phase);
+extern void phase_end(int phase);
+
+// Latency bookkeeping, driven by stats_begin(), stats_end() and SIFS_reset_stats()
+extern void latency_begin(void);
+extern void latency_end(int op);
+extern void latency_reset(void);
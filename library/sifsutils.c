@@ -1,69 +1,501 @@
 //  CITS2002 Project 2 2019
 //  Name(s):             Ethan Lim
 //  Student number(s):   22701593
+#define _POSIX_C_SOURCE 200809L
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <stddef.h>
 #include "sifsutils.h"
 
+// Blocks described by each byte of a packed bitmap
+#define PACKED_PER_BYTE	4
+
+// Directory and file blocks read since the volume was opened that failed their checksum
+static uint32_t nbadblocks = 0;
+
+// Two bit codes of a packed bitmap, indexed by code. SIFS_UNUSED is 0 so that holes read as unused blocks
+static const SIFS_BIT packed_codes[] = { SIFS_UNUSED, SIFS_DIR, SIFS_FILE, SIFS_DATABLOCK };
+
+// Returns the two bit code of b in a packed bitmap
+static unsigned char packed_code(SIFS_BIT b)
+{
+	switch (b)
+	{
+	case SIFS_DIR:
+		return 1;
+	case SIFS_FILE:
+		return 2;
+	case SIFS_DATABLOCK:
+		return 3;
+	default:
+		return 0;
+	}
+}
+
+// Returns the number of bytes the bitmap takes up on the volume
+size_t bitmap_size(SIFS_VOLUME_HEADER header)
+{
+	if (header.flags & SIFS_FORMAT_PACKED)
+		return (header.nblocks + PACKED_PER_BYTE - 1) / PACKED_PER_BYTE;
+	return header.nblocks * sizeof(SIFS_BIT);
+}
+
+// Returns the number of bytes the header takes up on the volume. Version 1 headers end at flags
+size_t header_size(SIFS_VOLUME_HEADER header)
+{
+	return header.version >= 2 ? sizeof(SIFS_VOLUME_HEADER) : SIFS_V1_HEADER_SIZE;
+}
+
+// Returns the byte offset of the bitmap within a volume. Version 1 bitmaps always follow the header
+long bitmap_offset(SIFS_VOLUME_HEADER header)
+{
+	return header.version >= 2 ? (long)header.bitmapoffset : (long)header_size(header);
+}
+
+// Returns the byte offset of block id within a volume
+long block_offset(SIFS_VOLUME_HEADER header, SIFS_BLOCKID id)
+{
+	if (header.version >= 2)
+		return (long)header.dataoffset + (long)id * header.blocksize;
+	return header_size(header) + bitmap_size(header) + (long)id * header.blocksize;
+}
+
+// Returns the number of bytes of the host file that a volume takes up
+long volume_bytes(SIFS_VOLUME_HEADER header)
+{
+	long blocksend = block_offset(header, header.nblocks);
+	long bitmapend = bitmap_offset(header) + bitmap_size(header);
+	return blocksend > bitmapend ? blocksend : bitmapend;
+}
+
+// Reads nbytes at offset of vol into buf, bypassing the block cache. Returns the number of bytes read
+size_t read_uncached(FILE* vol, long offset, void* buf, size_t nbytes)
+{
+	fseek(vol, offset, SEEK_SET);
+	size_t nread = fread(buf, 1, nbytes, vol);
+
+	stat_seek(offset, nread);
+	STAT_ADD(nreads, 1);
+	STAT_ADD(bytesread, nread);
+	return nread;
+}
+
+// Writes nbytes of buf at offset of vol, bypassing the block cache. Returns the number of bytes written
+size_t write_uncached(FILE* vol, long offset, const void* buf, size_t nbytes)
+{
+	phase_begin(SIFS_PHASE_FLUSH);
+	fseek(vol, offset, SEEK_SET);
+	size_t nwritten = fwrite(buf, 1, nbytes, vol);
+	phase_end(SIFS_PHASE_FLUSH);
+
+	stat_seek(offset, nwritten);
+	STAT_ADD(nwrites, 1);
+	STAT_ADD(byteswritten, nwritten);
+	return nwritten;
+}
+
+// Reads nbytes at offset of vol into buf. Returns the number of bytes read
+size_t read_at(FILE* vol, long offset, void* buf, size_t nbytes)
+{
+	// Blocks still waiting in the cache must reach the volume before it is read around them
+	cache_flush();
+	return read_uncached(vol, offset, buf, nbytes);
+}
+
+// Writes nbytes of buf at offset of vol. Returns the number of bytes written
+size_t write_at(FILE* vol, long offset, const void* buf, size_t nbytes)
+{
+	cache_forget(vol, offset, nbytes);
+	return write_uncached(vol, offset, buf, nbytes);
+}
+
+// Sets the size of vol to nbytes. New bytes are holes that read as zeroes. Returns true if action was successful
+bool resize_volume(FILE* vol, long nbytes)
+{
+	fflush(vol);
+	return ftruncate(fileno(vol), nbytes) == 0;
+}
+
+// Writes everything written to vol so far through to the host's storage. Returns true if action was successful
+bool sync_volume(FILE* vol)
+{
+	return fflush(vol) == 0 && fsync(fileno(vol)) == 0;
+}
+
 // Returns volume header of a valid FILE* volume
 SIFS_VOLUME_HEADER get_volumeheader(FILE* vol)
 {
-	// Seek to beggining
-	fseek(vol, 0, SEEK_SET);
-
 	// Read header
 	SIFS_VOLUME_HEADER header;
-	fread(&header, sizeof(SIFS_VOLUME_HEADER), 1, vol);
+	memset(&header, 0, sizeof(SIFS_VOLUME_HEADER));
+	read_at(vol, 0, &header, sizeof(SIFS_VOLUME_HEADER));
 
+	// Without the magic number the header is a version 1 one, and the bytes read after it belong to the bitmap
+	if (header.magic != SIFS_MAGIC)
+	{
+		memset((char*)&header + SIFS_V1_HEADER_SIZE, 0, sizeof(SIFS_VOLUME_HEADER) - SIFS_V1_HEADER_SIZE);
+		header.version = 1;
+	}
 	return header;
 }
 
-// Stores volume bitmap of a valid FILE* volume
+// Returns the checksum of header, taken with its checksum field zeroed
+uint32_t header_checksum(SIFS_VOLUME_HEADER header)
+{
+	unsigned char image[sizeof(SIFS_VOLUME_HEADER)];
+	memcpy(image, &header, sizeof(SIFS_VOLUME_HEADER));
+	memset(image + offsetof(SIFS_VOLUME_HEADER, checksum), 0, sizeof(header.checksum));
+	return CRC32C_buffer(image, sizeof(SIFS_VOLUME_HEADER));
+}
+
+// Stores volume bitmap of a valid FILE* volume. A packed bitmap is expanded to one SIFS_BIT per block, so
+// packing saves bitmap I/O but not memory
 void get_volumebitmap(FILE* vol, SIFS_BIT** bitmap)
 {
 	SIFS_VOLUME_HEADER header = get_volumeheader(vol);
 	*bitmap = malloc(header.nblocks);
-	// vol file pointer already points to beginning of bitmap
-	fread(*bitmap, sizeof(SIFS_BIT), header.nblocks, vol);
+	if (!*bitmap)
+		return;
+
+	if (!(header.flags & SIFS_FORMAT_PACKED))
+	{
+		read_at(vol, bitmap_offset(header), *bitmap, header.nblocks * sizeof(SIFS_BIT));
+		return;
+	}
+
+	unsigned char* packed = calloc(bitmap_size(header), 1);
+	if (!packed)
+	{
+		free(*bitmap);
+		*bitmap = NULL;
+		return;
+	}
+	read_at(vol, bitmap_offset(header), packed, bitmap_size(header));
+	for (uint32_t id = 0; id < header.nblocks; id++)
+	{
+		(*bitmap)[id] = packed_codes[(packed[id / PACKED_PER_BYTE] >> (2 * (id % PACKED_PER_BYTE))) & 3];
+	}
+	free(packed);
 }
 
-// Returns SIFS_DIRBLOCK of directory block pointed to by dir
-SIFS_DIRBLOCK get_dirblock(SIFS_VOLUME_HEADER header, FILE* vol, SIFS_BLOCKID dir)
+// Writes header to a valid FILE* volume. Headers from version 2 are written with their checksum
+void put_volumeheader(FILE* vol, const SIFS_VOLUME_HEADER* header)
 {
-	// Seek to beggining of blocks
-	int offset = sizeof(SIFS_VOLUME_HEADER) + header.nblocks * sizeof(SIFS_BIT);
-	fseek(vol, offset, SEEK_SET);
+	SIFS_VOLUME_HEADER sealed = *header;
+	if (sealed.version >= 2)
+		sealed.checksum = header_checksum(sealed);
+	write_at(vol, 0, &sealed, header_size(sealed));
+	cache_reset(vol, sealed);
+}
+
+// Writes the whole bitmap to a valid FILE* volume, packing it if the volume was made that way
+void put_volumebitmap(SIFS_VOLUME_HEADER header, FILE* vol, const SIFS_BIT* bitmap)
+{
+	if (!(header.flags & SIFS_FORMAT_PACKED))
+	{
+		write_at(vol, bitmap_offset(header), bitmap, header.nblocks * sizeof(SIFS_BIT));
+		return;
+	}
+
+	unsigned char* packed = calloc(bitmap_size(header), 1);
+	if (!packed)
+		return;
+	for (uint32_t id = 0; id < header.nblocks; id++)
+	{
+		packed[id / PACKED_PER_BYTE] |= packed_code(bitmap[id]) << (2 * (id % PACKED_PER_BYTE));
+	}
+	write_at(vol, bitmap_offset(header), packed, bitmap_size(header));
+	free(packed);
+}
 
-	// Seek to pointed block
-	offset = dir * header.blocksize;
-	fseek(vol, offset, SEEK_CUR);
+// Writes bitmap at offset, then the header of a volume of resized.nblocks blocks that points at it, each one
+// synced before the next. Returns true if action was successful
+static bool place_bitmap(FILE* vol, SIFS_VOLUME_HEADER* header, SIFS_VOLUME_HEADER resized, long offset,
+	const SIFS_BIT* bitmap)
+{
+	resized.bitmapoffset = offset;
+	put_volumebitmap(resized, vol, bitmap);
+	if (!sync_volume(vol))
+		return false;
+
+	put_volumeheader(vol, &resized);
+	*header = resized;
+	return sync_volume(vol);
+}
+
+// Resizes a version 2 volume to nblocks blocks by moving its bitmap alone: into the room in front of block 0
+// while it fits there, and after the last block otherwise. Blocks past a new, smaller end must be unused.
+// The header is only rewritten once the bitmap it points at is written, so a crash leaves the volume
+// at either size. Returns true if action was successful
+bool relocate_bitmap(FILE* vol, SIFS_VOLUME_HEADER* header, uint32_t nblocks, const SIFS_BIT* bitmap)
+{
+	SIFS_VOLUME_HEADER resized = *header;
+	resized.nblocks = nblocks;
+	long room = (long)header->dataoffset - (long)header_size(*header);
+	long home = (long)bitmap_size(resized) <= room ? (long)header_size(resized) : block_offset(resized, nblocks);
+	resized.bitmapoffset = home;
+
+	// In front of block 0 the new bitmap agrees with the old one wherever they overlap, so it is written in place.
+	// Anywhere else, a new place that overlaps the old bitmap is reached by way of a place past both
+	long old = bitmap_offset(*header), oldend = old + bitmap_size(*header);
+	long end = home + bitmap_size(resized);
+	long scratch = home != old && home < oldend && old < end ? (oldend > end ? oldend : end) : 0;
+
+	long nbytes = volume_bytes(resized) > volume_bytes(*header) ? volume_bytes(resized) : volume_bytes(*header);
+	if (scratch + (long)bitmap_size(resized) > nbytes)
+		nbytes = scratch + bitmap_size(resized);
+	if (!resize_volume(vol, nbytes))
+		return false;
+
+	if (scratch && !place_bitmap(vol, header, resized, scratch, bitmap))
+		return false;
+	if (!place_bitmap(vol, header, resized, home, bitmap))
+		return false;
+
+	// The part of an old bitmap left among the blocks of the volume is cleared, as unused blocks read as zeroes
+	long blocksend = block_offset(resized, nblocks);
+	if (old != home && old >= block_offset(resized, 0) && old < blocksend)
+	{
+		long nzeroes = (oldend < blocksend ? oldend : blocksend) - old;
+		void* zeroes = calloc(nzeroes, 1);
+		if (!zeroes)
+			return false;
+		write_at(vol, old, zeroes, nzeroes);
+		free(zeroes);
+	}
+	return resize_volume(vol, volume_bytes(resized));
+}
+
+// Returns the bitmap entry of block id, read from a valid FILE* volume
+SIFS_BIT get_bitmapentry(SIFS_VOLUME_HEADER header, FILE* vol, SIFS_BLOCKID id)
+{
+	if (!(header.flags & SIFS_FORMAT_PACKED))
+	{
+		SIFS_BIT b = SIFS_UNUSED;
+		read_at(vol, bitmap_offset(header) + id * sizeof(SIFS_BIT), &b, sizeof(SIFS_BIT));
+		return b;
+	}
+
+	unsigned char packed = 0;
+	read_at(vol, bitmap_offset(header) + id / PACKED_PER_BYTE, &packed, 1);
+	return packed_codes[(packed >> (2 * (id % PACKED_PER_BYTE))) & 3];
+}
+
+// Writes only the byte of the bitmap that holds block id to a valid FILE* volume
+void put_bitmapentry(SIFS_VOLUME_HEADER header, FILE* vol, const SIFS_BIT* bitmap, SIFS_BLOCKID id)
+{
+	if (!(header.flags & SIFS_FORMAT_PACKED))
+	{
+		write_at(vol, bitmap_offset(header) + id * sizeof(SIFS_BIT), &bitmap[id], sizeof(SIFS_BIT));
+		return;
+	}
+
+	// Pack the neighbours that share the byte too
+	SIFS_BLOCKID first = id - id % PACKED_PER_BYTE;
+	unsigned char packed = 0;
+	for (SIFS_BLOCKID b = first; b < first + PACKED_PER_BYTE && b < header.nblocks; b++)
+	{
+		packed |= packed_code(bitmap[b]) << (2 * (b - first));
+	}
+	write_at(vol, bitmap_offset(header) + id / PACKED_PER_BYTE, &packed, 1);
+}
+
+// Waits for a lock on the whole of vol. Exclusive locks keep out every other process, shared locks only writers
+bool lock_volume(FILE* vol, bool exclusive)
+{
+	struct flock lock = { .l_type = exclusive ? F_WRLCK : F_RDLCK, .l_whence = SEEK_SET, .l_start = 0, .l_len = 0 };
+	return fcntl(fileno(vol), F_SETLKW, &lock) == 0;
+}
+
+// Releases the lock taken by lock_volume(). Closing vol also releases it
+void unlock_volume(FILE* vol)
+{
+	struct flock lock = { .l_type = F_UNLCK, .l_whence = SEEK_SET, .l_start = 0, .l_len = 0 };
+	fcntl(fileno(vol), F_SETLK, &lock);
+}
+
+// Opens volumename with mode, reading and validating its header and bitmap. The volume stays locked until it is
+// closed: shared if mode only reads, exclusive otherwise. Returns NULL and sets SIFS_errno on failure
+FILE* open_volume(const char* volumename, const char* mode, SIFS_VOLUME_HEADER* header, SIFS_BIT** bitmap)
+{
+	phase_begin(SIFS_PHASE_OPEN);
+
+	// Try to open volume
+	FILE* vol = fopen(volumename, mode);
+	if (!vol)
+	{
+		SIFS_errno = SIFS_ENOVOL;
+		phase_end(SIFS_PHASE_OPEN);
+		return NULL;
+	}
+	if (!lock_volume(vol, strcmp(mode, "r") != 0))
+	{
+		SIFS_errno = SIFS_EIO;
+		fclose(vol);
+		phase_end(SIFS_PHASE_OPEN);
+		return NULL;
+	}
+
+	// Read and validate header. From version 2 the magic number and checksum recognise the volume
+	*header = get_volumeheader(vol);
+	bool versioned = header->version >= 2;
+	int err = SIFS_EOK;
+	if (versioned && header->checksum != header_checksum(*header))
+		err = SIFS_EBADCRC;
+	else if (header->blocksize < SIFS_MIN_BLOCKSIZE || header->nblocks == 0 || (header->flags & ~SIFS_FORMAT_ALL) ||
+		header->version > SIFS_VERSION || (header->features & ~SIFS_FEATURE_ALL))
+		err = SIFS_ENOTVOL;
+	if (err != SIFS_EOK)
+	{
+		SIFS_errno = err;
+		fclose(vol);
+		phase_end(SIFS_PHASE_OPEN);
+		return NULL;
+	}
+	nbadblocks = 0;
+
+	// Read and validate bitmap
+	get_volumebitmap(vol, bitmap);
+	if (!*bitmap)
+	{
+		SIFS_errno = SIFS_ENOMEM;
+		fclose(vol);
+		phase_end(SIFS_PHASE_OPEN);
+		return NULL;
+	}
+	// Only version 1 volumes, which have nothing else to recognise them by, need the whole bitmap checked
+	if (!versioned && !validate_bitmap(*bitmap, header->nblocks))
+	{
+		SIFS_errno = SIFS_ENOTVOL;
+		free(*bitmap);
+		fclose(vol);
+		phase_end(SIFS_PHASE_OPEN);
+		return NULL;
+	}
+
+	cache_attach(vol, *header);
+	phase_end(SIFS_PHASE_OPEN);
+	return vol;
+}
+
+// Returns the CRC32C of the crcoffset bytes of a metadata block that come before its crc field
+static uint32_t block_crc(const void* block, size_t crcoffset)
+{
+	return CRC32C_buffer(block, crcoffset);
+}
+
+// Returns true if block holds the checksum of its contents, or if the volume keeps none
+static bool block_intact(SIFS_VOLUME_HEADER header, const void* block, size_t crcoffset)
+{
+	if (!(header.features & SIFS_FEATURE_CRC))
+		return true;
+	uint32_t crc;
+	memcpy(&crc, (const char*)block + crcoffset, sizeof(crc));
+	return crc == block_crc(block, crcoffset);
+}
+
+// Returns true if the directory block holds the checksum of its contents, or if the volume keeps none
+bool dirblock_intact(SIFS_VOLUME_HEADER header, const SIFS_DIRBLOCK* block)
+{
+	return block_intact(header, block, offsetof(SIFS_DIRBLOCK, crc));
+}
+
+// Returns true if the file block holds the checksum of its contents, or if the volume keeps none
+bool fileblock_intact(SIFS_VOLUME_HEADER header, const SIFS_FILEBLOCK* block)
+{
+	return block_intact(header, block, offsetof(SIFS_FILEBLOCK, crc));
+}
+
+// Returns true if no directory or file block read from the volume since it was opened failed its checksum.
+// Operations that change the volume check this before writing anything
+bool metadata_intact(void)
+{
+	return nbadblocks == 0;
+}
+
+// Returns the number of bytes a directory block takes up on the volume. Without SIFS_FEATURE_CRC it ends before crc
+size_t dirblock_size(SIFS_VOLUME_HEADER header)
+{
+	return header.features & SIFS_FEATURE_CRC ? sizeof(SIFS_DIRBLOCK) : offsetof(SIFS_DIRBLOCK, crc);
+}
 
-	// Read block
+// Returns the number of bytes a file block takes up on the volume. Without SIFS_FEATURE_CRC it ends before crc,
+// where the inline contents of older volumes start
+size_t fileblock_size(SIFS_VOLUME_HEADER header)
+{
+	return header.features & SIFS_FEATURE_CRC ? sizeof(SIFS_FILEBLOCK) : offsetof(SIFS_FILEBLOCK, crc);
+}
+
+// Returns SIFS_DIRBLOCK of directory block pointed to by dir. Blocks that fail their checksum are not cached
+SIFS_DIRBLOCK get_dirblock(SIFS_VOLUME_HEADER header, FILE* vol, SIFS_BLOCKID dir)
+{
 	SIFS_DIRBLOCK block;
-	fread(&block, sizeof(SIFS_DIRBLOCK), 1, vol);
+	block.crc = 0;
+	if (!cache_get(vol, dir, &block, dirblock_size(header)))
+	{
+		read_uncached(vol, block_offset(header, dir), &block, dirblock_size(header));
+		if (dirblock_intact(header, &block))
+			cache_fill(vol, dir, &block, dirblock_size(header));
+		else
+			nbadblocks++;
+	}
+	STAT_ADD(dirblocks, 1);
 
 	return block;
 }
 
-// Returns SIFS_FILEBLOCK of file block pointed to by file
+// Returns SIFS_FILEBLOCK of file block pointed to by file. Blocks that fail their checksum are not cached
 SIFS_FILEBLOCK get_fileblock(SIFS_VOLUME_HEADER header, FILE* vol, SIFS_BLOCKID file)
 {
-	// Seek to beggining of blocks
-	int offset = sizeof(SIFS_VOLUME_HEADER) + header.nblocks * sizeof(SIFS_BIT);
-	fseek(vol, offset, SEEK_SET);
-
-	// Seek to pointed block
-	offset = file * header.blocksize;
-	fseek(vol, offset, SEEK_CUR);
-
-	// Read block
 	SIFS_FILEBLOCK block;
-	fread(&block, sizeof(SIFS_FILEBLOCK), 1, vol);
+	block.crc = 0;
+	if (!cache_get(vol, file, &block, fileblock_size(header)))
+	{
+		read_uncached(vol, block_offset(header, file), &block, fileblock_size(header));
+		if (fileblock_intact(header, &block))
+			cache_fill(vol, file, &block, fileblock_size(header));
+		else
+			nbadblocks++;
+	}
+	STAT_ADD(fileblocks, 1);
 
 	return block;
 }
 
+// Writes nbytes of block, a metadata block with its crc field at crcoffset, to block id. On volumes with
+// SIFS_FEATURE_CRC the checksum is taken over the exact bytes written
+static void put_block(SIFS_VOLUME_HEADER header, FILE* vol, SIFS_BLOCKID id, const void* block, size_t nbytes,
+	size_t crcoffset)
+{
+	unsigned char image[nbytes];
+	memcpy(image, block, nbytes);
+	if (header.features & SIFS_FEATURE_CRC)
+	{
+		uint32_t crc = block_crc(image, crcoffset);
+		memcpy(image + crcoffset, &crc, sizeof(crc));
+	}
+
+	if (!cache_put(vol, id, image, nbytes, block_offset(header, id)))
+		write_at(vol, block_offset(header, id), image, nbytes);
+}
+
+// Writes block to the directory block pointed to by dir
+void put_dirblock(SIFS_VOLUME_HEADER header, FILE* vol, SIFS_BLOCKID dir, const SIFS_DIRBLOCK* block)
+{
+	put_block(header, vol, dir, block, dirblock_size(header), offsetof(SIFS_DIRBLOCK, crc));
+}
+
+// Writes block to the file block pointed to by file
+void put_fileblock(SIFS_VOLUME_HEADER header, FILE* vol, SIFS_BLOCKID file, const SIFS_FILEBLOCK* block)
+{
+	put_block(header, vol, file, block, fileblock_size(header), offsetof(SIFS_FILEBLOCK, crc));
+}
+
 // Returns true if bitmap is valid, false otherwise
 bool validate_bitmap(SIFS_BIT* bitmap, uint32_t nblocks)
 {
+	STAT_ADD(bitmapscans, 1);
 	for (uint32_t i = 0; i < nblocks; i++)
 	{
 		SIFS_BIT b = bitmap[i];
@@ -73,8 +505,165 @@ bool validate_bitmap(SIFS_BIT* bitmap, uint32_t nblocks)
 	return true;
 }
 
+// Returns true if file's contents are stored compressed
+bool is_compressed(SIFS_VOLUME_HEADER header, const SIFS_FILEBLOCK* file)
+{
+	// Older volumes never wrote the compression fields, so they are only trusted when the volume asks for them
+	return (header.flags & SIFS_FORMAT_COMPRESS) && file->compression != SIFS_COMPRESS_NONE;
+}
+
+// Returns true if file's contents are stored inside its own file block, where firstblockID points
+bool is_inline(SIFS_VOLUME_HEADER header, const SIFS_FILEBLOCK* file)
+{
+	return (header.flags & SIFS_FORMAT_INLINE) && (file->fileflags & SIFS_FILE_INLINE);
+}
+
+// Returns true if file's data blocks hold a list of the chunk blocks its contents are stored in
+bool is_chunked(SIFS_VOLUME_HEADER header, const SIFS_FILEBLOCK* file)
+{
+	return (header.flags & SIFS_FORMAT_CHUNKED) && (file->fileflags & SIFS_FILE_CHUNKED);
+}
+
+// Returns true if file is a chunk block, which no directory points at
+bool is_chunk(SIFS_VOLUME_HEADER header, const SIFS_FILEBLOCK* file)
+{
+	return (header.flags & SIFS_FORMAT_CHUNKED) && (file->fileflags & SIFS_FILE_CHUNK);
+}
+
+// Returns the number of bytes left over in a block after a file block, which inline contents may use
+size_t inline_capacity(SIFS_VOLUME_HEADER header)
+{
+	return header.blocksize - fileblock_size(header);
+}
+
+// Returns the byte offset of file's contents within a volume
+long data_offset(SIFS_VOLUME_HEADER header, const SIFS_FILEBLOCK* file)
+{
+	long offset = block_offset(header, file->firstblockID);
+	return is_inline(header, file) ? offset + fileblock_size(header) : offset;
+}
+
+// Returns the number of bytes of file's contents stored on the volume
+size_t stored_length(SIFS_VOLUME_HEADER header, const SIFS_FILEBLOCK* file)
+{
+	if (is_chunked(header, file))
+		return file->nchunks * sizeof(SIFS_BLOCKID);
+	return is_compressed(header, file) ? file->storedlength : file->length;
+}
+
+// Returns true if file's length is no more than its stored contents could expand to. A damaged length that
+// fails this must not be trusted to size a buffer
+bool length_plausible(SIFS_VOLUME_HEADER header, const SIFS_FILEBLOCK* file)
+{
+	uint64_t stored = stored_length(header, file);
+	uint64_t room = is_inline(header, file) ? inline_capacity(header) : (uint64_t)header.nblocks * header.blocksize;
+	if (stored > room)
+		return false;
+
+	// Chunks may be shared and compressed contents expand; plain contents are exactly what is stored
+	if (is_chunked(header, file))
+		return file->length <= (uint64_t)file->nchunks * SIFS_CHUNK_MAX;
+	if (is_compressed(header, file))
+		return file->length <= stored * LZ_MAXRATIO;
+	return true;
+}
+
+// Returns the number of data blocks holding file's contents
+uint32_t data_blocks(SIFS_VOLUME_HEADER header, const SIFS_FILEBLOCK* file)
+{
+	if (is_inline(header, file))
+		return 0;
+	return (stored_length(header, file) + header.blocksize - 1) / header.blocksize; // Round up
+}
+
+// Sets how file's contents are to be stored and returns the bytes to write. Contents are compressed
+// only on volumes that ask for it, and only if that saves a block. The caller frees the result if it is not data
+const void* pack_filedata(SIFS_VOLUME_HEADER header, const void* data, SIFS_FILEBLOCK* file)
+{
+	file->compression = SIFS_COMPRESS_NONE;
+	file->storedlength = file->length;
+
+	size_t nblocks = (file->length + header.blocksize - 1) / header.blocksize;
+	if (!(header.flags & SIFS_FORMAT_COMPRESS) || is_inline(header, file) || nblocks < 2)
+		return data;
+
+	char* packed = malloc((nblocks - 1) * header.blocksize);
+	size_t packedlength = packed ? LZ_compress(data, file->length, packed, (nblocks - 1) * header.blocksize) : 0;
+	if (packedlength == 0)
+	{
+		free(packed);
+		return data;
+	}
+
+	file->compression = SIFS_COMPRESS_LZ;
+	file->storedlength = packedlength;
+	return packed;
+}
+
+// Expands the stored contents of file into data, which holds file->length bytes. Returns true if action was successful
+bool unpack_filedata(SIFS_VOLUME_HEADER header, const SIFS_FILEBLOCK* file, const void* stored, void* data)
+{
+	if (!is_compressed(header, file))
+	{
+		if (stored != data)
+			memcpy(data, stored, file->length);
+		return true;
+	}
+	return file->compression == SIFS_COMPRESS_LZ && LZ_decompress(stored, file->storedlength, data, file->length);
+}
+
+// Reads the contents of file into data, which holds file->length bytes. Returns true if action was successful
+bool read_filedata(SIFS_VOLUME_HEADER header, FILE* vol, const SIFS_FILEBLOCK* file, void* data)
+{
+	if (is_chunked(header, file))
+		return read_chunks(header, vol, file, data);
+	if (!is_compressed(header, file))
+		return read_run(vol, data_offset(header, file), data, file->length) == file->length;
+
+	char* stored = malloc(file->storedlength);
+	bool success = stored && read_run(vol, data_offset(header, file), stored, file->storedlength) ==
+		file->storedlength && unpack_filedata(header, file, stored, data);
+	free(stored);
+	return success;
+}
+
+// Reads the contents of a chunked file into data by joining its chunks. Returns true if action was successful
+bool read_chunks(SIFS_VOLUME_HEADER header, FILE* vol, const SIFS_FILEBLOCK* file, void* data)
+{
+	SIFS_BLOCKID* list = get_chunklist(header, vol, file);
+	if (!list)
+		return false;
+
+	bool success = true;
+	size_t offset = 0;
+	for (uint32_t i = 0; i < file->nchunks && success; i++)
+	{
+		SIFS_FILEBLOCK chunk;
+		success = list[i] < header.nblocks;
+		if (success)
+			chunk = get_fileblock(header, vol, list[i]);
+		success = success && is_chunk(header, &chunk) && chunk.length <= file->length - offset &&
+			read_filedata(header, vol, &chunk, (char*)data + offset);
+		if (success)
+			offset += chunk.length;
+	}
+	free(list);
+	return success && offset == file->length;
+}
+
+// Returns the first unused block at or after from, or header.nblocks if there is none.
+// memchr() steps over runs of used blocks a word at a time
+SIFS_BLOCKID find_unused(SIFS_VOLUME_HEADER header, const SIFS_BIT* bitmap, SIFS_BLOCKID from)
+{
+	if (from >= header.nblocks)
+		return header.nblocks;
+
+	const SIFS_BIT* unused = memchr(bitmap + from, SIFS_UNUSED, header.nblocks - from);
+	return unused ? unused - bitmap : header.nblocks;
+}
+
 // Returns the SIFS_BLOCKID of the directory pointed to by filepath. Note filepath is relative to dir
-SIFS_BLOCKID find_dir(SIFS_VOLUME_HEADER header, SIFS_BIT* bitmap, FILE* vol, SIFS_BLOCKID dir, const char* filepath, int* err)
+static SIFS_BLOCKID find_dir_from(SIFS_VOLUME_HEADER header, SIFS_BIT* bitmap, FILE* vol, SIFS_BLOCKID dir, const char* filepath, int* err)
 {
 	if (bitmap[dir] != SIFS_DIR || filepath == NULL || *filepath == '\0')
 	{
@@ -102,33 +691,40 @@ SIFS_BLOCKID find_dir(SIFS_VOLUME_HEADER header, SIFS_BIT* bitmap, FILE* vol, SI
 	}
 	strncpy(dirname, filepath, pFirstSlash - filepath);
 
+	// Only the directory searched and the entry found need to pass their checksums
 	SIFS_DIRBLOCK block = get_dirblock(header, vol, dir);
+	char names[SIFS_MAX_ENTRIES][SIFS_MAX_NAME_LENGTH];
+	bool intact[SIFS_MAX_ENTRIES];
+	get_entrynames(header, bitmap, vol, &block, names, intact);
+	if (!dirblock_intact(header, &block))
+	{
+		*err = SIFS_EBADCRC;
+		return 0;
+	}
+
 	SIFS_BLOCKID newdirID;
 	bool success = false;
 	// Attempt to find child directory
-	for (uint32_t i = 0; i < block.nentries; i++)
+	for (uint32_t i = 0; i < block.nentries && i < SIFS_MAX_ENTRIES; i++)
 	{
 		SIFS_BLOCKID entryID = block.entries[i].blockID;
-		if (bitmap[entryID] == SIFS_DIR)
+		if (strcmp(names[i], dirname) != 0)
+			continue;
+
+		if (!intact[i])
 		{
-			SIFS_DIRBLOCK nextblock = get_dirblock(header, vol, entryID);
-			if (strcmp(nextblock.name, dirname) == 0)
-			{
-				newdirID = entryID;
-				success = true;
-				break;
-			}
+			*err = SIFS_EBADCRC;
+			return 0;
 		}
-		// Check if supplied path was actually to a file
-		else if (bitmap[entryID] == SIFS_FILE)
+		if (bitmap[entryID] == SIFS_DIR)
 		{
-			SIFS_FILEBLOCK fileblock = get_fileblock(header, vol, entryID);
-			if (strcmp(fileblock.filenames[block.entries[i].fileindex], dirname) == 0)
-			{
-				*err = SIFS_ENOTDIR;
-				return 0;
-			}
+			newdirID = entryID;
+			success = true;
+			break;
 		}
+		// Check if supplied path was actually to a file
+		*err = SIFS_ENOTDIR;
+		return 0;
 	}
 	if (!success)
 	{
@@ -147,41 +743,198 @@ SIFS_BLOCKID find_dir(SIFS_VOLUME_HEADER header, SIFS_BIT* bitmap, FILE* vol, SI
 	}
 	else
 	{
-		return find_dir(header, bitmap, vol, newdirID, filepath, err);
+		return find_dir_from(header, bitmap, vol, newdirID, filepath, err);
 	}
 }
 
+// Returns the SIFS_BLOCKID of the directory pointed to by filepath. Note filepath is relative to dir
+SIFS_BLOCKID find_dir(SIFS_VOLUME_HEADER header, SIFS_BIT* bitmap, FILE* vol, SIFS_BLOCKID dir, const char* filepath, int* err)
+{
+	phase_begin(SIFS_PHASE_PATH);
+	SIFS_BLOCKID id = find_dir_from(header, bitmap, vol, dir, filepath, err);
+	phase_end(SIFS_PHASE_PATH);
+	return id;
+}
+
 // Returns the SIFS_BLOCKID of the fileblock pointed to by dir with name filename
-SIFS_BLOCKID find_file(SIFS_VOLUME_HEADER header, SIFS_BIT* bitmap, FILE* vol, SIFS_BLOCKID dir, const char* filename, int* err)
+static SIFS_BLOCKID find_file_in(SIFS_VOLUME_HEADER header, SIFS_BIT* bitmap, FILE* vol, SIFS_BLOCKID dir, const char* filename, int* err)
 {
+	// Only the directory searched and the entry found need to pass their checksums
 	SIFS_DIRBLOCK dblock = get_dirblock(header, vol, dir);
-	for (uint32_t entry = 0; entry < dblock.nentries; entry++)
+	char names[SIFS_MAX_ENTRIES][SIFS_MAX_NAME_LENGTH];
+	bool intact[SIFS_MAX_ENTRIES];
+	get_entrynames(header, bitmap, vol, &dblock, names, intact);
+	if (!dirblock_intact(header, &dblock))
+	{
+		*err = SIFS_EBADCRC;
+		return 0;
+	}
+
+	for (uint32_t entry = 0; entry < dblock.nentries && entry < SIFS_MAX_ENTRIES; entry++)
 	{
 		SIFS_BLOCKID id = dblock.entries[entry].blockID;
-		if (bitmap[id] == SIFS_FILE)
+		if (strcmp(filename, names[entry]) != 0)
+			continue;
+
+		if (!intact[entry])
 		{
-			SIFS_FILEBLOCK fblock = get_fileblock(header, vol, id);
-			if (strcmp(filename, fblock.filenames[dblock.entries[entry].fileindex]) == 0)
-			{
-				*err = SIFS_EOK;
-				return id;
-			}
+			*err = SIFS_EBADCRC;
+			return 0;
 		}
-		if (bitmap[id] == SIFS_DIR)
+		if (bitmap[id] == SIFS_FILE)
 		{
-			SIFS_DIRBLOCK entrydir = get_dirblock(header, vol, id);
-			if (strcmp(filename, entrydir.name) == 0)
-			{
-				*err = SIFS_ENOTFILE;
-				return 0;
-			}
+			*err = SIFS_EOK;
+			return id;
 		}
+		*err = SIFS_ENOTFILE;
+		return 0;
 	}
 	// No such file was found
 	*err = SIFS_ENOENT;
 	return 0;
 }
 
+// Returns the SIFS_BLOCKID of the fileblock pointed to by dir with name filename
+SIFS_BLOCKID find_file(SIFS_VOLUME_HEADER header, SIFS_BIT* bitmap, FILE* vol, SIFS_BLOCKID dir, const char* filename, int* err)
+{
+	phase_begin(SIFS_PHASE_PATH);
+	SIFS_BLOCKID id = find_file_in(header, bitmap, vol, dir, filename, err);
+	phase_end(SIFS_PHASE_PATH);
+	return id;
+}
+
+// Stores the name of every entry of dblock in names, reading the blocks of the entries that are not cached as
+// one batch, and whether each block read passed its checksum in intact. Entries that point to neither a directory
+// nor a file get an empty name. Returns false if there are any
+bool get_entrynames(SIFS_VOLUME_HEADER header, const SIFS_BIT* bitmap, FILE* vol, const SIFS_DIRBLOCK* dblock,
+	char names[][SIFS_MAX_NAME_LENGTH], bool intact[])
+{
+	uint32_t nentries = dblock->nentries < SIFS_MAX_ENTRIES ? dblock->nentries : SIFS_MAX_ENTRIES;
+	union {
+		SIFS_DIRBLOCK	dir;
+		SIFS_FILEBLOCK	file;
+	} blocks[nentries > 0 ? nentries : 1];
+	SIFS_BIT kinds[SIFS_MAX_ENTRIES];
+	bool inblock[SIFS_MAX_ENTRIES];
+	IO_REQUEST reqs[SIFS_MAX_ENTRIES];
+	uint32_t missing[SIFS_MAX_ENTRIES];
+	size_t nreqs = 0;
+	bool valid = true;
+
+	// Blocks that are not cached are read together. Without a cache to keep them in, only the names are read,
+	// which cannot be checked
+	bool caching = cache_active(vol);
+	for (uint32_t i = 0; i < nentries; i++)
+	{
+		SIFS_BLOCKID id = dblock->entries[i].blockID;
+		uint32_t fileindex = dblock->entries[i].fileindex;
+		kinds[i] = id < header.nblocks ? bitmap[id] : SIFS_UNUSED;
+		if (kinds[i] == SIFS_FILE && fileindex >= SIFS_MAX_ENTRIES)
+			kinds[i] = SIFS_UNUSED;
+
+		names[i][0] = '\0';
+		inblock[i] = false;
+		intact[i] = true;
+		if (kinds[i] != SIFS_DIR && kinds[i] != SIFS_FILE)
+		{
+			valid = false;
+			continue;
+		}
+
+		size_t nbytes = kinds[i] == SIFS_DIR ? dirblock_size(header) : fileblock_size(header);
+		if (kinds[i] == SIFS_DIR)
+			STAT_ADD(dirblocks, 1);
+		else
+			STAT_ADD(fileblocks, 1);
+
+		inblock[i] = caching;
+		if (caching && cache_get(vol, id, &blocks[i], nbytes))
+			continue;
+
+		IO_REQUEST* req = &reqs[nreqs];
+		req->offset = block_offset(header, id);
+		if (caching)
+		{
+			memset(&blocks[i], 0, sizeof(blocks[i]));
+			req->buf = &blocks[i];
+			req->nbytes = nbytes;
+		}
+		else
+		{
+			req->offset += kinds[i] == SIFS_DIR ? offsetof(SIFS_DIRBLOCK, name) :
+				offsetof(SIFS_FILEBLOCK, filenames) + fileindex * SIFS_MAX_NAME_LENGTH;
+			req->buf = names[i];
+			req->nbytes = SIFS_MAX_NAME_LENGTH;
+		}
+		missing[nreqs++] = i;
+	}
+	if (nreqs > 0)
+		read_batch(vol, reqs, nreqs);
+
+	for (size_t r = 0; r < nreqs; r++)
+	{
+		if (reqs[r].ndone < reqs[r].nbytes && !inblock[missing[r]])
+			names[missing[r]][0] = '\0';
+		else if (inblock[missing[r]])
+		{
+			// Blocks that fail their checksum are not cached
+			uint32_t i = missing[r];
+			intact[i] = kinds[i] == SIFS_DIR ? dirblock_intact(header, &blocks[i].dir) :
+				fileblock_intact(header, &blocks[i].file);
+			if (intact[i])
+				cache_fill(vol, dblock->entries[i].blockID, &blocks[i], reqs[r].nbytes);
+			else
+				nbadblocks++;
+		}
+	}
+	for (uint32_t i = 0; i < nentries; i++)
+	{
+		if (inblock[i] && kinds[i] == SIFS_DIR)
+			memcpy(names[i], blocks[i].dir.name, SIFS_MAX_NAME_LENGTH);
+		else if (inblock[i])
+			memcpy(names[i], blocks[i].file.filenames[dblock->entries[i].fileindex], SIFS_MAX_NAME_LENGTH);
+		names[i][SIFS_MAX_NAME_LENGTH - 1] = '\0';
+	}
+	return valid;
+}
+
+// Returns the index of the entry of dblock called name, or dblock->nentries if there is none.
+// Sets err if the directory points to an invalid block, or if dblock or the entry found fails its checksum
+uint32_t find_entry(SIFS_VOLUME_HEADER header, const SIFS_BIT* bitmap, FILE* vol, const SIFS_DIRBLOCK* dblock,
+	const char* name, int* err)
+{
+	char names[SIFS_MAX_ENTRIES][SIFS_MAX_NAME_LENGTH];
+	bool intact[SIFS_MAX_ENTRIES];
+	get_entrynames(header, bitmap, vol, dblock, names, intact);
+	if (!dirblock_intact(header, dblock))
+	{
+		*err = SIFS_EBADCRC;
+		return dblock->nentries;
+	}
+
+	for (uint32_t i = 0; i < dblock->nentries && i < SIFS_MAX_ENTRIES; i++)
+	{
+		SIFS_BLOCKID entryID = dblock->entries[i].blockID;
+		bool valid = entryID < header.nblocks && (bitmap[entryID] == SIFS_DIR ||
+			(bitmap[entryID] == SIFS_FILE && dblock->entries[i].fileindex < SIFS_MAX_ENTRIES));
+
+		// directory points to an invalid block. Volume is corrupted
+		if (!valid)
+		{
+			*err = SIFS_ENOTVOL;
+			return dblock->nentries;
+		}
+		if (strcmp(names[i], name) == 0 && !intact[i])
+		{
+			*err = SIFS_EBADCRC;
+			return dblock->nentries;
+		}
+		if (strcmp(names[i], name) == 0)
+			return i;
+	}
+	return dblock->nentries;
+}
+
 // Splits src by the last occurence of '/' character. If no '/' character was found,
 // or if there is only a leading slash (e.g. "/file.txt" ) src is copied into name and *dirpath is set to NULL
 bool split_filepath(const char* src, char** dirpath, char** name)
@@ -213,7 +966,7 @@ bool split_filepath(const char* src, char** dirpath, char** name)
 
 		strcpy(*name, pLastSlash + 1);
 		strncpy(*dirpath, src, pathlen);
-		(*dirpath)[pathlen + 1] = '\0';
+		(*dirpath)[pathlen] = '\0';
 	}
 	else
 	{
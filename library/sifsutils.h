@@ -3,28 +3,210 @@
 #include <stdbool.h>
 
 #include "sifs-internal.h"
+#include "sifsstats.h"
+#include "sifscache.h"
+#include "sifsbatch.h"
+#include "sifsalloc.h"
+#include "sifspunch.h"
+#include "sifssnap.h"
+
+// Returns the number of bytes the bitmap takes up on the volume
+extern size_t bitmap_size(SIFS_VOLUME_HEADER header);
+
+// Returns the number of bytes the header takes up on the volume. Version 1 headers end at flags
+extern size_t header_size(SIFS_VOLUME_HEADER header);
+
+// Returns the byte offset of the bitmap within a volume. Version 1 bitmaps always follow the header
+extern long bitmap_offset(SIFS_VOLUME_HEADER header);
+
+// Returns the byte offset of block id within a volume
+extern long block_offset(SIFS_VOLUME_HEADER header, SIFS_BLOCKID id);
+
+// Returns the number of bytes of the host file that a volume takes up
+extern long volume_bytes(SIFS_VOLUME_HEADER header);
+
+// Reads nbytes at offset of vol into buf, bypassing the block cache. Returns the number of bytes read
+extern size_t read_uncached(FILE* vol, long offset, void* buf, size_t nbytes);
+
+// Writes nbytes of buf at offset of vol, bypassing the block cache. Returns the number of bytes written
+extern size_t write_uncached(FILE* vol, long offset, const void* buf, size_t nbytes);
+
+// Reads nbytes at offset of vol into buf. Returns the number of bytes read
+extern size_t read_at(FILE* vol, long offset, void* buf, size_t nbytes);
+
+// Writes nbytes of buf at offset of vol. Returns the number of bytes written
+extern size_t write_at(FILE* vol, long offset, const void* buf, size_t nbytes);
+
+// Sets the size of vol to nbytes. New bytes are holes that read as zeroes. Returns true if action was successful
+extern bool resize_volume(FILE* vol, long nbytes);
+
+// Writes everything written to vol so far through to the host's storage. Returns true if action was successful
+extern bool sync_volume(FILE* vol);
+
 
 // Returns volume header of a valid FILE* volume
 extern SIFS_VOLUME_HEADER get_volumeheader(FILE* vol);
 
-// Stores volume bitmap of a valid FILE* volume
+// Returns the checksum of header, taken with its checksum field zeroed
+extern uint32_t header_checksum(SIFS_VOLUME_HEADER header);
+
+// Writes header to a valid FILE* volume. Headers from version 2 are written with their checksum
+extern void put_volumeheader(FILE* vol, const SIFS_VOLUME_HEADER* header);
+
+// Stores volume bitmap of a valid FILE* volume. A packed bitmap is expanded to one SIFS_BIT per block, so
+// packing saves bitmap I/O but not memory
 extern void get_volumebitmap(FILE* vol, SIFS_BIT** bitmap);
 
-// Returns SIFS_DIRBLOCK of directory block pointed to by dir
+// Writes the whole bitmap to a valid FILE* volume, packing it if the volume was made that way
+extern void put_volumebitmap(SIFS_VOLUME_HEADER header, FILE* vol, const SIFS_BIT* bitmap);
+
+// Returns the bitmap entry of block id, read from a valid FILE* volume
+extern SIFS_BIT get_bitmapentry(SIFS_VOLUME_HEADER header, FILE* vol, SIFS_BLOCKID id);
+
+// Writes only the byte of the bitmap that holds block id to a valid FILE* volume
+extern void put_bitmapentry(SIFS_VOLUME_HEADER header, FILE* vol, const SIFS_BIT* bitmap, SIFS_BLOCKID id);
+
+// Resizes a version 2 volume to nblocks blocks by moving its bitmap alone: into the room in front of block 0
+// while it fits there, and after the last block otherwise. Blocks past a new, smaller end must be unused.
+// The header is only rewritten once the bitmap it points at is written, so a crash leaves the volume
+// at either size. Returns true if action was successful
+extern bool relocate_bitmap(FILE* vol, SIFS_VOLUME_HEADER* header, uint32_t nblocks, const SIFS_BIT* bitmap);
+
+// Waits for a lock on the whole of vol. Exclusive locks keep out every other process, shared locks only writers.
+// Returns true if action was successful
+extern bool lock_volume(FILE* vol, bool exclusive);
+
+// Releases the lock taken by lock_volume(). Closing vol also releases it
+extern void unlock_volume(FILE* vol);
+
+// Opens volumename with mode, reading and validating its header and bitmap. The volume stays locked until it is
+// closed: shared if mode only reads, exclusive otherwise. Returns NULL and sets SIFS_errno on failure
+extern FILE* open_volume(const char* volumename, const char* mode, SIFS_VOLUME_HEADER* header, SIFS_BIT** bitmap);
+
+// Returns the number of bytes a directory block takes up on the volume. Without SIFS_FEATURE_CRC it ends before crc
+extern size_t dirblock_size(SIFS_VOLUME_HEADER header);
+
+// Returns the number of bytes a file block takes up on the volume. Without SIFS_FEATURE_CRC it ends before crc,
+// where the inline contents of older volumes start
+extern size_t fileblock_size(SIFS_VOLUME_HEADER header);
+
+// Returns true if the directory block holds the checksum of its contents, or if the volume keeps none
+extern bool dirblock_intact(SIFS_VOLUME_HEADER header, const SIFS_DIRBLOCK* block);
+
+// Returns true if the file block holds the checksum of its contents, or if the volume keeps none
+extern bool fileblock_intact(SIFS_VOLUME_HEADER header, const SIFS_FILEBLOCK* block);
+
+// Returns true if no directory or file block read from the volume since it was opened failed its checksum.
+// Operations that change the volume check this before writing anything
+extern bool metadata_intact(void);
+
+// Returns SIFS_DIRBLOCK of directory block pointed to by dir. Blocks that fail their checksum are not cached
 extern SIFS_DIRBLOCK get_dirblock(SIFS_VOLUME_HEADER header, FILE* vol, SIFS_BLOCKID dir);
 
-// Returns SIFS_FILEBLOCK of file block pointed to by file
+// Returns SIFS_FILEBLOCK of file block pointed to by file. Blocks that fail their checksum are not cached
 extern SIFS_FILEBLOCK get_fileblock(SIFS_VOLUME_HEADER header, FILE* vol, SIFS_BLOCKID file);
 
+// Writes block to the directory block pointed to by dir
+extern void put_dirblock(SIFS_VOLUME_HEADER header, FILE* vol, SIFS_BLOCKID dir, const SIFS_DIRBLOCK* block);
+
+// Writes block to the file block pointed to by file
+extern void put_fileblock(SIFS_VOLUME_HEADER header, FILE* vol, SIFS_BLOCKID file, const SIFS_FILEBLOCK* block);
+
 // Returns true if bitmap is valid, false otherwise
 extern bool validate_bitmap(SIFS_BIT* bitmap, uint32_t nblocks);
 
+// Returns true if file's contents are stored compressed
+extern bool is_compressed(SIFS_VOLUME_HEADER header, const SIFS_FILEBLOCK* file);
+
+// Returns true if file's contents are stored inside its own file block, where firstblockID points
+extern bool is_inline(SIFS_VOLUME_HEADER header, const SIFS_FILEBLOCK* file);
+
+// Returns true if file's data blocks hold a list of the chunk blocks its contents are stored in
+extern bool is_chunked(SIFS_VOLUME_HEADER header, const SIFS_FILEBLOCK* file);
+
+// Returns true if file is a chunk block, which no directory points at
+extern bool is_chunk(SIFS_VOLUME_HEADER header, const SIFS_FILEBLOCK* file);
+
+// Returns the number of bytes left over in a block after a file block, which inline contents may use
+extern size_t inline_capacity(SIFS_VOLUME_HEADER header);
+
+// Returns the byte offset of file's contents within a volume
+extern long data_offset(SIFS_VOLUME_HEADER header, const SIFS_FILEBLOCK* file);
+
+// Returns the number of bytes of file's contents stored on the volume
+extern size_t stored_length(SIFS_VOLUME_HEADER header, const SIFS_FILEBLOCK* file);
+
+// Returns true if file's length is no more than its stored contents could expand to. A damaged length that
+// fails this must not be trusted to size a buffer
+extern bool length_plausible(SIFS_VOLUME_HEADER header, const SIFS_FILEBLOCK* file);
+
+// Returns the number of data blocks holding file's contents
+extern uint32_t data_blocks(SIFS_VOLUME_HEADER header, const SIFS_FILEBLOCK* file);
+
+// Sets how file's contents are to be stored and returns the bytes to write. Contents are compressed
+// only on volumes that ask for it, and only if that saves a block. The caller frees the result if it is not data
+extern const void* pack_filedata(SIFS_VOLUME_HEADER header, const void* data, SIFS_FILEBLOCK* file);
+
+// Expands the stored contents of file into data, which holds file->length bytes. Returns true if action was successful
+extern bool unpack_filedata(SIFS_VOLUME_HEADER header, const SIFS_FILEBLOCK* file, const void* stored, void* data);
+
+// Reads the contents of file into data, which holds file->length bytes. Returns true if action was successful
+extern bool read_filedata(SIFS_VOLUME_HEADER header, FILE* vol, const SIFS_FILEBLOCK* file, void* data);
+
+// Reads the contents of a chunked file into data by joining its chunks. Returns true if action was successful
+extern bool read_chunks(SIFS_VOLUME_HEADER header, FILE* vol, const SIFS_FILEBLOCK* file, void* data);
+
+// Splits nbytes of data into content-defined chunks, storing those the volume does not hold yet and marking
+// their blocks in bitmap. Sets file's chunk list and returns it for the caller to write and free. Chunks hold
+// no new references until add_chunkrefs() is called. fileID is the file's own block, marked in bitmap but not
+// yet written. Returns NULL and sets err on failure
+extern const void* chunk_filedata(SIFS_VOLUME_HEADER header, SIFS_BIT* bitmap, FILE* vol, const void* data,
+	size_t nbytes, SIFS_BLOCKID fileID, SIFS_FILEBLOCK* file, int* err);
+
+// Reads the chunk list of file. Returns NULL on failure; the caller frees the result
+extern SIFS_BLOCKID* get_chunklist(SIFS_VOLUME_HEADER header, FILE* vol, const SIFS_FILEBLOCK* file);
+
+// Returns true if every chunk block in list passes its checksum
+extern bool chunks_intact(SIFS_VOLUME_HEADER header, const SIFS_BIT* bitmap, FILE* vol, const SIFS_BLOCKID* list,
+	uint32_t nchunks);
+
+// Adds a reference to each chunk in list, once for every time it appears.
+// Returns false and sets err, changing nothing, if a chunk fails its checksum or memory runs out
+extern bool add_chunkrefs(SIFS_VOLUME_HEADER header, SIFS_BIT* bitmap, FILE* vol, const SIFS_BLOCKID* list,
+	uint32_t nchunks, int* err);
+
+// Drops a reference to each chunk in list. Chunks left with none are freed in bitmap, which the caller writes.
+// Returns false and sets err, changing nothing, if a chunk fails its checksum or memory runs out
+extern bool release_chunks(SIFS_VOLUME_HEADER header, SIFS_BIT* bitmap, FILE* vol, const SIFS_BLOCKID* list,
+	uint32_t nchunks, int* err);
+
+// Points every chunk list that refers to chunk block from at chunk block to instead
+extern void relink_chunk(SIFS_VOLUME_HEADER header, const SIFS_BIT* bitmap, FILE* vol, SIFS_BLOCKID from,
+	SIFS_BLOCKID to);
+
+// Returns the first unused block at or after from, or header.nblocks if there is none
+extern SIFS_BLOCKID find_unused(SIFS_VOLUME_HEADER header, const SIFS_BIT* bitmap, SIFS_BLOCKID from);
+
 // Returns the SIFS_BLOCKID of the directory pointed to by filepath. Note filepath is relative to dir
 extern SIFS_BLOCKID find_dir(SIFS_VOLUME_HEADER header, SIFS_BIT* bitmap, FILE* vol, SIFS_BLOCKID dir, const char* filepath, int* err);
 
 // Returns the SIFS_BLOCKID of the fileblock pointed to by dir with name filename
 extern SIFS_BLOCKID find_file(SIFS_VOLUME_HEADER header, SIFS_BIT* bitmap, FILE* vol, SIFS_BLOCKID dir, const char* filename, int* err);
 
+// Stores the name of every entry of dblock in names, reading the blocks of the entries that are not cached as
+// one batch, and whether each block read passed its checksum in intact. Entries that point to neither a directory
+// nor a file get an empty name. Returns false if there are any
+extern bool get_entrynames(SIFS_VOLUME_HEADER header, const SIFS_BIT* bitmap, FILE* vol, const SIFS_DIRBLOCK* dblock,
+	char names[][SIFS_MAX_NAME_LENGTH], bool intact[]);
+
+// Returns the index of the entry of dblock called name, or dblock->nentries if there is none.
+// Sets err if the directory points to an invalid block, or if dblock or the entry found fails its checksum
+extern uint32_t find_entry(SIFS_VOLUME_HEADER header, const SIFS_BIT* bitmap, FILE* vol, const SIFS_DIRBLOCK* dblock,
+	const char* name, int* err);
+
+// Defragments the volume, moving every used block to the front. Returns 0 if action was successful
+extern int defragment(const char* volumename);
+
 // Splits src by the last occurence of '/' character. If no '/' character was found,
 // src is copied into name and dirpath is set to NULL. Returns true if action was successful
 extern bool split_filepath(const char* src, char** dirpath, char** name);
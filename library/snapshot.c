@@ -0,0 +1,591 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <unistd.h>
+#include "sifsutils.h"
+
+// A walk of the live volume that moves every entry referring to one file block over to its copy
+typedef struct {
+	SIFS_VOLUME_HEADER	header;
+	SIFS_BIT*		bitmap;
+	FILE*			vol;
+	SIFS_BLOCKID		from;
+	SIFS_BLOCKID		to;
+	SIFS_FILEBLOCK		original;
+	SIFS_FILEBLOCK		copy;				// gains a name for each name of from still in use
+	uint32_t		slots[SIFS_MAX_ENTRIES];	// index in copy of each name of from, or SIFS_MAX_ENTRIES
+	int			err;
+} COW_WALK;
+
+// What removing a snapshot found out about each block: reached from a root that stays, or a chunk list already released
+#define KEPT	1
+#define SWEPT	2
+
+// Returns the generation to stamp on blocks made or copied now. Always 0 on volumes without snapshots
+uint32_t snapshot_generation(SIFS_VOLUME_HEADER header, FILE* vol)
+{
+	if (!(header.flags & SIFS_FORMAT_SNAPSHOT))
+		return 0;
+	return get_dirblock(header, vol, SIFS_SNAPSHOT_BLOCKID).generation;
+}
+
+// Returns true if a block stamped with generation is shared with a snapshot, so must be neither changed nor freed
+bool snapshot_shared(SIFS_VOLUME_HEADER header, FILE* vol, uint32_t generation)
+{
+	if (!(header.flags & SIFS_FORMAT_SNAPSHOT))
+		return false;
+
+	// Every block made before a snapshot and still in use when it was taken belongs to it
+	SIFS_DIRBLOCK table = get_dirblock(header, vol, SIFS_SNAPSHOT_BLOCKID);
+	for (uint32_t i = 0; i < table.nentries && i < SIFS_MAX_ENTRIES; i++)
+	{
+		if (generation <= table.entries[i].fileindex)
+			return true;
+	}
+	return false;
+}
+
+// Writes dblock, stamped with the current generation, to a new block near parent. The caller points the entry
+// of parent at the copy. Returns header.nblocks and sets err on failure
+SIFS_BLOCKID copy_dirblock(SIFS_VOLUME_HEADER header, SIFS_BIT* bitmap, FILE* vol, SIFS_DIRBLOCK* dblock,
+	SIFS_BLOCKID parent, int* err)
+{
+	phase_begin(SIFS_PHASE_ALLOC);
+	STAT_ADD(bitmapscans, 1);
+	SIFS_BLOCKID copy = place_dirblock(header, bitmap, parent);
+	phase_end(SIFS_PHASE_ALLOC);
+	if (copy >= header.nblocks)
+	{
+		*err = SIFS_ENOSPC;
+		return header.nblocks;
+	}
+
+	dblock->generation = snapshot_generation(header, vol);
+	bitmap[copy] = SIFS_DIR;
+	put_bitmapentry(header, vol, bitmap, copy);
+	put_dirblock(header, vol, copy, dblock);
+	return copy;
+}
+
+// Returns the SIFS_BLOCKID of the directory dirpath of the live volume (the root directory if dirpath is NULL),
+// first copying it and each directory above it that a snapshot shares, so that it may be changed in place
+SIFS_BLOCKID cow_dir(SIFS_VOLUME_HEADER header, SIFS_BIT* bitmap, FILE* vol, const char* dirpath, int* err)
+{
+	if (dirpath == NULL)
+		return SIFS_ROOTDIR_BLOCKID;
+
+	// The path is checked by find_dir() before anything is copied, and nothing is copied once a block read
+	// has failed its checksum
+	SIFS_BLOCKID id = find_dir(header, bitmap, vol, SIFS_ROOTDIR_BLOCKID, dirpath, err);
+	if (*err == SIFS_EOK && !metadata_intact())
+		*err = SIFS_EBADCRC;
+	if (*err != SIFS_EOK || !(header.flags & SIFS_FORMAT_SNAPSHOT))
+		return id;
+
+	phase_begin(SIFS_PHASE_PATH);
+	SIFS_BLOCKID dir = SIFS_ROOTDIR_BLOCKID;
+	for (const char* name = dirpath; *name != '\0' && *err == SIFS_EOK; /*blank*/)
+	{
+		if (*name == '/')
+		{
+			name++;
+			continue;
+		}
+		const char* slash = strchr(name, '/');
+		size_t length = slash ? (size_t)(slash - name) : strlen(name);
+		char dirname[SIFS_MAX_NAME_LENGTH + 1] = "";
+		memcpy(dirname, name, length);
+		name += length;
+
+		SIFS_DIRBLOCK dblock = get_dirblock(header, vol, dir);
+		uint32_t entry = find_entry(header, bitmap, vol, &dblock, dirname, err);
+		SIFS_BLOCKID child = dblock.entries[entry].blockID;
+		SIFS_DIRBLOCK cblock = get_dirblock(header, vol, child);
+		bool shared = snapshot_shared(header, vol, cblock.generation);
+		if (!metadata_intact())
+		{
+			*err = SIFS_EBADCRC;
+			break;
+		}
+		if (shared)
+		{
+			child = copy_dirblock(header, bitmap, vol, &cblock, dir, err);
+			if (child >= header.nblocks)
+				break;
+			dblock.entries[entry].blockID = child;
+			put_dirblock(header, vol, dir, &dblock);
+		}
+		dir = child;
+	}
+	phase_end(SIFS_PHASE_PATH);
+	return dir;
+}
+
+// Points the entries of directory *dir, and of every directory beneath it, that refer to walk->from at walk->to.
+// A shared directory that changes is copied first and *dir set to the copy. A directory failing its checksum
+// stops the walk, so neither it nor any directory above it is written
+static void relink_entries(COW_WALK* walk, SIFS_BLOCKID* dir, SIFS_BLOCKID parent)
+{
+	SIFS_DIRBLOCK dblock = get_dirblock(walk->header, walk->vol, *dir);
+	if (!dirblock_intact(walk->header, &dblock))
+	{
+		walk->err = SIFS_EBADCRC;
+		return;
+	}
+	bool changed = false;
+	for (uint32_t i = 0; i < dblock.nentries && i < SIFS_MAX_ENTRIES && walk->err == SIFS_EOK; i++)
+	{
+		SIFS_BLOCKID child = dblock.entries[i].blockID;
+		if (child >= walk->header.nblocks)
+			continue;
+
+		if (walk->bitmap[child] == SIFS_DIR)
+		{
+			relink_entries(walk, &child, *dir);
+			changed = changed || child != dblock.entries[i].blockID;
+			dblock.entries[i].blockID = child;
+		}
+		else if (child == walk->from && dblock.entries[i].fileindex < SIFS_MAX_ENTRIES)
+		{
+			// Names keep the order they had, without the ones no entry of the live volume uses any more
+			uint32_t old = dblock.entries[i].fileindex;
+			if (walk->slots[old] == SIFS_MAX_ENTRIES)
+			{
+				walk->slots[old] = walk->copy.nfiles;
+				memcpy(walk->copy.filenames[walk->copy.nfiles], walk->original.filenames[old], SIFS_MAX_NAME_LENGTH);
+				walk->copy.nfiles++;
+			}
+			dblock.entries[i].blockID = walk->to;
+			dblock.entries[i].fileindex = walk->slots[old];
+			changed = true;
+		}
+	}
+	if (!changed || walk->err != SIFS_EOK)
+		return;
+
+	if (*dir != SIFS_ROOTDIR_BLOCKID && snapshot_shared(walk->header, walk->vol, dblock.generation))
+	{
+		SIFS_BLOCKID copy = copy_dirblock(walk->header, walk->bitmap, walk->vol, &dblock, parent, &walk->err);
+		if (copy < walk->header.nblocks)
+			*dir = copy;
+	}
+	else
+		put_dirblock(walk->header, walk->vol, *dir, &dblock);
+}
+
+// Copies the shared file block file for the live volume, and points every entry of the live volume that
+// refers to it at the copy. The copy holds only the names those entries use. Returns header.nblocks and
+// sets err on failure
+SIFS_BLOCKID cow_file(SIFS_VOLUME_HEADER header, SIFS_BIT* bitmap, FILE* vol, SIFS_BLOCKID file, int* err)
+{
+	COW_WALK walk = { .header = header, .bitmap = bitmap, .vol = vol, .from = file, .err = SIFS_EOK };
+	walk.original = get_fileblock(header, vol, file);
+
+	phase_begin(SIFS_PHASE_ALLOC);
+	STAT_ADD(bitmapscans, 1);
+	walk.to = place_fileblock(header, bitmap, file, 0);
+	phase_end(SIFS_PHASE_ALLOC);
+	char* block = walk.to < header.nblocks && is_inline(header, &walk.original) ? malloc(header.blocksize) : NULL;
+	if (walk.to >= header.nblocks || (is_inline(header, &walk.original) && !block))
+	{
+		*err = walk.to >= header.nblocks ? SIFS_ENOSPC : SIFS_ENOMEM;
+		return header.nblocks;
+	}
+
+	// The copy shares the data blocks of the original. Contents kept inside the file block are copied with it,
+	// and contents that need no data blocks point at the copy
+	walk.copy = walk.original;
+	walk.copy.generation = snapshot_generation(header, vol);
+
+	// Nothing is written if the original, or any block read before it, failed its checksum
+	if (!metadata_intact())
+	{
+		free(block);
+		*err = SIFS_EBADCRC;
+		return header.nblocks;
+	}
+	if (walk.original.firstblockID == file)
+		walk.copy.firstblockID = walk.to;
+	if (block)
+	{
+		read_at(vol, block_offset(header, file), block, header.blocksize);
+		write_at(vol, block_offset(header, walk.to), block, header.blocksize);
+		free(block);
+	}
+	bitmap[walk.to] = SIFS_FILE;
+	put_bitmapentry(header, vol, bitmap, walk.to);
+	put_fileblock(header, vol, walk.to, &walk.copy);
+
+	walk.copy.nfiles = 0;
+	memset(walk.copy.filenames, 0, sizeof(walk.copy.filenames));
+	for (uint32_t i = 0; i < SIFS_MAX_ENTRIES; i++)
+	{
+		walk.slots[i] = SIFS_MAX_ENTRIES;
+	}
+
+	phase_begin(SIFS_PHASE_PATH);
+	SIFS_BLOCKID root = SIFS_ROOTDIR_BLOCKID;
+	relink_entries(&walk, &root, SIFS_ROOTDIR_BLOCKID);
+	phase_end(SIFS_PHASE_PATH);
+
+	put_fileblock(header, vol, walk.to, &walk.copy);
+	if (walk.err != SIFS_EOK)
+	{
+		*err = walk.err;
+		return header.nblocks;
+	}
+	return walk.to;
+}
+
+// Opens volumename for reading like open_volume(), and sets root to the directory that paths start from.
+// A volumename of the form volume@name, where no such host file exists, opens the snapshot name of volume
+FILE* open_snapshot(const char* volumename, SIFS_VOLUME_HEADER* header, SIFS_BIT** bitmap, SIFS_BLOCKID* root)
+{
+	*root = SIFS_ROOTDIR_BLOCKID;
+	const char* at = strrchr(volumename, '@');
+	if (!at || access(volumename, F_OK) == 0)
+		return open_volume(volumename, "r", header, bitmap);
+
+	char basename[at - volumename + 1];
+	memcpy(basename, volumename, at - volumename);
+	basename[at - volumename] = '\0';
+	FILE* vol = open_volume(basename, "r", header, bitmap);
+	if (!vol)
+		return NULL;
+
+	// Snapshots are found by the names of their root directories
+	int err = SIFS_EOK;
+	if (header->flags & SIFS_FORMAT_SNAPSHOT)
+	{
+		SIFS_DIRBLOCK table = get_dirblock(*header, vol, SIFS_SNAPSHOT_BLOCKID);
+		uint32_t entry = find_entry(*header, *bitmap, vol, &table, at + 1, &err);
+		if (err == SIFS_EOK && entry == table.nentries)
+			err = SIFS_ENOENT;
+		if (err == SIFS_EOK)
+			*root = table.entries[entry].blockID;
+	}
+	else
+		err = SIFS_ENOENT;
+
+	if (err != SIFS_EOK)
+	{
+		SIFS_errno = err;
+		free(*bitmap);
+		close_volume(vol);
+		return NULL;
+	}
+	return vol;
+}
+
+// Marks the data blocks of fblock
+static void mark_data(SIFS_VOLUME_HEADER header, const SIFS_FILEBLOCK* fblock, unsigned char* marked)
+{
+	SIFS_BLOCKID end = fblock->firstblockID + data_blocks(header, fblock);
+	for (SIFS_BLOCKID id = fblock->firstblockID; id < end && id < header.nblocks; id++)
+	{
+		marked[id] = KEPT;
+	}
+}
+
+// Marks the data blocks of file block file, and the chunks its chunk list points at.
+// Returns false if there was no memory to read the list
+static bool mark_file(SIFS_VOLUME_HEADER header, FILE* vol, SIFS_BLOCKID file, unsigned char* marked)
+{
+	SIFS_FILEBLOCK fblock = get_fileblock(header, vol, file);
+	mark_data(header, &fblock, marked);
+	if (!is_chunked(header, &fblock))
+		return true;
+
+	SIFS_BLOCKID* list = get_chunklist(header, vol, &fblock);
+	if (!list)
+		return false;
+	for (uint32_t c = 0; c < fblock.nchunks; c++)
+	{
+		if (list[c] >= header.nblocks || marked[list[c]])
+			continue;
+		marked[list[c]] = KEPT;
+		SIFS_FILEBLOCK chunk = get_fileblock(header, vol, list[c]);
+		mark_data(header, &chunk, marked);
+	}
+	free(list);
+	return true;
+}
+
+// Marks every block that directory top reaches. Returns SIFS_EOK if action was successful
+static int mark_tree(SIFS_VOLUME_HEADER header, const SIFS_BIT* bitmap, FILE* vol, SIFS_BLOCKID top,
+	unsigned char* marked)
+{
+	uint32_t ndirs = 0, capacity = 64;
+	SIFS_BLOCKID* dirs = malloc(sizeof(SIFS_BLOCKID) * capacity);
+	if (!dirs)
+		return SIFS_ENOMEM;
+
+	marked[top] = KEPT;
+	dirs[ndirs++] = top;
+	while (ndirs > 0)
+	{
+		SIFS_DIRBLOCK dblock = get_dirblock(header, vol, dirs[--ndirs]);
+		for (uint32_t i = 0; i < dblock.nentries && i < SIFS_MAX_ENTRIES; i++)
+		{
+			SIFS_BLOCKID id = dblock.entries[i].blockID;
+			if (id >= header.nblocks || marked[id])
+				continue;
+			marked[id] = KEPT;
+
+			if (bitmap[id] == SIFS_FILE && !mark_file(header, vol, id, marked))
+			{
+				free(dirs);
+				return SIFS_ENOMEM;
+			}
+			if (bitmap[id] != SIFS_DIR)
+				continue;
+
+			if (ndirs == capacity)
+			{
+				SIFS_BLOCKID* grown = realloc(dirs, sizeof(SIFS_BLOCKID) * capacity * 2);
+				if (!grown)
+				{
+					free(dirs);
+					return SIFS_ENOMEM;
+				}
+				dirs = grown;
+				capacity *= 2;
+			}
+			dirs[ndirs++] = id;
+		}
+	}
+
+	free(dirs);
+	return SIFS_EOK;
+}
+
+// Returns true if every file block that is in use but not marked, and every chunk that the chunk lists among
+// them point at, passes its checksum, so may be swept
+static bool unmarked_intact(SIFS_VOLUME_HEADER header, const SIFS_BIT* bitmap, FILE* vol, const unsigned char* marked)
+{
+	STAT_ADD(bitmapscans, 1);
+	for (SIFS_BLOCKID id = 0; id < header.nblocks; id++)
+	{
+		if (bitmap[id] != SIFS_FILE || marked[id])
+			continue;
+		SIFS_FILEBLOCK fblock = get_fileblock(header, vol, id);
+		if (!fileblock_intact(header, &fblock))
+			return false;
+		if (!is_chunked(header, &fblock) || fblock.firstblockID >= header.nblocks || marked[fblock.firstblockID])
+			continue;
+
+		SIFS_BLOCKID* list = get_chunklist(header, vol, &fblock);
+		bool intact = !list || chunks_intact(header, bitmap, vol, list, fblock.nchunks);
+		free(list);
+		if (!intact)
+			return false;
+	}
+	return true;
+}
+
+// Frees every block that is in use but not marked. Chunks go when the last chunk list referring to them does.
+// File blocks copied for the live volume share their chunk list, so each list is released once
+static void sweep_unmarked(SIFS_VOLUME_HEADER header, SIFS_BIT* bitmap, FILE* vol, unsigned char* marked)
+{
+	SIFS_BIT* before = punch_begin(header, bitmap);
+
+	STAT_ADD(bitmapscans, 1);
+	for (SIFS_BLOCKID id = 0; id < header.nblocks; id++)
+	{
+		if (bitmap[id] != SIFS_FILE || marked[id])
+			continue;
+		SIFS_FILEBLOCK fblock = get_fileblock(header, vol, id);
+		if (!is_chunked(header, &fblock) || fblock.firstblockID >= header.nblocks || marked[fblock.firstblockID] != 0)
+			continue;
+
+		// Chunks whose references cannot be dropped stay in use, which fsck reports, rather than being lost
+		int err = SIFS_EOK;
+		SIFS_BLOCKID* list = get_chunklist(header, vol, &fblock);
+		if (list)
+			release_chunks(header, bitmap, vol, list, fblock.nchunks, &err);
+		free(list);
+		marked[fblock.firstblockID] = SWEPT;
+	}
+
+	STAT_ADD(bitmapscans, 1);
+	for (SIFS_BLOCKID id = 0; id < header.nblocks; id++)
+	{
+		if (bitmap[id] == SIFS_UNUSED || marked[id] == KEPT)
+			continue;
+		if (bitmap[id] == SIFS_FILE)
+		{
+			SIFS_FILEBLOCK fblock = get_fileblock(header, vol, id);
+			if (is_chunk(header, &fblock))
+				continue;
+		}
+		bitmap[id] = SIFS_UNUSED;
+	}
+
+	put_volumebitmap(header, vol, bitmap);
+	punch_end(header, vol, before, bitmap);
+}
+
+// take a read-only snapshot of the whole of an existing volume
+static int take_snapshot(const char* volumename, const char* name)
+{
+	// Check arguments
+	if (volumename == NULL || name == NULL || *volumename == '\0' || *name == '\0' || strchr(name, '/') ||
+		strlen(name) + 1 > SIFS_MAX_NAME_LENGTH)
+	{
+		SIFS_errno = SIFS_EINVAL;
+		return 1;
+	}
+
+	// Open volume, reading and validating its header and bitmap
+	SIFS_VOLUME_HEADER header;
+	SIFS_BIT* bitmap;
+	FILE* vol = open_volume(volumename, "r+", &header, &bitmap);
+	if (!vol)
+		return 1;
+
+	int err = SIFS_EOK;
+	SIFS_DIRBLOCK table;
+	if (!(header.flags & SIFS_FORMAT_SNAPSHOT))
+		err = SIFS_EINVAL;
+	if (err == SIFS_EOK)
+	{
+		table = get_dirblock(header, vol, SIFS_SNAPSHOT_BLOCKID);
+		if (find_entry(header, bitmap, vol, &table, name, &err) != table.nentries && err == SIFS_EOK)
+			err = SIFS_EEXIST;
+		if (err == SIFS_EOK && table.nentries >= SIFS_MAX_ENTRIES)
+			err = SIFS_EMAXENTRY;
+	}
+
+	// The snapshot's root directory is a copy of the live one, named after the snapshot.
+	// Everything beneath it is shared from now on. Nothing is written if a block read failed its checksum
+	SIFS_BLOCKID rootID = header.nblocks;
+	if (err == SIFS_EOK)
+	{
+		SIFS_DIRBLOCK root = get_dirblock(header, vol, SIFS_ROOTDIR_BLOCKID);
+		memset(root.name, 0, SIFS_MAX_NAME_LENGTH);
+		strcpy(root.name, name);
+		if (!metadata_intact())
+			err = SIFS_EBADCRC;
+		else
+			rootID = copy_dirblock(header, bitmap, vol, &root, SIFS_SNAPSHOT_BLOCKID, &err);
+	}
+
+	if (err != SIFS_EOK)
+	{
+		SIFS_errno = err;
+		free(bitmap);
+		close_volume(vol);
+		return 1;
+	}
+
+	table.entries[table.nentries].blockID = rootID;
+	table.entries[table.nentries].fileindex = table.generation;
+	table.nentries++;
+	table.generation++;
+	table.modtime = time(NULL);
+	put_dirblock(header, vol, SIFS_SNAPSHOT_BLOCKID, &table);
+
+	free(bitmap);
+	if (close_volume(vol) != 0)
+	{
+		SIFS_errno = SIFS_EIO;
+		return 1;
+	}
+	return 0;
+}
+
+// remove a snapshot, freeing the blocks nothing else uses
+static int remove_snapshot(const char* volumename, const char* name)
+{
+	// Check arguments
+	if (volumename == NULL || name == NULL || *volumename == '\0' || *name == '\0')
+	{
+		SIFS_errno = SIFS_EINVAL;
+		return 1;
+	}
+
+	// Open volume, reading and validating its header and bitmap
+	SIFS_VOLUME_HEADER header;
+	SIFS_BIT* bitmap;
+	FILE* vol = open_volume(volumename, "r+", &header, &bitmap);
+	if (!vol)
+		return 1;
+
+	int err = SIFS_EOK;
+	SIFS_DIRBLOCK table;
+	uint32_t entry = 0;
+	if (!(header.flags & SIFS_FORMAT_SNAPSHOT))
+		err = SIFS_EINVAL;
+	if (err == SIFS_EOK)
+	{
+		table = get_dirblock(header, vol, SIFS_SNAPSHOT_BLOCKID);
+		entry = find_entry(header, bitmap, vol, &table, name, &err);
+		if (err == SIFS_EOK && entry == table.nentries)
+			err = SIFS_ENOENT;
+	}
+	unsigned char* marked = err == SIFS_EOK ? calloc(header.nblocks, 1) : NULL;
+	if (err == SIFS_EOK && !marked)
+		err = SIFS_ENOMEM;
+
+	// What the live volume and the other snapshots still reach is kept, everything else goes. Both are read
+	// before the table changes, so that nothing is written if a block fails its checksum
+	if (err == SIFS_EOK)
+	{
+		phase_begin(SIFS_PHASE_PATH);
+		marked[SIFS_SNAPSHOT_BLOCKID] = KEPT;
+		err = mark_tree(header, bitmap, vol, SIFS_ROOTDIR_BLOCKID, marked);
+		for (uint32_t j = 0; j < table.nentries && j < SIFS_MAX_ENTRIES && err == SIFS_EOK; j++)
+		{
+			if (j != entry && table.entries[j].blockID < header.nblocks)
+				err = mark_tree(header, bitmap, vol, table.entries[j].blockID, marked);
+		}
+		phase_end(SIFS_PHASE_PATH);
+	}
+	if (err == SIFS_EOK && (!unmarked_intact(header, bitmap, vol, marked) || !metadata_intact()))
+		err = SIFS_EBADCRC;
+
+	if (err != SIFS_EOK)
+	{
+		SIFS_errno = err;
+		free(marked);
+		free(bitmap);
+		close_volume(vol);
+		return 1;
+	}
+
+	for (uint32_t j = entry; j < table.nentries - 1; j++)
+	{
+		table.entries[j] = table.entries[j + 1];
+	}
+	table.nentries--;
+	table.modtime = time(NULL);
+	put_dirblock(header, vol, SIFS_SNAPSHOT_BLOCKID, &table);
+	sweep_unmarked(header, bitmap, vol, marked);
+
+	free(marked);
+	free(bitmap);
+	if (close_volume(vol) != 0)
+	{
+		SIFS_errno = SIFS_EIO;
+		return 1;
+	}
+	return 0;
+}
+
+// take a read-only snapshot of the whole of an existing volume
+int SIFS_snapshot(const char* volumename, const char* name)
+{
+	stats_begin(SIFS_OP_SNAPSHOT);
+	int result = take_snapshot(volumename, name);
+	stats_end();
+	return result;
+}
+
+// remove a snapshot, freeing the blocks nothing else uses
+int SIFS_rmsnapshot(const char* volumename, const char* name)
+{
+	stats_begin(SIFS_OP_RMSNAPSHOT);
+	int result = remove_snapshot(volumename, name);
+	stats_end();
+	return result;
+}
@@ -0,0 +1,76 @@
+#include <string.h>
+#include "../sifs.h"
+#include "sifsstats.h"
+
+SIFS_STATS	SIFS_stats[SIFS_NOPS];
+int		SIFS_currentop = SIFS_OP_MKVOLUME;
+
+const char* SIFS_opnames[SIFS_NOPS] = {
+	"mkvolume",		// SIFS_OP_MKVOLUME
+	"mkdir",		// SIFS_OP_MKDIR
+	"rmdir",		// SIFS_OP_RMDIR
+	"writefile",		// SIFS_OP_WRITEFILE
+	"readfile",		// SIFS_OP_READFILE
+	"rmfile",		// SIFS_OP_RMFILE
+	"dirinfo",		// SIFS_OP_DIRINFO
+	"fileinfo",		// SIFS_OP_FILEINFO
+	"defrag",		// SIFS_OP_DEFRAG
+	"export",		// SIFS_OP_EXPORT
+	"growvolume",		// SIFS_OP_GROWVOLUME
+	"shrinkvolume",		// SIFS_OP_SHRINKVOLUME
+	"fsck",			// SIFS_OP_FSCK
+	"scrub",		// SIFS_OP_SCRUB
+	"dirinfo_plus",		// SIFS_OP_DIRINFO_PLUS
+	"walk",			// SIFS_OP_WALK
+	"rename",		// SIFS_OP_RENAME
+	"link",			// SIFS_OP_LINK
+	"readfiles",		// SIFS_OP_READFILES
+	"snapshot",		// SIFS_OP_SNAPSHOT
+	"rmsnapshot",		// SIFS_OP_RMSNAPSHOT
+};
+
+// Where the last transfer of the operation in progress ended. Each operation opens its volume at offset 0
+static long position;
+
+// Counts a seek to offset before nbytes are transferred there, and how far it moved from the last transfer
+void stat_seek(long offset, size_t nbytes)
+{
+	STAT_ADD(nseeks, 1);
+	STAT_ADD(seekbytes, offset > position ? offset - position : position - offset);
+	position = offset + nbytes;
+}
+
+// Marks the start of a call to operation op
+void stats_begin(int op)
+{
+	SIFS_currentop = op;
+	position = 0;
+	SIFS_stats[op].calls++;
+	latency_begin();
+}
+
+// Marks the end of the call started by stats_begin()
+void stats_end(void)
+{
+	latency_end(SIFS_currentop);
+}
+
+// get the counters of a type of operation
+int SIFS_get_stats(int op, SIFS_STATS *stats)
+{
+	if (op < 0 || op >= SIFS_NOPS || stats == NULL)
+	{
+		SIFS_errno = SIFS_EINVAL;
+		return 1;
+	}
+
+	*stats = SIFS_stats[op];
+	return 0;
+}
+
+// reset the counters and latency histograms of every type of operation to zero
+void SIFS_reset_stats(void)
+{
+	memset(SIFS_stats, 0, sizeof(SIFS_stats));
+	latency_reset();
+}
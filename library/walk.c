@@ -0,0 +1,229 @@
+#include "sifsutils.h"
+
+// One entry of a directory being walked. Subdirectory blocks are kept so they are read only once
+typedef struct {
+	SIFS_BLOCKID	id;
+	uint32_t	fileindex;
+	SIFS_DIRENTRY	entry;
+	char		name[SIFS_MAX_NAME_LENGTH];
+	SIFS_DIRBLOCK	dblock;
+} WALK_CHILD;
+
+// A directory on the walk's stack, and how far through its entries the walk is
+typedef struct {
+	SIFS_DIRENTRY	entry;		// of the directory itself, for its SIFS_WALK_POST visit
+	char*		path;
+	WALK_CHILD*	children;
+	uint32_t	nchildren;
+	uint32_t	next;
+} WALK_FRAME;
+
+static int compare_children(const void* a, const void* b)
+{
+	const WALK_CHILD* ca = a;
+	const WALK_CHILD* cb = b;
+	return ca->id < cb->id ? -1 : ca->id > cb->id;
+}
+
+// Joins a volume directory path and an entry name. Returns NULL on failure
+static char* join_path(const char* dir, const char* name)
+{
+	char* path = malloc(strlen(dir) + strlen(name) + 2); // For '/' and null byte
+	if (path)
+	{
+		if (*dir == '\0')
+			strcpy(path, name);
+		else
+			sprintf(path, "%s/%s", dir, name);
+	}
+	return path;
+}
+
+// Reads the entries of dblock in block order, so the volume is read front to back. Directories already
+// seen are left out, so a corrupted volume cannot make the walk loop. Returns SIFS_EOK if action was successful,
+// or SIFS_EBADCRC if the block of an entry fails its checksum
+static int read_children(SIFS_VOLUME_HEADER header, const SIFS_BIT* bitmap, FILE* vol, const SIFS_DIRBLOCK* dblock,
+	unsigned char* seen, WALK_FRAME* frame)
+{
+	uint32_t nentries = dblock->nentries < SIFS_MAX_ENTRIES ? dblock->nentries : SIFS_MAX_ENTRIES;
+	frame->children = malloc(sizeof(WALK_CHILD) * (nentries ? nentries : 1));
+	frame->nchildren = 0;
+	frame->next = 0;
+	if (!frame->children)
+		return SIFS_ENOMEM;
+
+	for (uint32_t i = 0; i < nentries; i++)
+	{
+		WALK_CHILD* child = &frame->children[frame->nchildren];
+		child->id = dblock->entries[i].blockID;
+		child->fileindex = dblock->entries[i].fileindex;
+		if (child->id < header.nblocks && (bitmap[child->id] == SIFS_FILE ||
+			(bitmap[child->id] == SIFS_DIR && !seen[child->id])))
+		{
+			if (bitmap[child->id] == SIFS_DIR)
+				seen[child->id] = true;
+			frame->nchildren++;
+		}
+	}
+	qsort(frame->children, frame->nchildren, sizeof(WALK_CHILD), compare_children);
+
+	for (uint32_t i = 0; i < frame->nchildren; i++)
+	{
+		WALK_CHILD* child = &frame->children[i];
+		SIFS_DIRENTRY* entry = &child->entry;
+		if (bitmap[child->id] == SIFS_DIR)
+		{
+			child->dblock = get_dirblock(header, vol, child->id);
+			if (!dirblock_intact(header, &child->dblock))
+				return SIFS_EBADCRC;
+			strncpy(child->name, child->dblock.name, SIFS_MAX_NAME_LENGTH);
+			entry->type = SIFS_ENTRY_DIR;
+			entry->length = child->dblock.nentries;
+			entry->modtime = child->dblock.modtime;
+			memset(entry->md5, 0, sizeof(entry->md5));
+		}
+		else
+		{
+			SIFS_FILEBLOCK fblock = get_fileblock(header, vol, child->id);
+			if (!fileblock_intact(header, &fblock))
+				return SIFS_EBADCRC;
+			uint32_t fileindex = child->fileindex < SIFS_MAX_ENTRIES ? child->fileindex : 0;
+			strncpy(child->name, fblock.filenames[fileindex], SIFS_MAX_NAME_LENGTH);
+			entry->type = SIFS_ENTRY_FILE;
+			entry->length = fblock.length;
+			entry->modtime = fblock.modtime;
+			memcpy(entry->md5, fblock.md5, MD5_BYTELEN);
+		}
+		child->name[SIFS_MAX_NAME_LENGTH - 1] = '\0';
+		entry->name = child->name;
+	}
+	return SIFS_EOK;
+}
+
+// visit every directory and file beneath root on one open of the volume
+static int walk_volume(const char* volumename, const char* root, SIFS_WALK_CALLBACK callback, void* arg, int flags)
+{
+	// Check arguments
+	if (volumename == NULL || root == NULL || *volumename == '\0' || callback == NULL ||
+		(flags & ~(SIFS_WALK_PRE | SIFS_WALK_POST)) != 0)
+	{
+		SIFS_errno = SIFS_EINVAL;
+		return 1;
+	}
+
+	// Open volume, reading and validating its header and bitmap
+	SIFS_VOLUME_HEADER header;
+	SIFS_BIT* bitmap;
+	SIFS_BLOCKID rootID;
+	FILE* vol = open_snapshot(volumename, &header, &bitmap, &rootID);
+	if (!vol)
+		return 1;
+
+	int err = SIFS_EOK;
+	// If root is '\0' we are walking from the root directory
+	SIFS_BLOCKID dir = (*root == '\0') ? rootID :
+		find_dir(header, bitmap, vol, rootID, root, &err);
+	unsigned char* seen = calloc(header.nblocks, 1);
+	uint32_t nframes = 0, capacity = 16;
+	WALK_FRAME* frames = malloc(sizeof(WALK_FRAME) * capacity);
+	char* rootpath = malloc(strlen(root) + 1);
+	if (err == SIFS_EOK && (!seen || !frames || !rootpath))
+		err = SIFS_ENOMEM;
+
+	// The root of the walk is the first frame. It is not visited itself
+	SIFS_DIRBLOCK dblock;
+	if (err == SIFS_EOK)
+	{
+		dblock = get_dirblock(header, vol, dir);
+		if (!dirblock_intact(header, &dblock))
+			err = SIFS_EBADCRC;
+	}
+	if (err == SIFS_EOK)
+	{
+		seen[dir] = true;
+		strcpy(rootpath, root);
+		frames[0].path = rootpath;
+		rootpath = NULL;
+		nframes = 1;
+		err = read_children(header, bitmap, vol, &dblock, seen, &frames[0]);
+	}
+
+	bool stopped = false;
+	while (nframes > 0 && err == SIFS_EOK && !stopped)
+	{
+		WALK_FRAME* frame = &frames[nframes - 1];
+		if (frame->next == frame->nchildren)
+		{
+			// Every entry has been visited
+			if (nframes > 1 && (flags & SIFS_WALK_POST))
+				stopped = callback(frame->path, &frame->entry, SIFS_WALK_POST, arg) == SIFS_WALK_STOP;
+			free(frame->children);
+			free(frame->path);
+			nframes--;
+			continue;
+		}
+
+		WALK_CHILD* child = &frame->children[frame->next++];
+		char* path = join_path(frame->path, child->name);
+		if (!path)
+		{
+			err = SIFS_ENOMEM;
+			break;
+		}
+
+		int action = SIFS_WALK_CONTINUE;
+		if (child->entry.type == SIFS_ENTRY_FILE || (flags & SIFS_WALK_PRE) || flags == 0)
+			action = callback(path, &child->entry, SIFS_WALK_PRE, arg);
+		stopped = action == SIFS_WALK_STOP;
+
+		if (child->entry.type == SIFS_ENTRY_FILE || action != SIFS_WALK_CONTINUE)
+		{
+			free(path);
+			continue;
+		}
+
+		// Descend into the directory
+		if (nframes == capacity)
+		{
+			WALK_FRAME* grown = realloc(frames, sizeof(WALK_FRAME) * capacity * 2);
+			if (!grown)
+			{
+				free(path);
+				err = SIFS_ENOMEM;
+				break;
+			}
+			frames = grown;
+			capacity *= 2;
+		}
+		// The entry's name stays in the parent frame, which outlives this one
+		WALK_FRAME* next = &frames[nframes++];
+		next->path = path;
+		next->entry = child->entry;
+		err = read_children(header, bitmap, vol, &child->dblock, seen, next);
+	}
+
+	// Deallocate directories the walk did not finish
+	for (uint32_t i = 0; i < nframes; i++)
+	{
+		free(frames[i].children);
+		free(frames[i].path);
+	}
+	if (err != SIFS_EOK)
+		SIFS_errno = err;
+
+	free(frames);
+	free(rootpath);
+	free(seen);
+	free(bitmap);
+	close_volume(vol);
+	return err == SIFS_EOK ? 0 : 1;
+}
+
+// visit every directory and file beneath root on one open of the volume
+int SIFS_walk(const char* volumename, const char* root, SIFS_WALK_CALLBACK callback, void* arg, int flags)
+{
+	stats_begin(SIFS_OP_WALK);
+	int result = walk_volume(volumename, root, callback, arg, flags);
+	stats_end();
+	return result;
+}
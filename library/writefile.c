@@ -3,6 +3,8 @@
 // Returns blockID of file with same MD5. If no file is found, function returns SIFS_ROOTDIR_BLOCKID
 SIFS_BLOCKID search_MD5(SIFS_VOLUME_HEADER header, SIFS_BIT* bitmap, FILE* vol, const unsigned char* md5_digest)
 {
+	STAT_ADD(bitmapscans, 1);
+
 	// For every block
 	for (SIFS_BLOCKID id = 0; id < header.nblocks; id++)
 	{
@@ -10,6 +12,9 @@ SIFS_BLOCKID search_MD5(SIFS_VOLUME_HEADER header, SIFS_BIT* bitmap, FILE* vol,
 		if (bitmap[id] == SIFS_FILE)
 		{
 			SIFS_FILEBLOCK file = get_fileblock(header, vol, id);
+			// Chunks are shared by chunked files, never by names
+			if (is_chunk(header, &file))
+				continue;
 			bool success = true;
 			// If the block shares the same md5_digest
 			for (int i = 0; i < MD5_BYTELEN; i++)
@@ -26,7 +31,7 @@ SIFS_BLOCKID search_MD5(SIFS_VOLUME_HEADER header, SIFS_BIT* bitmap, FILE* vol,
 }
 
 // add a copy of a new file to an existing volume
-int SIFS_writefile(const char *volumename, const char *pathname,
+static int write_file(const char *volumename, const char *pathname,
 		   void *data, size_t nbytes)
 {
 	// Check arguments
@@ -36,33 +41,12 @@ int SIFS_writefile(const char *volumename, const char *pathname,
 		return 1;
 	}
 
-	// Try to open volume
-	FILE* vol = fopen(volumename, "r+");
-	if (!vol)
-	{
-		SIFS_errno = SIFS_ENOVOL;
-		return 1;
-	}
-
-	// Read and validate header
-	SIFS_VOLUME_HEADER header = get_volumeheader(vol);
-	if (header.blocksize < SIFS_MIN_BLOCKSIZE || header.nblocks == 0)
-	{
-		SIFS_errno = SIFS_ENOTVOL;
-		fclose(vol);
-		return 1;
-	}
-
-	// Read and validate bitmap
+	// Open volume, reading and validating its header and bitmap
+	SIFS_VOLUME_HEADER header;
 	SIFS_BIT* bitmap;
-	get_volumebitmap(vol, &bitmap);
-	if (!validate_bitmap(bitmap, header.nblocks))
-	{
-		SIFS_errno = SIFS_ENOTVOL;
-		free(bitmap);
-		fclose(vol);
+	FILE* vol = open_volume(volumename, "r+", &header, &bitmap);
+	if (!vol)
 		return 1;
-	}
 
 	// Split pathname into its path and name
 	char* dirpath, * name;
@@ -70,7 +54,7 @@ int SIFS_writefile(const char *volumename, const char *pathname,
 	{
 		SIFS_errno = SIFS_ENOMEM;
 		free(bitmap);
-		fclose(vol);
+		close_volume(vol);
 		return 1;
 	}
 
@@ -82,15 +66,16 @@ int SIFS_writefile(const char *volumename, const char *pathname,
 		if (dirpath)
 			free(dirpath);
 		free(name);
-		fclose(vol);
+		close_volume(vol);
 		return 1;
 	}
 
-	// Find SIFS_BLOCKID of dirpath
+	// Find SIFS_BLOCKID of dirpath. Directories that a snapshot shares are only copied once the file is known
+	// to fit. If dirpath is NULL we are working in the root directory
 	int err = SIFS_EOK;
-	// If dirpath is NULL we are working in the root directory
-	SIFS_BLOCKID dblockID = (dirpath) ? find_dir(header, bitmap, vol, SIFS_ROOTDIR_BLOCKID, dirpath, &err) :
-		SIFS_ROOTDIR_BLOCKID;
+	SIFS_BLOCKID dblockID = SIFS_ROOTDIR_BLOCKID;
+	if (dirpath)
+		dblockID = find_dir(header, bitmap, vol, SIFS_ROOTDIR_BLOCKID, dirpath, &err);
 	if (err != SIFS_EOK)
 	{
 		SIFS_errno = err;
@@ -98,7 +83,7 @@ int SIFS_writefile(const char *volumename, const char *pathname,
 		if (dirpath)
 			free(dirpath);
 		free(name);
-		fclose(vol);
+		close_volume(vol);
 		return 1;
 	}
 
@@ -112,143 +97,154 @@ int SIFS_writefile(const char *volumename, const char *pathname,
 		if (dirpath)
 			free(dirpath);
 		free(name);
-		fclose(vol);
+		close_volume(vol);
 		return 1;
 	}
 
-	// Check if name already exists
-	for (uint32_t i = 0; i < dblock.nentries; i++)
+	// Check if name already exists. A directory pointing to an invalid block means the volume is corrupted
+	if (find_entry(header, bitmap, vol, &dblock, name, &err) != dblock.nentries || err != SIFS_EOK)
 	{
-		SIFS_BLOCKID entryID = dblock.entries[i].blockID;
-		// If the entry is a directory block
-		if (bitmap[entryID] == SIFS_DIR)
-		{
-			SIFS_DIRBLOCK entrydir = get_dirblock(header, vol, entryID);
-
-			if (strcmp(entrydir.name, name) == 0)
-			{
-				SIFS_errno = SIFS_EEXIST;
-				free(bitmap);
-				if (dirpath)
-					free(dirpath);
-				free(name);
-				fclose(vol);
-				return 1;
-			}
-		}
-		// If the entry is a file block
-		else if (bitmap[entryID] == SIFS_FILE)
-		{
-			SIFS_FILEBLOCK entryfile = get_fileblock(header, vol, entryID);
-			// If the entry name is the same as our given name
-			if (strcmp(entryfile.filenames[dblock.entries[i].fileindex], name) == 0)
-			{
-				SIFS_errno = SIFS_EEXIST;
-				free(bitmap);
-				if (dirpath)
-					free(dirpath);
-				free(name);
-				fclose(vol);
-				return 1;
-			}
-		}
-		// directory points to an invalid block. Volume is corrupted
-		else
-		{
-			SIFS_errno = SIFS_ENOTVOL;
-			free(bitmap);
-			if (dirpath)
-				free(dirpath);
-			free(name);
-			fclose(vol);
-			return 1;
-		}
+		SIFS_errno = err != SIFS_EOK ? err : SIFS_EEXIST;
+		free(bitmap);
+		if (dirpath)
+			free(dirpath);
+		free(name);
+		close_volume(vol);
+		return 1;
 	}
 
 	// Calculate md5 digest
 	unsigned char md5_digest[MD5_BYTELEN];
+	phase_begin(SIFS_PHASE_HASH);
 	MD5_buffer(data, nbytes, md5_digest);
+	STAT_ADD(md5bytes, nbytes);
+	phase_end(SIFS_PHASE_HASH);
 	
 	// Attempt to find fileblockID with same md5 digest
 	SIFS_BLOCKID fileID = search_MD5(header, bitmap, vol, md5_digest);
 	SIFS_FILEBLOCK fblock;
 
+	// Nothing is written if any block read, those searched among them, failed its checksum. A copy made for
+	// a snapshot holds no more names than the original, so nothing is copied for a name that cannot be added
+	if (!metadata_intact())
+		err = SIFS_EBADCRC;
+	else if (fileID != SIFS_ROOTDIR_BLOCKID && get_fileblock(header, vol, fileID).nfiles == SIFS_MAX_ENTRIES)
+		err = SIFS_EMAXENTRY;
+	else if (header.flags & SIFS_FORMAT_SNAPSHOT)
+	{
+		dblockID = cow_dir(header, bitmap, vol, dirpath, &err);
+		if (err == SIFS_EOK)
+			dblock = get_dirblock(header, vol, dblockID);
+	}
+	if (err != SIFS_EOK)
+	{
+		SIFS_errno = err;
+		free(bitmap);
+		if (dirpath)
+			free(dirpath);
+		free(name);
+		close_volume(vol);
+		return 1;
+	}
+
 	// Configure fblock and dblock
 	if (fileID == SIFS_ROOTDIR_BLOCKID)
 	{
 		// No file with the same md5 digest found. Create new file block
 		memset(&fblock, 0, sizeof(SIFS_FILEBLOCK));
 
-		// Find a free block
-		bool foundblock = false;
-		for (SIFS_BLOCKID i = 0; i < header.nblocks; i++)
+		// Find a free block, leaving room after it for the contents if they were stored as they are
+		uint32_t ndata = (header.flags & SIFS_FORMAT_INLINE) && nbytes <= inline_capacity(header) ? 0 :
+			(nbytes + header.blocksize - 1) / header.blocksize;
+		phase_begin(SIFS_PHASE_ALLOC);
+		STAT_ADD(bitmapscans, 1);
+		fileID = place_fileblock(header, bitmap, dblockID, ndata);
+		bool foundblock = fileID < header.nblocks;
+		if (foundblock)
 		{
-			if (bitmap[i] == SIFS_UNUSED)
-			{
-				foundblock = true;
-				fileID = i;
-				bitmap[fileID] = SIFS_FILE;
+			bitmap[fileID] = SIFS_FILE;
 
-				fblock.modtime = time(NULL);
-				fblock.length = nbytes;
-				memcpy(fblock.md5, md5_digest, MD5_BYTELEN);
+			fblock.modtime = time(NULL);
+			fblock.length = nbytes;
+			fblock.generation = fblock.datageneration = snapshot_generation(header, vol);
+			memcpy(fblock.md5, md5_digest, MD5_BYTELEN);
 
-				// Find a contigious block of memory for data
-				int nblocks = (nbytes + header.blocksize - 1) / header.blocksize; // Round up 
-				uint32_t currentlength = 0;
-				SIFS_BLOCKID firstblockID;
-				bool success = false;
-				// Start search from i + 1 th BLOCKID as all previous blocks are in use 
-				for (uint32_t j =  i + 1; j < header.nblocks; j++)
-				{
-					if (bitmap[j] == SIFS_UNUSED)
-						currentlength++;
-					else
-						currentlength = 0;
+			// Small contents are kept in the unused tail of the file block itself
+			if ((header.flags & SIFS_FORMAT_INLINE) && nbytes <= inline_capacity(header))
+				fblock.fileflags = SIFS_FILE_INLINE;
 
-					if (currentlength == nblocks)
-					{
-						success = true;
-						firstblockID = j - currentlength + 1;
-						break;
-					}
-				}
-				if (!success)
-				{
-					SIFS_errno = SIFS_ENOSPC;
-					free(bitmap);
-					if (dirpath)
-						free(dirpath);
-					free(name);
-					fclose(vol);
-					return 1;
-				}
-				fblock.firstblockID = firstblockID;
+			// Compress the contents if the volume asks for it. Dedup stays keyed on the raw contents.
+			// Chunked volumes store the rest as a list of chunks that other files may share
+			const void* stored;
+			if ((header.flags & SIFS_FORMAT_CHUNKED) && !is_inline(header, &fblock))
+				stored = chunk_filedata(header, bitmap, vol, data, nbytes, fileID, &fblock, &err);
+			else
+				stored = pack_filedata(header, data, &fblock);
+			if (!stored)
+			{
+				SIFS_errno = err;
+				free(bitmap);
+				if (dirpath)
+					free(dirpath);
+				free(name);
+				close_volume(vol);
+				return 1;
+			}
 
-				strcpy(fblock.filenames[fblock.nfiles], name);
-				dblock.entries[dblock.nentries].blockID = fileID;
-				dblock.entries[dblock.nentries].fileindex = fblock.nfiles;
-				dblock.modtime = time(NULL);
+			// Find a contigious block of memory for data. Contents that need no data blocks point at the file block
+			int nblocks = data_blocks(header, &fblock);
+			SIFS_BLOCKID firstblockID = nblocks == 0 ? fileID : place_data(header, bitmap, fileID, nblocks);
+			bool success = firstblockID < header.nblocks;
+			if (!success)
+			{
+				SIFS_errno = SIFS_ENOSPC;
+				if (stored != data)
+					free((void*)stored);
+				free(bitmap);
+				if (dirpath)
+					free(dirpath);
+				free(name);
+				close_volume(vol);
+				return 1;
+			}
+			fblock.firstblockID = firstblockID;
 
-				dblock.nentries++;
-				fblock.nfiles++;
+			strcpy(fblock.filenames[fblock.nfiles], name);
+			dblock.entries[dblock.nentries].blockID = fileID;
+			dblock.entries[dblock.nentries].fileindex = fblock.nfiles;
+			dblock.modtime = time(NULL);
 
-				// Write bitmap to volume
-				for (SIFS_BLOCKID id = firstblockID; id < firstblockID + nblocks; id++)
-				{
-					bitmap[id] = SIFS_DATABLOCK;
-				}
-				fseek(vol, sizeof(SIFS_VOLUME_HEADER), SEEK_SET);
-				fwrite(bitmap, sizeof(SIFS_BIT), header.nblocks, vol);
+			dblock.nentries++;
+			fblock.nfiles++;
 
-				// Write data to volume
-				long offset = sizeof(SIFS_VOLUME_HEADER) + header.nblocks + firstblockID * header.blocksize;
-				fseek(vol, offset, SEEK_SET);
-				fwrite(data, 1, nbytes, vol);
+			// Write bitmap to volume
+			for (SIFS_BLOCKID id = firstblockID; id < firstblockID + nblocks; id++)
+			{
+				bitmap[id] = SIFS_DATABLOCK;
+			}
 
-				break;
+			// The file must count in every chunk it points at before anything refers to them. New chunks stay
+			// unused while the bitmap is not written
+			if (is_chunked(header, &fblock) && !add_chunkrefs(header, bitmap, vol, stored, fblock.nchunks, &err))
+			{
+				SIFS_errno = err;
+				if (stored != data)
+					free((void*)stored);
+				free(bitmap);
+				if (dirpath)
+					free(dirpath);
+				free(name);
+				close_volume(vol);
+				return 1;
 			}
+			put_volumebitmap(header, vol, bitmap);
+
+			// Write data to volume
+			write_run(vol, data_offset(header, &fblock), stored, stored_length(header, &fblock));
+			if (stored != data)
+				free((void*)stored);
 		}
+		phase_end(SIFS_PHASE_ALLOC);
 		if (!foundblock)
 		{
 			SIFS_errno = SIFS_ENOSPC;
@@ -256,7 +252,7 @@ int SIFS_writefile(const char *volumename, const char *pathname,
 			if (dirpath)
 				free(dirpath);
 			free(name);
-			fclose(vol);
+			close_volume(vol);
 			return 1;
 		}
 	}
@@ -264,15 +260,22 @@ int SIFS_writefile(const char *volumename, const char *pathname,
 	{
 		fblock = get_fileblock(header, vol, fileID);
 
-		if (fblock.nfiles == SIFS_MAX_ENTRIES)
+		// A file block that a snapshot shares gets a copy of its own first, moving the entries that refer to it
+		if (snapshot_shared(header, vol, fblock.generation))
 		{
-			SIFS_errno = SIFS_EMAXENTRY;
-			free(bitmap);
-			if (dirpath)
-				free(dirpath);
-			free(name);
-			fclose(vol);
-			return 1;
+			fileID = cow_file(header, bitmap, vol, fileID, &err);
+			if (err != SIFS_EOK)
+			{
+				SIFS_errno = err;
+				free(bitmap);
+				if (dirpath)
+					free(dirpath);
+				free(name);
+				close_volume(vol);
+				return 1;
+			}
+			fblock = get_fileblock(header, vol, fileID);
+			dblock = get_dirblock(header, vol, dblockID);
 		}
 
 		strcpy(fblock.filenames[fblock.nfiles], name);
@@ -285,16 +288,28 @@ int SIFS_writefile(const char *volumename, const char *pathname,
 	}
 
 	// Write dblock and fblock to volume
-	fseek(vol, sizeof(SIFS_VOLUME_HEADER) + header.nblocks + header.blocksize * fileID, SEEK_SET);
-	fwrite(&fblock, sizeof(SIFS_FILEBLOCK), 1, vol);
+	put_fileblock(header, vol, fileID, &fblock);
 
-	fseek(vol, sizeof(SIFS_VOLUME_HEADER) + header.nblocks + header.blocksize * dblockID, SEEK_SET);
-	fwrite(&dblock, sizeof(SIFS_DIRBLOCK), 1, vol);
+	put_dirblock(header, vol, dblockID, &dblock);
 
 	free(bitmap);
 	if (dirpath)
 		free(dirpath);
 	free(name);
-	fclose(vol);
-    return 0;
+	if (close_volume(vol) != 0)
+	{
+		SIFS_errno = SIFS_EIO;
+		return 1;
+	}
+	return 0;
+}
+
+// add a copy of a new file to an existing volume
+int SIFS_writefile(const char *volumename, const char *pathname,
+		   void *data, size_t nbytes)
+{
+	stats_begin(SIFS_OP_WRITEFILE);
+	int result = write_file(volumename, pathname, data, nbytes);
+	stats_end();
+	return result;
 }
@@ -6,4 +6,67 @@ echo "SIFS_rmdir() TESTS"
 echo "-------------------------"
 echo "SIFS_writefile() TESTS"
 ./test_writefile
+echo "-------------------------"
+echo "SIFS_export() TESTS"
+./test_export
+echo "-------------------------"
+echo "SIFS_get_stats() TESTS"
+./test_stats
+echo "-------------------------"
+echo "SIFS_growvolume() AND SIFS_shrinkvolume() TESTS"
+./test_resize
+echo "-------------------------"
+echo "SIFS_FORMAT_PACKED TESTS"
+./test_packed
+echo "-------------------------"
+echo "SIFS_fsck() TESTS"
+./test_fsck
+echo "-------------------------"
+echo "SIFS_scrub() TESTS"
+./test_scrub
+echo "-------------------------"
+echo "SIFS_FORMAT_COMPRESS TESTS"
+./test_compress
+echo "-------------------------"
+echo "SIFS_FORMAT_INLINE TESTS"
+./test_inline
+echo "-------------------------"
+echo "SIFS_FORMAT_CHUNKED TESTS"
+./test_chunk
+echo "-------------------------"
+echo "SIFS_dirinfo_plus() TESTS"
+./test_dirplus
+echo "-------------------------"
+echo "SIFS_walk() TESTS"
+./test_walk
+echo "-------------------------"
+echo "SIFS_rename() TESTS"
+./test_rename
+echo "-------------------------"
+echo "SIFS_link() TESTS"
+./test_link
+echo "-------------------------"
+echo "TESTING BLOCK CACHE"
+./test_cache
+echo "-------------------------"
+echo "TESTING BATCHED I/O"
+./test_batch
+echo "-------------------------"
+echo "SIFS_readfiles() TESTS"
+./test_readfiles
+echo "-------------------------"
+echo "TESTING BLOCK PLACEMENT"
+./test_place
+echo "-------------------------"
+echo "TESTING ALLOCATION STRATEGIES"
+./test_alloc
+echo "-------------------------"
+echo "TESTING HOLE PUNCHING"
+./test_punch
+echo "-------------------------"
+echo "TESTING SNAPSHOTS"
+./test_snapshot
+echo "-------------------------"
+echo "TESTING METADATA CHECKSUMS"
+./test_crc
 echo "-------------------------"
\ No newline at end of file
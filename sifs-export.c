@@ -0,0 +1,24 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "sifs.h"
+
+//  EXPORTS EVERY DIRECTORY AND FILE OF A VOLUME TO A HOST DIRECTORY
+//  FILES WITH IDENTICAL CONTENTS ARE RECREATED AS HARD LINKS
+
+int main(int argc, char* argv[])
+{
+	if (argc != 3)
+	{
+		printf("USAGE: %s [volumename] [host directory]\n", argv[0]);
+		exit(EXIT_FAILURE);
+	}
+
+	if (SIFS_export(argv[1], argv[2]) != 0)
+	{
+		SIFS_perror(argv[0]);
+		exit(EXIT_FAILURE);
+	}
+
+	return 0;
+}
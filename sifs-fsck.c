@@ -0,0 +1,59 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include "sifs.h"
+
+//  CHECKS THE CONSISTENCY OF A VOLUME, OPTIONALLY FREEING BLOCKS THAT NO DIRECTORY REACHES.
+//  EXITS WITH A NON-ZERO STATUS IF ANY PROBLEM REMAINS
+
+static void usage(const char* progname)
+{
+	printf("USAGE: %s [-r] [-j nthreads] [volumename]\n", progname);
+	exit(EXIT_FAILURE);
+}
+
+int main(int argc, char* argv[])
+{
+	int flags = 0;
+	int nthreads = 0;
+	const char* volumename = NULL;
+
+	for (int a = 1; a < argc; a++)
+	{
+		if (strcmp(argv[a], "-r") == 0)
+			flags |= SIFS_FSCK_REPAIR;
+		else if (strcmp(argv[a], "-j") == 0 && a + 1 < argc)
+			nthreads = atoi(argv[++a]);
+		else if (volumename == NULL)
+			volumename = argv[a];
+		else
+			usage(argv[0]);
+	}
+	if (volumename == NULL)
+		usage(argv[0]);
+
+	SIFS_FSCK_REPORT report;
+	if (SIFS_fsck(volumename, nthreads, flags, &report) != 0)
+	{
+		SIFS_perror(argv[0]);
+		exit(EXIT_FAILURE);
+	}
+
+	printf("%s: %" PRIu64 " blocks in use, %" PRIu64 " files\n", volumename, report.used, report.files);
+	printf("unreachable blocks:        %" PRIu64 "\n", report.unreachable);
+	printf("bad directory entries:     %" PRIu64 "\n", report.badentries);
+	printf("bad file indices:          %" PRIu64 "\n", report.badindex);
+	printf("overlapping data blocks:   %" PRIu64 "\n", report.overlaps);
+	printf("files failing MD5:         %" PRIu64 "\n", report.badmd5);
+	printf("bad chunk references:      %" PRIu64 "\n", report.badrefs);
+	printf("blocks failing checksum:   %" PRIu64 "\n", report.badcrc);
+	printf("duplicate file entries:    %" PRIu64 "\n", report.duplicates);
+	printf("orphaned blocks freed:     %" PRIu64 "\n", report.repaired);
+	printf("stale entries dropped:     %" PRIu64 "\n", report.dropped);
+
+	uint64_t remaining = report.unreachable - report.repaired + report.badentries + report.badindex +
+		report.overlaps + report.badmd5 + report.badrefs + report.badcrc + report.duplicates - report.dropped;
+	return remaining == 0 ? 0 : EXIT_FAILURE;
+}
@@ -0,0 +1,72 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <inttypes.h>
+
+#include "sifs.h"
+
+//  REHASHES THE DATA OF A VOLUME'S FILES, REPORTING ANY THAT NO LONGER MATCH THEIR MD5.
+//  WITH -d THE SCRUB RUNS FOREVER, STARTING A NEW PASS EVERY interval SECONDS. IT NEEDS -c,
+//  AS EACH BATCH RESUMES FROM THE CURSOR THE LAST ONE SAVED
+
+// Files scrubbed between saves of the cursor in daemon mode
+#define DAEMON_BATCH	1024
+
+static void usage(const char* progname)
+{
+	printf("USAGE: %s [-r MB/s] [-c cursorfile [-d interval]] [volumename]\n", progname);
+	exit(EXIT_FAILURE);
+}
+
+static void report_mismatch(const char* volumename, uint32_t fileblockID, void* arg)
+{
+	uint64_t* nmismatches = arg;
+	(*nmismatches)++;
+	printf("%s: file block %u does not match its MD5\n", volumename, fileblockID);
+	fflush(stdout);
+}
+
+int main(int argc, char* argv[])
+{
+	double mbps = 0;
+	int interval = -1;
+	const char* cursorfile = NULL;
+	const char* volumename = NULL;
+
+	for (int a = 1; a < argc; a++)
+	{
+		if (strcmp(argv[a], "-r") == 0 && a + 1 < argc)
+			mbps = atof(argv[++a]);
+		else if (strcmp(argv[a], "-c") == 0 && a + 1 < argc)
+			cursorfile = argv[++a];
+		else if (strcmp(argv[a], "-d") == 0 && a + 1 < argc)
+			interval = atoi(argv[++a]);
+		else if (volumename == NULL)
+			volumename = argv[a];
+		else
+			usage(argv[0]);
+	}
+	if (volumename == NULL || (interval >= 0 && cursorfile == NULL))
+		usage(argv[0]);
+
+	uint64_t nmismatches = 0;
+	SIFS_SCRUB_REPORT report;
+	do
+	{
+		if (SIFS_scrub(volumename, mbps, interval < 0 ? 0 : DAEMON_BATCH, cursorfile,
+			report_mismatch, &nmismatches, &report) != 0)
+		{
+			SIFS_perror(argv[0]);
+			exit(EXIT_FAILURE);
+		}
+		if (report.finished && interval >= 0)
+			sleep(interval);
+	} while (interval >= 0);
+
+	printf("%s: %" PRIu64 " files, %" PRIu64 " bytes scrubbed, %" PRIu64 " mismatches\n",
+		volumename, report.files, report.bytes, nmismatches);
+	return nmismatches == 0 ? 0 : EXIT_FAILURE;
+}
@@ -1,3 +1,6 @@
+#ifndef SIFS_H
+#define SIFS_H
+
 #include <stdlib.h>
 #include <stdint.h>
 #include <time.h>
@@ -8,9 +11,16 @@
 //  YOU MAY ADD THINGS, BUT DON'T CHANGE ANYTHING (else your project can't be tested)
 
 
-//  MAKE A NEW VOLUME
+//  MAKE A NEW VOLUME. NEW VOLUMES ARE FORMAT VERSION 2: THEIR HEADER CARRIES A MAGIC NUMBER
+//  AND A CHECKSUM, AND EACH DIRECTORY AND FILE BLOCK A CRC32C CHECKED WHEN IT IS READ.
+//  OPERATIONS THAT READ A BLOCK FAILING ITS CHECK FAIL WITH SIFS_EBADCRC
+//  AND, IF THEY CHANGE THE VOLUME, WRITE NOTHING
 extern	int SIFS_mkvolume(const char *volumename, size_t blocksize, uint32_t nblocks);
 
+//  MAKE A NEW VOLUME WITH THE GIVEN SIFS_FORMAT_* OPTIONS
+extern	int SIFS_mkvolume_format(const char *volumename, size_t blocksize,
+				 uint32_t nblocks, uint32_t format);
+
 //  MAKE A NEW DIRECTORY WITHIN AN EXISTING VOLUME
 extern	int SIFS_mkdir(const char *volumename, const char *dirname);
 
@@ -25,13 +35,82 @@ extern	int SIFS_writefile(const char *volumename, const char *pathname,
 extern	int SIFS_readfile(const char *volumename, const char *pathname,
 			  void **data, size_t *nbytes);
 
+//  READ THE CONTENTS OF MANY FILES OF AN EXISTING VOLUME ON ONE OPEN OF IT. PATHS IN THE SAME
+//  DIRECTORY SHARE ITS LOOKUP, CONTENTS ARE READ IN THE ORDER THEY ARE STORED, AND CONTENTS SHARED
+//  BY SEVERAL PATHS ARE READ ONCE. results[i] DESCRIBES pathnames[i], AND ITS data IS RELEASED WITH
+//  free(). THE CALL SUCCEEDS EVEN IF SOME PATHS CANNOT BE READ; THEIR error SAYS WHY
+typedef struct {
+    void		*data;		// NULL unless error is SIFS_EOK
+    size_t		length;
+    int			error;		// one of SIFS_E*
+} SIFS_READRESULT;
+
+extern	int SIFS_readfiles(const char *volumename, const char **pathnames, size_t npaths,
+			   SIFS_READRESULT *results);
+
 //  REMOVE AN EXISTING FILE FROM AN EXISTING VOLUME
 extern	int SIFS_rmfile(const char *volumename, const char *pathname);
 
+//  RENAME OR MOVE AN EXISTING FILE OR DIRECTORY WITHIN AN EXISTING VOLUME. ONLY THE NAME AND
+//  THE PARENT DIRECTORY ENTRIES ARE REWRITTEN. AN EXISTING newpathname IS NOT REPLACED
+extern	int SIFS_rename(const char *volumename, const char *oldpathname,
+			const char *newpathname);
+
+//  ADD A NEW NAME FOR THE CONTENTS OF AN EXISTING FILE, AS IF IT HAD BEEN WRITTEN AGAIN.
+//  THE CONTENTS ARE NEITHER READ NOR HASHED
+extern	int SIFS_link(const char *volumename, const char *srcpathname,
+		      const char *dstpathname);
+
 //  GET INFORMATION ABOUT A REQUESTED DIRECTORY
 extern	int SIFS_dirinfo(const char *volumename, const char *pathname,
 			 char ***entrynames, uint32_t *nentries, time_t *modtime);
 
+//  GET THE NAME, TYPE, LENGTH, MODIFICATION TIME AND MD5 OF EVERY ENTRY OF A REQUESTED
+//  DIRECTORY IN ONE CALL. *entries AND THE NAMES IT POINTS TO ARE ONE ALLOCATION, RELEASED
+//  WITH A SINGLE CALL TO free()
+typedef struct {
+    char		*name;
+    int			type;		// SIFS_ENTRY_DIR or SIFS_ENTRY_FILE
+    size_t		length;		// of a file's contents, or n entries of a directory
+    time_t		modtime;
+    unsigned char	md5[16];	// of a file's contents, zeroes for a directory
+} SIFS_DIRENTRY;
+
+#define	SIFS_ENTRY_DIR		0
+#define	SIFS_ENTRY_FILE		1
+
+extern	int SIFS_dirinfo_plus(const char *volumename, const char *pathname,
+			      SIFS_DIRENTRY **entries, uint32_t *nentries, time_t *modtime);
+
+//  VISIT EVERY DIRECTORY AND FILE BENEATH root ("" FOR THE ROOT DIRECTORY) ON ONE OPEN OF THE
+//  VOLUME. callback IS GIVEN THE FULL PATH AND DETAILS OF EACH ENTRY. THE ENTRIES OF A DIRECTORY
+//  ARE VISITED IN THE ORDER THEIR BLOCKS ARE STORED. DIRECTORIES ARE VISITED BEFORE THEIR ENTRIES
+//  WITH SIFS_WALK_PRE IN flags (THE DEFAULT), AFTER THEM WITH SIFS_WALK_POST, OR BOTH.
+//  FILES ARE VISITED ONCE, AS SIFS_WALK_PRE. callback RETURNS ONE OF SIFS_WALK_CONTINUE,
+//  SIFS_WALK_PRUNE TO SKIP THE ENTRIES OF THE DIRECTORY JUST VISITED, OR SIFS_WALK_STOP
+typedef	int		(*SIFS_WALK_CALLBACK)(const char *path, const SIFS_DIRENTRY *entry,
+					      int visit, void *arg);
+
+#define	SIFS_WALK_PRE		0x1
+#define	SIFS_WALK_POST		0x2
+
+#define	SIFS_WALK_CONTINUE	0
+#define	SIFS_WALK_PRUNE		1
+#define	SIFS_WALK_STOP		2
+
+extern	int SIFS_walk(const char *volumename, const char *root,
+		      SIFS_WALK_CALLBACK callback, void *arg, int flags);
+
+//  TAKE A READ-ONLY SNAPSHOT OF THE WHOLE OF A VOLUME MADE WITH SIFS_FORMAT_SNAPSHOT. ONLY THE
+//  ROOT DIRECTORY IS COPIED; LATER CHANGES COPY THE DIRECTORY AND FILE BLOCKS THEY TOUCH, AND
+//  BLOCKS THE VOLUME NO LONGER USES ARE KEPT WHILE A SNAPSHOT DOES. A VOLUME NAME OF THE FORM
+//  volumename@name PASSED TO SIFS_readfile, SIFS_readfiles, SIFS_dirinfo, SIFS_dirinfo_plus,
+//  SIFS_walk, SIFS_fileinfo OR SIFS_export READS THE SNAPSHOT name INSTEAD
+extern	int SIFS_snapshot(const char *volumename, const char *name);
+
+//  REMOVE A SNAPSHOT, FREEING THE BLOCKS THAT NEITHER THE VOLUME NOR ANOTHER SNAPSHOT USES
+extern	int SIFS_rmsnapshot(const char *volumename, const char *name);
+
 //  GET INFORMATION ABOUT A REQUESTED FILE
 extern	int SIFS_fileinfo(const char *volumename, const char *pathname,
 			  size_t *length, time_t *modtime);
@@ -39,6 +118,139 @@ extern	int SIFS_fileinfo(const char *volumename, const char *pathname,
 //  DEFRAGMENT THE VOLUME
 extern  int SIFS_defrag(const char* volumename);
 
+//  GROW AN EXISTING VOLUME TO nblocks BLOCKS, KEEPING ALL OF ITS CONTENTS.
+//  ONLY THE BITMAP MOVES, SO THE TIME TAKEN FOLLOWS nblocks AND NOT THE DATA HELD. VERSION 1
+//  VOLUMES, WHOSE EVERY BLOCK WOULD HAVE TO MOVE, FAIL WITH SIFS_EINVAL AND MUST BE MADE AGAIN
+extern	int SIFS_growvolume(const char *volumename, uint32_t nblocks);
+
+//  SHRINK AN EXISTING VOLUME TO nblocks BLOCKS, DEFRAGMENTING IT FIRST IF NEEDED
+//  VERSION 1 VOLUMES FAIL WITH SIFS_EINVAL, AS FOR SIFS_growvolume
+extern	int SIFS_shrinkvolume(const char *volumename, uint32_t nblocks);
+
+//  EXPORT ALL DIRECTORIES AND FILES OF AN EXISTING VOLUME TO A HOST DIRECTORY
+extern	int SIFS_export(const char *volumename, const char *hostdir);
+
+//  CHECK THE CONSISTENCY OF AN EXISTING VOLUME WITH nthreads THREADS (0 FOR ONE PER CPU).
+//  WITH SIFS_FSCK_REPAIR IN flags, BLOCKS THAT NO DIRECTORY REACHES ARE FREED, AND OF TWO
+//  DIRECTORY ENTRIES NAMING THE SAME FILE NAME THE STALE ONE IS DROPPED
+typedef struct {
+    uint64_t		used;		// blocks in use
+    uint64_t		files;		// file blocks checked
+    uint64_t		unreachable;	// blocks in use that no directory reaches
+    uint64_t		badentries;	// directory entries pointing at the wrong kind of block
+    uint64_t		badindex;	// directory entries with an invalid fileindex
+    uint64_t		overlaps;	// data blocks claimed twice, outside the volume or not marked as data
+    uint64_t		badmd5;		// files whose data does not match their MD5
+    uint64_t		badrefs;	// chunk lists pointing at no chunk, and chunks with a wrong reference count
+    uint64_t		repaired;	// orphaned blocks freed
+    uint64_t		largestfree;	// longest run of unused blocks, after any repair
+    uint64_t		badcrc;		// reachable directory and file blocks that fail their checksum
+    uint64_t		duplicates;	// directory entries naming a file name another entry names
+    uint64_t		dropped;	// of those, stale entries removed
+} SIFS_FSCK_REPORT;
+
+#define	SIFS_FSCK_REPAIR	0x1
+
+extern	int SIFS_fsck(const char *volumename, int nthreads, int flags,
+		      SIFS_FSCK_REPORT *report);
+
+//  REHASH THE DATA OF UP TO maxfiles FILES (0 FOR ALL) IN PHYSICAL ORDER AT NO MORE THAN
+//  mbps MEGABYTES PER SECOND (0 FOR NO LIMIT), STARTING FROM THE BLOCK SAVED IN cursorfile.
+//  WITHOUT A cursorfile EVERY CALL STARTS FROM THE FIRST BLOCK, SO A LIMITED maxfiles NEEDS ONE
+//  onmismatch IS CALLED WITH THE FILE BLOCK OF EVERY FILE WHOSE DATA NO LONGER MATCHES ITS MD5
+typedef struct {
+    uint64_t		files;		// file blocks checked
+    uint64_t		bytes;		// bytes of stored data read
+    uint64_t		mismatches;	// files whose data did not match their MD5
+    int			finished;	// 1 if the end of the volume was reached
+} SIFS_SCRUB_REPORT;
+
+typedef	void		(*SIFS_SCRUB_CALLBACK)(const char *volumename, uint32_t fileblockID, void *arg);
+
+extern	int SIFS_scrub(const char *volumename, double mbps, uint32_t maxfiles,
+		       const char *cursorfile, SIFS_SCRUB_CALLBACK onmismatch, void *arg,
+		       SIFS_SCRUB_REPORT *report);
+
+//  GET THE I/O AND WORK COUNTERS OF A TYPE OF OPERATION (ONE OF SIFS_OP_*)
+typedef struct {
+    uint64_t		calls;		// number of calls made
+    uint64_t		nseeks;		// fseek() calls
+    uint64_t		nreads;		// fread() calls
+    uint64_t		nwrites;	// fwrite() calls
+    uint64_t		bytesread;
+    uint64_t		byteswritten;
+    uint64_t		dirblocks;	// directory blocks visited
+    uint64_t		fileblocks;	// file blocks visited
+    uint64_t		bitmapscans;	// passes over the whole bitmap
+    uint64_t		md5bytes;	// bytes hashed with MD5
+    uint64_t		cachehits;	// directory and file blocks found in the block cache
+    uint64_t		seekbytes;	// distance moved by seeks, from the end of one access to the next
+} SIFS_STATS;
+
+extern	int SIFS_get_stats(int op, SIFS_STATS *stats);
+
+//  RESET THE COUNTERS AND LATENCY HISTOGRAMS OF EVERY TYPE OF OPERATION TO ZERO
+extern	void SIFS_reset_stats(void);
+
+//  GET THE LATENCY PERCENTILES OF A TYPE OF OPERATION, OR OF ONE PHASE (SIFS_PHASE_*) OF IT
+typedef struct {
+    uint64_t		count;		// number of calls that entered the phase
+    uint64_t		p50_ns;
+    uint64_t		p99_ns;
+    uint64_t		p999_ns;
+    uint64_t		max_ns;
+} SIFS_LATENCY;
+
+extern	int SIFS_get_latency(int op, int phase, SIFS_LATENCY *latency);
+
+//  WRITE THE LATENCY PERCENTILES OF EVERY OPERATION AND PHASE AS JSON TO A HOST FILE.
+//  A NULL OR "-" FILENAME WRITES TO THE STANDARD ERROR OUTPUT. THE SAME REPORT IS
+//  WRITTEN AT EXIT WHEN THE ENVIRONMENT VARIABLE SIFS_LATENCY_REPORT NAMES A FILE
+extern	int SIFS_report_latency(const char *filename);
+
+//  SET THE SIZE OF THE BLOCK CACHE SHARED BY EVERY OPERATION, IN MEGABYTES (0 TURNS IT OFF).
+//  DIRECTORY AND FILE BLOCKS STAY CACHED FROM ONE CALL TO THE NEXT UNTIL THE VOLUME'S SIZE OR
+//  CHANGE TIME SHOWS THAT SOMEONE ELSE HAS CHANGED IT. THE CACHE IS OFF UNLESS THE ENVIRONMENT
+//  VARIABLE SIFS_CACHE_MB GIVES ITS SIZE. A CALL WHOSE CHANGES CANNOT ALL BE WRITTEN BACK TO THE
+//  VOLUME FAILS WITH SIFS_EIO
+extern	int SIFS_set_cache_size(size_t megabytes);
+
+//  CHOOSE HOW BATCHES OF BLOCK READS AND WRITES ARE ISSUED: ONE AT A TIME (SIFS_IO_SYNC), OR
+//  SUBMITTED TO THE KERNEL TOGETHER THROUGH io_uring (SIFS_IO_URING). BATCHES ARE MADE OF THE
+//  CHILD BLOCKS OF A DIRECTORY, THE DATA OF A FILE AND THE RUNS OF BLOCKS MOVED BY SIFS_defrag().
+//  SIFS_IO_URING IS USED WHEREVER THE KERNEL SUPPORTS IT, AND FAILS WITH SIFS_EIO WHERE IT DOES NOT
+#define	SIFS_IO_SYNC		0
+#define	SIFS_IO_URING		1
+
+extern	int SIFS_set_io_backend(int iobackend);
+
+//  CHOOSE WHERE NEW DIRECTORY, FILE AND DATA BLOCKS ARE PLACED: WHEREVER THE ALLOCATION STRATEGY
+//  FINDS ROOM (SIFS_PLACE_FIRST, THE DEFAULT), OR BY LOCALITY (SIFS_PLACE_NEAR). SIFS_PLACE_NEAR LEAVES
+//  ROOM AFTER EACH NEW DIRECTORY AND GATHERS ITS FILES THERE, WITH EACH FILE'S DATA STRAIGHT AFTER
+//  ITS FILE BLOCK, SO THAT LISTING A DIRECTORY AND READING ITS FILES STAYS WITHIN ONE REGION OF
+//  THE VOLUME
+#define	SIFS_PLACE_FIRST	0
+#define	SIFS_PLACE_NEAR		1
+
+extern	int SIFS_set_placement(int policy);
+
+//  CHOOSE WHICH RUN OF UNUSED BLOCKS NEW BLOCKS TAKE UNDER SIFS_PLACE_FIRST: THE FIRST RUN LONG
+//  ENOUGH (SIFS_ALLOC_FIRST_FIT, THE DEFAULT), THE SHORTEST (SIFS_ALLOC_BEST_FIT), THE FIRST AFTER
+//  THE LAST ONE CHOSEN (SIFS_ALLOC_NEXT_FIT), OR THE FIRST OF THE SMALLEST SIZE CLASS OF RUNS, IN
+//  POWERS OF TWO, THAT FITS (SIFS_ALLOC_SIZE_CLASS). ALL BUT FIRST FIT KEEP SMALL FILES OUT OF
+//  LONG RUNS THAT LARGE FILES NEED
+#define	SIFS_ALLOC_FIRST_FIT	0
+#define	SIFS_ALLOC_BEST_FIT	1
+#define	SIFS_ALLOC_NEXT_FIT	2
+#define	SIFS_ALLOC_SIZE_CLASS	3
+
+extern	int SIFS_set_allocator(int allocator);
+
+//  CHOOSE WHETHER BLOCKS FREED BY SIFS_rmfile, SIFS_rmdir, SIFS_defrag AND SIFS_fsck ARE PUNCHED
+//  OUT OF THE HOST FILE, SO THAT THE SPACE IT TAKES FOLLOWS THE BLOCKS IN USE. OFF BY DEFAULT.
+//  FAILS WITH SIFS_EIO IF THE HOST CANNOT PUNCH HOLES
+extern	int SIFS_set_hole_punching(int enabled);
+
 //  ON SUCCESS, EACH OF THE ABOVE FUNCTIONS RETURN 0.
 //  ON FAILURE, EACH FUNCTION RETURNS 1 AND SETS SIFS_errno
 extern	int		SIFS_errno;
@@ -57,6 +269,50 @@ extern	int		SIFS_errno;
 #define	SIFS_ENOMEM	11	// Memory allocation failed
 #define	SIFS_ENOTYET	12	// Not yet implemented
 #define	SIFS_ENOTEMPTY	13	// Directory is not empty
+#define	SIFS_EIO	14	// Host file input/output failed
+#define	SIFS_EBADCRC	15	// Volume metadata fails its checksum
+
+//  VOLUME FORMAT OPTIONS, COMBINED WITH | AND PASSED TO SIFS_mkvolume_format()
+#define	SIFS_FORMAT_CHARMAP	0x0	// one byte per block in the bitmap
+#define	SIFS_FORMAT_PACKED	0x1	// two bits per block in the bitmap on disk, still one byte in memory
+#define	SIFS_FORMAT_COMPRESS	0x2	// compress file contents where it saves blocks
+#define	SIFS_FORMAT_INLINE	0x4	// keep small files inside their file block
+#define	SIFS_FORMAT_CHUNKED	0x8	// share identical chunks of data between files
+#define	SIFS_FORMAT_SNAPSHOT	0x10	// allow copy-on-write snapshots of the volume
+
+#define	SIFS_OP_MKVOLUME	0
+#define	SIFS_OP_MKDIR		1
+#define	SIFS_OP_RMDIR		2
+#define	SIFS_OP_WRITEFILE	3
+#define	SIFS_OP_READFILE	4
+#define	SIFS_OP_RMFILE		5
+#define	SIFS_OP_DIRINFO		6
+#define	SIFS_OP_FILEINFO	7
+#define	SIFS_OP_DEFRAG		8
+#define	SIFS_OP_EXPORT		9
+#define	SIFS_OP_GROWVOLUME	10
+#define	SIFS_OP_SHRINKVOLUME	11
+#define	SIFS_OP_FSCK		12
+#define	SIFS_OP_SCRUB		13
+#define	SIFS_OP_DIRINFO_PLUS	14
+#define	SIFS_OP_WALK		15
+#define	SIFS_OP_RENAME		16
+#define	SIFS_OP_LINK		17
+#define	SIFS_OP_READFILES	18
+#define	SIFS_OP_SNAPSHOT	19
+#define	SIFS_OP_RMSNAPSHOT	20
+#define	SIFS_NOPS		21
+
+#define	SIFS_PHASE_TOTAL	0	// the whole call
+#define	SIFS_PHASE_OPEN		1	// opening and validating the volume
+#define	SIFS_PHASE_PATH		2	// resolving paths to blocks
+#define	SIFS_PHASE_HASH		3	// hashing file contents
+#define	SIFS_PHASE_ALLOC	4	// finding free blocks
+#define	SIFS_PHASE_FLUSH	5	// writing to the volume
+#define	SIFS_NPHASES		6
+
+//  THE NAME OF EACH TYPE OF OPERATION, INDEXED BY SIFS_OP_*
+extern	const char	*SIFS_opnames[SIFS_NOPS];
 
 
 //  THE FUNCTION SIFS_perror() PRODUCES A MESSAGE ON THE STANDARD ERROR OUTPUT,
@@ -64,3 +320,4 @@ extern	int		SIFS_errno;
 //  IF PROVIDED WITH A NON-NULL PREFIX, IT IS PRINTED BEFORE THE MESSAGE
 extern	void		SIFS_perror(const char *prefix);
 
+#endif
@@ -0,0 +1,117 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "sifs.h"
+#include "testutils.h"
+
+// Writes a file of nblocks data blocks whose contents are unique to c. Returns true if action was successful
+bool write_blocks(const char* pathname, char c, int nblocks)
+{
+	char* data = malloc(nblocks * 1024);
+	memset(data, c, nblocks * 1024);
+	bool success = SIFS_writefile("volume", pathname, data, nblocks * 1024) == 0 &&
+		filecmp("volume", pathname, data, nblocks * 1024);
+	free(data);
+	return success;
+}
+
+// Leaves a hole of 6 blocks and a hole of 3 blocks in an otherwise full volume, fills the small hole
+// with a file of 2 data blocks, then writes a file of 5 data blocks. Returns true if that last write succeeds
+bool fits_after_holes(int allocator)
+{
+	remove("volume");
+	SIFS_set_allocator(allocator);
+	SIFS_mkvolume("volume", 1024, 16);
+
+	// Every file takes its file block and data blocks
+	bool passed = write_blocks("six", 'a', 5) && write_blocks("s1", 'b', 1) && write_blocks("three", 'c', 2) &&
+		write_blocks("s2", 'd', 1) && write_blocks("s3", 'e', 1);
+	passed = passed && SIFS_rmfile("volume", "six") == 0 && SIFS_rmfile("volume", "three") == 0;
+	passed = passed && write_blocks("small", 'f', 2);
+
+	bool fits = passed && write_blocks("large", 'g', 5);
+	passed = passed && consistent("volume");
+	SIFS_set_allocator(SIFS_ALLOC_FIRST_FIT);
+	return passed && fits;
+}
+
+// Invalid argument
+void test_error_SIFS_EINVAL(void)
+{
+	printf("RUNNING TEST ERROR EINVAL\n");
+	int i = SIFS_set_allocator(4);
+	if (i == 1 && SIFS_errno == SIFS_EINVAL)
+	{
+		printf("TEST PASSED\n");
+	}
+	else
+		printf("TEST FAILED\n");
+}
+
+// Best fit and size classes keep a small file out of the run a large file needs. First fit splits it
+void test_fit(void)
+{
+	printf("RUNNING TEST FIT\n");
+	bool passed = !fits_after_holes(SIFS_ALLOC_FIRST_FIT) && fits_after_holes(SIFS_ALLOC_BEST_FIT) &&
+		fits_after_holes(SIFS_ALLOC_SIZE_CLASS);
+	if (passed)
+	{
+		printf("TEST PASSED\n");
+	}
+	else
+		printf("TEST FAILED\n");
+}
+
+// Every strategy keeps the volume consistent through churn, and finds room wherever there is some
+void test_churn(void)
+{
+	printf("RUNNING TEST CHURN\n");
+	int allocators[] = { SIFS_ALLOC_FIRST_FIT, SIFS_ALLOC_BEST_FIT, SIFS_ALLOC_NEXT_FIT, SIFS_ALLOC_SIZE_CLASS };
+	bool passed = true;
+	for (int a = 0; a < 4 && passed; a++)
+	{
+		remove("volume");
+		SIFS_set_allocator(allocators[a]);
+		SIFS_mkvolume("volume", 1024, 128);
+		SIFS_mkdir("volume", "dir");
+
+		char name[32];
+		for (int i = 0; i < 20 && passed; i++)
+		{
+			sprintf(name, "%sf%02i", i % 2 ? "dir/" : "", i);
+			passed = write_blocks(name, 'A' + i, 1 + i % 5);
+		}
+		for (int i = 0; i < 20 && passed; i += 3)
+		{
+			sprintf(name, "%sf%02i", i % 2 ? "dir/" : "", i);
+			passed = SIFS_rmfile("volume", name) == 0;
+		}
+		for (int i = 20; i < 30 && passed; i++)
+		{
+			sprintf(name, "%sf%02i", i % 2 ? "dir/" : "", i);
+			passed = write_blocks(name, 'A' + i, 1 + i % 3);
+		}
+		// Some blocks are still unused
+		SIFS_FSCK_REPORT report;
+		passed = passed && consistent("volume") && SIFS_fsck("volume", 1, 0, &report) == 0 &&
+			report.largestfree > 0 && report.used < 128;
+	}
+	SIFS_set_allocator(SIFS_ALLOC_FIRST_FIT);
+
+	if (passed)
+	{
+		printf("TEST PASSED\n");
+	}
+	else
+		printf("TEST FAILED\n");
+}
+
+int main(int argcount, char* argvalue[])
+{
+	test_error_SIFS_EINVAL();
+	test_fit();
+	test_churn();
+
+	remove("volume");
+	return 0;
+}
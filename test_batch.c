@@ -0,0 +1,104 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "sifs.h"
+#include "testutils.h"
+
+// Fills a directory with files and directories, lists it, then writes, fragments and defragments a large file
+bool workload(void)
+{
+	remove("volume");
+	SIFS_mkvolume("volume", 1024, 1024);
+	SIFS_mkdir("volume", "full");
+
+	char name[32];
+	bool passed = true;
+	for (int i = 0; i < 24 && passed; i++)
+	{
+		sprintf(name, "full/%02i", i);
+		passed = i % 3 == 0 ? SIFS_mkdir("volume", name) == 0 : SIFS_writefile("volume", name, name, 8) == 0;
+	}
+
+	char** entrynames;
+	uint32_t nentries;
+	time_t modtime;
+	bool listed = passed && SIFS_dirinfo("volume", "full", &entrynames, &nentries, &modtime) == 0;
+	passed = listed && nentries == 24;
+	for (uint32_t i = 0; listed && i < nentries; i++)
+	{
+		sprintf(name, "%02i", i);
+		passed = passed && strcmp(entrynames[i], name) == 0;
+		free(entrynames[i]);
+	}
+	if (listed)
+		free(entrynames);
+	passed = passed && SIFS_writefile("volume", "full/another", "x", 1) == 1 && SIFS_errno == SIFS_EMAXENTRY;
+	passed = passed && SIFS_mkdir("volume", "full/03/x") == 0 && SIFS_writefile("volume", "full/04/x", "x", 1) == 1 &&
+		SIFS_errno == SIFS_ENOTDIR;
+
+	// A file larger than one request, moved down the volume by defrag
+	size_t nbytes = 300 * 1024;
+	char* data = malloc(nbytes);
+	for (size_t i = 0; i < nbytes; i++)
+	{
+		data[i] = (char)(i * 7 + i / 1024);
+	}
+	passed = passed && SIFS_writefile("volume", "spacer", "spacer", 6) == 0;
+	passed = passed && SIFS_writefile("volume", "large", data, nbytes) == 0;
+	passed = passed && SIFS_rmfile("volume", "spacer") == 0 && SIFS_defrag("volume") == 0;
+	passed = passed && filecmp("volume", "large", data, nbytes) && filecmp("volume", "full/23", "full/23", 8);
+	passed = passed && consistent("volume");
+
+	free(data);
+	return passed;
+}
+
+// Invalid argument
+void test_error_SIFS_EINVAL(void)
+{
+	printf("RUNNING TEST ERROR EINVAL\n");
+	int i = SIFS_set_io_backend(7);
+	if (i == 1 && SIFS_errno == SIFS_EINVAL)
+	{
+		printf("TEST PASSED\n");
+	}
+	else
+		printf("TEST FAILED\n");
+}
+
+// Every backend gives the same results, with and without the block cache.
+// io_uring is only tried where the kernel supports it
+void test_backends(void)
+{
+	printf("RUNNING TEST BACKENDS\n");
+	bool passed = SIFS_set_io_backend(SIFS_IO_SYNC) == 0 && workload();
+	SIFS_set_cache_size(1);
+	passed = passed && workload();
+	SIFS_set_cache_size(0);
+
+	if (SIFS_set_io_backend(SIFS_IO_URING) == 0)
+	{
+		passed = passed && workload();
+		SIFS_set_cache_size(1);
+		passed = passed && workload();
+		SIFS_set_cache_size(0);
+	}
+	else
+		passed = passed && SIFS_errno == SIFS_EIO;
+
+	if (passed)
+	{
+		printf("TEST PASSED\n");
+	}
+	else
+		printf("TEST FAILED\n");
+}
+
+int main(int argcount, char* argvalue[])
+{
+	test_error_SIFS_EINVAL();
+	test_backends();
+
+	remove("volume");
+	return 0;
+}
@@ -0,0 +1,196 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <sys/resource.h>
+
+#include "sifs.h"
+#include "testutils.h"
+
+// Returns the number of entries of the root directory, or -1 on failure
+int nrootentries(const char* vol)
+{
+	char** entrynames;
+	uint32_t nentries;
+	time_t modtime;
+	if (SIFS_dirinfo(vol, "", &entrynames, &nentries, &modtime) != 0)
+		return -1;
+
+	for (uint32_t i = 0; i < nentries; i++)
+	{
+		free(entrynames[i]);
+	}
+	free(entrynames);
+	return nentries;
+}
+
+// A second lookup of the same path is served from the cache
+void test_hits(void)
+{
+	printf("RUNNING TEST HITS\n");
+	remove("volume");
+	SIFS_mkvolume("volume", 1024, 32);
+	SIFS_mkdir("volume", "a");
+	SIFS_mkdir("volume", "a/b");
+	SIFS_writefile("volume", "a/b/file", "data", 4);
+	SIFS_set_cache_size(1);
+
+	size_t length;
+	time_t modtime;
+	SIFS_STATS first, second;
+	SIFS_reset_stats();
+	bool passed = SIFS_fileinfo("volume", "a/b/file", &length, &modtime) == 0 && length == 4;
+	SIFS_get_stats(SIFS_OP_FILEINFO, &first);
+	passed = passed && SIFS_fileinfo("volume", "a/b/file", &length, &modtime) == 0 && length == 4;
+	SIFS_get_stats(SIFS_OP_FILEINFO, &second);
+
+	passed = passed && second.cachehits - first.cachehits == first.dirblocks + first.fileblocks;
+	passed = passed && second.nreads - first.nreads < first.nreads;
+
+	SIFS_set_cache_size(0);
+	if (passed)
+	{
+		printf("TEST PASSED\n");
+	}
+	else
+		printf("TEST FAILED\n");
+}
+
+// Writes n small files of distinct contents into dirname
+bool fill(const char* dirname, int n)
+{
+	char name[64];
+	bool passed = true;
+	for (int i = 0; i < n && passed; i++)
+	{
+		sprintf(name, "%s/%02i", dirname, i);
+		passed = SIFS_writefile("volume", name, name, strlen(name)) == 0;
+	}
+	return passed;
+}
+
+// Blocks held back by a cache too small for the volume all reach it, whatever the operations do around them
+void test_writeback(void)
+{
+	printf("RUNNING TEST WRITEBACK\n");
+	SIFS_set_cache_size(1);
+	remove("volume");
+	SIFS_mkvolume("volume", 1024, 4096);
+
+	char data[5000], name[32];
+	memset(data, 'w', sizeof(data));
+	bool passed = true;
+	for (int i = 0; i < 20 && passed; i++)
+	{
+		sprintf(name, "d%02i", i);
+		passed = SIFS_mkdir("volume", name) == 0;
+		sprintf(name, "d%02i/f", i);
+		data[0] = 'a' + i;
+		passed = passed && SIFS_writefile("volume", name, data, sizeof(data)) == 0;
+
+		// More file blocks than the cache holds
+		sprintf(name, "d%02i/s", i);
+		passed = passed && SIFS_mkdir("volume", name) == 0 && fill(name, 22);
+		sprintf(name, "d%02i/s/t", i);
+		passed = passed && SIFS_mkdir("volume", name) == 0 && fill(name, 24);
+		sprintf(name, "d%02i/s/u", i);
+		passed = passed && SIFS_mkdir("volume", name) == 0 && fill(name, 24);
+	}
+	passed = passed && SIFS_rename("volume", "d00/f", "d01/g") == 0 && SIFS_link("volume", "d02/f", "d03/g") == 0;
+	passed = passed && SIFS_rmfile("volume", "d04/f") == 0;
+	passed = passed && SIFS_defrag("volume") == 0 && SIFS_growvolume("volume", 5000) == 0;
+	passed = passed && SIFS_shrinkvolume("volume", 4000) == 0;
+
+	// Read everything back from the volume itself
+	SIFS_set_cache_size(0);
+	data[0] = 'a';
+	passed = passed && filecmp("volume", "d01/g", data, sizeof(data));
+	data[0] = 'c';
+	passed = passed && filecmp("volume", "d03/g", data, sizeof(data));
+	data[0] = 'a' + 19;
+	passed = passed && filecmp("volume", "d19/f", data, sizeof(data));
+	passed = passed && filecmp("volume", "d07/s/t/23", "d07/s/t/23", 10);
+	passed = passed && nrootentries("volume") == 20 && consistent("volume");
+
+	if (passed)
+	{
+		printf("TEST PASSED\n");
+	}
+	else
+		printf("TEST FAILED\n");
+}
+
+// Cached blocks are not used once the volume has been made again or replaced
+void test_replaced(void)
+{
+	printf("RUNNING TEST REPLACED\n");
+	SIFS_set_cache_size(1);
+	remove("volume");
+	SIFS_mkvolume("volume", 1024, 32);
+	SIFS_writefile("volume", "old", "old", 3);
+	bool passed = nrootentries("volume") == 1;
+
+	remove("volume");
+	SIFS_mkvolume("volume", 1024, 32);
+	passed = passed && nrootentries("volume") == 0;
+
+	remove("other");
+	SIFS_mkvolume("other", 1024, 32);
+	SIFS_mkdir("other", "x");
+	SIFS_mkdir("other", "y");
+	rename("other", "volume");
+	passed = passed && nrootentries("volume") == 2 && consistent("volume");
+
+	SIFS_set_cache_size(0);
+	if (passed)
+	{
+		printf("TEST PASSED\n");
+	}
+	else
+		printf("TEST FAILED\n");
+}
+
+// A call whose blocks cannot be written back fails, and what it left in the cache is not used afterwards.
+// Writes past the file size limit fail, and the root directory lies past 100 bytes
+void test_writeback_error(void)
+{
+	printf("RUNNING TEST WRITEBACK ERROR\n");
+	bool passed = true;
+	signal(SIGXFSZ, SIG_IGN);
+	for (size_t megabytes = 0; megabytes < 2; megabytes++)
+	{
+		SIFS_set_cache_size(megabytes);
+		remove("volume");
+		SIFS_mkvolume("volume", 1024, 32);
+
+		struct rlimit unlimited;
+		getrlimit(RLIMIT_FSIZE, &unlimited);
+		struct rlimit limited = { .rlim_cur = 100, .rlim_max = unlimited.rlim_max };
+		setrlimit(RLIMIT_FSIZE, &limited);
+		passed = passed && SIFS_mkdir("volume", "a") != 0 && SIFS_errno == SIFS_EIO;
+		setrlimit(RLIMIT_FSIZE, &unlimited);
+
+		passed = passed && nrootentries("volume") == 0;
+	}
+	signal(SIGXFSZ, SIG_DFL);
+	SIFS_set_cache_size(0);
+
+	if (passed)
+	{
+		printf("TEST PASSED\n");
+	}
+	else
+		printf("TEST FAILED\n");
+}
+
+int main(int argcount, char* argvalue[])
+{
+	test_hits();
+	test_writeback();
+	test_replaced();
+	test_writeback_error();
+
+	remove("volume");
+	return 0;
+}
@@ -0,0 +1,143 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "sifs.h"
+#include "testutils.h"
+
+#define BUILD_SIZE	(200 * 1024)
+
+// Fills data with contents that are unique to seed
+void fill_data(char* data, size_t nbytes, int seed)
+{
+	srand(seed);
+	for (size_t i = 0; i < nbytes; i++)
+	{
+		data[i] = rand();
+	}
+}
+
+// Returns true if the volume is consistent, storing the number of blocks in use
+bool check(const char* vol, uint64_t* used)
+{
+	SIFS_FSCK_REPORT report;
+	if (SIFS_fsck(vol, 1, 0, &report) != 0)
+		return false;
+	*used = report.used;
+	return report.unreachable == 0 && report.badentries == 0 && report.badindex == 0 && report.overlaps == 0 &&
+		report.badmd5 == 0 && report.badrefs == 0;
+}
+
+// Two builds that differ by a few bytes share most of their blocks
+void test_versions(void)
+{
+	printf("RUNNING TEST VERSIONS\n");
+	remove("volume");
+	SIFS_mkvolume_format("volume", 1024, 1024, SIFS_FORMAT_CHUNKED);
+
+	char* build1 = malloc(BUILD_SIZE);
+	char* build2 = malloc(BUILD_SIZE + 16);
+	fill_data(build1, BUILD_SIZE, 1);
+
+	// The second build has one byte changed and 16 bytes inserted further on
+	memcpy(build2, build1, 80000);
+	build2[40000] ^= 0xFF;
+	memset(build2 + 80000, 'x', 16);
+	memcpy(build2 + 80016, build1 + 80000, BUILD_SIZE - 80000);
+
+	uint64_t empty, one, two;
+	bool passed = check("volume", &empty);
+	passed = passed && SIFS_writefile("volume", "build1", build1, BUILD_SIZE) == 0 && check("volume", &one);
+	passed = passed && SIFS_writefile("volume", "build2", build2, BUILD_SIZE + 16) == 0 && check("volume", &two);
+	passed = passed && filecmp("volume", "build1", build1, BUILD_SIZE);
+	passed = passed && filecmp("volume", "build2", build2, BUILD_SIZE + 16);
+
+	// The second build stores its changed chunks only
+	passed = passed && one - empty >= BUILD_SIZE / 1024 && two - one < (one - empty) / 2;
+
+	size_t length;
+	time_t modtime;
+	passed = passed && SIFS_fileinfo("volume", "build2", &length, &modtime) == 0 && length == BUILD_SIZE + 16;
+
+	SIFS_SCRUB_REPORT scrub;
+	passed = passed && SIFS_scrub("volume", 0, 0, NULL, NULL, NULL, &scrub) == 0 && scrub.mismatches == 0;
+
+	// Shared chunks outlive the first build, and go with the second
+	passed = passed && SIFS_rmfile("volume", "build1") == 0 && filecmp("volume", "build2", build2, BUILD_SIZE + 16);
+	passed = passed && check("volume", &one) && SIFS_rmfile("volume", "build2") == 0;
+	passed = passed && check("volume", &two) && two == empty;
+
+	if (passed)
+	{
+		printf("TEST PASSED\n");
+	}
+	else
+		printf("TEST FAILED\n");
+	free(build1);
+	free(build2);
+}
+
+// Defrag keeps chunk lists pointing at the chunks it moves
+void test_defrag(void)
+{
+	printf("RUNNING TEST DEFRAG\n");
+	remove("volume");
+	SIFS_mkvolume_format("volume", 1024, 1024, SIFS_FORMAT_CHUNKED | SIFS_FORMAT_PACKED);
+
+	char* first = malloc(BUILD_SIZE);
+	char* build = malloc(BUILD_SIZE);
+	fill_data(first, BUILD_SIZE, 2);
+	fill_data(build, BUILD_SIZE, 3);
+
+	uint64_t used;
+	bool passed = SIFS_writefile("volume", "first", first, BUILD_SIZE) == 0;
+	passed = passed && SIFS_writefile("volume", "build", build, BUILD_SIZE) == 0;
+	passed = passed && SIFS_writefile("volume", "copy", build, BUILD_SIZE) == 0;
+	passed = passed && SIFS_rmfile("volume", "first") == 0;
+	passed = passed && SIFS_defrag("volume") == 0;
+	passed = passed && filecmp("volume", "build", build, BUILD_SIZE);
+	passed = passed && filecmp("volume", "copy", build, BUILD_SIZE);
+	passed = passed && check("volume", &used);
+
+	if (passed)
+	{
+		printf("TEST PASSED\n");
+	}
+	else
+		printf("TEST FAILED\n");
+	free(first);
+	free(build);
+}
+
+// Running out of space leaves the volume as it was
+void test_error_SIFS_ENOSPC(void)
+{
+	printf("RUNNING TEST ERROR ENOSPC\n");
+	remove("volume");
+	SIFS_mkvolume_format("volume", 1024, 64, SIFS_FORMAT_CHUNKED);
+
+	char* build = malloc(BUILD_SIZE);
+	fill_data(build, BUILD_SIZE, 4);
+
+	uint64_t before, after;
+	bool passed = check("volume", &before);
+	passed = passed && SIFS_writefile("volume", "build", build, BUILD_SIZE) == 1 && SIFS_errno == SIFS_ENOSPC;
+	passed = passed && check("volume", &after) && after == before;
+
+	if (passed)
+	{
+		printf("TEST PASSED\n");
+	}
+	else
+		printf("TEST FAILED\n");
+	free(build);
+}
+
+int main(int argcount, char* argvalue[])
+{
+	test_versions();
+	test_defrag();
+	test_error_SIFS_ENOSPC();
+
+	remove("volume");
+	return 0;
+}
@@ -0,0 +1,111 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "sifs.h"
+#include "testutils.h"
+
+// Fills data with compressible text
+void fill_text(char* data, size_t nbytes, int seed)
+{
+	const char* words[] = { "single ", "instance ", "file ", "system ", "volume ", "block " };
+	size_t n = 0;
+	srand(seed);
+	while (n < nbytes)
+	{
+		const char* w = words[rand() % 6];
+		for (/*blank*/; *w && n < nbytes; w++)
+		{
+			data[n++] = *w;
+		}
+	}
+}
+
+// Invalid format options
+void test_error_SIFS_EINVAL(void)
+{
+	printf("RUNNING TEST ERROR EINVAL\n");
+	remove("volume");
+	int i = SIFS_mkvolume_format("volume", 1024, 16, SIFS_FORMAT_COMPRESS | 0x100);
+	if (i == 1 && SIFS_errno == SIFS_EINVAL)
+	{
+		printf("TEST PASSED\n");
+	}
+	else
+		printf("TEST FAILED\n");
+}
+
+// Text that needs 20 blocks when stored raw fits in a volume of 12 blocks
+void test_compressed(void)
+{
+	printf("RUNNING TEST COMPRESSED\n");
+	remove("volume");
+	SIFS_mkvolume_format("volume", 1024, 12, SIFS_FORMAT_COMPRESS | SIFS_FORMAT_PACKED);
+
+	char text[20000];
+	fill_text(text, sizeof(text), 1);
+	bool passed = SIFS_writefile("volume", "text", text, sizeof(text)) == 0;
+	passed = passed && filecmp("volume", "text", text, sizeof(text));
+
+	// Identical contents are found by their uncompressed MD5
+	passed = passed && SIFS_writefile("volume", "copy", text, sizeof(text)) == 0;
+	passed = passed && filecmp("volume", "copy", text, sizeof(text));
+
+	size_t length;
+	time_t modtime;
+	passed = passed && SIFS_fileinfo("volume", "copy", &length, &modtime) == 0 && length == sizeof(text);
+
+	SIFS_FSCK_REPORT report;
+	passed = passed && SIFS_fsck("volume", 1, 0, &report) == 0 && report.badmd5 == 0 && report.overlaps == 0 &&
+		report.unreachable == 0;
+	SIFS_SCRUB_REPORT scrub;
+	passed = passed && SIFS_scrub("volume", 0, 0, NULL, NULL, NULL, &scrub) == 0 && scrub.files == 1 &&
+		scrub.mismatches == 0 && scrub.bytes < sizeof(text);
+
+	// Removing both names frees every stored block
+	passed = passed && SIFS_rmfile("volume", "text") == 0 && SIFS_rmfile("volume", "copy") == 0;
+	passed = passed && SIFS_fsck("volume", 1, 0, &report) == 0 && report.used == 1;
+
+	if (passed)
+	{
+		printf("TEST PASSED\n");
+	}
+	else
+		printf("TEST FAILED\n");
+}
+
+// Contents that do not compress are stored as they are
+void test_incompressible(void)
+{
+	printf("RUNNING TEST INCOMPRESSIBLE\n");
+	remove("volume");
+	SIFS_mkvolume_format("volume", 1024, 16, SIFS_FORMAT_COMPRESS);
+
+	char data[5000];
+	srand(2);
+	for (int i = 0; i < sizeof(data); i++)
+	{
+		data[i] = rand();
+	}
+	bool passed = SIFS_writefile("volume", "noise", data, sizeof(data)) == 0;
+	passed = passed && filecmp("volume", "noise", data, sizeof(data));
+
+	SIFS_FSCK_REPORT report;
+	passed = passed && SIFS_fsck("volume", 1, 0, &report) == 0 && report.used == 7 && report.badmd5 == 0;
+
+	if (passed)
+	{
+		printf("TEST PASSED\n");
+	}
+	else
+		printf("TEST FAILED\n");
+}
+
+int main(int argcount, char* argvalue[])
+{
+	test_error_SIFS_EINVAL();
+	test_compressed();
+	test_incompressible();
+
+	remove("volume");
+	return 0;
+}
@@ -0,0 +1,274 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "sifs.h"
+#include "testutils.h"
+
+// Overwrites one byte of the volume file at offset
+void poke(const char* vol, long offset, char c)
+{
+	FILE* f = fopen(vol, "r+");
+	fseek(f, offset, SEEK_SET);
+	fputc(c, f);
+	fclose(f);
+}
+
+// Reads nbytes of the volume file at offset into buf
+void peek(const char* vol, long offset, void* buf, size_t nbytes)
+{
+	FILE* f = fopen(vol, "r");
+	fseek(f, offset, SEEK_SET);
+	if (fread(buf, 1, nbytes, f) != nbytes)
+		memset(buf, 0, nbytes);
+	fclose(f);
+}
+
+// Returns the number of blocks failing their checksum, or -1 if the volume cannot be checked
+int64_t badcrc(const char* vol)
+{
+	SIFS_FSCK_REPORT report;
+	return SIFS_fsck(vol, 1, 0, &report) == 0 ? (int64_t)report.badcrc : -1;
+}
+
+// Changes an unused byte of the name of the nth directory block of the volume, counting the root as 0
+void poke_dir(const char* vol, int n)
+{
+	char bitmap[64];
+	peek(vol, 48, bitmap, 64);
+	long dirID = 0;
+	for (int seen = -1; seen < n; dirID++)
+	{
+		if (bitmap[dirID] == 'd' && ++seen == n)
+			break;
+	}
+	poke(vol, 48 + 64 + dirID * 1024 + 5, 'X');
+}
+
+// Makes a volume of 1024 byte blocks, 64 of them, holding a directory and a file in it
+void make_tree(void)
+{
+	remove("volume");
+	SIFS_mkvolume("volume", 1024, 64);
+	SIFS_mkdir("volume", "d");
+	SIFS_writefile("volume", "d/f", "hello", 5);
+}
+
+// A file that is not a volume is rejected
+void test_error_SIFS_ENOTVOL(void)
+{
+	printf("RUNNING TEST ERROR ENOTVOL\n");
+	remove("volume");
+	FILE* f = fopen("volume", "w");
+	for (int i = 0; i < 4096; i++)
+	{
+		fputc(i * 37 % 256, f);
+	}
+	fclose(f);
+
+	char** entrynames;
+	uint32_t nentries;
+	time_t modtime;
+	bool passed = SIFS_dirinfo("volume", "", &entrynames, &nentries, &modtime) != 0 && SIFS_errno == SIFS_ENOTVOL;
+
+	if (passed)
+	{
+		printf("TEST PASSED\n");
+	}
+	else
+		printf("TEST FAILED\n");
+}
+
+// New volumes start with the magic number, and their blocks all pass their checksum
+void test_header(void)
+{
+	printf("RUNNING TEST HEADER\n");
+	make_tree();
+
+	char magic[4];
+	peek("volume", 16, magic, 4);
+	bool passed = memcmp(magic, "SIFS", 4) == 0 && badcrc("volume") == 0;
+
+	void* contents;
+	size_t length;
+	passed = passed && SIFS_readfile("volume", "d/f", &contents, &length) == 0 && length == 5;
+	if (passed)
+		free(contents);
+
+	// Changing the header is caught by its checksum
+	poke("volume", 0, 0x01);
+	passed = passed && SIFS_readfile("volume", "d/f", &contents, &length) != 0 && SIFS_errno == SIFS_EBADCRC;
+
+	if (passed)
+	{
+		printf("TEST PASSED\n");
+	}
+	else
+		printf("TEST FAILED\n");
+}
+
+// A directory block that changes on disk is not trusted, whether or not it was cached before
+void test_corrupt_dir(void)
+{
+	printf("RUNNING TEST CORRUPT DIR\n");
+	make_tree();
+
+	char** entrynames;
+	uint32_t nentries;
+	time_t modtime;
+	bool passed = SIFS_dirinfo("volume", "", &entrynames, &nentries, &modtime) == 0 && nentries == 1;
+	if (passed)
+		free_entrynames(entrynames, nentries);
+
+	// Change an unused byte of the root directory's name. The bitmap of 64 blocks follows the 48 byte header
+	poke("volume", 48 + 64 + 5, 'X');
+	passed = passed && SIFS_dirinfo("volume", "", &entrynames, &nentries, &modtime) != 0 &&
+		SIFS_errno == SIFS_EBADCRC;
+
+	void* contents;
+	size_t length;
+	passed = passed && SIFS_readfile("volume", "d/f", &contents, &length) != 0 && SIFS_errno == SIFS_EBADCRC;
+	passed = passed && SIFS_mkdir("volume", "e") != 0 && SIFS_errno == SIFS_EBADCRC;
+	passed = passed && badcrc("volume") == 1;
+
+	if (passed)
+	{
+		printf("TEST PASSED\n");
+	}
+	else
+		printf("TEST FAILED\n");
+}
+
+// A file block that changes on disk is not trusted
+void test_corrupt_file(void)
+{
+	printf("RUNNING TEST CORRUPT FILE\n");
+	make_tree();
+
+	// Find the file block in the bitmap
+	char bitmap[64];
+	peek("volume", 48, bitmap, 64);
+	long fileID = (char*)memchr(bitmap, 'f', 64) - bitmap;
+	poke("volume", 48 + 64 + fileID * 1024 + 200, 'X');
+
+	size_t length;
+	time_t modtime;
+	bool passed = SIFS_fileinfo("volume", "d/f", &length, &modtime) != 0 && SIFS_errno == SIFS_EBADCRC;
+
+	void* contents;
+	passed = passed && SIFS_readfile("volume", "d/f", &contents, &length) != 0 && SIFS_errno == SIFS_EBADCRC;
+	passed = passed && badcrc("volume") == 1;
+
+	if (passed)
+	{
+		printf("TEST PASSED\n");
+	}
+	else
+		printf("TEST FAILED\n");
+}
+
+// Removing a file does not write a fresh checksum over a directory block that failed its own
+void test_corrupt_dir_rmfile(void)
+{
+	printf("RUNNING TEST CORRUPT DIR RMFILE\n");
+	make_tree();
+	SIFS_writefile("volume", "a", "top", 3);
+	poke_dir("volume", 0);
+
+	char** entrynames;
+	uint32_t nentries;
+	time_t modtime;
+	bool passed = SIFS_rmfile("volume", "a") != 0 && SIFS_errno == SIFS_EBADCRC;
+	passed = passed && SIFS_rmfile("volume", "d/f") != 0 && SIFS_errno == SIFS_EBADCRC;
+	passed = passed && SIFS_dirinfo("volume", "", &entrynames, &nentries, &modtime) != 0 &&
+		SIFS_errno == SIFS_EBADCRC;
+	passed = passed && badcrc("volume") == 1;
+
+	if (passed)
+	{
+		printf("TEST PASSED\n");
+	}
+	else
+		printf("TEST FAILED\n");
+}
+
+// Only the paths beneath a corrupted directory fail, with the block cache on or off
+void test_corrupt_sibling(void)
+{
+	printf("RUNNING TEST CORRUPT SIBLING\n");
+	bool passed = true;
+	for (size_t megabytes = 0; megabytes < 2; megabytes++)
+	{
+		SIFS_set_cache_size(megabytes);
+		remove("volume");
+		SIFS_mkvolume("volume", 1024, 64);
+		SIFS_mkdir("volume", "a");
+		SIFS_mkdir("volume", "b");
+		SIFS_writefile("volume", "a/x", "ax", 2);
+		SIFS_writefile("volume", "b/y", "by", 2);
+		poke_dir("volume", 1);
+
+		const char* paths[] = { "a/x", "b/y" };
+		SIFS_READRESULT results[2];
+		passed = passed && SIFS_readfiles("volume", paths, 2, results) == 0;
+		passed = passed && results[0].error == SIFS_EBADCRC && results[0].data == NULL;
+		passed = passed && results[1].error == SIFS_EOK && results[1].length == 2 &&
+			memcmp(results[1].data, "by", 2) == 0;
+		free(results[1].data);
+
+		void* contents;
+		size_t length;
+		passed = passed && SIFS_readfile("volume", "b/y", &contents, &length) == 0 && length == 2;
+		if (passed)
+			free(contents);
+	}
+	SIFS_set_cache_size(0);
+
+	if (passed)
+	{
+		printf("TEST PASSED\n");
+	}
+	else
+		printf("TEST FAILED\n");
+}
+
+// Visits every entry of a walk
+int visit(const char* path, const SIFS_DIRENTRY* entry, int when, void* arg)
+{
+	return SIFS_WALK_CONTINUE;
+}
+
+// Listing or walking a directory fails when one of its children failed its checksum
+void test_corrupt_child(void)
+{
+	printf("RUNNING TEST CORRUPT CHILD\n");
+	make_tree();
+	poke_dir("volume", 1);
+
+	SIFS_DIRENTRY* entries = NULL;
+	uint32_t nentries;
+	time_t modtime;
+	bool passed = SIFS_dirinfo_plus("volume", "", &entries, &nentries, &modtime) != 0 &&
+		SIFS_errno == SIFS_EBADCRC && entries == NULL;
+	passed = passed && SIFS_walk("volume", "", visit, NULL, SIFS_WALK_PRE) != 0 && SIFS_errno == SIFS_EBADCRC;
+
+	if (passed)
+	{
+		printf("TEST PASSED\n");
+	}
+	else
+		printf("TEST FAILED\n");
+}
+
+int main(int argcount, char* argvalue[])
+{
+	test_error_SIFS_ENOTVOL();
+	test_header();
+	test_corrupt_dir();
+	test_corrupt_file();
+	test_corrupt_dir_rmfile();
+	test_corrupt_sibling();
+	test_corrupt_child();
+
+	remove("volume");
+	return 0;
+}
@@ -0,0 +1,139 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "sifs.h"
+#include "testutils.h"
+
+// Invalid argument
+void test_error_SIFS_EINVAL(void)
+{
+	printf("RUNNING TEST ERROR EINVAL\n");
+	remove("volume");
+	SIFS_mkvolume("volume", 1024, 8);
+
+	uint32_t nentries;
+	time_t modtime;
+	int i = SIFS_dirinfo_plus("volume", "", NULL, &nentries, &modtime);
+	if (i == 1 && SIFS_errno == SIFS_EINVAL)
+	{
+		printf("TEST PASSED\n");
+	}
+	else
+		printf("TEST FAILED\n");
+}
+
+// No such directory
+void test_error_SIFS_ENOENT(void)
+{
+	printf("RUNNING TEST ERROR ENOENT\n");
+	remove("volume");
+	SIFS_mkvolume("volume", 1024, 8);
+
+	SIFS_DIRENTRY* entries;
+	uint32_t nentries;
+	time_t modtime;
+	int i = SIFS_dirinfo_plus("volume", "missing", &entries, &nentries, &modtime);
+	if (i == 1 && SIFS_errno == SIFS_ENOENT)
+	{
+		printf("TEST PASSED\n");
+	}
+	else
+		printf("TEST FAILED\n");
+}
+
+// Every entry matches what SIFS_dirinfo() and SIFS_fileinfo() report, from one call
+void test_entries(void)
+{
+	printf("RUNNING TEST ENTRIES\n");
+	remove("volume");
+	SIFS_mkvolume("volume", 1024, 64);
+	SIFS_mkdir("volume", "dir");
+	SIFS_mkdir("volume", "dir/sub");
+	SIFS_mkdir("volume", "dir/sub/leaf");
+
+	char name[32], data[64];
+	for (int i = 0; i < 22; i++)
+	{
+		sprintf(name, "dir/f%02i", i);
+		memset(data, 'a' + i % 4, sizeof(data)); // Only four different contents
+		SIFS_writefile("volume", name, data, 10 + i);
+	}
+	SIFS_mkdir("volume", "dir/last");
+
+	SIFS_reset_stats();
+	SIFS_DIRENTRY* entries;
+	uint32_t nentries;
+	time_t modtime;
+	bool passed = SIFS_dirinfo_plus("volume", "dir", &entries, &nentries, &modtime) == 0 && nentries == 24;
+
+	SIFS_STATS stats;
+	SIFS_get_stats(SIFS_OP_DIRINFO_PLUS, &stats);
+	passed = passed && stats.calls == 1 && stats.fileblocks == 22;
+
+	char** names;
+	uint32_t nnames;
+	time_t dirmodtime;
+	passed = passed && SIFS_dirinfo("volume", "dir", &names, &nnames, &dirmodtime) == 0 && nnames == nentries &&
+		dirmodtime == modtime;
+	for (uint32_t i = 0; passed && i < nentries; i++)
+	{
+		passed = strcmp(entries[i].name, names[i]) == 0;
+		if (entries[i].type == SIFS_ENTRY_FILE)
+		{
+			size_t length;
+			time_t filemodtime;
+			sprintf(name, "dir/%s", entries[i].name);
+			passed = passed && SIFS_fileinfo("volume", name, &length, &filemodtime) == 0 &&
+				length == entries[i].length && filemodtime == entries[i].modtime;
+		}
+		else
+			passed = passed && (strcmp(entries[i].name, "sub") == 0 ? entries[i].length == 1 :
+				strcmp(entries[i].name, "last") == 0 && entries[i].length == 0);
+	}
+	for (uint32_t i = 0; i < nnames; i++)
+	{
+		free(names[i]);
+	}
+	free(names);
+	free(entries);
+
+	if (passed)
+	{
+		printf("TEST PASSED\n");
+	}
+	else
+		printf("TEST FAILED\n");
+}
+
+// An empty directory still returns an allocation that can be freed
+void test_empty(void)
+{
+	printf("RUNNING TEST EMPTY\n");
+	remove("volume");
+	SIFS_mkvolume("volume", 1024, 8);
+
+	SIFS_DIRENTRY* entries;
+	uint32_t nentries;
+	time_t modtime;
+	bool passed = SIFS_dirinfo_plus("volume", "", &entries, &nentries, &modtime) == 0 && nentries == 0;
+	if (passed)
+		free(entries);
+
+	if (passed)
+	{
+		printf("TEST PASSED\n");
+	}
+	else
+		printf("TEST FAILED\n");
+}
+
+int main(int argcount, char* argvalue[])
+{
+	test_error_SIFS_EINVAL();
+	test_error_SIFS_ENOENT();
+	test_entries();
+	test_empty();
+
+	remove("volume");
+	return 0;
+}
@@ -0,0 +1,146 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "sifs.h"
+#include "testutils.h"
+
+// Returns true if the host file at path holds exactly nbytes of data
+bool hostfilecmp(const char* path, const char* data, size_t nbytes)
+{
+	FILE* f = fopen(path, "r");
+	if (!f)
+		return false;
+
+	char* buffer = malloc(nbytes + 1);
+	size_t nread = fread(buffer, 1, nbytes + 1, f);
+	bool same = nread == nbytes && memcmp(buffer, data, nbytes) == 0;
+
+	free(buffer);
+	fclose(f);
+	return same;
+}
+
+// Invalid argument
+void test_error_SIFS_EINVAL(void)
+{
+	printf("RUNNING TEST ERROR EINVAL\n");
+	int i = SIFS_export(NULL, "");
+	if (i == 1 && SIFS_errno == SIFS_EINVAL)
+	{
+		printf("TEST PASSED\n");
+	}
+	else
+		printf("TEST FAILED\n");
+}
+
+// No such volume
+void test_error_SIFS_ENOVOL(void)
+{
+	printf("RUNNING TEST ERROR ENOVOL\n");
+	int i = SIFS_export("NON_EXISTENT_VOLUME", "exported");
+	if (i == 1 && SIFS_errno == SIFS_ENOVOL)
+	{
+		printf("TEST PASSED\n");
+	}
+	else
+		printf("TEST FAILED\n");
+}
+
+// Not a volume
+void test_error_SIFS_ENOTVOL(void)
+{
+	printf("RUNNING TEST ERROR ENOTVOL\n");
+	int i = SIFS_export("test_export.c", "exported");
+	if (i == 1 && SIFS_errno == SIFS_ENOTVOL)
+	{
+		printf("TEST PASSED\n");
+	}
+	else
+		printf("TEST FAILED\n");
+}
+
+void test_export_tree(void)
+{
+	printf("RUNNING TEST EXPORT TREE\n");
+	remove("volume");
+	SIFS_mkvolume("volume", 1024, 64);
+
+	char* hello = "Hello";
+	char* world = "World, this is a longer file";
+	SIFS_mkdir("volume", "DIRA");
+	SIFS_mkdir("volume", "DIRA/DIRB");
+	SIFS_writefile("volume", "t.txt", hello, 6);
+	SIFS_writefile("volume", "DIRA/w.txt", world, 29);
+	SIFS_writefile("volume", "DIRA/DIRB/copy.txt", hello, 6);
+
+	if (SIFS_export("volume", "exported") != 0)
+	{
+		printf("TEST FAILED\n");
+		SIFS_perror(NULL);
+		return;
+	}
+
+	bool passed = hostfilecmp("exported/t.txt", hello, 6) &&
+		hostfilecmp("exported/DIRA/w.txt", world, 29) &&
+		hostfilecmp("exported/DIRA/DIRB/copy.txt", hello, 6);
+
+	// Duplicate contents should share a single host file
+	struct stat a, b;
+	passed = passed && stat("exported/t.txt", &a) == 0 && stat("exported/DIRA/DIRB/copy.txt", &b) == 0 &&
+		a.st_ino == b.st_ino;
+
+	remove("exported/DIRA/DIRB/copy.txt");
+	remove("exported/DIRA/w.txt");
+	remove("exported/t.txt");
+	rmdir("exported/DIRA/DIRB");
+	rmdir("exported/DIRA");
+	rmdir("exported");
+
+	if (passed)
+	{
+		printf("TEST PASSED\n");
+	}
+	else
+		printf("TEST FAILED\n");
+}
+
+// Names that would leave the host directory are refused, and nothing outside it is written or removed
+void test_hostile_names(void)
+{
+	printf("RUNNING TEST HOSTILE NAMES\n");
+	remove("volume");
+	SIFS_mkvolume("volume", 1024, 64);
+	SIFS_mkdir("volume", "..");
+	SIFS_writefile("volume", "../escaped", "volume", 6);
+
+	FILE* f = fopen("escaped", "w");
+	fputs("host", f);
+	fclose(f);
+
+	bool passed = SIFS_export("volume", "exported") == 1 && SIFS_errno == SIFS_ENOTVOL;
+	passed = passed && hostfilecmp("escaped", "host", 4);
+
+	remove("escaped");
+	rmdir("exported");
+
+	if (passed)
+	{
+		printf("TEST PASSED\n");
+	}
+	else
+		printf("TEST FAILED\n");
+}
+
+int main(int argcount, char* argvalue[])
+{
+	test_error_SIFS_EINVAL();
+	test_error_SIFS_ENOVOL();
+	test_error_SIFS_ENOTVOL();
+	test_export_tree();
+	test_hostile_names();
+
+	remove("volume");
+	return 0;
+}
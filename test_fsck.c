@@ -0,0 +1,177 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "sifs.h"
+#include "testutils.h"
+
+// Overwrites one byte of the volume file at offset
+void poke(const char* vol, long offset, char c)
+{
+	FILE* f = fopen(vol, "r+");
+	fseek(f, offset, SEEK_SET);
+	fputc(c, f);
+	fclose(f);
+}
+
+// Copies block id of a volume of 64 blocks of 1024 bytes into block, or block back into it
+void copy_block(const char* vol, long id, char* block, bool restore)
+{
+	FILE* f = fopen(vol, "r+");
+	fseek(f, 48 + 64 + id * 1024, SEEK_SET);
+	if (restore)
+		fwrite(block, 1, 1024, f);
+	else if (fread(block, 1, 1024, f) != 1024)
+		memset(block, 0, 1024);
+	fclose(f);
+}
+
+// Returns true if every problem counter of report is zero
+bool clean(const SIFS_FSCK_REPORT* report)
+{
+	return report->unreachable == 0 && report->badentries == 0 && report->badindex == 0 &&
+		report->overlaps == 0 && report->badmd5 == 0 && report->duplicates == 0;
+}
+
+// Makes a volume of 1024 byte blocks holding a few directories and files
+void make_tree(void)
+{
+	remove("volume");
+	SIFS_mkvolume("volume", 1024, 64);
+
+	char data[3000];
+	for (int i = 0; i < sizeof(data); i++)
+	{
+		data[i] = i % 249;
+	}
+	SIFS_mkdir("volume", "FILEA");
+	SIFS_mkdir("volume", "FILEA/FILEB");
+	SIFS_writefile("volume", "FILEA/data", data, sizeof(data));
+	SIFS_writefile("volume", "FILEA/FILEB/same", data, sizeof(data));
+}
+
+// No such volume
+void test_error_SIFS_ENOVOL(void)
+{
+	printf("RUNNING TEST ERROR ENOVOL\n");
+	SIFS_FSCK_REPORT report;
+	int i = SIFS_fsck("NON_EXISTENT_VOLUME", 1, 0, &report);
+	if (i == 1 && SIFS_errno == SIFS_ENOVOL)
+	{
+		printf("TEST PASSED\n");
+	}
+	else
+		printf("TEST FAILED\n");
+}
+
+void test_clean(void)
+{
+	printf("RUNNING TEST CLEAN\n");
+	make_tree();
+
+	SIFS_FSCK_REPORT report;
+	bool passed = SIFS_fsck("volume", 4, 0, &report) == 0;
+	// root, 2 directories, 1 shared file block, 3 data blocks
+	passed = passed && clean(&report) && report.used == 7 && report.files == 1;
+
+	if (passed)
+	{
+		printf("TEST PASSED\n");
+	}
+	else
+		printf("TEST FAILED\n");
+}
+
+void test_repair(void)
+{
+	printf("RUNNING TEST REPAIR\n");
+	make_tree();
+
+	// Mark two unused blocks as in use. The bitmap starts after the 48 byte header
+	poke("volume", 48 + 40, 'd');
+	poke("volume", 48 + 41, 'b');
+
+	SIFS_FSCK_REPORT report;
+	bool passed = SIFS_fsck("volume", 2, 0, &report) == 0 && report.unreachable == 2 && report.repaired == 0;
+	passed = passed && SIFS_fsck("volume", 2, SIFS_FSCK_REPAIR, &report) == 0 && report.repaired == 2;
+	passed = passed && SIFS_fsck("volume", 2, 0, &report) == 0 && clean(&report) && report.used == 7;
+
+	if (passed)
+	{
+		printf("TEST PASSED\n");
+	}
+	else
+		printf("TEST FAILED\n");
+}
+
+void test_corrupt(void)
+{
+	printf("RUNNING TEST CORRUPT\n");
+	make_tree();
+
+	// Change a byte of the file's data, which starts at block 4
+	poke("volume", 48 + 64 + 4 * 1024 + 100, 'X');
+	// Mark a data block as a directory
+	poke("volume", 48 + 5, 'd');
+
+	SIFS_FSCK_REPORT report;
+	bool passed = SIFS_fsck("volume", 0, 0, &report) == 0;
+	passed = passed && report.badmd5 == 1 && report.overlaps == 1 && report.unreachable == 0;
+
+	if (passed)
+	{
+		printf("TEST PASSED\n");
+	}
+	else
+		printf("TEST FAILED\n");
+}
+
+// A crash while a file moves between directories leaves its entry in both. The stale one is dropped
+void test_duplicate(void)
+{
+	printf("RUNNING TEST DUPLICATE\n");
+	make_tree();
+	SIFS_mkdir("volume", "other");
+
+	// Put FILEA back as it was before the file moved out of it, as if the rename stopped halfway
+	char block[1024];
+	copy_block("volume", 1, block, false);
+	bool passed = SIFS_rename("volume", "FILEA/data", "other/data") == 0;
+	copy_block("volume", 1, block, true);
+
+	SIFS_FSCK_REPORT report;
+	passed = passed && SIFS_fsck("volume", 1, 0, &report) == 0 && report.duplicates == 1 && report.dropped == 0;
+	passed = passed && SIFS_fsck("volume", 1, SIFS_FSCK_REPAIR, &report) == 0 && report.dropped == 1;
+	passed = passed && SIFS_fsck("volume", 1, 0, &report) == 0 && clean(&report);
+
+	char** entrynames;
+	uint32_t nentries;
+	time_t modtime;
+	passed = passed && SIFS_dirinfo("volume", "FILEA", &entrynames, &nentries, &modtime) == 0 && nentries == 1;
+	if (passed)
+		free_entrynames(entrynames, nentries);
+	passed = passed && SIFS_dirinfo("volume", "other", &entrynames, &nentries, &modtime) == 0 && nentries == 1;
+	if (passed)
+		free_entrynames(entrynames, nentries);
+
+	// The file keeps its name, and goes with it
+	passed = passed && SIFS_rmfile("volume", "other/data") == 0 && consistent("volume");
+
+	if (passed)
+	{
+		printf("TEST PASSED\n");
+	}
+	else
+		printf("TEST FAILED\n");
+}
+
+int main(int argcount, char* argvalue[])
+{
+	test_error_SIFS_ENOVOL();
+	test_clean();
+	test_repair();
+	test_corrupt();
+	test_duplicate();
+
+	remove("volume");
+	return 0;
+}
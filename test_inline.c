@@ -0,0 +1,109 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "sifs.h"
+#include "testutils.h"
+
+// Small files take a file block and no data blocks
+void test_inline(void)
+{
+	printf("RUNNING TEST INLINE\n");
+	remove("volume");
+	SIFS_mkvolume_format("volume", 1024, 8, SIFS_FORMAT_INLINE);
+
+	char small[100], other[100];
+	memset(small, 's', sizeof(small));
+	memset(other, 'o', sizeof(other));
+	bool passed = SIFS_writefile("volume", "small", small, sizeof(small)) == 0;
+	passed = passed && SIFS_writefile("volume", "other", other, sizeof(other)) == 0;
+	passed = passed && filecmp("volume", "small", small, sizeof(small));
+	passed = passed && filecmp("volume", "other", other, sizeof(other));
+
+	// Identical contents share the inline copy
+	passed = passed && SIFS_writefile("volume", "copy", small, sizeof(small)) == 0;
+	passed = passed && filecmp("volume", "copy", small, sizeof(small));
+
+	size_t length;
+	time_t modtime;
+	passed = passed && SIFS_fileinfo("volume", "copy", &length, &modtime) == 0 && length == sizeof(small);
+
+	SIFS_FSCK_REPORT report;
+	passed = passed && SIFS_fsck("volume", 1, 0, &report) == 0 && report.used == 3 && report.files == 2 &&
+		report.badmd5 == 0 && report.badindex == 0;
+	SIFS_SCRUB_REPORT scrub;
+	passed = passed && SIFS_scrub("volume", 0, 0, NULL, NULL, NULL, &scrub) == 0 && scrub.files == 2 &&
+		scrub.mismatches == 0;
+
+	if (passed)
+	{
+		printf("TEST PASSED\n");
+	}
+	else
+		printf("TEST FAILED\n");
+}
+
+// Files larger than the space left in a file block still use data blocks
+void test_large(void)
+{
+	printf("RUNNING TEST LARGE\n");
+	remove("volume");
+	SIFS_mkvolume_format("volume", 1024, 8, SIFS_FORMAT_INLINE);
+
+	char data[2000];
+	memset(data, 'l', sizeof(data));
+	bool passed = SIFS_writefile("volume", "large", data, sizeof(data)) == 0;
+	passed = passed && filecmp("volume", "large", data, sizeof(data));
+
+	SIFS_FSCK_REPORT report;
+	passed = passed && SIFS_fsck("volume", 1, 0, &report) == 0 && report.used == 4 && report.badmd5 == 0;
+
+	if (passed)
+	{
+		printf("TEST PASSED\n");
+	}
+	else
+		printf("TEST FAILED\n");
+}
+
+// Defrag carries inline contents along with their file block
+void test_defrag(void)
+{
+	printf("RUNNING TEST DEFRAG\n");
+	remove("volume");
+	SIFS_mkvolume_format("volume", 1024, 8, SIFS_FORMAT_INLINE);
+
+	char first[3000], small[50];
+	memset(first, 'f', sizeof(first));
+	memset(small, 'i', sizeof(small));
+	bool passed = SIFS_writefile("volume", "first", first, sizeof(first)) == 0;
+	passed = passed && SIFS_writefile("volume", "small", small, sizeof(small)) == 0;
+	passed = passed && SIFS_rmfile("volume", "first") == 0;
+	passed = passed && SIFS_defrag("volume") == 0;
+	passed = passed && filecmp("volume", "small", small, sizeof(small));
+
+	SIFS_FSCK_REPORT report;
+	passed = passed && SIFS_fsck("volume", 1, 0, &report) == 0 && report.used == 2 && report.badmd5 == 0 &&
+		report.badindex == 0;
+
+	// The hole left by the large file is now at the end of the volume
+	char fill[5 * 1024];
+	memset(fill, 'x', sizeof(fill));
+	passed = passed && SIFS_writefile("volume", "fill", fill, sizeof(fill) - 1024) == 0;
+
+	if (passed)
+	{
+		printf("TEST PASSED\n");
+	}
+	else
+		printf("TEST FAILED\n");
+}
+
+int main(int argcount, char* argvalue[])
+{
+	test_inline();
+	test_large();
+	test_defrag();
+
+	remove("volume");
+	return 0;
+}
@@ -0,0 +1,112 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "sifs.h"
+#include "testutils.h"
+
+// Source is a directory
+void test_error_SIFS_ENOTFILE(void)
+{
+	printf("RUNNING TEST ERROR ENOTFILE\n");
+	remove("volume");
+	SIFS_mkvolume("volume", 1024, 8);
+	SIFS_mkdir("volume", "dir");
+	int i = SIFS_link("volume", "dir", "copy");
+	if (i == 1 && SIFS_errno == SIFS_ENOTFILE)
+	{
+		printf("TEST PASSED\n");
+	}
+	else
+		printf("TEST FAILED\n");
+}
+
+// The new name is taken
+void test_error_SIFS_EEXIST(void)
+{
+	printf("RUNNING TEST ERROR EEXIST\n");
+	remove("volume");
+	SIFS_mkvolume("volume", 1024, 8);
+	SIFS_mkdir("volume", "dir");
+	SIFS_writefile("volume", "file", "data", 4);
+	int i = SIFS_link("volume", "file", "dir");
+	int j = SIFS_link("volume", "file", "file");
+	if (i == 1 && j == 1 && SIFS_errno == SIFS_EEXIST)
+	{
+		printf("TEST PASSED\n");
+	}
+	else
+		printf("TEST FAILED\n");
+}
+
+// The file block has no room for another name
+void test_error_SIFS_EMAXENTRY(void)
+{
+	printf("RUNNING TEST ERROR EMAXENTRY\n");
+	remove("volume");
+	SIFS_mkvolume("volume", 1024, 8);
+	SIFS_mkdir("volume", "a");
+	SIFS_mkdir("volume", "b");
+	SIFS_writefile("volume", "a/f00", "data", 4);
+
+	char name[32];
+	bool passed = true;
+	for (int i = 1; i < 24 && passed; i++)
+	{
+		sprintf(name, "%c/f%02i", i < 20 ? 'a' : 'b', i);
+		passed = SIFS_link("volume", "a/f00", name) == 0;
+	}
+	passed = passed && SIFS_link("volume", "a/f00", "b/one_too_many") == 1 && SIFS_errno == SIFS_EMAXENTRY;
+
+	if (passed)
+	{
+		printf("TEST PASSED\n");
+	}
+	else
+		printf("TEST FAILED\n");
+}
+
+// A copy adds a name without hashing, and behaves like a second write of the same contents
+void test_link(void)
+{
+	printf("RUNNING TEST LINK\n");
+	remove("volume");
+	SIFS_mkvolume("volume", 1024, 16);
+	SIFS_mkdir("volume", "dir");
+
+	char data[3000];
+	memset(data, 'l', sizeof(data));
+	SIFS_writefile("volume", "file", data, sizeof(data));
+
+	SIFS_reset_stats();
+	bool passed = SIFS_link("volume", "file", "dir/copy") == 0;
+	SIFS_STATS stats;
+	SIFS_get_stats(SIFS_OP_LINK, &stats);
+	passed = passed && stats.md5bytes == 0 && stats.bytesread < 3 * 1024;
+
+	passed = passed && filecmp("volume", "dir/copy", data, sizeof(data));
+	SIFS_FSCK_REPORT report;
+	passed = passed && SIFS_fsck("volume", 1, 0, &report) == 0 && report.used == 6 && report.badindex == 0;
+
+	// Either name can be removed without losing the contents
+	passed = passed && SIFS_rmfile("volume", "file") == 0 && filecmp("volume", "dir/copy", data, sizeof(data));
+	passed = passed && SIFS_rmfile("volume", "dir/copy") == 0;
+	passed = passed && SIFS_fsck("volume", 1, 0, &report) == 0 && report.used == 2;
+
+	if (passed)
+	{
+		printf("TEST PASSED\n");
+	}
+	else
+		printf("TEST FAILED\n");
+}
+
+int main(int argcount, char* argvalue[])
+{
+	test_error_SIFS_ENOTFILE();
+	test_error_SIFS_EEXIST();
+	test_error_SIFS_EMAXENTRY();
+	test_link();
+
+	remove("volume");
+	return 0;
+}
@@ -0,0 +1,102 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+
+#include "sifs.h"
+#include "testutils.h"
+
+// Returns true if the volume file is exactly nbytes long
+bool volume_size(const char* vol, long nbytes)
+{
+	struct stat st;
+	return stat(vol, &st) == 0 && st.st_size == nbytes;
+}
+
+// Invalid argument
+void test_error_SIFS_EINVAL(void)
+{
+	printf("RUNNING TEST ERROR EINVAL\n");
+	remove("volume");
+	int i = SIFS_mkvolume_format("volume", 1024, 16, 0x80);
+	if (i == 1 && SIFS_errno == SIFS_EINVAL)
+	{
+		printf("TEST PASSED\n");
+	}
+	else
+		printf("TEST FAILED\n");
+}
+
+// The bitmap takes two bits per block
+void test_size(void)
+{
+	printf("RUNNING TEST SIZE\n");
+	remove("volume");
+	bool passed = SIFS_mkvolume_format("volume", 1024, 1001, SIFS_FORMAT_PACKED) == 0;
+	passed = passed && volume_size("volume", 48 + 251 + 1001 * 1024);
+
+	if (passed)
+	{
+		printf("TEST PASSED\n");
+	}
+	else
+		printf("TEST FAILED\n");
+}
+
+// Every operation works the same on a packed volume
+void test_operations(void)
+{
+	printf("RUNNING TEST OPERATIONS\n");
+	remove("volume");
+	SIFS_mkvolume_format("volume", 1024, 13, SIFS_FORMAT_PACKED);
+
+	char data[2500];
+	for (int i = 0; i < sizeof(data); i++)
+	{
+		data[i] = i % 253;
+	}
+	bool passed = SIFS_mkdir("volume", "FILEA") == 0 && SIFS_mkdir("volume", "FILEB") == 0;
+	passed = passed && SIFS_writefile("volume", "FILEA/data", data, sizeof(data)) == 0;
+	passed = passed && SIFS_writefile("volume", "FILEB/same", data, sizeof(data)) == 0;
+	data[0]++;
+	passed = passed && SIFS_writefile("volume", "other", data, sizeof(data)) == 0;
+	passed = passed && SIFS_rmdir("volume", "FILEA") == 1 && SIFS_errno == SIFS_ENOTEMPTY;
+	passed = passed && SIFS_rmfile("volume", "FILEA/data") == 0 && SIFS_rmdir("volume", "FILEA") == 0;
+
+	// 1 root + 1 dir + 2 files + 6 data blocks are used, leaving 3
+	passed = passed && SIFS_mkdir("volume", "C") == 0 && SIFS_mkdir("volume", "D") == 0 && SIFS_mkdir("volume", "E") == 0;
+	passed = passed && SIFS_mkdir("volume", "F") == 1 && SIFS_errno == SIFS_ENOSPC;
+
+	const char* ref[] = {
+		"FILEB", "other", "C", "D", "E"
+	};
+	passed = passed && dircmp("volume", "", ref, 5);
+
+	void* contents;
+	size_t length;
+	passed = passed && SIFS_readfile("volume", "other", &contents, &length) == 0;
+	passed = passed && length == sizeof(data) && memcmp(contents, data, sizeof(data)) == 0;
+	if (passed)
+		free(contents);
+
+	// Resizing keeps the bitmap packed. Block 0 stays after the 4 bytes it started with, so the bitmap moves past the last block
+	passed = passed && SIFS_growvolume("volume", 100) == 0 && volume_size("volume", 48 + 4 + 100 * 1024 + 25);
+	passed = passed && SIFS_shrinkvolume("volume", 20) == 0 && volume_size("volume", 48 + 4 + 20 * 1024 + 5);
+	passed = passed && dircmp("volume", "", ref, 5);
+
+	if (passed)
+	{
+		printf("TEST PASSED\n");
+	}
+	else
+		printf("TEST FAILED\n");
+}
+
+int main(int argcount, char* argvalue[])
+{
+	test_error_SIFS_EINVAL();
+	test_size();
+	test_operations();
+
+	remove("volume");
+	return 0;
+}
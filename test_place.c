@@ -0,0 +1,120 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "sifs.h"
+#include "testutils.h"
+
+static int visit(const char* path, const SIFS_DIRENTRY* entry, int when, void* arg)
+{
+	return SIFS_WALK_CONTINUE;
+}
+
+// Writes a file to each of four directories in turn, checks every file, and returns how far a walk of the
+// tree seeks. Returns 0 if anything went wrong
+uint64_t walk_seekbytes(int policy)
+{
+	remove("volume");
+	SIFS_set_placement(policy);
+	SIFS_mkvolume("volume", 1024, 2048);
+
+	char name[32], data[3000];
+	bool passed = true;
+	for (int d = 0; d < 4 && passed; d++)
+	{
+		sprintf(name, "d%i", d);
+		passed = SIFS_mkdir("volume", name) == 0;
+	}
+	for (int i = 0; i < 32 && passed; i++)
+	{
+		memset(data, 'a' + i % 26, sizeof(data));
+		sprintf(data, "%i", i);
+		sprintf(name, "d%i/f%02i", i % 4, i / 4);
+		passed = SIFS_writefile("volume", name, data, sizeof(data)) == 0;
+	}
+	for (int i = 0; i < 32 && passed; i++)
+	{
+		memset(data, 'a' + i % 26, sizeof(data));
+		sprintf(data, "%i", i);
+		sprintf(name, "d%i/f%02i", i % 4, i / 4);
+		passed = filecmp("volume", name, data, sizeof(data));
+	}
+	passed = passed && consistent("volume");
+
+	SIFS_reset_stats();
+	passed = passed && SIFS_walk("volume", "", visit, NULL, SIFS_WALK_PRE) == 0;
+	SIFS_STATS stats;
+	SIFS_get_stats(SIFS_OP_WALK, &stats);
+
+	SIFS_set_placement(SIFS_PLACE_FIRST);
+	return passed ? stats.seekbytes : 0;
+}
+
+// Invalid argument
+void test_error_SIFS_EINVAL(void)
+{
+	printf("RUNNING TEST ERROR EINVAL\n");
+	int i = SIFS_set_placement(7);
+	if (i == 1 && SIFS_errno == SIFS_EINVAL)
+	{
+		printf("TEST PASSED\n");
+	}
+	else
+		printf("TEST FAILED\n");
+}
+
+// Files kept near their directory are walked with less seeking than files placed first-fit
+void test_near(void)
+{
+	printf("RUNNING TEST NEAR\n");
+	// Cached blocks are not seeked to
+	SIFS_set_cache_size(0);
+	uint64_t first = walk_seekbytes(SIFS_PLACE_FIRST);
+	uint64_t near = walk_seekbytes(SIFS_PLACE_NEAR);
+	if (first > 0 && near > 0 && near < first)
+	{
+		printf("TEST PASSED\n");
+	}
+	else
+		printf("TEST FAILED\n");
+}
+
+// A volume too small to leave room around its directories still fills up completely
+void test_full(void)
+{
+	printf("RUNNING TEST FULL\n");
+	remove("volume");
+	SIFS_set_placement(SIFS_PLACE_NEAR);
+	SIFS_mkvolume("volume", 1024, 16);
+
+	char name[32], data[1000];
+	bool passed = SIFS_mkdir("volume", "dir") == 0;
+	int nwritten = 0;
+	for (int i = 0; i < 16; i++)
+	{
+		memset(data, 'a' + i, sizeof(data));
+		sprintf(name, "%sf%02i", i % 2 ? "dir/" : "", i);
+		if (SIFS_writefile("volume", name, data, sizeof(data)) != 0)
+			break;
+		nwritten++;
+	}
+	// The root directory, dir, and a file block and data block for each file
+	passed = passed && SIFS_errno == SIFS_ENOSPC && nwritten == 7 && consistent("volume");
+	SIFS_set_placement(SIFS_PLACE_FIRST);
+
+	if (passed)
+	{
+		printf("TEST PASSED\n");
+	}
+	else
+		printf("TEST FAILED\n");
+}
+
+int main(int argcount, char* argvalue[])
+{
+	test_error_SIFS_EINVAL();
+	test_near();
+	test_full();
+
+	remove("volume");
+	return 0;
+}
@@ -0,0 +1,158 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+
+#include "sifs.h"
+#include "testutils.h"
+
+// Returns the number of bytes the host has allocated to the volume
+long long host_usage(void)
+{
+	struct stat st;
+	return stat("volume", &st) == 0 ? (long long)st.st_blocks * 512 : -1;
+}
+
+// Returns nbytes of data that differ from one seed to the next
+char* make_data(size_t nbytes, int seed)
+{
+	char* data = malloc(nbytes);
+	for (size_t i = 0; i < nbytes; i++)
+	{
+		data[i] = (char)(i * seed + i / 1024);
+	}
+	return data;
+}
+
+// Turning hole punching off always succeeds
+void test_disable(void)
+{
+	printf("RUNNING TEST DISABLE\n");
+	if (SIFS_set_hole_punching(0) == 0)
+	{
+		printf("TEST PASSED\n");
+	}
+	else
+		printf("TEST FAILED\n");
+}
+
+// Removing a large file gives its blocks back to the host, and the file beside it survives
+void test_rmfile(void)
+{
+	printf("RUNNING TEST RMFILE\n");
+	if (SIFS_set_hole_punching(1) != 0)
+	{
+		// Nothing to check where the host cannot punch holes
+		printf(SIFS_errno == SIFS_EIO ? "TEST PASSED\n" : "TEST FAILED\n");
+		return;
+	}
+
+	remove("volume");
+	SIFS_mkvolume("volume", 1024, 1024);
+	size_t nbytes = 512 * 1024;
+	char* large = make_data(nbytes, 7);
+	char* small = make_data(3000, 11);
+	bool passed = SIFS_writefile("volume", "large", large, nbytes) == 0 &&
+		SIFS_writefile("volume", "small", small, 3000) == 0;
+
+	long long full = host_usage();
+	passed = passed && SIFS_rmfile("volume", "large") == 0;
+	long long emptied = host_usage();
+	passed = passed && full > 0 && emptied >= 0 && full - emptied >= (long long)nbytes / 2;
+	passed = passed && filecmp("volume", "small", small, 3000) && consistent("volume");
+
+	// The punched blocks can be used again
+	passed = passed && SIFS_writefile("volume", "again", large, nbytes) == 0 &&
+		filecmp("volume", "again", large, nbytes) && consistent("volume");
+
+	SIFS_set_hole_punching(0);
+	free(large);
+	free(small);
+	if (passed)
+	{
+		printf("TEST PASSED\n");
+	}
+	else
+		printf("TEST FAILED\n");
+}
+
+// Removing directories, with and without hole punching, leaves blocks that can be used again
+void test_rmdir(void)
+{
+	printf("RUNNING TEST RMDIR\n");
+	remove("volume");
+	SIFS_mkvolume("volume", 1024, 64);
+
+	bool passed = true;
+	for (int punch = 0; punch < 2 && passed; punch++)
+	{
+		if (punch && SIFS_set_hole_punching(1) != 0)
+			break;
+		passed = SIFS_mkdir("volume", "a") == 0 && SIFS_mkdir("volume", "a/b") == 0 &&
+			SIFS_rmdir("volume", "a/b") == 0 && SIFS_rmdir("volume", "a") == 0;
+
+		char** entrynames;
+		uint32_t nentries;
+		time_t modtime;
+		passed = passed && SIFS_dirinfo("volume", "", &entrynames, &nentries, &modtime) == 0 && nentries == 0;
+		if (passed)
+			free(entrynames);
+
+		passed = passed && SIFS_mkdir("volume", "a") == 0 && SIFS_writefile("volume", "a/x", "x", 1) == 0 &&
+			filecmp("volume", "a/x", "x", 1) && SIFS_rmfile("volume", "a/x") == 0 &&
+			SIFS_rmdir("volume", "a") == 0 && consistent("volume");
+	}
+
+	SIFS_set_hole_punching(0);
+	if (passed)
+	{
+		printf("TEST PASSED\n");
+	}
+	else
+		printf("TEST FAILED\n");
+}
+
+// Defragmenting punches out the blocks left behind at the end of the volume
+void test_defrag(void)
+{
+	printf("RUNNING TEST DEFRAG\n");
+	if (SIFS_set_hole_punching(1) != 0)
+	{
+		printf(SIFS_errno == SIFS_EIO ? "TEST PASSED\n" : "TEST FAILED\n");
+		return;
+	}
+
+	remove("volume");
+	SIFS_mkvolume("volume", 1024, 1024);
+	size_t nbytes = 256 * 1024;
+	char* first = make_data(nbytes, 3);
+	char* second = make_data(nbytes, 5);
+	bool passed = SIFS_writefile("volume", "first", first, nbytes) == 0 &&
+		SIFS_writefile("volume", "second", second, nbytes) == 0 && SIFS_rmfile("volume", "first") == 0;
+
+	long long before = host_usage();
+	passed = passed && SIFS_defrag("volume") == 0;
+	long long after = host_usage();
+	passed = passed && before > 0 && after >= 0 && after <= before;
+	passed = passed && filecmp("volume", "second", second, nbytes) && consistent("volume");
+
+	SIFS_set_hole_punching(0);
+	free(first);
+	free(second);
+	if (passed)
+	{
+		printf("TEST PASSED\n");
+	}
+	else
+		printf("TEST FAILED\n");
+}
+
+int main(int argcount, char* argvalue[])
+{
+	test_disable();
+	test_rmfile();
+	test_rmdir();
+	test_defrag();
+
+	remove("volume");
+	return 0;
+}
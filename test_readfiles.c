@@ -0,0 +1,114 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "sifs.h"
+#include "testutils.h"
+
+// Returns true if result holds exactly nbytes of data
+bool resultcmp(const SIFS_READRESULT* result, const char* data, size_t nbytes)
+{
+	return result->error == SIFS_EOK && result->length == nbytes && memcmp(result->data, data, nbytes) == 0;
+}
+
+// Invalid argument
+void test_error_SIFS_EINVAL(void)
+{
+	printf("RUNNING TEST ERROR EINVAL\n");
+	remove("volume");
+	SIFS_mkvolume("volume", 1024, 8);
+	SIFS_READRESULT results[2];
+	int i = SIFS_readfiles("volume", NULL, 2, results);
+	if (i == 1 && SIFS_errno == SIFS_EINVAL)
+	{
+		printf("TEST PASSED\n");
+	}
+	else
+		printf("TEST FAILED\n");
+}
+
+// No such volume
+void test_error_SIFS_ENOVOL(void)
+{
+	printf("RUNNING TEST ERROR ENOVOL\n");
+	remove("volume");
+	const char* paths[] = { "file" };
+	SIFS_READRESULT results[1];
+	int i = SIFS_readfiles("volume", paths, 1, results);
+	if (i == 1 && SIFS_errno == SIFS_ENOVOL)
+	{
+		printf("TEST PASSED\n");
+	}
+	else
+		printf("TEST FAILED\n");
+}
+
+// Every path gets its own contents or its own error, and shared contents are read once
+void test_readfiles(void)
+{
+	printf("RUNNING TEST READFILES\n");
+	remove("volume");
+	SIFS_mkvolume("volume", 1024, 64);
+	SIFS_mkdir("volume", "a");
+	SIFS_mkdir("volume", "a/b");
+
+	char same[3000], other[2000];
+	memset(same, 's', sizeof(same));
+	memset(other, 'o', sizeof(other));
+	SIFS_writefile("volume", "a/b/other", other, sizeof(other));
+	SIFS_writefile("volume", "a/one", same, sizeof(same));
+	SIFS_writefile("volume", "top", "top", 3);
+	SIFS_writefile("volume", "a/b/two", same, sizeof(same));
+
+	const char* paths[] = { "a/one", "a/b/other", "top", "a/b/two", "a/one", "a/missing",
+		"a/b", "top/x", "none/x", "" };
+	size_t npaths = sizeof(paths) / sizeof(paths[0]);
+	SIFS_READRESULT results[npaths];
+
+	SIFS_reset_stats();
+	bool passed = SIFS_readfiles("volume", paths, npaths, results) == 0;
+	passed = passed && resultcmp(&results[0], same, sizeof(same)) && resultcmp(&results[1], other, sizeof(other)) &&
+		resultcmp(&results[2], "top", 3) && resultcmp(&results[3], same, sizeof(same)) &&
+		resultcmp(&results[4], same, sizeof(same));
+	passed = passed && results[5].error == SIFS_ENOENT && results[6].error == SIFS_ENOTFILE &&
+		results[7].error == SIFS_ENOTDIR && results[8].error == SIFS_ENOENT && results[9].error == SIFS_EINVAL;
+	for (size_t i = 5; i < npaths; i++)
+	{
+		passed = passed && results[i].data == NULL && results[i].length == 0;
+	}
+	// Each path owns its copy
+	passed = passed && results[0].data != results[3].data && results[0].data != results[4].data;
+	for (size_t i = 0; i < npaths; i++)
+	{
+		free(results[i].data);
+	}
+
+	// Reading the same files one at a time reads more of the volume
+	SIFS_STATS many, one;
+	SIFS_get_stats(SIFS_OP_READFILES, &many);
+	for (size_t i = 0; i < 5; i++)
+	{
+		void* data;
+		size_t length;
+		if (SIFS_readfile("volume", paths[i], &data, &length) == 0)
+			free(data);
+	}
+	SIFS_get_stats(SIFS_OP_READFILE, &one);
+	passed = passed && many.calls == 1 && many.bytesread + 2 * sizeof(same) <= one.bytesread;
+
+	if (passed)
+	{
+		printf("TEST PASSED\n");
+	}
+	else
+		printf("TEST FAILED\n");
+}
+
+int main(int argcount, char* argvalue[])
+{
+	test_error_SIFS_EINVAL();
+	test_error_SIFS_ENOVOL();
+	test_readfiles();
+
+	remove("volume");
+	return 0;
+}
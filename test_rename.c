@@ -0,0 +1,136 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "sifs.h"
+#include "testutils.h"
+
+// Builds a small tree: a/ a/x a/b/ a/b/y c/
+void make_tree(void)
+{
+	remove("volume");
+	SIFS_mkvolume("volume", 1024, 32);
+	SIFS_mkdir("volume", "a");
+	SIFS_writefile("volume", "a/x", "xxxx", 4);
+	SIFS_mkdir("volume", "a/b");
+	SIFS_writefile("volume", "a/b/y", "yyyy", 4);
+	SIFS_mkdir("volume", "c");
+}
+
+// Invalid argument, and moving a directory inside itself
+void test_error_SIFS_EINVAL(void)
+{
+	printf("RUNNING TEST ERROR EINVAL\n");
+	make_tree();
+	int i = SIFS_rename("volume", "a/x", "");
+	int j = SIFS_rename("volume", "a", "a/b/a");
+	bool inside = j == 1 && SIFS_errno == SIFS_EINVAL;
+	j = SIFS_rename("volume", "/a", "a/moved");
+	inside = inside && j == 1 && SIFS_errno == SIFS_EINVAL;
+	int k = SIFS_rename("volume", "a/x", "a/this_name_is_much_too_long_for_sifs");
+	// A name that only starts with the same letters is not inside
+	bool beside = SIFS_rename("volume", "a", "ab") == 0 && SIFS_rename("volume", "ab", "a") == 0;
+	if (i == 1 && inside && k == 1 && SIFS_errno == SIFS_EINVAL && beside && consistent("volume"))
+	{
+		printf("TEST PASSED\n");
+	}
+	else
+		printf("TEST FAILED\n");
+}
+
+// No such file or directory
+void test_error_SIFS_ENOENT(void)
+{
+	printf("RUNNING TEST ERROR ENOENT\n");
+	make_tree();
+	int i = SIFS_rename("volume", "a/missing", "c/x");
+	int j = SIFS_rename("volume", "a/x", "missing/x");
+	if (i == 1 && j == 1 && SIFS_errno == SIFS_ENOENT)
+	{
+		printf("TEST PASSED\n");
+	}
+	else
+		printf("TEST FAILED\n");
+}
+
+// The new name is taken
+void test_error_SIFS_EEXIST(void)
+{
+	printf("RUNNING TEST ERROR EEXIST\n");
+	make_tree();
+	int i = SIFS_rename("volume", "a/x", "a/b");
+	if (i == 1 && SIFS_errno == SIFS_EEXIST && filecmp("volume", "a/x", "xxxx", 4))
+	{
+		printf("TEST PASSED\n");
+	}
+	else
+		printf("TEST FAILED\n");
+}
+
+// Files are renamed and moved without their data being read or written
+void test_files(void)
+{
+	printf("RUNNING TEST FILES\n");
+	make_tree();
+
+	SIFS_reset_stats();
+	bool passed = SIFS_rename("volume", "a/x", "a/published") == 0;
+	passed = passed && SIFS_rename("volume", "a/published", "c/published") == 0;
+	passed = passed && SIFS_rename("volume", "c/published", "c/published") == 0;
+
+	SIFS_STATS stats;
+	SIFS_get_stats(SIFS_OP_RENAME, &stats);
+	passed = passed && stats.calls == 3 && stats.md5bytes == 0;
+
+	size_t length;
+	time_t modtime;
+	passed = passed && SIFS_fileinfo("volume", "a/x", &length, &modtime) == 1 && SIFS_errno == SIFS_ENOENT;
+	passed = passed && filecmp("volume", "c/published", "xxxx", 4) && consistent("volume");
+
+	if (passed)
+	{
+		printf("TEST PASSED\n");
+	}
+	else
+		printf("TEST FAILED\n");
+}
+
+// A directory moves with its whole subtree
+void test_directories(void)
+{
+	printf("RUNNING TEST DIRECTORIES\n");
+	make_tree();
+
+	bool passed = SIFS_rename("volume", "a/b", "c/moved") == 0;
+	passed = passed && SIFS_rename("volume", "c", "top") == 0;
+	passed = passed && filecmp("volume", "top/moved/y", "yyyy", 4) && filecmp("volume", "a/x", "xxxx", 4);
+
+	char** entrynames;
+	uint32_t nentries;
+	time_t modtime;
+	passed = passed && SIFS_dirinfo("volume", "a", &entrynames, &nentries, &modtime) == 0 && nentries == 1;
+	if (passed)
+	{
+		free(entrynames[0]);
+		free(entrynames);
+	}
+	passed = passed && consistent("volume");
+
+	if (passed)
+	{
+		printf("TEST PASSED\n");
+	}
+	else
+		printf("TEST FAILED\n");
+}
+
+int main(int argcount, char* argvalue[])
+{
+	test_error_SIFS_EINVAL();
+	test_error_SIFS_ENOENT();
+	test_error_SIFS_EEXIST();
+	test_files();
+	test_directories();
+
+	remove("volume");
+	return 0;
+}
@@ -0,0 +1,236 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "sifs.h"
+#include "testutils.h"
+
+// Invalid argument
+void test_error_SIFS_EINVAL(void)
+{
+	printf("RUNNING TEST ERROR EINVAL\n");
+	remove("volume");
+	SIFS_mkvolume("volume", 1024, 16);
+	int i = SIFS_growvolume("volume", 8);
+	if (i == 1 && SIFS_errno == SIFS_EINVAL)
+	{
+		printf("TEST PASSED\n");
+	}
+	else
+		printf("TEST FAILED\n");
+}
+
+// Version 1 volumes would have every block moved, so they are refused
+void test_error_SIFS_EINVAL_v1(void)
+{
+	printf("RUNNING TEST ERROR EINVAL VERSION 1\n");
+	remove("volume");
+
+	// A version 1 volume has no magic: the header is followed by its bitmap and then its blocks
+	FILE* fp = fopen("volume", "wb");
+	size_t blocksize = 1024;
+	uint32_t nblocks = 8;
+	uint32_t flags = 0;
+	fwrite(&blocksize, sizeof(blocksize), 1, fp);
+	fwrite(&nblocks, sizeof(nblocks), 1, fp);
+	fwrite(&flags, sizeof(flags), 1, fp);
+	fwrite("duuuuuuu", 1, nblocks, fp);
+	char block[1024] = { 0 };
+	for (uint32_t i = 0; i < nblocks; i++)
+	{
+		fwrite(block, sizeof(block), 1, fp);
+	}
+	fclose(fp);
+
+	struct stat before;
+	struct stat after;
+	stat("volume", &before);
+	bool passed = SIFS_growvolume("volume", 16) == 1 && SIFS_errno == SIFS_EINVAL;
+	passed = passed && SIFS_shrinkvolume("volume", 4) == 1 && SIFS_errno == SIFS_EINVAL;
+	passed = passed && stat("volume", &after) == 0 && after.st_size == before.st_size;
+
+	if (passed)
+	{
+		printf("TEST PASSED\n");
+	}
+	else
+		printf("TEST FAILED\n");
+}
+
+// No such volume
+void test_error_SIFS_ENOVOL(void)
+{
+	printf("RUNNING TEST ERROR ENOVOL\n");
+	int i = SIFS_growvolume("NON_EXISTENT_VOLUME", 16);
+	if (i == 1 && SIFS_errno == SIFS_ENOVOL)
+	{
+		printf("TEST PASSED\n");
+	}
+	else
+		printf("TEST FAILED\n");
+}
+
+void test_grow(void)
+{
+	printf("RUNNING TEST GROW\n");
+	remove("volume");
+	SIFS_mkvolume("volume", 1024, 8);
+
+	char data[3000];
+	for (int i = 0; i < sizeof(data); i++)
+	{
+		data[i] = i % 251;
+	}
+	SIFS_mkdir("volume", "FILEA");
+	SIFS_writefile("volume", "FILEA/data", data, sizeof(data));
+
+	// The volume is too small for a second copy
+	data[0]++;
+	bool passed = SIFS_writefile("volume", "copy", data, sizeof(data)) == 1 && SIFS_errno == SIFS_ENOSPC;
+
+	passed = passed && SIFS_growvolume("volume", 4096) == 0;
+	passed = passed && SIFS_writefile("volume", "copy", data, sizeof(data)) == 0;
+
+	const char* ref[] = {
+		"FILEA", "copy"
+	};
+	const char* ref2[] = {
+		"data"
+	};
+	passed = passed && dircmp("volume", "", ref, 2) && dircmp("volume", "FILEA", ref2, 1);
+	passed = passed && filecmp("volume", "copy", data, sizeof(data));
+	data[0]--;
+	passed = passed && filecmp("volume", "FILEA/data", data, sizeof(data));
+
+	if (passed)
+	{
+		printf("TEST PASSED\n");
+	}
+	else
+		printf("TEST FAILED\n");
+}
+
+// Resizing moves the bitmap but no block, and leaves a consistent volume at every step
+void test_bitmap_moves(void)
+{
+	printf("RUNNING TEST BITMAP MOVES\n");
+	remove("volume");
+	SIFS_mkvolume("volume", 1024, 1100);
+
+	char data[40000];
+	for (int i = 0; i < sizeof(data); i++)
+	{
+		data[i] = i % 249;
+	}
+	SIFS_writefile("volume", "data", data, sizeof(data));
+
+	// Past the room in front of block 0 the bitmap goes after the last block. From 1200 to 1201 blocks and
+	// back, its new place overlaps its old one
+	uint32_t sizes[] = { 1200, 1201, 1200, 1000 };
+	uint32_t nblocks = 1100;
+	bool passed = true;
+	SIFS_reset_stats();
+	for (int s = 0; s < 4 && passed; s++)
+	{
+		SIFS_FSCK_REPORT report;
+		int result = sizes[s] > nblocks ? SIFS_growvolume("volume", sizes[s]) : SIFS_shrinkvolume("volume", sizes[s]);
+		nblocks = sizes[s];
+		passed = result == 0 &&
+			SIFS_fsck("volume", 1, 0, &report) == 0 && report.unreachable == 0 && report.overlaps == 0 &&
+			report.badmd5 == 0 && filecmp("volume", "data", data, sizeof(data));
+	}
+
+	// Only bitmaps and headers were written, far less than the 40 blocks of data
+	SIFS_STATS grow, shrink;
+	passed = passed && SIFS_get_stats(SIFS_OP_GROWVOLUME, &grow) == 0 && SIFS_get_stats(SIFS_OP_SHRINKVOLUME, &shrink) == 0 &&
+		grow.byteswritten + shrink.byteswritten < 10 * 1024;
+
+	struct stat st;
+	passed = passed && stat("volume", &st) == 0 && st.st_size == 48 + 1100 + 1000 * 1024;
+
+	if (passed)
+	{
+		printf("TEST PASSED\n");
+	}
+	else
+		printf("TEST FAILED\n");
+}
+
+// Shrinking past the blocks in use
+void test_error_SIFS_ENOSPC(void)
+{
+	printf("RUNNING TEST ERROR ENOSPC\n");
+	remove("volume");
+	SIFS_mkvolume("volume", 1024, 16);
+	char data[4096] = { 0 };
+	SIFS_writefile("volume", "file", data, sizeof(data));
+	int i = SIFS_shrinkvolume("volume", 4);
+	if (i == 1 && SIFS_errno == SIFS_ENOSPC)
+	{
+		printf("TEST PASSED\n");
+	}
+	else
+		printf("TEST FAILED\n");
+}
+
+void test_shrink(void)
+{
+	printf("RUNNING TEST SHRINK\n");
+	remove("volume");
+	SIFS_mkvolume("volume", 1024, 64);
+
+	char data[3000];
+	for (int i = 0; i < sizeof(data); i++)
+	{
+		data[i] = i % 251;
+	}
+	SIFS_mkdir("volume", "FILEA");
+	SIFS_mkdir("volume", "FILEB");
+	SIFS_writefile("volume", "FILEA/data", data, sizeof(data));
+	data[0]++;
+	SIFS_writefile("volume", "FILEB/data", data, sizeof(data));
+
+	// Leave a hole at the front so that the shrink has to defragment the volume
+	SIFS_rmfile("volume", "FILEA/data");
+	SIFS_rmdir("volume", "FILEA");
+
+	bool passed = SIFS_shrinkvolume("volume", 8) == 0;
+
+	struct stat st;
+	passed = passed && stat("volume", &st) == 0 && st.st_size == 48 + 64 + 8 * 1024;
+
+	const char* ref[] = {
+		"FILEB"
+	};
+	const char* ref2[] = {
+		"data"
+	};
+	passed = passed && dircmp("volume", "", ref, 1) && dircmp("volume", "FILEB", ref2, 1);
+	passed = passed && filecmp("volume", "FILEB/data", data, sizeof(data));
+
+	// The volume is now full
+	passed = passed && SIFS_mkdir("volume", "FILEC") == 0 && SIFS_mkdir("volume", "FILED") == 0;
+	passed = passed && SIFS_mkdir("volume", "FILEE") == 1 && SIFS_errno == SIFS_ENOSPC;
+
+	if (passed)
+	{
+		printf("TEST PASSED\n");
+	}
+	else
+		printf("TEST FAILED\n");
+}
+
+int main(int argcount, char* argvalue[])
+{
+	test_error_SIFS_EINVAL();
+	test_error_SIFS_EINVAL_v1();
+	test_error_SIFS_ENOVOL();
+	test_grow();
+	test_bitmap_moves();
+	test_error_SIFS_ENOSPC();
+	test_shrink();
+
+	remove("volume");
+	return 0;
+}
@@ -0,0 +1,253 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "sifs.h"
+#include "testutils.h"
+
+// Returns the number of blocks in use, or 0 if the volume cannot be checked
+uint64_t used_blocks(const char* vol)
+{
+	SIFS_FSCK_REPORT report;
+	return SIFS_fsck(vol, 1, 0, &report) == 0 ? report.used : 0;
+}
+
+// Returns true if the directory at pathname has exactly nentries entries
+bool count_entries(const char* vol, const char* pathname, uint32_t expected)
+{
+	char** entrynames;
+	uint32_t nentries;
+	time_t modtime;
+	if (SIFS_dirinfo(vol, pathname, &entrynames, &nentries, &modtime) != 0)
+		return false;
+	for (uint32_t i = 0; i < nentries; i++)
+	{
+		free(entrynames[i]);
+	}
+	free(entrynames);
+	return nentries == expected;
+}
+
+// Returns nbytes of data that differ from one seed to the next
+char* make_data(size_t nbytes, int seed)
+{
+	char* data = malloc(nbytes);
+	for (size_t i = 0; i < nbytes; i++)
+	{
+		data[i] = (char)(i * seed + i / 1024);
+	}
+	return data;
+}
+
+// Snapshots need a volume made for them, a name of their own, and a snapshot that exists to be read or removed
+void test_errors(void)
+{
+	printf("RUNNING TEST ERRORS\n");
+	remove("volume");
+	SIFS_mkvolume("volume", 1024, 64);
+	bool passed = SIFS_snapshot("volume", "s1") != 0 && SIFS_errno == SIFS_EINVAL;
+
+	remove("volume");
+	SIFS_mkvolume_format("volume", 1024, 64, SIFS_FORMAT_SNAPSHOT);
+	passed = passed && SIFS_snapshot("volume", "a/b") != 0 && SIFS_errno == SIFS_EINVAL;
+	passed = passed && SIFS_snapshot("volume", "s1") == 0;
+	passed = passed && SIFS_snapshot("volume", "s1") != 0 && SIFS_errno == SIFS_EEXIST;
+	passed = passed && SIFS_rmsnapshot("volume", "s2") != 0 && SIFS_errno == SIFS_ENOENT;
+	passed = passed && !count_entries("volume@s2", "", 0) && SIFS_errno == SIFS_ENOENT;
+	passed = passed && count_entries("volume@s1", "", 0) && consistent("volume");
+
+	if (passed)
+	{
+		printf("TEST PASSED\n");
+	}
+	else
+		printf("TEST FAILED\n");
+}
+
+// A snapshot keeps reading what the volume held when it was taken, whatever changes the volume afterwards
+void test_point_in_time(void)
+{
+	printf("RUNNING TEST POINT IN TIME\n");
+	int formats[] = { SIFS_FORMAT_SNAPSHOT, SIFS_FORMAT_SNAPSHOT | SIFS_FORMAT_PACKED | SIFS_FORMAT_INLINE };
+	char* big = make_data(5000, 7);
+
+	bool passed = true;
+	for (int f = 0; f < 2 && passed; f++)
+	{
+		remove("volume");
+		SIFS_mkvolume_format("volume", 1024, 256, formats[f]);
+		passed = SIFS_writefile("volume", "a", "alpha", 5) == 0 && SIFS_mkdir("volume", "d") == 0 &&
+			SIFS_writefile("volume", "d/b", big, 5000) == 0 && SIFS_mkdir("volume", "d/e") == 0 &&
+			SIFS_writefile("volume", "d/e/c", "gamma", 5) == 0 && SIFS_link("volume", "a", "d/a") == 0;
+
+		// Taking the snapshot only copies the root directory
+		uint64_t before = used_blocks("volume");
+		passed = passed && SIFS_snapshot("volume", "s1") == 0 && used_blocks("volume") == before + 1 &&
+			consistent("volume");
+
+		passed = passed && SIFS_rmfile("volume", "a") == 0 && consistent("volume");
+		passed = passed && SIFS_writefile("volume", "d/new", "delta", 5) == 0 && consistent("volume");
+		passed = passed && SIFS_mkdir("volume", "x") == 0 && consistent("volume");
+		passed = passed && SIFS_rmfile("volume", "d/e/c") == 0 && SIFS_rmdir("volume", "d/e") == 0 &&
+			consistent("volume");
+		passed = passed && SIFS_rename("volume", "d/b", "x/b2") == 0 && consistent("volume");
+		passed = passed && SIFS_link("volume", "d/a", "x/a2") == 0 && consistent("volume");
+		passed = passed && SIFS_writefile("volume", "again", "alpha", 5) == 0 && consistent("volume");
+
+		// The live volume has every change
+		passed = passed && !filecmp("volume", "a", "alpha", 5) && filecmp("volume", "d/a", "alpha", 5) &&
+			filecmp("volume", "x/a2", "alpha", 5) && filecmp("volume", "again", "alpha", 5) &&
+			filecmp("volume", "x/b2", big, 5000) && filecmp("volume", "d/new", "delta", 5) &&
+			count_entries("volume", "", 3) && count_entries("volume", "d", 2) && count_entries("volume", "x", 2);
+
+		// The snapshot has none of them
+		passed = passed && filecmp("volume@s1", "a", "alpha", 5) && filecmp("volume@s1", "d/a", "alpha", 5) &&
+			filecmp("volume@s1", "d/b", big, 5000) && filecmp("volume@s1", "d/e/c", "gamma", 5) &&
+			!filecmp("volume@s1", "d/new", "delta", 5) && count_entries("volume@s1", "", 2) &&
+			count_entries("volume@s1", "d", 3) && count_entries("volume@s1", "d/e", 1);
+	}
+
+	free(big);
+	if (passed)
+	{
+		printf("TEST PASSED\n");
+	}
+	else
+		printf("TEST FAILED\n");
+}
+
+// Removing the last snapshot frees every block the volume no longer uses
+void test_rmsnapshot(void)
+{
+	printf("RUNNING TEST RMSNAPSHOT\n");
+	remove("volume");
+	SIFS_mkvolume_format("volume", 1024, 256, SIFS_FORMAT_SNAPSHOT);
+	char* big = make_data(20000, 3);
+	bool passed = SIFS_mkdir("volume", "d") == 0 && SIFS_writefile("volume", "d/big", big, 20000) == 0 &&
+		SIFS_writefile("volume", "small", "x", 1) == 0 && SIFS_snapshot("volume", "s1") == 0 &&
+		SIFS_writefile("volume", "later", "y", 1) == 0 && SIFS_snapshot("volume", "s2") == 0;
+
+	// Emptying the live volume frees nothing the snapshots hold
+	passed = passed && SIFS_rmfile("volume", "d/big") == 0 && SIFS_rmdir("volume", "d") == 0 &&
+		SIFS_rmfile("volume", "small") == 0 && SIFS_rmfile("volume", "later") == 0 && consistent("volume");
+	passed = passed && filecmp("volume@s1", "d/big", big, 20000) && filecmp("volume@s2", "later", "y", 1);
+
+	// The blocks of s1 that s2 shares stay until s2 goes too
+	passed = passed && SIFS_rmsnapshot("volume", "s1") == 0 && consistent("volume") &&
+		filecmp("volume@s2", "d/big", big, 20000) && filecmp("volume@s2", "small", "x", 1);
+	passed = passed && SIFS_rmsnapshot("volume", "s2") == 0 && consistent("volume") && used_blocks("volume") == 2;
+
+	// The freed blocks can be used again
+	passed = passed && SIFS_writefile("volume", "big", big, 20000) == 0 && filecmp("volume", "big", big, 20000) &&
+		consistent("volume");
+
+	free(big);
+	if (passed)
+	{
+		printf("TEST PASSED\n");
+	}
+	else
+		printf("TEST FAILED\n");
+}
+
+// Defragmenting moves blocks shared with snapshots, and chunked files keep their chunks while a snapshot holds them
+void test_defrag(void)
+{
+	printf("RUNNING TEST DEFRAG\n");
+	int formats[] = { SIFS_FORMAT_SNAPSHOT, SIFS_FORMAT_SNAPSHOT | SIFS_FORMAT_CHUNKED };
+	size_t nbytes = 40000;
+	char* first = make_data(nbytes, 5);
+	char* second = make_data(nbytes, 9);
+
+	bool passed = true;
+	for (int f = 0; f < 2 && passed; f++)
+	{
+		remove("volume");
+		SIFS_mkvolume_format("volume", 1024, 512, formats[f]);
+		passed = SIFS_writefile("volume", "gap", second, nbytes) == 0 && SIFS_mkdir("volume", "d") == 0 &&
+			SIFS_writefile("volume", "d/first", first, nbytes) == 0 &&
+			SIFS_link("volume", "d/first", "copy") == 0 && SIFS_snapshot("volume", "s1") == 0;
+
+		passed = passed && SIFS_rmfile("volume", "gap") == 0 && SIFS_rename("volume", "d/first", "moved") == 0 &&
+			SIFS_writefile("volume", "d/second", second, nbytes) == 0 && SIFS_rmfile("volume", "d/second") == 0 &&
+			consistent("volume");
+		passed = passed && SIFS_defrag("volume") == 0 && consistent("volume");
+
+		passed = passed && filecmp("volume", "moved", first, nbytes) && filecmp("volume", "copy", first, nbytes) &&
+			filecmp("volume@s1", "d/first", first, nbytes) && filecmp("volume@s1", "gap", second, nbytes) &&
+			!filecmp("volume", "gap", second, nbytes);
+
+		passed = passed && SIFS_rmsnapshot("volume", "s1") == 0 && consistent("volume") &&
+			filecmp("volume", "moved", first, nbytes) && SIFS_rmfile("volume", "moved") == 0 &&
+			SIFS_rmfile("volume", "copy") == 0 && consistent("volume") && used_blocks("volume") == 3;
+	}
+
+	free(first);
+	free(second);
+	if (passed)
+	{
+		printf("TEST PASSED\n");
+	}
+	else
+		printf("TEST FAILED\n");
+}
+
+// A link that cannot be made copies nothing that a snapshot shares
+void test_link_taken(void)
+{
+	printf("RUNNING TEST LINK TAKEN\n");
+	remove("volume");
+	SIFS_mkvolume_format("volume", 1024, 64, SIFS_FORMAT_SNAPSHOT);
+	bool passed = SIFS_mkdir("volume", "d") == 0 && SIFS_writefile("volume", "d/a", "alpha", 5) == 0 &&
+		SIFS_writefile("volume", "d/b", "beta", 4) == 0 && SIFS_snapshot("volume", "s1") == 0;
+
+	uint64_t used = used_blocks("volume");
+	passed = passed && SIFS_link("volume", "d/a", "d/b") == 1 && SIFS_errno == SIFS_EEXIST &&
+		used_blocks("volume") == used && consistent("volume") && filecmp("volume", "d/b", "beta", 4);
+
+	if (passed)
+	{
+		printf("TEST PASSED\n");
+	}
+	else
+		printf("TEST FAILED\n");
+}
+
+// Contents held under every name a file block has room for copy nothing that a snapshot shares
+void test_names_full(void)
+{
+	printf("RUNNING TEST NAMES FULL\n");
+	remove("volume");
+	SIFS_mkvolume_format("volume", 1024, 64, SIFS_FORMAT_SNAPSHOT);
+	bool passed = SIFS_mkdir("volume", "d") == 0;
+	char name[8];
+	for (int i = 0; i < 24 && passed; i++)
+	{
+		sprintf(name, "%s/%c", i < 12 ? "d" : "", 'a' + i);
+		passed = SIFS_writefile("volume", name, "same", 4) == 0;
+	}
+	passed = passed && SIFS_snapshot("volume", "s1") == 0;
+
+	uint64_t used = used_blocks("volume");
+	passed = passed && SIFS_writefile("volume", "d/z", "same", 4) == 1 && SIFS_errno == SIFS_EMAXENTRY &&
+		used_blocks("volume") == used && consistent("volume") && count_entries("volume", "d", 12);
+
+	if (passed)
+	{
+		printf("TEST PASSED\n");
+	}
+	else
+		printf("TEST FAILED\n");
+}
+
+int main(int argcount, char* argvalue[])
+{
+	test_errors();
+	test_point_in_time();
+	test_rmsnapshot();
+	test_defrag();
+	test_link_taken();
+	test_names_full();
+
+	remove("volume");
+	return 0;
+}
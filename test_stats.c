@@ -0,0 +1,102 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "sifs.h"
+#include "testutils.h"
+
+// Invalid argument
+void test_error_SIFS_EINVAL(void)
+{
+	printf("RUNNING TEST ERROR EINVAL\n");
+	SIFS_STATS stats;
+	int i = SIFS_get_stats(SIFS_NOPS, &stats);
+	if (i == 1 && SIFS_errno == SIFS_EINVAL)
+	{
+		printf("TEST PASSED\n");
+	}
+	else
+		printf("TEST FAILED\n");
+}
+
+void test_counters(void)
+{
+	printf("RUNNING TEST COUNTERS\n");
+	remove("volume");
+	SIFS_mkvolume("volume", 1024, 8);
+	SIFS_mkdir("volume", "FILEA");
+
+	SIFS_reset_stats();
+	char* data = "Hello";
+	SIFS_writefile("volume", "FILEA/t.txt", data, 6);
+	SIFS_writefile("volume", "FILEA/u.txt", data, 6);
+
+	SIFS_STATS stats;
+	SIFS_get_stats(SIFS_OP_WRITEFILE, &stats);
+	bool passed = stats.calls == 2 && stats.md5bytes == 12 && stats.byteswritten > 0 &&
+		stats.nseeks >= stats.nreads && stats.dirblocks > 0 && stats.fileblocks > 0 && stats.bitmapscans > 0;
+
+	// Other operations should be left untouched
+	SIFS_get_stats(SIFS_OP_MKDIR, &stats);
+	passed = passed && stats.calls == 0 && stats.bytesread == 0;
+
+	SIFS_reset_stats();
+	SIFS_get_stats(SIFS_OP_WRITEFILE, &stats);
+	passed = passed && stats.calls == 0 && stats.md5bytes == 0;
+
+	if (passed)
+	{
+		printf("TEST PASSED\n");
+	}
+	else
+		printf("TEST FAILED\n");
+}
+
+void test_latency(void)
+{
+	printf("RUNNING TEST LATENCY\n");
+	remove("volume");
+	SIFS_mkvolume("volume", 1024, 64);
+	SIFS_mkdir("volume", "FILEA");
+
+	SIFS_reset_stats();
+	char name[] = "FILEA/a";
+	for (int i = 0; i < 20; i++)
+	{
+		name[6] = 'a' + i;
+		SIFS_writefile("volume", name, name, sizeof(name));
+	}
+
+	SIFS_LATENCY total, hash, open;
+	SIFS_get_latency(SIFS_OP_WRITEFILE, SIFS_PHASE_TOTAL, &total);
+	SIFS_get_latency(SIFS_OP_WRITEFILE, SIFS_PHASE_HASH, &hash);
+	SIFS_get_latency(SIFS_OP_WRITEFILE, SIFS_PHASE_OPEN, &open);
+	bool passed = total.count == 20 && hash.count == 20 && open.count == 20 &&
+		total.p50_ns <= total.p99_ns && total.p99_ns <= total.p999_ns && total.p999_ns <= total.max_ns &&
+		total.max_ns > 0 && open.max_ns <= total.max_ns;
+
+	// A call that fails before opening the volume never enters the open phase
+	SIFS_writefile("volume", NULL, name, sizeof(name));
+	SIFS_get_latency(SIFS_OP_WRITEFILE, SIFS_PHASE_TOTAL, &total);
+	SIFS_get_latency(SIFS_OP_WRITEFILE, SIFS_PHASE_OPEN, &open);
+	passed = passed && total.count == 21 && open.count == 20;
+
+	passed = passed && SIFS_get_latency(SIFS_OP_WRITEFILE, SIFS_NPHASES, &total) == 1 && SIFS_errno == SIFS_EINVAL;
+
+	if (passed)
+	{
+		printf("TEST PASSED\n");
+	}
+	else
+		printf("TEST FAILED\n");
+}
+
+int main(int argcount, char* argvalue[])
+{
+	test_error_SIFS_EINVAL();
+	test_counters();
+	test_latency();
+
+	remove("volume");
+	return 0;
+}
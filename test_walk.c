@@ -0,0 +1,142 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "sifs.h"
+#include "testutils.h"
+
+// What a walk saw, in the order it saw it
+typedef struct {
+	char		log[4096];
+	int		nfiles;
+	int		ndirs;
+	size_t		bytes;
+	const char*	prune;		// directory whose entries are skipped
+	int		stopafter;	// visits before the walk is stopped, 0 for never
+	int		nvisits;
+} WALK_LOG;
+
+int record(const char* path, const SIFS_DIRENTRY* entry, int visit, void* arg)
+{
+	WALK_LOG* log = arg;
+	sprintf(log->log + strlen(log->log), "%s%s%s;", visit == SIFS_WALK_POST ? "<" : "", path,
+		entry->type == SIFS_ENTRY_DIR ? "/" : "");
+	if (entry->type == SIFS_ENTRY_FILE)
+	{
+		log->nfiles++;
+		log->bytes += entry->length;
+	}
+	else if (visit == SIFS_WALK_PRE)
+		log->ndirs++;
+
+	log->nvisits++;
+	if (log->stopafter != 0 && log->nvisits == log->stopafter)
+		return SIFS_WALK_STOP;
+	if (log->prune && visit == SIFS_WALK_PRE && strcmp(path, log->prune) == 0)
+		return SIFS_WALK_PRUNE;
+	return SIFS_WALK_CONTINUE;
+}
+
+// Builds a small tree: a/ a/x a/b/ a/b/y c/ z
+void make_tree(void)
+{
+	remove("volume");
+	SIFS_mkvolume("volume", 1024, 32);
+	SIFS_mkdir("volume", "a");
+	SIFS_writefile("volume", "a/x", "xx", 2);
+	SIFS_mkdir("volume", "a/b");
+	SIFS_writefile("volume", "a/b/y", "yyy", 3);
+	SIFS_mkdir("volume", "c");
+	SIFS_writefile("volume", "z", "z", 1);
+}
+
+// Invalid argument
+void test_error_SIFS_EINVAL(void)
+{
+	printf("RUNNING TEST ERROR EINVAL\n");
+	make_tree();
+	int i = SIFS_walk("volume", "", NULL, NULL, SIFS_WALK_PRE);
+	int j = SIFS_walk("volume", "", record, NULL, 0x100);
+	if (i == 1 && j == 1 && SIFS_errno == SIFS_EINVAL)
+	{
+		printf("TEST PASSED\n");
+	}
+	else
+		printf("TEST FAILED\n");
+}
+
+// No such directory
+void test_error_SIFS_ENOENT(void)
+{
+	printf("RUNNING TEST ERROR ENOENT\n");
+	make_tree();
+	WALK_LOG log = { "" };
+	int i = SIFS_walk("volume", "missing", record, &log, SIFS_WALK_PRE);
+	if (i == 1 && SIFS_errno == SIFS_ENOENT && log.nvisits == 0)
+	{
+		printf("TEST PASSED\n");
+	}
+	else
+		printf("TEST FAILED\n");
+}
+
+// Pre and post order visits with full paths, in the order blocks were made
+void test_orders(void)
+{
+	printf("RUNNING TEST ORDERS\n");
+	make_tree();
+
+	WALK_LOG pre = { "" }, post = { "" }, both = { "" };
+	SIFS_reset_stats();
+	bool passed = SIFS_walk("volume", "", record, &pre, SIFS_WALK_PRE) == 0;
+	passed = passed && strcmp(pre.log, "a/;a/x;a/b/;a/b/y;c/;z;") == 0;
+	passed = passed && pre.nfiles == 3 && pre.ndirs == 3 && pre.bytes == 6;
+
+	// Every block is read once, on one open of the volume
+	SIFS_STATS stats;
+	SIFS_get_stats(SIFS_OP_WALK, &stats);
+	passed = passed && stats.calls == 1 && stats.dirblocks == 4 && stats.fileblocks == 3;
+
+	passed = passed && SIFS_walk("volume", "", record, &post, SIFS_WALK_POST) == 0;
+	passed = passed && strcmp(post.log, "a/x;a/b/y;<a/b/;<a/;<c/;z;") == 0;
+
+	passed = passed && SIFS_walk("volume", "a", record, &both, SIFS_WALK_PRE | SIFS_WALK_POST) == 0;
+	passed = passed && strcmp(both.log, "a/x;a/b/;a/b/y;<a/b/;") == 0;
+
+	if (passed)
+	{
+		printf("TEST PASSED\n");
+	}
+	else
+		printf("TEST FAILED\n");
+}
+
+// Pruned directories are not descended into, and a stopped walk visits nothing more
+void test_prune(void)
+{
+	printf("RUNNING TEST PRUNE\n");
+	make_tree();
+
+	WALK_LOG pruned = { "", .prune = "a" }, stopped = { "", .stopafter = 2 };
+	bool passed = SIFS_walk("volume", "", record, &pruned, SIFS_WALK_PRE | SIFS_WALK_POST) == 0;
+	passed = passed && strcmp(pruned.log, "a/;c/;<c/;z;") == 0;
+	passed = passed && SIFS_walk("volume", "", record, &stopped, SIFS_WALK_PRE) == 0;
+	passed = passed && strcmp(stopped.log, "a/;a/x;") == 0;
+
+	if (passed)
+	{
+		printf("TEST PASSED\n");
+	}
+	else
+		printf("TEST FAILED\n");
+}
+
+int main(int argcount, char* argvalue[])
+{
+	test_error_SIFS_EINVAL();
+	test_error_SIFS_ENOENT();
+	test_orders();
+	test_prune();
+
+	remove("volume");
+	return 0;
+}
@@ -52,4 +52,24 @@ bool dircmp(const char* vol, const char* dir, const char** ref, uint32_t n)
 	}
 
 	return true;
-}
\ No newline at end of file
+}
+
+bool filecmp(const char* vol, const char* pathname, const char* data, size_t nbytes)
+{
+	void* contents;
+	size_t length;
+	if (SIFS_readfile(vol, pathname, &contents, &length) != 0)
+		return false;
+
+	bool same = length == nbytes && memcmp(contents, data, nbytes) == 0;
+	free(contents);
+	return same;
+}
+
+bool consistent(const char* vol)
+{
+	SIFS_FSCK_REPORT report;
+	return SIFS_fsck(vol, 1, 0, &report) == 0 && report.unreachable == 0 && report.badentries == 0 &&
+		report.badindex == 0 && report.overlaps == 0 && report.badmd5 == 0 && report.badrefs == 0 &&
+		report.duplicates == 0;
+}
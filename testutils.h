@@ -7,4 +7,6 @@
 
 extern void free_entrynames(char** entrynames, uint32_t nentries);
 extern void print_dir(const char* vol, const char* dir);
-extern bool dircmp(const char* vol, const char* dir, const char** ref, uint32_t n);
\ No newline at end of file
+extern bool dircmp(const char* vol, const char* dir, const char** ref, uint32_t n);
+extern bool filecmp(const char* vol, const char* pathname, const char* data, size_t nbytes);
+extern bool consistent(const char* vol);